@@ -0,0 +1,197 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+
+#include <glib.h>
+
+#include "bundle.h"
+
+/* cjs-bundle: packs a directory of JS modules into a module bundle, see
+ * bundle.h for the format. The output only depends on the names and contents
+ * of the files, so bundles are reproducible. */
+
+static char *output_path = nullptr;
+
+static GOptionEntry entries[] = {
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output_path,
+        "Write the bundle to FILE (required)", "FILE" },
+    { NULL }
+};
+
+/* Maps bundle paths to file contents, or to nullptr for directories */
+typedef std::map<std::string, GBytes *> BundleContents;
+
+static bool
+collect(const char     *dirname,
+        const char     *prefix,
+        BundleContents& contents,
+        GError        **error)
+{
+    GDir *dir = g_dir_open(dirname, 0, error);
+    if (!dir)
+        return false;
+
+    const char *name;
+    bool ok = true;
+    while (ok && (name = g_dir_read_name(dir))) {
+        /* skip hidden files and directories (.svn, .git, ...) */
+        if (name[0] == '.')
+            continue;
+
+        char *full_path = g_build_filename(dirname, name, nullptr);
+        std::string path(prefix);
+        if (!path.empty())
+            path += '/';
+        path += name;
+
+        if (g_file_test(full_path, G_FILE_TEST_IS_DIR)) {
+            contents[path] = nullptr;
+            ok = collect(full_path, path.c_str(), contents, error);
+        } else if (g_str_has_suffix(name, ".js")) {
+            char *data;
+            size_t len;
+            ok = g_file_get_contents(full_path, &data, &len, error);
+            if (ok)
+                contents[path] = g_bytes_new_take(data, len);
+        }
+
+        g_free(full_path);
+    }
+
+    g_dir_close(dir);
+    return ok;
+}
+
+static size_t
+align8(size_t offset)
+{
+    return (offset + 7) & ~size_t(7);
+}
+
+static bool
+write_bundle(const BundleContents& contents,
+             GError              **error)
+{
+    GjsBundleHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GJS_BUNDLE_MAGIC, sizeof(header.magic));
+    header.n_entries = GUINT32_TO_LE(contents.size());
+
+    size_t paths_offset = sizeof(header) + contents.size() * sizeof(GjsBundleEntry);
+    size_t paths_len = 0;
+    for (auto& kv : contents)
+        paths_len += kv.first.size();
+
+    std::string buffer(paths_offset, '\0');
+    memcpy(&buffer[0], &header, sizeof(header));
+
+    std::string data;
+    size_t data_offset = align8(paths_offset + paths_len);
+    size_t ix = 0;
+    for (auto& kv : contents) {
+        GjsBundleEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.path_offset = GUINT32_TO_LE(buffer.size());
+        entry.path_len = GUINT32_TO_LE(kv.first.size());
+
+        if (kv.second) {
+            size_t len;
+            const char *file_data =
+                static_cast<const char *>(g_bytes_get_data(kv.second, &len));
+            if (len > G_MAXUINT32) {
+                g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FBIG,
+                            "%s is too large", kv.first.c_str());
+                return false;
+            }
+
+            entry.type = GUINT32_TO_LE(G_FILE_TYPE_REGULAR);
+            entry.data_len = GUINT32_TO_LE(len);
+            entry.data_offset = GUINT64_TO_LE(data_offset + data.size());
+            data.append(file_data, len);
+            data.resize(align8(data.size() + 1), '\0');
+        } else {
+            entry.type = GUINT32_TO_LE(G_FILE_TYPE_DIRECTORY);
+        }
+
+        buffer.append(kv.first);
+        memcpy(&buffer[sizeof(header) + ix * sizeof(entry)], &entry,
+               sizeof(entry));
+        ix++;
+    }
+
+    buffer.resize(data_offset, '\0');
+    buffer.append(data);
+
+    return g_file_set_contents(output_path, buffer.data(), buffer.size(),
+                               error);
+}
+
+int
+main(int    argc,
+     char **argv)
+{
+    GError *error = NULL;
+    GOptionContext *context = g_option_context_new("DIRECTORY");
+    g_option_context_set_summary(context,
+        "Packs the JS modules in DIRECTORY into a module bundle, which can be "
+        "added to imports.searchPath in place of the directory.");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+        g_error("option parsing failed: %s", error->message);
+
+    if (argc != 2 || !output_path) {
+        char *help = g_option_context_get_help(context, true, NULL);
+        g_printerr("%s", help);
+        g_free(help);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    if (!g_str_has_suffix(output_path, GJS_BUNDLE_SUFFIX))
+        g_printerr("Warning: %s does not end in " GJS_BUNDLE_SUFFIX ", so the "
+                   "importer will not recognize it as a bundle\n", output_path);
+
+    BundleContents contents;
+    bool ok = collect(argv[1], "", contents, &error) &&
+        write_bundle(contents, &error);
+
+    for (auto& kv : contents)
+        if (kv.second)
+            g_bytes_unref(kv.second);
+
+    if (!ok) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    return 0;
+}
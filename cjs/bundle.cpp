@@ -0,0 +1,252 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <memory>
+#include <unordered_map>
+
+#include "bundle.h"
+#include "util/log.h"
+
+G_STATIC_ASSERT(sizeof(GjsBundleHeader) == 16);
+G_STATIC_ASSERT(sizeof(GjsBundleEntry) == 24);
+
+/* Bundles stay mapped for the lifetime of the process; a null entry records
+ * a path that could not be opened as a bundle */
+static std::unordered_map<std::string, std::unique_ptr<GjsBundle>> bundles;
+
+GjsBundle::GjsBundle(GMappedFile *file) :
+    m_file(file),
+    m_data(g_mapped_file_get_contents(file)),
+    m_size(g_mapped_file_get_length(file)),
+    m_entries(nullptr),
+    m_n_entries(0)
+{
+}
+
+GjsBundle::~GjsBundle()
+{
+    g_mapped_file_unref(m_file);
+}
+
+/* Everything is checked once when the bundle is opened, so that lookups can
+ * trust the offsets */
+bool
+GjsBundle::validate(void)
+{
+    GjsBundleHeader header;
+    if (m_size < sizeof(header))
+        return false;
+    memcpy(&header, m_data, sizeof(header));
+    if (memcmp(header.magic, GJS_BUNDLE_MAGIC, sizeof(header.magic)) != 0)
+        return false;
+
+    uint64_t n_entries = GUINT32_FROM_LE(header.n_entries);
+    if (sizeof(header) + n_entries * sizeof(GjsBundleEntry) > m_size)
+        return false;
+    m_entries = reinterpret_cast<const GjsBundleEntry *>(m_data + sizeof(header));
+    m_n_entries = n_entries;
+
+    const GjsBundleEntry *prev = nullptr;
+    for (uint32_t ix = 0; ix < m_n_entries; ix++) {
+        const GjsBundleEntry *entry = &m_entries[ix];
+        uint64_t path_offset = GUINT32_FROM_LE(entry->path_offset);
+        uint64_t path_len = GUINT32_FROM_LE(entry->path_len);
+        uint32_t type = GUINT32_FROM_LE(entry->type);
+
+        if (path_offset + path_len > m_size)
+            return false;
+
+        if (type == G_FILE_TYPE_REGULAR) {
+            uint64_t data_offset = GUINT64_FROM_LE(entry->data_offset);
+            uint64_t data_len = GUINT32_FROM_LE(entry->data_len);
+            /* data_offset is 64 bits, so adding to it could wrap */
+            if (data_offset >= m_size || data_len >= m_size - data_offset ||
+                m_data[data_offset + data_len] != '\0')
+                return false;
+        } else if (type != G_FILE_TYPE_DIRECTORY) {
+            return false;
+        }
+
+        if (prev && entry_path(prev) >= entry_path(entry))
+            return false;
+        prev = entry;
+    }
+
+    return true;
+}
+
+std::string
+GjsBundle::entry_path(const GjsBundleEntry *entry)
+{
+    return std::string(m_data + GUINT32_FROM_LE(entry->path_offset),
+                       GUINT32_FROM_LE(entry->path_len));
+}
+
+static int
+compare_path(const char *entry_path,
+             size_t      entry_len,
+             const char *path,
+             size_t      len)
+{
+    int cmp = memcmp(entry_path, path, MIN(entry_len, len));
+    if (cmp != 0)
+        return cmp;
+    return (entry_len > len) - (entry_len < len);
+}
+
+const GjsBundleEntry *
+GjsBundle::find(const char *path)
+{
+    size_t len = strlen(path);
+    uint32_t lo = 0, hi = m_n_entries;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const GjsBundleEntry *entry = &m_entries[mid];
+        int cmp = compare_path(m_data + GUINT32_FROM_LE(entry->path_offset),
+                               GUINT32_FROM_LE(entry->path_len), path, len);
+        if (cmp == 0)
+            return entry;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return nullptr;
+}
+
+/**
+ * GjsBundle::get:
+ * @path: a path that may point into a bundle
+ * @inner_path: return location for the part of @path inside the bundle,
+ *   which is the empty string for the root of the bundle
+ *
+ * Returns: the bundle, which stays valid for the lifetime of the process, or
+ * %NULL if @path does not point into a bundle.
+ */
+GjsBundle *
+GjsBundle::get(const char  *path,
+               const char **inner_path)
+{
+    static const size_t suffix_len = strlen(GJS_BUNDLE_SUFFIX);
+
+    const char *suffix = path;
+    while ((suffix = strstr(suffix, GJS_BUNDLE_SUFFIX))) {
+        suffix += suffix_len;
+        if (*suffix == '\0' || *suffix == '/')
+            break;
+    }
+    if (!suffix)
+        return nullptr;
+
+    *inner_path = *suffix == '/' ? suffix + 1 : suffix;
+
+    std::string bundle_path(path, suffix - path);
+    auto iter = bundles.find(bundle_path);
+    if (iter != bundles.end())
+        return iter->second.get();
+
+    GError *error = nullptr;
+    GMappedFile *file = g_mapped_file_new(bundle_path.c_str(), false, &error);
+    std::unique_ptr<GjsBundle> bundle;
+    if (file) {
+        bundle.reset(new GjsBundle(file));
+        if (!bundle->validate()) {
+            g_warning("%s is not a valid module bundle", bundle_path.c_str());
+            bundle.reset();
+        }
+    } else {
+        gjs_debug(GJS_DEBUG_IMPORTER, "Could not open bundle %s: %s",
+                  bundle_path.c_str(), error->message);
+        g_error_free(error);
+    }
+
+    if (bundle)
+        gjs_debug(GJS_DEBUG_IMPORTER, "Opened bundle %s with %u entries",
+                  bundle_path.c_str(), bundle->m_n_entries);
+
+    GjsBundle *retval = bundle.get();
+    bundles.emplace(bundle_path, std::move(bundle));
+    return retval;
+}
+
+/* Returns the type of @inner_path, or G_FILE_TYPE_UNKNOWN if it doesn't
+ * exist in the bundle */
+GFileType
+GjsBundle::lookup(const char *inner_path)
+{
+    if (*inner_path == '\0')
+        return G_FILE_TYPE_DIRECTORY;
+
+    const GjsBundleEntry *entry = find(inner_path);
+    if (!entry)
+        return G_FILE_TYPE_UNKNOWN;
+    return GFileType(GUINT32_FROM_LE(entry->type));
+}
+
+/* Points @data at the contents of the file at @inner_path, which are
+ * nul-terminated and valid as long as the bundle */
+bool
+GjsBundle::get_contents(const char  *inner_path,
+                        const char **data,
+                        size_t      *len)
+{
+    const GjsBundleEntry *entry = find(inner_path);
+    if (!entry || GUINT32_FROM_LE(entry->type) != G_FILE_TYPE_REGULAR)
+        return false;
+
+    *data = m_data + GUINT64_FROM_LE(entry->data_offset);
+    *len = GUINT32_FROM_LE(entry->data_len);
+    return true;
+}
+
+/* Appends the names and types of the direct children of the directory at
+ * @inner_path to @children */
+void
+GjsBundle::list_directory(const char                                   *inner_path,
+                          std::vector<std::pair<std::string, GFileType>>& children)
+{
+    std::string prefix(inner_path);
+    if (!prefix.empty())
+        prefix += '/';
+
+    /* Children sort directly after the directory itself, but not necessarily
+     * contiguously with each other, since "a/b/c" sorts before "a/b0" */
+    for (uint32_t ix = 0; ix < m_n_entries; ix++) {
+        std::string path = entry_path(&m_entries[ix]);
+        if (path.compare(0, prefix.size(), prefix) != 0)
+            continue;
+
+        std::string name = path.substr(prefix.size());
+        if (name.empty() || name.find('/') != std::string::npos)
+            continue;
+
+        children.emplace_back(name,
+                              GFileType(GUINT32_FROM_LE(m_entries[ix].type)));
+    }
+}
@@ -0,0 +1,96 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GJS_BUNDLE_H
+#define GJS_BUNDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <gio/gio.h>
+
+/* Module bundles pack a tree of JS modules into one file, which is mapped
+ * into memory and can be put on the importer's search path in place of a
+ * directory. Bundle files must have the extension GJS_BUNDLE_SUFFIX, so that
+ * a path like /usr/share/app/app.cjsbundle/ui/main.js can be recognized as
+ * referring into a bundle without any syscalls. Bundles are created with the
+ * cjs-bundle tool.
+ *
+ * File layout, all integers little-endian:
+ *
+ *   GjsBundleHeader
+ *   GjsBundleEntry[n_entries], sorted bytewise by path
+ *   paths, not nul-terminated
+ *   file contents, each followed by a nul byte that is not counted in
+ *   data_len, and aligned to 8 bytes
+ *
+ * Paths are relative to the root of the bundle, use '/' as separator, and
+ * have no leading or trailing slash. Every directory that contains an entry
+ * has an entry of its own. */
+
+#define GJS_BUNDLE_SUFFIX ".cjsbundle"
+#define GJS_BUNDLE_MAGIC "CJSBUN01"
+
+struct GjsBundleHeader {
+    char magic[8];
+    uint32_t n_entries;
+    uint32_t reserved;
+};
+
+struct GjsBundleEntry {
+    uint32_t path_offset;
+    uint32_t path_len;
+    uint32_t type;  /* GFileType, only REGULAR or DIRECTORY */
+    uint32_t data_len;
+    uint64_t data_offset;
+};
+
+class GjsBundle {
+    GMappedFile *m_file;
+    const char *m_data;
+    size_t m_size;
+    const GjsBundleEntry *m_entries;
+    uint32_t m_n_entries;
+
+    explicit GjsBundle(GMappedFile *file);
+    bool validate(void);
+    std::string entry_path(const GjsBundleEntry *entry);
+    const GjsBundleEntry *find(const char *path);
+
+public:
+    ~GjsBundle();
+
+    static GjsBundle *get(const char *path, const char **inner_path);
+
+    GFileType lookup(const char *inner_path);
+    bool get_contents(const char  *inner_path,
+                      const char **data,
+                      size_t      *len);
+    void list_directory(const char                                   *inner_path,
+                        std::vector<std::pair<std::string, GFileType>>& children);
+};
+
+#endif  /* GJS_BUNDLE_H */
@@ -25,18 +25,48 @@
 #include <string.h>
 #include <glib.h>
 #include "byteArray.h"
+#include "context-private.h"
 #include "gi/boxed.h"
 #include "jsapi-class.h"
 #include "jsapi-wrapper.h"
 #include "jsapi-util-args.h"
 #include <girepository.h>
 #include <util/log.h>
+#include <util/misc.h>
 
+/* A ByteArray's bytes live either in an ArrayBuffer, kept in the object's
+ * BYTE_ARRAY_SLOT_BUFFER reserved slot, in a GBytes shared with C code, or in
+ * a GByteArray shared with C code.
+ *
+ * The GBytes is read-only, so the first write copies it into a new
+ * ArrayBuffer. Going the other way, the ArrayBuffer's contents are stolen and
+ * handed to a GBytes without copying them. The ArrayBuffer may be bigger than
+ * the ByteArray, so that a ByteArray growing one byte at a time doesn't have
+ * to reallocate every time.
+ *
+ * The first time the ByteArray is passed to C as a GByteArray, its bytes are
+ * moved into one, which then stays its storage: both sides see each other's
+ * changes, including to the length, and later calls pass the same GByteArray
+ * without copying. Only asking for a GBytes or a Uint8Array moves the bytes
+ * out of it again.
+ *
+ * ArrayBuffer contents are always allocated separately from the ArrayBuffer
+ * object here, never inline, so pointers to them stay valid across a GC.
+ * The ArrayBuffer is recorded in the context's GjsArrayBufferMaps, so that a
+ * view on it from toUint8Array() that is passed to C gets copied rather than
+ * having its memory taken away from the ByteArray.
+ */
 typedef struct {
-    GByteArray *array;
-    GBytes     *bytes;
+    GBytes     *bytes;  /* non-null if the bytes are in a GBytes */
+    GByteArray *array;  /* non-null if the bytes are in a GByteArray */
+    size_t      len;    /* unused while the bytes are in a GByteArray */
 } ByteArrayInstance;
 
+enum {
+    BYTE_ARRAY_SLOT_BUFFER,
+    BYTE_ARRAY_N_SLOTS
+};
+
 extern struct JSClass gjs_byte_array_class;
 GJS_DEFINE_PRIV_FROM_JS(ByteArrayInstance, gjs_byte_array_class)
 
@@ -68,7 +98,9 @@ static const struct JSClassOps gjs_byte_array_class_ops = {
 
 struct JSClass gjs_byte_array_class = {
     "ByteArray",
-    JSCLASS_HAS_PRIVATE | JSCLASS_BACKGROUND_FINALIZE,
+    JSCLASS_HAS_PRIVATE |
+    JSCLASS_HAS_RESERVED_SLOTS(BYTE_ARRAY_N_SLOTS) |
+    JSCLASS_BACKGROUND_FINALIZE,
     &gjs_byte_array_class_ops
 };
 
@@ -80,6 +112,42 @@ gjs_typecheck_bytearray(JSContext       *context,
     return do_base_typecheck(context, object, throw_error);
 }
 
+/* Whether @key would be put in the map */
+bool
+GjsWeakObjectMap::can_hold(JSContext *cx,
+                           JSObject  *key)
+{
+    JS::Zone *zone = m_zone ? m_zone :
+        js::GetCompartmentZone(js::GetContextCompartment(cx));
+    return js::GetObjectZone(key) == zone;
+}
+
+JSObject *
+GjsWeakObjectMap::lookup(JSObject *key)
+{
+    if (!m_map.initialized() || js::GetObjectZone(key) != m_zone)
+        return nullptr;
+    return m_map.lookup(key);
+}
+
+/* Returns false on OOM, without an exception pending. Objects outside the
+ * map's zone are not put in it. */
+bool
+GjsWeakObjectMap::put(JSContext *cx,
+                      JSObject  *key,
+                      JSObject  *value)
+{
+    if (!m_map.initialized()) {
+        if (!m_map.init(cx))
+            return false;
+        m_zone = js::GetCompartmentZone(js::GetContextCompartment(cx));
+    }
+
+    if (js::GetObjectZone(key) != m_zone || js::GetObjectZone(value) != m_zone)
+        return true;
+    return m_map.put(cx, key, value);
+}
+
 static JS::Value
 gjs_value_from_gsize(gsize v)
 {
@@ -89,26 +157,237 @@ gjs_value_from_gsize(gsize v)
     return JS::NumberValue(v);
 }
 
+static JSObject *
+byte_array_get_buffer(JSObject *obj)
+{
+    JS::Value v_buffer = JS_GetReservedSlot(obj, BYTE_ARRAY_SLOT_BUFFER);
+    return v_buffer.isUndefined() ? nullptr : &v_buffer.toObject();
+}
+
+/* Whether @buffer is where a ByteArray keeps its bytes, so it must not be
+ * detached */
+bool
+gjs_array_buffer_backs_byte_array(JSContext *cx,
+                                  JSObject  *buffer)
+{
+    auto gjs_context = static_cast<GjsContext *>(JS_GetContextPrivate(cx));
+    JSObject *byte_array =
+        _gjs_context_get_array_buffer_maps(gjs_context)->byte_arrays.lookup(
+            buffer);
+    return byte_array && byte_array_get_buffer(byte_array) == buffer;
+}
+
+/* In case the ArrayBuffer was detached anyway, the ByteArray is emptied
+ * rather than left pointing at memory it no longer owns */
 static void
-byte_array_ensure_array (ByteArrayInstance  *priv)
+byte_array_check_detached(JSObject          *obj,
+                          ByteArrayInstance *priv)
 {
-    if (priv->bytes) {
-        priv->array = g_bytes_unref_to_array(priv->bytes);
-        priv->bytes = NULL;
-    } else {
-        g_assert(priv->array);
+    JSObject *buffer = byte_array_get_buffer(obj);
+    if (buffer && JS_IsDetachedArrayBufferObject(buffer)) {
+        JS_SetReservedSlot(obj, BYTE_ARRAY_SLOT_BUFFER, JS::UndefinedValue());
+        priv->len = 0;
     }
 }
 
-static void
-byte_array_ensure_gbytes (ByteArrayInstance  *priv)
+/* C code may resize a shared GByteArray at any time */
+static size_t
+byte_array_get_length(JSObject          *obj,
+                      ByteArrayInstance *priv)
+{
+    if (priv->array)
+        return priv->array->len;
+
+    byte_array_check_detached(obj, priv);
+    return priv->len;
+}
+
+static guint8 *
+byte_array_get_data(JSObject          *obj,
+                    ByteArrayInstance *priv)
+{
+    if (priv->array)
+        return priv->array->data;
+    if (priv->bytes)
+        return (guint8 *) g_bytes_get_data(priv->bytes, nullptr);
+
+    JSObject *buffer = byte_array_get_buffer(obj);
+    if (!buffer)
+        return nullptr;
+
+    bool is_shared;
+    JS::AutoCheckCannotGC nogc;
+    return JS_GetArrayBufferData(buffer, &is_shared, nogc);
+}
+
+/* Takes ownership of @contents, which must have been allocated with
+ * js_malloc() and friends */
+static bool
+byte_array_set_contents(JSContext       *context,
+                        JS::HandleObject obj,
+                        void            *contents,
+                        size_t           capacity)
+{
+    JSObject *buffer = JS_NewArrayBufferWithContents(context, capacity,
+                                                     contents);
+    if (!buffer) {
+        js_free(contents);
+        return false;
+    }
+
+    /* From here on the ArrayBuffer frees @contents */
+    auto gjs_context = static_cast<GjsContext *>(JS_GetContextPrivate(context));
+    if (!_gjs_context_get_array_buffer_maps(gjs_context)->byte_arrays.put(
+            context, buffer, obj)) {
+        JS_ReportOutOfMemory(context);
+        return false;
+    }
+
+    JS_SetReservedSlot(obj, BYTE_ARRAY_SLOT_BUFFER, JS::ObjectValue(*buffer));
+    return true;
+}
+
+static bool
+byte_array_ensure_buffer(JSContext         *context,
+                         JS::HandleObject   obj,
+                         ByteArrayInstance *priv)
 {
+    size_t len = byte_array_get_length(obj, priv);
+    if (byte_array_get_buffer(obj))
+        return true;
+
+    /* Zero-length contents would be indistinguishable from a failed
+     * allocation */
+    size_t capacity = MAX(len, 1);
+    void *contents = js_calloc(capacity);
+    if (!contents) {
+        JS_ReportOutOfMemory(context);
+        return false;
+    }
+
+    if (priv->bytes || priv->array)
+        memcpy(contents, byte_array_get_data(obj, priv), len);
+
+    if (!byte_array_set_contents(context, obj, contents, capacity))
+        return false;
+
+    g_clear_pointer(&priv->bytes, g_bytes_unref);
+    g_clear_pointer(&priv->array, g_byte_array_unref);
+    priv->len = len;
+    return true;
+}
+
+/* A GByteArray is writable in place, a GBytes isn't */
+static bool
+byte_array_ensure_writable(JSContext         *context,
+                           JS::HandleObject   obj,
+                           ByteArrayInstance *priv)
+{
+    if (priv->array)
+        return true;
+    return byte_array_ensure_buffer(context, obj, priv);
+}
+
+static GBytes *
+byte_array_ensure_gbytes(JSContext         *context,
+                         JS::HandleObject   obj,
+                         ByteArrayInstance *priv)
+{
+    if (priv->bytes)
+        return priv->bytes;
+
+    /* The GByteArray may be held on to and changed by C code, so it can't
+     * become the GBytes' memory */
     if (priv->array) {
-        priv->bytes = g_byte_array_free_to_bytes(priv->array);
-        priv->array = NULL;
-    } else {
-        g_assert(priv->bytes);
+        priv->len = priv->array->len;
+        priv->bytes = g_bytes_new(priv->array->data, priv->len);
+        g_clear_pointer(&priv->array, g_byte_array_unref);
+        return priv->bytes;
+    }
+
+    /* Without storage after a failed allocation or a detached ArrayBuffer,
+     * and so empty */
+    byte_array_check_detached(obj, priv);
+    JS::RootedObject buffer(context, byte_array_get_buffer(obj));
+    if (!buffer) {
+        priv->len = 0;
+        priv->bytes = g_bytes_new(nullptr, 0);
+        return priv->bytes;
+    }
+
+    void *contents = JS_StealArrayBufferContents(context, buffer);
+    if (!contents)
+        return nullptr;
+
+    JS_SetReservedSlot(obj, BYTE_ARRAY_SLOT_BUFFER, JS::UndefinedValue());
+    priv->bytes = g_bytes_new_with_free_func(contents, priv->len, js_free,
+                                             contents);
+    return priv->bytes;
+}
+
+/* New bytes are zeroed. If the ArrayBuffer has to grow, its contents are
+ * reallocated, which detaches the old ArrayBuffer and any views on it. */
+static bool
+byte_array_set_length(JSContext         *context,
+                      JS::HandleObject   obj,
+                      ByteArrayInstance *priv,
+                      size_t             len)
+{
+    if (priv->array) {
+        size_t old_len = priv->array->len;
+        if (len > G_MAXUINT32) {
+            gjs_throw(context, "ByteArray length %" G_GSIZE_FORMAT
+                      " is too large", len);
+            return false;
+        }
+        g_byte_array_set_size(priv->array, len);
+        if (len > old_len)
+            memset(priv->array->data + old_len, 0, len - old_len);
+        return true;
     }
+
+    if (!byte_array_ensure_buffer(context, obj, priv))
+        return false;
+
+    JS::RootedObject buffer(context, byte_array_get_buffer(obj));
+    size_t capacity = JS_GetArrayBufferByteLength(buffer);
+
+    if (len > capacity) {
+        size_t new_capacity = MAX(len, capacity * 2);
+        if (new_capacity > G_MAXUINT32) {
+            gjs_throw(context, "ByteArray length %" G_GSIZE_FORMAT
+                      " is too large", len);
+            return false;
+        }
+
+        void *contents = JS_StealArrayBufferContents(context, buffer);
+        if (!contents)
+            return false;
+
+        void *new_contents = js_realloc(contents, new_capacity);
+        if (!new_contents) {
+            /* Put the old contents back, so the ByteArray stays usable */
+            byte_array_set_contents(context, obj, contents, capacity);
+            JS_ReportOutOfMemory(context);
+            return false;
+        }
+
+        if (!byte_array_set_contents(context, obj, new_contents,
+                                     new_capacity)) {
+            /* The old ArrayBuffer is detached already */
+            JS_SetReservedSlot(obj, BYTE_ARRAY_SLOT_BUFFER,
+                               JS::UndefinedValue());
+            priv->len = 0;
+            return false;
+        }
+    }
+
+    /* Also clears anything written through a view after a shrink */
+    if (len > priv->len)
+        memset(byte_array_get_data(obj, priv) + priv->len, 0, len - priv->len);
+
+    priv->len = len;
+    return true;
 }
 
 static bool
@@ -170,11 +449,7 @@ byte_array_get_index(JSContext         *context,
                      gsize              idx,
                      JS::MutableHandleValue value_p)
 {
-    gsize len;
-    guint8 *data;
-    
-    gjs_byte_array_peek_data(context, obj, &data, &len);
-
+    size_t len = byte_array_get_length(obj, priv);
     if (idx >= len) {
         gjs_throw(context,
                   "Index %" G_GSIZE_FORMAT " is out of range for ByteArray length %lu",
@@ -183,7 +458,7 @@ byte_array_get_index(JSContext         *context,
         return false;
     }
 
-    value_p.setInt32(data[idx]);
+    value_p.setInt32(byte_array_get_data(obj, priv)[idx]);
 
     return true;
 }
@@ -197,30 +472,18 @@ byte_array_get_prop(JSContext *context,
                     JS::HandleId id,
                     JS::MutableHandleValue value_p)
 {
-    ByteArrayInstance *priv;
+    /* Only array indexing is special. Indices that don't fit in an int jsid
+     * are strings, and regular JS arrays allow string versions of ints for
+     * the index, but we don't bother. */
+    if (!JSID_IS_INT(id))
+        return true;
 
-    priv = priv_from_js(context, obj);
+    ByteArrayInstance *priv = priv_from_js(context, obj);
 
     if (!priv)
         return true; /* prototype, not an instance. */
 
-    JS::RootedValue id_value(context);
-    if (!JS_IdToValue(context, id, &id_value))
-        return false;
-
-    /* First handle array indexing */
-    if (id_value.isNumber()) {
-        gsize idx;
-        if (!gjs_value_to_gsize(context, id_value, &idx))
-            return false;
-        return byte_array_get_index(context, obj, priv, idx, value_p);
-    }
-
-    /* We don't special-case anything else for now. Regular JS arrays
-     * allow string versions of ints for the index, we don't bother.
-     */
-
-    return true;
+    return byte_array_get_index(context, obj, priv, JSID_TO_INT(id), value_p);
 }
 
 static bool
@@ -229,16 +492,11 @@ byte_array_length_getter(JSContext *context,
                          JS::Value *vp)
 {
     GJS_GET_PRIV(context, argc, vp, args, to, ByteArrayInstance, priv);
-    gsize len = 0;
 
     if (!priv)
         return true; /* prototype, not an instance. */
 
-    if (priv->array != NULL)
-        len = priv->array->len;
-    else if (priv->bytes != NULL)
-        len = g_bytes_get_size (priv->bytes);
-    args.rval().set(gjs_value_from_gsize(len));
+    args.rval().set(gjs_value_from_gsize(byte_array_get_length(to, priv)));
     return true;
 }
 
@@ -253,14 +511,13 @@ byte_array_length_setter(JSContext *context,
     if (!priv)
         return true; /* prototype, not instance */
 
-    byte_array_ensure_array(priv);
-
     if (!gjs_value_to_gsize(context, args[0], &len)) {
         gjs_throw(context,
                   "Can't set ByteArray length to non-integer");
         return false;
     }
-    g_byte_array_set_size(priv->array, len);
+    if (!byte_array_set_length(context, to, priv, len))
+        return false;
     args.rval().setUndefined();
     return true;
 }
@@ -279,15 +536,15 @@ byte_array_set_index(JSContext         *context,
         return false;
     }
 
-    byte_array_ensure_array(priv);
+    if (!byte_array_ensure_writable(context, obj, priv))
+        return false;
 
     /* grow the array if necessary */
-    if (idx >= priv->array->len) {
-        g_byte_array_set_size(priv->array,
-                              idx + 1);
-    }
+    if (idx >= byte_array_get_length(obj, priv) &&
+        !byte_array_set_length(context, obj, priv, idx + 1))
+        return false;
 
-    g_array_index(priv->array, guint8, idx) = v;
+    byte_array_get_data(obj, priv)[idx] = v;
 
     /* Stop JS from storing a copy of the value */
     value_p.setUndefined();
@@ -305,52 +562,17 @@ byte_array_set_prop(JSContext *context,
                     JS::MutableHandleValue value_p,
                     JS::ObjectOpResult&    result)
 {
-    ByteArrayInstance *priv;
+    /* We don't special-case anything but array indexing for now */
+    if (!JSID_IS_INT(id))
+        return result.succeed();
 
-    priv = priv_from_js(context, obj);
+    ByteArrayInstance *priv = priv_from_js(context, obj);
 
     if (!priv)
         return result.succeed(); /* prototype, not an instance. */
 
-    JS::RootedValue id_value(context);
-    if (!JS_IdToValue(context, id, &id_value))
-        return false;
-
-    /* First handle array indexing */
-    if (id_value.isNumber()) {
-        gsize idx;
-        if (!gjs_value_to_gsize(context, id_value, &idx))
-            return false;
-
-        return byte_array_set_index(context, obj, priv, idx, value_p, result);
-    }
-
-    /* We don't special-case anything else for now */
-
-    return result.succeed();
-}
-
-static GByteArray *
-gjs_g_byte_array_new(int preallocated_length)
-{
-    GByteArray *array;
-
-    /* can't use g_byte_array_new() because we need to clear to zero.
-     * We nul-terminate too for ease of toString() and for security
-     * paranoia.
-     */
-    array =  (GByteArray*) g_array_sized_new (true, /* nul-terminated */
-                                              true, /* clear to zero */
-                                              1, /* element size */
-                                              preallocated_length);
-   if (preallocated_length > 0) {
-       /* we want to not only allocate the size, but have it
-        * already be the array's length.
-        */
-       g_byte_array_set_size(array, preallocated_length);
-   }
-
-   return array;
+    return byte_array_set_index(context, obj, priv, JSID_TO_INT(id), value_p,
+                                result);
 }
 
 GJS_NATIVE_CONSTRUCTOR_DECLARE(byte_array)
@@ -371,10 +593,12 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(byte_array)
     }
 
     priv = g_slice_new0(ByteArrayInstance);
-    priv->array = gjs_g_byte_array_new(preallocated_length);
     g_assert(priv_from_js(context, object) == NULL);
     JS_SetPrivate(object, priv);
 
+    if (!byte_array_set_length(context, object, priv, preallocated_length))
+        return false;
+
     GJS_NATIVE_CONSTRUCTOR_FINISH(byte_array);
 
     return true;
@@ -391,16 +615,78 @@ byte_array_finalize(JSFreeOp *fop,
     if (!priv)
         return; /* prototype, not instance */
 
-    if (priv->array) {
-        g_byte_array_free(priv->array, true);
-        priv->array = NULL;
-    } else if (priv->bytes) {
-        g_clear_pointer(&priv->bytes, g_bytes_unref);
-    }
+    /* The ArrayBuffer, if any, is finalized by itself */
+    g_clear_pointer(&priv->bytes, g_bytes_unref);
+    g_clear_pointer(&priv->array, g_byte_array_unref);
 
     g_slice_free(ByteArrayInstance, priv);
 }
 
+typedef enum {
+    BYTE_ARRAY_ENCODING_UTF8,
+    BYTE_ARRAY_ENCODING_LATIN1,
+    BYTE_ARRAY_ENCODING_OTHER  /* converted with g_convert() */
+} ByteArrayEncoding;
+
+/* maybe we should be smarter about synonyms here. doesn't matter much
+ * though; any other name still works, it just goes through iconv.
+ */
+static ByteArrayEncoding
+byte_array_classify_encoding(const char *encoding)
+{
+    if (g_ascii_strcasecmp(encoding, "UTF-8") == 0 ||
+        g_ascii_strcasecmp(encoding, "UTF8") == 0)
+        return BYTE_ARRAY_ENCODING_UTF8;
+    if (g_ascii_strcasecmp(encoding, "ISO-8859-1") == 0 ||
+        g_ascii_strcasecmp(encoding, "ISO8859-1") == 0 ||
+        g_ascii_strcasecmp(encoding, "LATIN1") == 0)
+        return BYTE_ARRAY_ENCODING_LATIN1;
+    return BYTE_ARRAY_ENCODING_OTHER;
+}
+
+/* Decodes straight into the buffer that the new string takes over, except
+ * for non-ASCII text that fits in Latin-1, which is rare enough to go
+ * through a temporary buffer, since JSAPI can't adopt Latin-1 chars */
+static bool
+byte_array_utf8_to_string(JSContext             *context,
+                          const char            *data,
+                          size_t                 len,
+                          JS::MutableHandleValue rval)
+{
+    size_t utf16_len;
+    bool is_latin1;
+
+    /* Let the engine throw its usual exception for invalid UTF-8 */
+    if (!gjs_utf8_validate(data, len, &utf16_len, &is_latin1))
+        return gjs_string_from_utf8_n(context, data, len, rval);
+
+    JSString *str;
+    if (utf16_len == len) {
+        /* Only ASCII */
+        str = JS_NewStringCopyN(context, data, len);
+    } else if (is_latin1) {
+        GjsAutoChar latin1(static_cast<char *>(g_malloc(utf16_len)));
+        gjs_utf8_to_latin1(data, len, latin1.get());
+        str = JS_NewStringCopyN(context, latin1, utf16_len);
+    } else {
+        char16_t *chars = js_pod_malloc<char16_t>(utf16_len + 1);
+        if (!chars) {
+            JS_ReportOutOfMemory(context);
+            return false;
+        }
+        gjs_utf8_to_utf16(data, len, chars);
+        chars[utf16_len] = 0;
+        str = JS_NewUCString(context, chars, utf16_len);
+        if (!str)
+            js_free(chars);
+    }
+
+    if (!str)
+        return false;
+    rval.setString(str);
+    return true;
+}
+
 /* implement toString() with an optional encoding arg */
 static bool
 to_string_func(JSContext *context,
@@ -409,40 +695,40 @@ to_string_func(JSContext *context,
 {
     GJS_GET_PRIV(context, argc, vp, argv, to, ByteArrayInstance, priv);
     GjsAutoJSChar encoding;
-    bool encoding_is_utf8;
+    ByteArrayEncoding encoding_kind;
     gchar *data;
 
     if (!priv)
         return true; /* prototype, not instance */
 
-    byte_array_ensure_array(priv);
-
     if (argc >= 1 && argv[0].isString()) {
         JS::RootedString str(context, argv[0].toString());
         encoding = JS_EncodeStringToUTF8(context, str);
         if (!encoding)
             return false;
 
-        /* maybe we should be smarter about utf8 synonyms here.
-         * doesn't matter much though. encoding_is_utf8 is
-         * just an optimization anyway.
-         */
-        encoding_is_utf8 = (strcmp(encoding, "UTF-8") == 0);
+        encoding_kind = byte_array_classify_encoding(encoding);
     } else {
-        encoding_is_utf8 = true;
+        encoding_kind = BYTE_ARRAY_ENCODING_UTF8;
     }
 
-    if (priv->array->len == 0)
+    size_t len = byte_array_get_length(to, priv);
+    if (len == 0)
         /* the internal data pointer could be NULL in this case */
         data = (gchar*)"";
     else
-        data = (gchar*)priv->array->data;
-
-    if (encoding_is_utf8) {
-        /* optimization, avoids iconv overhead and runs
-         * libmozjs hardwired utf8-to-utf16
-         */
-        return gjs_string_from_utf8_n(context, data, priv->array->len, argv.rval());
+        data = (gchar*)byte_array_get_data(to, priv);
+
+    if (encoding_kind == BYTE_ARRAY_ENCODING_UTF8) {
+        return byte_array_utf8_to_string(context, data, len,
+                                         argv.rval());
+    } else if (encoding_kind == BYTE_ARRAY_ENCODING_LATIN1) {
+        /* Latin-1 bytes are exactly the chars of a Latin-1 JS string */
+        JSString *s = JS_NewStringCopyN(context, data, len);
+        if (!s)
+            return false;
+        argv.rval().setString(s);
+        return true;
     } else {
         bool ok = false;
         gsize bytes_written;
@@ -453,7 +739,7 @@ to_string_func(JSContext *context,
 
         error = NULL;
         u16_str = g_convert(data,
-                           priv->array->len,
+                           len,
                            "UTF-16",
                            encoding,
                            NULL, /* bytes read */
@@ -496,7 +782,8 @@ to_gbytes_func(JSContext *context,
     if (!priv)
         return true; /* prototype, not instance */
 
-    byte_array_ensure_gbytes(priv);
+    if (!byte_array_ensure_gbytes(context, to, priv))
+        return false;
 
     gbytes_info = g_irepository_find_by_gtype(NULL, G_TYPE_BYTES);
     ret_bytes_obj = gjs_boxed_from_c_struct(context, (GIStructInfo*)gbytes_info,
@@ -506,6 +793,33 @@ to_gbytes_func(JSContext *context,
     return true;
 }
 
+/* toUint8Array() returns a view on the same memory. Indexing a typed array
+ * is much faster than going through the ByteArray's property hooks. The view
+ * stops sharing the memory once the ByteArray grows beyond the space it has,
+ * or is converted to a GLib.Bytes or a GByteArray; it is then detached, with
+ * length 0. */
+static bool
+to_uint8_array_func(JSContext *context,
+                    unsigned   argc,
+                    JS::Value *vp)
+{
+    GJS_GET_PRIV(context, argc, vp, rec, to, ByteArrayInstance, priv);
+
+    if (!priv)
+        return true; /* prototype, not instance */
+
+    if (!byte_array_ensure_buffer(context, to, priv))
+        return false;
+
+    JS::RootedObject buffer(context, byte_array_get_buffer(to));
+    JSObject *view = JS_NewUint8ArrayWithBuffer(context, buffer, 0, priv->len);
+    if (!view)
+        return false;
+
+    rec.rval().setObject(*view);
+    return true;
+}
+
 static JSObject*
 byte_array_new(JSContext *context)
 {
@@ -514,6 +828,8 @@ byte_array_new(JSContext *context)
     JS::RootedObject proto(context, gjs_byte_array_get_proto(context));
     JS::RootedObject array(context,
         JS_NewObjectWithGivenProto(context, &gjs_byte_array_class, proto));
+    if (!array)
+        return nullptr;
 
     priv = g_slice_new0(ByteArrayInstance);
 
@@ -523,6 +839,49 @@ byte_array_new(JSContext *context)
     return array;
 }
 
+/* Encodes straight into the ByteArray's storage, without the intermediate
+ * NUL-terminated copy that JS_EncodeStringToUTF8() would make */
+static bool
+byte_array_set_from_string_utf8(JSContext         *context,
+                                JS::HandleObject   obj,
+                                ByteArrayInstance *priv,
+                                JS::HandleString   str)
+{
+    JSFlatString *flat = JS_FlattenString(context, str);
+    if (!flat)
+        return false;
+
+    size_t len = JS_GetStringLength(str);
+    bool is_latin1 = JS_StringHasLatin1Chars(str);
+    size_t utf8_len;
+
+    {
+        JS::AutoCheckCannotGC nogc;
+        if (is_latin1)
+            utf8_len = gjs_latin1_utf8_length(reinterpret_cast<const char *>(
+                JS_GetLatin1FlatStringChars(nogc, flat)), len);
+        else
+            utf8_len = gjs_utf16_utf8_length(
+                JS_GetTwoByteFlatStringChars(nogc, flat), len);
+    }
+
+    if (!byte_array_set_length(context, obj, priv, utf8_len))
+        return false;
+
+    /* Allocating may have moved the string's chars */
+    flat = JS_ASSERT_STRING_IS_FLAT(str);
+    char *out = reinterpret_cast<char *>(byte_array_get_data(obj, priv));
+
+    JS::AutoCheckCannotGC nogc;
+    if (is_latin1)
+        gjs_latin1_to_utf8(reinterpret_cast<const char *>(
+            JS_GetLatin1FlatStringChars(nogc, flat)), len, out);
+    else
+        gjs_utf16_to_utf8(JS_GetTwoByteFlatStringChars(nogc, flat), len, out);
+
+    return true;
+}
+
 /* fromString() function implementation */
 static bool
 from_string_func(JSContext *context,
@@ -532,7 +891,7 @@ from_string_func(JSContext *context,
     JS::CallArgs argv = JS::CallArgsFromVp (argc, vp);
     ByteArrayInstance *priv;
     GjsAutoJSChar encoding;
-    bool encoding_is_utf8;
+    ByteArrayEncoding encoding_kind;
     JS::RootedObject obj(context, byte_array_new(context));
 
     if (!obj)
@@ -543,8 +902,6 @@ from_string_func(JSContext *context,
 
     g_assert(argc > 0); /* because we specified min args 1 */
 
-    priv->array = gjs_g_byte_array_new(0);
-
     if (!argv[0].isString()) {
         gjs_throw(context,
                   "byteArray.fromString() called with non-string as first arg");
@@ -557,30 +914,30 @@ from_string_func(JSContext *context,
         if (!encoding)
             return false;
 
-        /* maybe we should be smarter about utf8 synonyms here.
-         * doesn't matter much though. encoding_is_utf8 is
-         * just an optimization anyway.
-         */
-        encoding_is_utf8 = (strcmp(encoding, "UTF-8") == 0);
+        encoding_kind = byte_array_classify_encoding(encoding);
     } else {
-        encoding_is_utf8 = true;
+        encoding_kind = BYTE_ARRAY_ENCODING_UTF8;
     }
 
-    if (encoding_is_utf8) {
-        /* optimization? avoids iconv overhead and runs
-         * libmozjs hardwired utf16-to-utf8.
-         */
-        JS::RootedString str(context, argv[0].toString());
-        GjsAutoJSChar utf8 = JS_EncodeStringToUTF8(context, str);
-        if (!utf8)
+    JS::RootedString str(context, argv[0].toString());
+
+    if (encoding_kind == BYTE_ARRAY_ENCODING_UTF8) {
+        if (!byte_array_set_from_string_utf8(context, obj, priv, str))
+            return false;
+    } else if (encoding_kind == BYTE_ARRAY_ENCODING_LATIN1 &&
+               JS_StringHasLatin1Chars(str)) {
+        /* Latin-1 chars are exactly the bytes; a string with two-byte
+         * chars goes through iconv, which reports any that don't fit */
+        size_t len = JS_GetStringLength(str);
+        if (!JS_FlattenString(context, str) ||
+            !byte_array_set_length(context, obj, priv, len))
             return false;
 
-        g_byte_array_set_size(priv->array, 0);
-        g_byte_array_append(priv->array,
-                            reinterpret_cast<const guint8*>(utf8.get()),
-                            strlen(utf8));
+        JS::AutoCheckCannotGC nogc;
+        memcpy(byte_array_get_data(obj, priv),
+               JS_GetLatin1FlatStringChars(nogc, JS_ASSERT_STRING_IS_FLAT(str)),
+               len);
     } else {
-        JSString *str = argv[0].toString();  /* Rooted by argv */
         GError *error = NULL;
         char *encoded = NULL;
         gsize bytes_written;
@@ -622,10 +979,13 @@ from_string_func(JSContext *context,
             return false;
         }
 
-        g_byte_array_set_size(priv->array, 0);
-        g_byte_array_append(priv->array, (guint8*) encoded, bytes_written);
+        bool ok = byte_array_set_length(context, obj, priv, bytes_written);
+        if (ok)
+            memcpy(byte_array_get_data(obj, priv), encoded, bytes_written);
 
         g_free(encoded);
+        if (!ok)
+            return false;
     }
 
     argv.rval().setObject(*obj);
@@ -653,9 +1013,30 @@ from_array_func(JSContext *context,
 
     g_assert(argc > 0); /* because we specified min args 1 */
 
-    priv->array = gjs_g_byte_array_new(0);
+    if (!argv[0].isObject()) {
+        gjs_throw(context,
+                  "byteArray.fromArray() called with non-array as first arg");
+        return false;
+    }
 
     JS::RootedObject array_obj(context, &argv[0].toObject());
+
+    /* A Uint8Array can be copied in one go */
+    JS::RootedObject typed_array(context, js::UnwrapUint8Array(array_obj));
+    if (typed_array) {
+        len = JS_GetTypedArrayLength(typed_array);
+        if (!byte_array_set_length(context, obj, priv, len))
+            return false;
+
+        bool is_shared;
+        JS::AutoCheckCannotGC nogc;
+        memcpy(byte_array_get_data(obj, priv),
+               JS_GetUint8ArrayData(typed_array, &is_shared, nogc), len);
+
+        argv.rval().setObject(*obj);
+        return true;
+    }
+
     if (!JS_IsArrayObject(context, array_obj, &is_array))
         return false;
     if (!is_array) {
@@ -670,7 +1051,8 @@ from_array_func(JSContext *context,
         return false;
     }
 
-    g_byte_array_set_size(priv->array, len);
+    if (!byte_array_set_length(context, obj, priv, len))
+        return false;
 
     JS::RootedValue elem(context);
     for (i = 0; i < len; ++i) {
@@ -690,7 +1072,7 @@ from_array_func(JSContext *context,
         if (!gjs_value_to_byte(context, elem, &b))
             return false;
 
-        g_array_index(priv->array, guint8, i) = b;
+        byte_array_get_data(obj, priv)[i] = b;
     }
 
     argv.rval().setObject(*obj);
@@ -705,7 +1087,6 @@ from_gbytes_func(JSContext *context,
     JS::CallArgs argv = JS::CallArgsFromVp (argc, vp);
     JS::RootedObject bytes_obj(context);
     GBytes *gbytes;
-    ByteArrayInstance *priv;
 
     if (!gjs_parse_call_args(context, "overrides_gbytes_to_array", argv, "o",
                              "bytes", &bytes_obj))
@@ -716,18 +1097,79 @@ from_gbytes_func(JSContext *context,
 
     gbytes = (GBytes*) gjs_c_struct_from_boxed(context, bytes_obj);
 
-    JS::RootedObject obj(context, byte_array_new(context));
+    JSObject *obj = gjs_byte_array_from_bytes(context, gbytes);
     if (!obj)
         return false;
-    priv = priv_from_js(context, obj);
-    g_assert (priv != NULL);
 
-    priv->bytes = g_bytes_ref(gbytes);
+    argv.rval().setObject(*obj);
+    return true;
+}
+
+static bool
+uint8_array_from_gbytes_func(JSContext *context,
+                             unsigned   argc,
+                             JS::Value *vp)
+{
+    JS::CallArgs argv = JS::CallArgsFromVp (argc, vp);
+    JS::RootedObject bytes_obj(context);
+
+    if (!gjs_parse_call_args(context, "uint8ArrayFromGBytes", argv, "o",
+                             "bytes", &bytes_obj))
+        return false;
+
+    if (!gjs_typecheck_boxed(context, bytes_obj, NULL, G_TYPE_BYTES, true))
+        return false;
+
+    auto gbytes = static_cast<GBytes *>(gjs_c_struct_from_boxed(context,
+                                                                bytes_obj));
+    JSObject *obj = gjs_uint8_array_from_bytes(context, gbytes);
+    if (!obj)
+        return false;
 
     argv.rval().setObject(*obj);
     return true;
 }
 
+/* Shares the GBytes until the first write */
+JSObject *
+gjs_byte_array_from_bytes(JSContext *context,
+                          GBytes    *bytes)
+{
+    ByteArrayInstance *priv;
+
+    g_return_val_if_fail(context != NULL, NULL);
+    g_return_val_if_fail(bytes != NULL, NULL);
+
+    JS::RootedObject object(context, byte_array_new(context));
+    if (!object)
+        return NULL;
+
+    priv = priv_from_js(context, object);
+    g_assert(priv != NULL);
+
+    priv->bytes = g_bytes_ref(bytes);
+    priv->len = g_bytes_get_size(bytes);
+
+    return object;
+}
+
+/* Returns a ByteArray of @len zeroed bytes, or %NULL with an exception pending
+ * if they can't be allocated */
+JSObject *
+gjs_byte_array_new(JSContext *context,
+                   size_t     len)
+{
+    JS::RootedObject object(context, byte_array_new(context));
+    if (!object)
+        return nullptr;
+
+    ByteArrayInstance *priv = priv_from_js(context, object);
+    if (!byte_array_set_length(context, object, priv, len))
+        return nullptr;
+
+    return object;
+}
+
 JSObject *
 gjs_byte_array_from_byte_array (JSContext *context,
                                 GByteArray *array)
@@ -737,25 +1179,218 @@ gjs_byte_array_from_byte_array (JSContext *context,
     g_return_val_if_fail(context != NULL, NULL);
     g_return_val_if_fail(array != NULL, NULL);
 
-    JS::RootedObject proto(context, gjs_byte_array_get_proto(context));
-    JS::RootedObject object(context,
-        JS_NewObjectWithGivenProto(context, &gjs_byte_array_class, proto));
+    JS::RootedObject object(context, byte_array_new(context));
 
     if (!object) {
         gjs_throw(context, "failed to create byte array");
         return NULL;
     }
 
-    priv = g_slice_new0(ByteArrayInstance);
-    g_assert(priv_from_js(context, object) == NULL);
-    JS_SetPrivate(object, priv);
-    priv->array = g_byte_array_new();
-    priv->array->data = (guint8*) g_memdup(array->data, array->len);
-    priv->array->len = array->len;
+    priv = priv_from_js(context, object);
+    if (!byte_array_set_length(context, object, priv, array->len))
+        return NULL;
+    if (array->len > 0)
+        memcpy(byte_array_get_data(object, priv), array->data, array->len);
 
     return object;
 }
 
+/* ArrayBuffers and typed arrays can share memory with a GBytes. The GBytes is
+ * kept alive by a holder object, which the context's GjsArrayBufferMaps maps
+ * the ArrayBuffer or typed array to, and which drops its reference when it is
+ * finalized along with them.
+ *
+ * An ArrayBuffer made from a GBytes points straight at the memory of a copy
+ * of it, since JS may write to it while the GBytes may be read-only or shared.
+ * Passing that ArrayBuffer, or a view on it, back to C as a GBytes then
+ * doesn't copy again. Any other ArrayBuffer's memory may move or be freed by
+ * the engine, and belongs to the caller, so it is copied into a new GBytes
+ * each time instead; it is never detached. */
+
+static void
+bytes_holder_finalize(JSFreeOp *fop,
+                      JSObject *obj)
+{
+    auto bytes = static_cast<GBytes *>(JS_GetPrivate(obj));
+    if (bytes)
+        g_bytes_unref(bytes);
+}
+
+static const struct JSClassOps bytes_holder_class_ops = {
+    nullptr,  /* addProperty */
+    nullptr,  /* deleteProperty */
+    nullptr,  /* getProperty */
+    nullptr,  /* setProperty */
+    nullptr,  /* enumerate */
+    nullptr,  /* resolve */
+    nullptr,  /* mayResolve */
+    bytes_holder_finalize
+};
+
+static const struct JSClass bytes_holder_class = {
+    "GBytesHolder",
+    JSCLASS_HAS_PRIVATE | JSCLASS_BACKGROUND_FINALIZE,
+    &bytes_holder_class_ops
+};
+
+/* Takes ownership of @bytes, even on failure */
+static bool
+bytes_holder_attach(JSContext       *context,
+                    JS::HandleObject obj,
+                    GBytes          *bytes)
+{
+    auto gjs_context = static_cast<GjsContext *>(JS_GetContextPrivate(context));
+    GjsWeakObjectMap& holders =
+        _gjs_context_get_array_buffer_maps(gjs_context)->bytes_holders;
+
+    /* Nothing would keep the GBytes alive for as long as @obj is */
+    if (!holders.can_hold(context, obj)) {
+        g_bytes_unref(bytes);
+        gjs_throw(context, "ArrayBuffers from another compartment can't be "
+                  "used as GBytes");
+        return false;
+    }
+
+    JS::RootedObject holder(context,
+        JS_NewObjectWithGivenProto(context, &bytes_holder_class, nullptr));
+    if (!holder) {
+        g_bytes_unref(bytes);
+        return false;
+    }
+
+    JS_SetPrivate(holder, bytes);
+    if (!holders.put(context, obj, holder)) {
+        JS_ReportOutOfMemory(context);
+        return false;
+    }
+    return true;
+}
+
+/* Returns the GBytes held for @obj, if it still covers exactly the same
+ * memory as @obj does */
+static GBytes *
+bytes_holder_peek(JSContext       *context,
+                  JS::HandleObject obj)
+{
+    auto gjs_context = static_cast<GjsContext *>(JS_GetContextPrivate(context));
+    JSObject *holder =
+        _gjs_context_get_array_buffer_maps(gjs_context)->bytes_holders.lookup(
+            obj);
+    if (!holder)
+        return nullptr;
+
+    auto bytes = static_cast<GBytes *>(JS_GetPrivate(holder));
+    if (!bytes)
+        return nullptr;
+
+    uint32_t len;
+    uint8_t *data;
+    bool is_shared;
+    if (!JS_GetObjectAsArrayBuffer(obj, &len, &data) &&
+        !JS_GetObjectAsArrayBufferView(obj, &len, &is_shared, &data))
+        return nullptr;
+
+    /* Empty GBytes and ArrayBuffers may or may not have a data pointer */
+    if (len != g_bytes_get_size(bytes) ||
+        (len > 0 && data != g_bytes_get_data(bytes, nullptr)))
+        return nullptr;
+    return bytes;
+}
+
+/* Returns a Uint8Array with a copy of the bytes of @bytes, see above */
+JSObject *
+gjs_uint8_array_from_bytes(JSContext *context,
+                           GBytes    *bytes)
+{
+    size_t len;
+    const void *data = g_bytes_get_data(bytes, &len);
+
+    if (len == 0)
+        return JS_NewUint8Array(context, 0);
+    if (len > G_MAXUINT32) {
+        gjs_throw(context, "GBytes of %" G_GSIZE_FORMAT " bytes is too large "
+                  "for a Uint8Array", len);
+        return nullptr;
+    }
+
+    GBytes *copy = g_bytes_new(data, len);
+    void *contents = const_cast<void *>(g_bytes_get_data(copy, nullptr));
+
+    /* The engine never frees or moves external contents */
+    JS::RootedObject buffer(context,
+        JS_NewArrayBufferWithExternalContents(context, len, contents));
+    if (!buffer) {
+        g_bytes_unref(copy);
+        return nullptr;
+    }
+    if (!bytes_holder_attach(context, buffer, copy))
+        return nullptr;
+
+    return JS_NewUint8ArrayWithBuffer(context, buffer, 0, -1);
+}
+
+bool
+gjs_typecheck_array_buffer(JSObject *obj)
+{
+    return JS_IsArrayBufferObject(obj) || JS_IsArrayBufferViewObject(obj);
+}
+
+/* Returns a GBytes with the bytes of @obj, an ArrayBuffer or a typed array or
+ * DataView, which stays valid as long as @obj is alive. The GBytes shares the
+ * memory of an ArrayBuffer made by gjs_uint8_array_from_bytes(), and holds a
+ * copy of any other, see above. */
+GBytes *
+gjs_array_buffer_peek_bytes(JSContext       *context,
+                            JS::HandleObject obj)
+{
+    GBytes *bytes = bytes_holder_peek(context, obj);
+    if (bytes)
+        return bytes;
+
+    JS::RootedObject buffer(context, obj);
+    size_t offset = 0, len;
+
+    if (JS_IsArrayBufferObject(obj)) {
+        len = JS_GetArrayBufferByteLength(obj);
+    } else {
+        bool is_shared;
+        buffer = JS_GetArrayBufferViewBuffer(context, obj, &is_shared);
+        if (!buffer)
+            return nullptr;
+        if (is_shared) {
+            gjs_throw(context, "SharedArrayBuffers can't be used as GBytes");
+            return nullptr;
+        }
+        len = JS_GetArrayBufferViewByteLength(obj);
+        if (JS_IsTypedArrayObject(obj))
+            offset = JS_GetTypedArrayByteOffset(obj);
+        else
+            offset = JS_GetDataViewByteOffset(obj);
+    }
+
+    if (JS_IsDetachedArrayBufferObject(buffer)) {
+        gjs_throw(context, "ArrayBuffer is detached");
+        return nullptr;
+    }
+
+    GBytes *whole = bytes_holder_peek(context, buffer);
+    if (whole && obj == buffer)
+        return whole;
+
+    if (whole) {
+        bytes = g_bytes_new_from_bytes(whole, offset, len);
+    } else {
+        bool is_shared;
+        JS::AutoCheckCannotGC nogc;
+        bytes = g_bytes_new(JS_GetArrayBufferData(buffer, &is_shared, nogc) +
+                            offset, len);
+    }
+
+    if (!bytes_holder_attach(context, obj, bytes))
+        return nullptr;
+    return bytes;
+}
+
 GBytes *
 gjs_byte_array_get_bytes (JSContext       *context,
                           JS::HandleObject object)
@@ -764,11 +1399,12 @@ gjs_byte_array_get_bytes (JSContext       *context,
     priv = priv_from_js(context, object);
     g_assert(priv != NULL);
 
-    byte_array_ensure_gbytes(priv);
-
-    return g_bytes_ref (priv->bytes);
+    GBytes *bytes = byte_array_ensure_gbytes(context, object, priv);
+    return bytes ? g_bytes_ref(bytes) : NULL;
 }
 
+/* Returns a new reference to the GByteArray that the ByteArray's bytes are
+ * kept in from now on, or %NULL with an exception pending */
 GByteArray *
 gjs_byte_array_get_byte_array (JSContext       *context,
                                JS::HandleObject obj)
@@ -777,9 +1413,32 @@ gjs_byte_array_get_byte_array (JSContext       *context,
     priv = priv_from_js(context, obj);
     g_assert(priv != NULL);
 
-    byte_array_ensure_array(priv);
+    if (priv->array)
+        return g_byte_array_ref(priv->array);
+
+    byte_array_check_detached(obj, priv);
+
+    /* The ByteArray's own memory isn't allocated with g_malloc(), so it is
+     * copied this once. Any views on the ArrayBuffer are detached, rather than
+     * left showing stale bytes. */
+    GByteArray *array = g_byte_array_sized_new(priv->len);
+    JS::RootedObject buffer(context, byte_array_get_buffer(obj));
+    if (buffer) {
+        void *contents = JS_StealArrayBufferContents(context, buffer);
+        if (!contents) {
+            g_byte_array_unref(array);
+            return nullptr;
+        }
+        g_byte_array_append(array, static_cast<guint8 *>(contents), priv->len);
+        js_free(contents);
+        JS_SetReservedSlot(obj, BYTE_ARRAY_SLOT_BUFFER, JS::UndefinedValue());
+    } else if (priv->bytes) {
+        g_byte_array_append(array, byte_array_get_data(obj, priv), priv->len);
+        g_clear_pointer(&priv->bytes, g_bytes_unref);
+    }
 
-    return g_byte_array_ref (priv->array);
+    priv->array = array;
+    return g_byte_array_ref(array);
 }
 
 void
@@ -791,15 +1450,9 @@ gjs_byte_array_peek_data (JSContext       *context,
     ByteArrayInstance *priv;
     priv = priv_from_js(context, obj);
     g_assert(priv != NULL);
-    
-    if (priv->array != NULL) {
-        *out_data = (guint8*)priv->array->data;
-        *out_len = (gsize)priv->array->len;
-    } else if (priv->bytes != NULL) {
-        *out_data = (guint8*)g_bytes_get_data(priv->bytes, out_len);
-    } else {
-        g_assert_not_reached();
-    }
+
+    *out_len = byte_array_get_length(obj, priv);
+    *out_data = byte_array_get_data(obj, priv);
 }
 
 static JSPropertySpec gjs_byte_array_proto_props[] = {
@@ -811,6 +1464,7 @@ static JSPropertySpec gjs_byte_array_proto_props[] = {
 static JSFunctionSpec gjs_byte_array_proto_funcs[] = {
     JS_FS("toString", to_string_func, 0, 0),
     JS_FS("toGBytes", to_gbytes_func, 0, 0),
+    JS_FS("toUint8Array", to_uint8_array_func, 0, 0),
     JS_FS_END
 };
 
@@ -820,6 +1474,7 @@ static JSFunctionSpec gjs_byte_array_module_funcs[] = {
     JS_FS("fromString", from_string_func, 1, 0),
     JS_FS("fromArray", from_array_func, 1, 0),
     JS_FS("fromGBytes", from_gbytes_func, 1, 0),
+    JS_FS("uint8ArrayFromGBytes", uint8_array_from_gbytes_func, 1, 0),
     JS_FS_END
 };
 
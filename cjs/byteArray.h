@@ -40,12 +40,26 @@ bool gjs_define_byte_array_stuff(JSContext              *context,
 JSObject *    gjs_byte_array_from_byte_array (JSContext  *context,
                                               GByteArray *array);
 
+JSObject *  gjs_byte_array_from_bytes(JSContext *context,
+                                      GBytes    *bytes);
+
+JSObject   *gjs_byte_array_new(JSContext *context,
+                               size_t     len);
+
 GByteArray *gjs_byte_array_get_byte_array(JSContext       *context,
                                           JS::HandleObject object);
 
 GBytes     *gjs_byte_array_get_bytes(JSContext       *context,
                                      JS::HandleObject object);
 
+JSObject   *gjs_uint8_array_from_bytes(JSContext *context,
+                                       GBytes    *bytes);
+
+bool        gjs_typecheck_array_buffer(JSObject *obj);
+
+GBytes     *gjs_array_buffer_peek_bytes(JSContext       *context,
+                                        JS::HandleObject obj);
+
 void        gjs_byte_array_peek_data(JSContext       *context,
                                      JS::HandleObject object,
                                      guint8         **out_data,
@@ -53,4 +67,44 @@ void        gjs_byte_array_peek_data(JSContext       *context,
 
 G_END_DECLS
 
+/* Weakly maps JS objects to JS objects, without touching either of them. The
+ * map lives in the zone of the first object put in it; objects from any other
+ * zone, such as the code coverage debugger's, are never found. */
+class GjsWeakObjectMap {
+    JS::WeakMapPtr<JSObject *, JSObject *> m_map;
+    JS::Zone *m_zone = nullptr;
+
+public:
+    ~GjsWeakObjectMap() {
+        if (m_map.initialized())
+            m_map.destroy();
+    }
+
+    void trace(JSTracer *trc) {
+        if (m_map.initialized())
+            m_map.trace(trc);
+    }
+
+    bool can_hold(JSContext *cx, JSObject *key);
+    JSObject *lookup(JSObject *key);
+    bool put(JSContext *cx, JSObject *key, JSObject *value);
+};
+
+/* Per-GjsContext associations between ArrayBuffers and what their memory
+ * belongs to. Traced by the context, and deleted before the JSContext is. */
+struct GjsArrayBufferMaps {
+    /* ArrayBuffer -> ByteArray keeping its bytes in it */
+    GjsWeakObjectMap byte_arrays;
+    /* ArrayBuffer or view -> holder of the GBytes last made from it */
+    GjsWeakObjectMap bytes_holders;
+
+    void trace(JSTracer *trc) {
+        byte_arrays.trace(trc);
+        bytes_holders.trace(trc);
+    }
+};
+
+bool gjs_array_buffer_backs_byte_array(JSContext *cx,
+                                       JSObject  *buffer);
+
 #endif  /* __GJS_BYTE_ARRAY_H__ */
@@ -30,10 +30,13 @@
 
 #include <cjs/gjs.h>
 
+#include "zygote.h"
+
 static char **include_path = NULL;
 static char **coverage_prefixes = NULL;
 static char *coverage_output_path = NULL;
 static char *profile_output_path = nullptr;
+static char *import_trace_path = nullptr;
 static char *command = NULL;
 static gboolean print_version = false;
 static gboolean print_js_version = false;
@@ -54,6 +57,9 @@ static GOptionEntry entries[] = {
         G_OPTION_ARG_CALLBACK, reinterpret_cast<void *>(&parse_profile_arg),
         "Enable the profiler and write output to FILE (default: gjs-$PID.syscap)",
         "FILE" },
+    { "trace-imports", 0, 0, G_OPTION_ARG_FILENAME, &import_trace_path,
+        "Record the time taken by each module import and write it to FILE as JSON",
+        "FILE" },
     { NULL }
 };
 
@@ -201,15 +207,24 @@ main(int argc, char **argv)
     const char *program_name;
     gsize len;
     int code, gjs_argc = argc, script_argc, ix;
-    char **argv_copy = g_strdupv(argv), **argv_copy_addr = argv_copy;
+    char **argv_copy, **argv_copy_addr;
     char **gjs_argv, **gjs_argv_addr;
     char * const *script_argv;
     const char *env_coverage_output_path;
     const char *env_coverage_prefixes;
     bool interactive_mode = false;
 
+    /* A zygote only returns from here in a forked worker, with the command
+     * line of the client it is serving */
+    if (argc > 1 && g_str_has_prefix(argv[1], "--zygote"))
+        gjs_zygote_serve(&argc, &argv);
+    else if (gjs_zygote_connect(argc, argv, &code))
+        exit(code);
+
     setlocale(LC_ALL, "");
 
+    argv_copy_addr = argv_copy = g_strdupv(argv);
+
     context = g_option_context_new(NULL);
 
     g_option_context_set_ignore_unknown_options(context, true);
@@ -302,6 +317,7 @@ main(int argc, char **argv)
                                             "search-path", include_path,
                                             "program-name", program_name,
                                             "profiler-enabled", enable_profiler,
+                                            "import-trace-file", import_trace_path,
                                             NULL);
 
     env_coverage_output_path = g_getenv("GJS_COVERAGE_OUTPUT");
@@ -359,6 +375,7 @@ main(int argc, char **argv)
 
     g_free(coverage_output_path);
     g_free(profile_output_path);
+    g_free(import_trace_path);
     g_strfreev(coverage_prefixes);
     if (coverage)
         g_object_unref(coverage);
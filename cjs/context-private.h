@@ -32,6 +32,14 @@
 
 G_BEGIN_DECLS
 
+typedef struct {
+    size_t pending;  /* jobs currently in the queue */
+    size_t max_depth;
+    int64_t longest_drain;  /* us */
+    uint64_t drains;
+    uint64_t yields;  /* drains cut short by the time budget */
+} GjsJobQueueStats;
+
 bool         _gjs_context_destroying                  (GjsContext *js_context);
 
 void         _gjs_context_schedule_gc_if_needed       (GjsContext *js_context);
@@ -43,6 +51,8 @@ void _gjs_context_exit(GjsContext *js_context,
 
 bool _gjs_context_get_is_owner_thread(GjsContext *js_context);
 
+const char *_gjs_context_get_gc_profile(GjsContext *js_context);
+
 bool _gjs_context_should_exit(GjsContext *js_context,
                               uint8_t    *exit_code_p);
 
@@ -56,11 +66,29 @@ bool _gjs_context_enqueue_job(GjsContext      *gjs_context,
 
 bool _gjs_context_run_jobs(GjsContext *gjs_context);
 
+const GjsJobQueueStats *_gjs_context_get_job_queue_stats(GjsContext *gjs_context);
+
 void _gjs_context_unregister_unhandled_promise_rejection(GjsContext *gjs_context,
                                                          uint64_t    promise_id);
 
 G_END_DECLS
 
+class GjsGCStats;
+
+GjsGCStats *_gjs_context_get_gc_stats(GjsContext *js_context);
+
+class GjsModulePreloads;
+
+GjsModulePreloads *_gjs_context_get_module_preloads(GjsContext *js_context);
+
+class GjsDBusProxyTables;
+
+GjsDBusProxyTables *_gjs_context_get_dbus_proxy_tables(GjsContext *js_context);
+
+struct GjsArrayBufferMaps;
+
+GjsArrayBufferMaps *_gjs_context_get_array_buffer_maps(GjsContext *js_context);
+
 void _gjs_context_register_unhandled_promise_rejection(GjsContext   *gjs_context,
                                                        uint64_t      promise_id,
                                                        GjsAutoChar&& stack);
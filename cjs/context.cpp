@@ -34,14 +34,19 @@
 
 #include "context-private.h"
 #include "engine.h"
+#include "gc-stats.h"
 #include "global.h"
+#include "import-cache.h"
+#include "import-trace.h"
 #include "importer.h"
+#include "module.h"
 #include "jsapi-util.h"
 #include "jsapi-wrapper.h"
 #include "mem.h"
 #include "native.h"
 #include "profiler-private.h"
 #include "byteArray.h"
+#include "gi/dbus.h"
 #include "gi/object.h"
 #include "gi/repo.h"
 
@@ -83,6 +88,10 @@ struct _GjsContext {
 
     char **search_path;
 
+    char *gc_profile;
+
+    char *import_trace_file;
+
     bool destroying;
     bool in_gc_sweep;
 
@@ -92,11 +101,20 @@ struct _GjsContext {
     guint    auto_gc_id;
     bool     force_gc;
 
+    GjsGCStats *gc_stats;
+    GjsModulePreloads *module_preloads;
+    GjsDBusProxyTables *dbus_proxy_tables;
+    GjsArrayBufferMaps *array_buffer_maps;
+
     std::array<JS::PersistentRootedId*, GJS_STRING_LAST> const_strings;
 
     JS::PersistentRooted<JobQueue> *job_queue;
     unsigned idle_drain_handler;
     bool draining_job_queue;
+    bool job_queue_yielded;  /* idle_drain_handler lowered to G_PRIORITY_LOW */
+    int job_queue_priority;
+    unsigned job_queue_budget;  /* ms, 0 for unlimited */
+    GjsJobQueueStats job_queue_stats;
 
     std::unordered_map<uint64_t, GjsAutoChar> unhandled_rejection_stacks;
 
@@ -111,7 +129,7 @@ static const char *const_strings[] = {
     "imports", "__parentModule__", "__init__", "searchPath",
     "__gjsKeepAlive", "__gjsPrivateNS",
     "gi", "versions", "overrides",
-    "_init", "_instance_init", "_new_internal", "new",
+    "_init", "_instance_init", "new",
     "message", "code", "stack", "fileName", "lineNumber", "columnNumber",
     "name", "x", "y", "width", "height", "__modulePath__"
 };
@@ -138,6 +156,10 @@ enum {
     PROP_PROGRAM_NAME,
     PROP_PROFILER_ENABLED,
     PROP_PROFILER_SIGUSR2,
+    PROP_GC_PROFILE,
+    PROP_JOB_QUEUE_PRIORITY,
+    PROP_JOB_QUEUE_BUDGET,
+    PROP_IMPORT_TRACE_FILE,
 };
 
 static GMutex contexts_lock;
@@ -283,6 +305,73 @@ gjs_context_class_init(GjsContextClass *klass)
     g_object_class_install_property(object_class, PROP_PROFILER_SIGUSR2, pspec);
     g_param_spec_unref(pspec);
 
+    /**
+     * GjsContext:gc-profile:
+     *
+     * Name of the set of garbage collector tuning parameters to use: one of
+     * "default", "low-latency", "throughput", or "low-memory". May be changed
+     * while the context is running. Individual parameters can be adjusted on
+     * top of the profile with gjs_context_set_gc_parameter().
+     *
+     * The value of this property is superseded by the GJS_GC_PROFILE
+     * environment variable at construction time.
+     */
+    pspec = g_param_spec_string("gc-profile", "GC profile",
+                                "Garbage collector tuning profile",
+                                GJS_GC_PROFILE_DEFAULT,
+                                GParamFlags(G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+    g_object_class_install_property(object_class, PROP_GC_PROFILE, pspec);
+    g_param_spec_unref(pspec);
+
+    /**
+     * GjsContext:job-queue-priority:
+     *
+     * Main loop priority of the idle source that runs promise callbacks
+     * (microtasks). Lower it to let input and frame processing take
+     * precedence over bursts of async work.
+     */
+    pspec = g_param_spec_int("job-queue-priority", "Job queue priority",
+                             "Main loop priority for running promise callbacks",
+                             G_PRIORITY_HIGH, G_PRIORITY_LOW, G_PRIORITY_DEFAULT,
+                             GParamFlags(G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+    g_object_class_install_property(object_class, PROP_JOB_QUEUE_PRIORITY, pspec);
+    g_param_spec_unref(pspec);
+
+    /**
+     * GjsContext:job-queue-budget:
+     *
+     * Maximum time in milliseconds to spend running promise callbacks before
+     * yielding back to the main loop. The remaining callbacks are run on the
+     * next main loop iteration. 0 means to run until the queue is empty.
+     *
+     * The queue is always emptied completely at the end of
+     * gjs_context_eval() and before the context is torn down, regardless of
+     * this setting.
+     */
+    pspec = g_param_spec_uint("job-queue-budget", "Job queue budget",
+                              "Time budget in ms for running promise callbacks",
+                              0, G_MAXUINT, 0,
+                              GParamFlags(G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+    g_object_class_install_property(object_class, PROP_JOB_QUEUE_BUDGET, pspec);
+    g_param_spec_unref(pspec);
+
+    /**
+     * GjsContext:import-trace-file:
+     *
+     * If set, the time taken by each module import is recorded, and the tree
+     * of imports is written to this file as JSON when the context is
+     * disposed.
+     *
+     * The value of this property is superseded by the GJS_TRACE_IMPORTS
+     * environment variable.
+     */
+    pspec = g_param_spec_string("import-trace-file", "Import trace file",
+                                "File to write module import timings to",
+                                nullptr,
+                                GParamFlags(G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+    g_object_class_install_property(object_class, PROP_IMPORT_TRACE_FILE, pspec);
+    g_param_spec_unref(pspec);
+
     /* For GjsPrivate */
     {
 #ifdef G_OS_WIN32
@@ -309,6 +398,8 @@ gjs_context_tracer(JSTracer *trc, void *data)
 {
     GjsContext *gjs_context = reinterpret_cast<GjsContext *>(data);
     JS::TraceEdge<JSObject *>(trc, &gjs_context->global, "GJS global object");
+    if (gjs_context->array_buffer_maps)
+        gjs_context->array_buffer_maps->trace(trc);
 }
 
 static void
@@ -340,6 +431,41 @@ gjs_context_dispose(GObject *object)
     if (js_context->profiler)
         g_clear_pointer(&js_context->profiler, _gjs_profiler_free);
 
+    /* Callbacks still queued at this point would otherwise never run, and the
+     * idle source would outlive the context. Run them while the objects they
+     * may touch are still alive. */
+    if (js_context->context) {
+        gjs_debug(GJS_DEBUG_CONTEXT, "Draining promise job queue");
+        {
+            JSAutoCompartment ac(js_context->context, js_context->global);
+            _gjs_context_run_jobs(js_context);
+        }
+        if (js_context->idle_drain_handler) {
+            g_source_remove(js_context->idle_drain_handler);
+            js_context->idle_drain_handler = 0;
+            js_context->job_queue_yielded = false;
+        }
+
+        gjs_debug(GJS_DEBUG_CONTEXT, "Cancelling module preloads");
+        gjs_module_cancel_preloads(js_context->context);
+    }
+
+    const GjsImportCacheStats *import_stats = gjs_import_cache_get_stats();
+    gjs_debug(GJS_DEBUG_CONTEXT, "Import cache: %u directories listed, %u "
+              "invalidated, about %u syscalls avoided and %u spent",
+              import_stats->listings, import_stats->invalidations,
+              import_stats->syscalls_avoided, import_stats->syscalls_spent);
+
+    if (js_context->import_trace_file) {
+        GError *error = nullptr;
+        if (!gjs_import_trace_write(js_context->import_trace_file, &error)) {
+            g_warning("Failed to write import trace: %s", error->message);
+            g_error_free(error);
+        }
+        gjs_import_trace_stop();
+        g_clear_pointer(&js_context->import_trace_file, g_free);
+    }
+
     /* Stop accepting entries in the toggle queue before running dispose
      * notifications, which causes all GjsMaybeOwned instances to unroot.
      * We don't want any objects to toggle down after that. */
@@ -396,10 +522,20 @@ gjs_context_dispose(GObject *object)
 
         gjs_debug(GJS_DEBUG_CONTEXT, "Freeing allocated resources");
         delete js_context->job_queue;
+        /* Weak maps must be destroyed while the JS context is still alive */
+        delete js_context->array_buffer_maps;
+        js_context->array_buffer_maps = nullptr;
 
         /* Tear down JS */
         JS_DestroyContext(js_context->context);
         js_context->context = NULL;
+        delete js_context->gc_stats;
+        js_context->gc_stats = nullptr;
+        delete js_context->module_preloads;
+        js_context->module_preloads = nullptr;
+        /* Emptied by the weak pointer callback during the final GC */
+        delete js_context->dbus_proxy_tables;
+        js_context->dbus_proxy_tables = nullptr;
         gjs_debug(GJS_DEBUG_CONTEXT, "JS context destroyed");
     }
 }
@@ -421,6 +557,9 @@ gjs_context_finalize(GObject *object)
         js_context->program_name = NULL;
     }
 
+    g_clear_pointer(&js_context->gc_profile, g_free);
+    g_clear_pointer(&js_context->import_trace_file, g_free);
+
     if (gjs_context_get_current() == (GjsContext*)object)
         gjs_context_make_current(NULL);
 
@@ -444,6 +583,27 @@ gjs_context_constructed(GObject *object)
 
     js_context->owner_thread = g_thread_self();
 
+    const char *env_gc_profile = g_getenv("GJS_GC_PROFILE");
+    if (env_gc_profile) {
+        g_free(js_context->gc_profile);
+        js_context->gc_profile = g_strdup(env_gc_profile);
+    }
+
+    const char *env_trace_imports = g_getenv("GJS_TRACE_IMPORTS");
+    if (env_trace_imports) {
+        g_free(js_context->import_trace_file);
+        js_context->import_trace_file = g_strdup(env_trace_imports);
+    }
+    if (js_context->import_trace_file)
+        gjs_import_trace_start();
+
+    /* Needed before the JS context exists, since GCs may happen while it is
+     * being created */
+    js_context->gc_stats = new GjsGCStats();
+    js_context->module_preloads = new GjsModulePreloads();
+    js_context->dbus_proxy_tables = new GjsDBusProxyTables();
+    js_context->array_buffer_maps = new GjsArrayBufferMaps();
+
     JSContext *cx = gjs_create_js_context(js_context);
     if (!cx)
         g_error("Failed to create javascript context");
@@ -534,6 +694,18 @@ gjs_context_get_property (GObject     *object,
     case PROP_PROGRAM_NAME:
         g_value_set_string(value, js_context->program_name);
         break;
+    case PROP_GC_PROFILE:
+        g_value_set_string(value, js_context->gc_profile);
+        break;
+    case PROP_JOB_QUEUE_PRIORITY:
+        g_value_set_int(value, js_context->job_queue_priority);
+        break;
+    case PROP_JOB_QUEUE_BUDGET:
+        g_value_set_uint(value, js_context->job_queue_budget);
+        break;
+    case PROP_IMPORT_TRACE_FILE:
+        g_value_set_string(value, js_context->import_trace_file);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
         break;
@@ -563,6 +735,30 @@ gjs_context_set_property (GObject      *object,
     case PROP_PROFILER_SIGUSR2:
         js_context->should_listen_sigusr2 = g_value_get_boolean(value);
         break;
+    case PROP_GC_PROFILE:
+        if (!js_context->context) {
+            /* Validated when the JS context is created */
+            g_free(js_context->gc_profile);
+            js_context->gc_profile = g_value_dup_string(value);
+        } else {
+            GError *error = nullptr;
+            if (!gjs_context_set_gc_profile(js_context,
+                                            g_value_get_string(value),
+                                            &error)) {
+                g_warning("%s", error->message);
+                g_error_free(error);
+            }
+        }
+        break;
+    case PROP_JOB_QUEUE_PRIORITY:
+        js_context->job_queue_priority = g_value_get_int(value);
+        break;
+    case PROP_JOB_QUEUE_BUDGET:
+        js_context->job_queue_budget = g_value_get_uint(value);
+        break;
+    case PROP_IMPORT_TRACE_FILE:
+        js_context->import_trace_file = g_value_dup_string(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
         break;
@@ -664,6 +860,36 @@ _gjs_context_get_is_owner_thread(GjsContext *js_context)
     return js_context->owner_thread == g_thread_self();
 }
 
+GjsGCStats *
+_gjs_context_get_gc_stats(GjsContext *js_context)
+{
+    return js_context->gc_stats;
+}
+
+GjsModulePreloads *
+_gjs_context_get_module_preloads(GjsContext *js_context)
+{
+    return js_context->module_preloads;
+}
+
+GjsDBusProxyTables *
+_gjs_context_get_dbus_proxy_tables(GjsContext *js_context)
+{
+    return js_context->dbus_proxy_tables;
+}
+
+GjsArrayBufferMaps *
+_gjs_context_get_array_buffer_maps(GjsContext *js_context)
+{
+    return js_context->array_buffer_maps;
+}
+
+const char *
+_gjs_context_get_gc_profile(GjsContext *js_context)
+{
+    return js_context->gc_profile;
+}
+
 void
 _gjs_context_set_sweeping(GjsContext *js_context,
                           bool        sweeping)
@@ -678,14 +904,39 @@ _gjs_context_is_sweeping(JSContext *cx)
     return js_context->in_gc_sweep;
 }
 
+static bool run_jobs_until(GjsContext *gjs_context,
+                           int64_t     deadline,
+                           bool       *yielded_p);
+
 static gboolean
 drain_job_queue_idle_handler(void *data)
 {
     auto gjs_context = static_cast<GjsContext *>(data);
-    _gjs_context_run_jobs(gjs_context);
+    bool yielded;
+
+    int64_t deadline = G_MAXINT64;
+    if (gjs_context->job_queue_budget > 0)
+        deadline = g_get_monotonic_time() +
+            int64_t(gjs_context->job_queue_budget) * 1000;
+
     /* Uncatchable exceptions are swallowed here - no way to get a handle on
      * the main loop to exit it from this idle handler */
-    g_assert(((void) "_gjs_context_run_jobs() should have emptied queue",
+    run_jobs_until(gjs_context, deadline, &yielded);
+
+    if (yielded) {
+        /* Out of time; yield to the main loop so that input and frame
+         * processing can happen, and continue where we left off next time.
+         * An idle source is always ready, so if it stayed at its own
+         * priority it would starve every source of lower priority; the rest
+         * of the queue is drained at the lowest priority instead, until
+         * more jobs are queued from outside the queue. */
+        gjs_context->job_queue_stats.yields++;
+        g_source_set_priority(g_main_current_source(), G_PRIORITY_LOW);
+        gjs_context->job_queue_yielded = true;
+        return G_SOURCE_CONTINUE;
+    }
+
+    g_assert(((void) "run_jobs_until() should have emptied queue",
               gjs_context->idle_drain_handler == 0));
     return G_SOURCE_REMOVE;
 }
@@ -702,33 +953,52 @@ _gjs_context_enqueue_job(GjsContext      *gjs_context,
 
     if (!gjs_context->job_queue->append(job))
         return false;
-    if (!gjs_context->idle_drain_handler)
+
+    size_t depth = gjs_context->job_queue->length();
+    if (depth > gjs_context->job_queue_stats.max_depth)
+        gjs_context->job_queue_stats.max_depth = depth;
+
+    if (!gjs_context->idle_drain_handler) {
         gjs_context->idle_drain_handler =
-            g_idle_add_full(G_PRIORITY_DEFAULT, drain_job_queue_idle_handler,
-                            gjs_context, nullptr);
+            g_idle_add_full(gjs_context->job_queue_priority,
+                            drain_job_queue_idle_handler, gjs_context, nullptr);
+    } else if (gjs_context->job_queue_yielded &&
+               !gjs_context->draining_job_queue) {
+        /* A new burst of jobs, rather than a job queued by the jobs still
+         * being drained, goes back to the configured priority */
+        GSource *source = g_main_context_find_source_by_id(nullptr,
+            gjs_context->idle_drain_handler);
+        g_source_set_priority(source, gjs_context->job_queue_priority);
+        gjs_context->job_queue_yielded = false;
+    }
 
     return true;
 }
 
-/**
- * _gjs_context_run_jobs:
+/*
+ * run_jobs_until:
  * @gjs_context: The #GjsContext instance
+ * @deadline: monotonic time in microseconds after which no new job is started
+ * @yielded_p: (out): set to true if @deadline passed before the queue was
+ *   emptied
  *
- * Drains the queue of promise callbacks that the JS engine has reported
- * finished, calling each one and logging any exceptions that it throws.
- *
- * Adapted from js::RunJobs() in SpiderMonkey's default job queue
- * implementation.
+ * Runs promise callbacks from the queue in order until the queue is empty or
+ * @deadline passes. If the deadline passes, the remaining jobs stay in the
+ * queue and the idle source that drains it stays installed.
  *
  * Returns: false if one of the jobs threw an uncatchable exception;
  * otherwise true.
  */
-bool
-_gjs_context_run_jobs(GjsContext *gjs_context)
+static bool
+run_jobs_until(GjsContext *gjs_context,
+               int64_t     deadline,
+               bool       *yielded_p)
 {
     bool retval = true;
     g_assert(gjs_context->job_queue);
 
+    *yielded_p = false;
+
     if (gjs_context->draining_job_queue || gjs_context->should_exit)
         return true;
 
@@ -741,14 +1011,24 @@ _gjs_context_run_jobs(GjsContext *gjs_context)
     JS::HandleValueArray args(JS::HandleValueArray::empty());
     JS::RootedValue rval(cx);
 
+    int64_t start_time = g_get_monotonic_time();
+    bool out_of_time = false;
+
     /* Execute jobs in a loop until we've reached the end of the queue.
      * Since executing a job can trigger enqueueing of additional jobs,
      * it's crucial to recheck the queue length during each iteration. */
-    for (size_t ix = 0; ix < gjs_context->job_queue->length(); ix++) {
+    size_t ix;
+    for (ix = 0; ix < gjs_context->job_queue->length(); ix++) {
         /* A previous job might have set this flag. e.g., System.exit(). */
         if (gjs_context->should_exit)
             break;
 
+        /* Always run at least one job, so that we make progress */
+        if (ix > 0 && g_get_monotonic_time() >= deadline) {
+            out_of_time = true;
+            break;
+        }
+
         job = gjs_context->job_queue->get()[ix];
 
         /* It's possible that job draining was interrupted prematurely,
@@ -780,15 +1060,66 @@ _gjs_context_run_jobs(GjsContext *gjs_context)
         }
     }
 
+    int64_t drain_time = g_get_monotonic_time() - start_time;
+    gjs_context->job_queue_stats.drains++;
+    if (drain_time > gjs_context->job_queue_stats.longest_drain)
+        gjs_context->job_queue_stats.longest_drain = drain_time;
+
     gjs_context->draining_job_queue = false;
+
+    if (out_of_time) {
+        /* Remove the jobs that have run, so that the queue does not grow
+         * without bound under steady load */
+        JobQueue& queue = gjs_context->job_queue->get();
+        queue.erase(queue.begin(), queue.begin() + ix);
+        *yielded_p = true;
+        return retval;
+    }
+
     gjs_context->job_queue->clear();
     if (gjs_context->idle_drain_handler) {
         g_source_remove(gjs_context->idle_drain_handler);
         gjs_context->idle_drain_handler = 0;
+        gjs_context->job_queue_yielded = false;
     }
     return retval;
 }
 
+/**
+ * _gjs_context_run_jobs:
+ * @gjs_context: The #GjsContext instance
+ *
+ * Drains the queue of promise callbacks that the JS engine has reported
+ * finished, calling each one and logging any exceptions that it throws.
+ * Unlike the idle handler that normally drains the queue, this ignores
+ * the #GjsContext:job-queue-budget and runs until the queue is empty.
+ *
+ * Adapted from js::RunJobs() in SpiderMonkey's default job queue
+ * implementation.
+ *
+ * Returns: false if one of the jobs threw an uncatchable exception;
+ * otherwise true.
+ */
+bool
+_gjs_context_run_jobs(GjsContext *gjs_context)
+{
+    bool yielded;
+    return run_jobs_until(gjs_context, G_MAXINT64, &yielded);
+}
+
+/**
+ * _gjs_context_get_job_queue_stats:
+ * @gjs_context: The #GjsContext instance
+ *
+ * Returns: (transfer none): instrumentation for the promise job queue
+ */
+const GjsJobQueueStats *
+_gjs_context_get_job_queue_stats(GjsContext *gjs_context)
+{
+    gjs_context->job_queue_stats.pending = gjs_context->job_queue->length();
+    return &gjs_context->job_queue_stats;
+}
+
 void
 _gjs_context_register_unhandled_promise_rejection(GjsContext   *gjs_context,
                                                   uint64_t      id,
@@ -846,6 +1177,150 @@ gjs_context_gc (GjsContext  *context)
     JS_GC(context->context);
 }
 
+/**
+ * gjs_context_preload_modules:
+ * @context: a #GjsContext
+ * @module_names: %NULL-terminated array of dotted module names, as they would
+ *   be imported from the root importer, e.g. "ui.main"
+ *
+ * Starts compiling the given modules on helper threads, so that importing
+ * them later is faster. This is the same as calling System.preloadModules()
+ * from JS. Modules that can't be found are ignored.
+ */
+void
+gjs_context_preload_modules(GjsContext         *context,
+                            const char * const *module_names)
+{
+    g_return_if_fail(GJS_IS_CONTEXT(context));
+
+    JSContext *cx = context->context;
+    JSAutoCompartment ac(cx, context->global);
+    JSAutoRequest ar(cx);
+
+    JS::RootedObject importer(cx,
+        &gjs_get_global_slot(cx, GJS_GLOBAL_SLOT_IMPORTS).toObject());
+    for (const char * const *name = module_names; *name; name++) {
+        if (!gjs_importer_preload(cx, importer, *name))
+            gjs_log_exception(cx);
+    }
+}
+
+/**
+ * gjs_context_set_gc_profile:
+ * @context: a #GjsContext
+ * @profile: name of a GC profile
+ * @error: return location for a #GError
+ *
+ * Switches the garbage collector to the tuning parameters of @profile. See
+ * #GjsContext:gc-profile for the available profiles. Any parameters set with
+ * gjs_context_set_gc_parameter() are reset to the profile's values.
+ *
+ * Returns: %true on success, %false if @profile is not known.
+ */
+bool
+gjs_context_set_gc_profile(GjsContext  *context,
+                           const char  *profile,
+                           GError     **error)
+{
+    g_return_val_if_fail(GJS_IS_CONTEXT(context), false);
+    g_return_val_if_fail(profile, false);
+
+    if (!gjs_gc_profile_is_valid(profile)) {
+        g_set_error(error, GJS_ERROR, GJS_ERROR_FAILED,
+                    "Unknown GC profile '%s'", profile);
+        return false;
+    }
+
+    if (g_strcmp0(context->gc_profile, profile) != 0) {
+        g_free(context->gc_profile);
+        context->gc_profile = g_strdup(profile);
+        g_object_notify(G_OBJECT(context), "gc-profile");
+    }
+
+    if (context->context)
+        gjs_gc_profile_apply(context->context, profile);
+    return true;
+}
+
+/**
+ * gjs_context_set_gc_parameter:
+ * @context: a #GjsContext
+ * @name: name of a garbage collector parameter, e.g. "sliceTimeBudget"
+ * @value: new value for the parameter
+ * @error: return location for a #GError
+ *
+ * Overrides a single garbage collector tuning parameter. The parameter names
+ * are the same as those accepted by the gcparam() function of the
+ * SpiderMonkey shell, and by the GJS_GC_PARAMS environment variable.
+ *
+ * Returns: %true on success, %false if @name is not a writable parameter or
+ * @value is out of range for it.
+ */
+bool
+gjs_context_set_gc_parameter(GjsContext  *context,
+                             const char  *name,
+                             uint32_t     value,
+                             GError     **error)
+{
+    JSGCParamKey key;
+    bool writable;
+
+    g_return_val_if_fail(GJS_IS_CONTEXT(context), false);
+
+    if (!gjs_gc_parameter_lookup(name, &key, &writable)) {
+        g_set_error(error, GJS_ERROR, GJS_ERROR_FAILED,
+                    "Unknown GC parameter '%s'", name);
+        return false;
+    }
+    if (!writable) {
+        g_set_error(error, GJS_ERROR, GJS_ERROR_FAILED,
+                    "GC parameter '%s' is read-only", name);
+        return false;
+    }
+    if (!gjs_gc_parameter_value_is_valid(context->context, key, value)) {
+        g_set_error(error, GJS_ERROR, GJS_ERROR_FAILED,
+                    "Value %u is out of range for GC parameter '%s'", value,
+                    name);
+        return false;
+    }
+
+    JS_SetGCParameter(context->context, key, value);
+    return true;
+}
+
+/**
+ * gjs_context_get_gc_parameter:
+ * @context: a #GjsContext
+ * @name: name of a garbage collector parameter, e.g. "sliceTimeBudget"
+ * @value_p: (out): return location for the value
+ * @error: return location for a #GError
+ *
+ * Retrieves the current value of a garbage collector parameter. See
+ * gjs_context_set_gc_parameter(). Besides the writable parameters, this can
+ * also be used to read statistics such as "gcBytes" and "gcNumber".
+ *
+ * Returns: %true on success, %false if @name is not known.
+ */
+bool
+gjs_context_get_gc_parameter(GjsContext  *context,
+                             const char  *name,
+                             uint32_t    *value_p,
+                             GError     **error)
+{
+    JSGCParamKey key;
+
+    g_return_val_if_fail(GJS_IS_CONTEXT(context), false);
+
+    if (!gjs_gc_parameter_lookup(name, &key, nullptr)) {
+        g_set_error(error, GJS_ERROR, GJS_ERROR_FAILED,
+                    "Unknown GC parameter '%s'", name);
+        return false;
+    }
+
+    *value_p = JS_GetGCParameter(context->context, key);
+    return true;
+}
+
 /**
  * gjs_context_get_all:
  *
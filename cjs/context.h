@@ -29,6 +29,7 @@
 #endif
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <glib-object.h>
 
 #include <cjs/macros.h>
@@ -92,6 +93,27 @@ void            gjs_context_maybe_gc              (GjsContext  *context);
 GJS_EXPORT
 void            gjs_context_gc                    (GjsContext  *context);
 
+GJS_EXPORT
+void gjs_context_preload_modules(GjsContext         *context,
+                                 const char * const *module_names);
+
+GJS_EXPORT
+bool gjs_context_set_gc_profile(GjsContext  *context,
+                                const char  *profile,
+                                GError     **error);
+
+GJS_EXPORT
+bool gjs_context_set_gc_parameter(GjsContext  *context,
+                                  const char  *name,
+                                  uint32_t     value,
+                                  GError     **error);
+
+GJS_EXPORT
+bool gjs_context_get_gc_parameter(GjsContext  *context,
+                                  const char  *name,
+                                  uint32_t    *value_p,
+                                  GError     **error);
+
 GJS_EXPORT
 GjsProfiler *gjs_context_get_profiler(GjsContext *self);
 
@@ -23,13 +23,19 @@
 
 #include <config.h>
 
+#include <errno.h>
+#include <string.h>
+
 #include "jsapi-wrapper.h"
 #include <js/Initialization.h>
 
 #include "context-private.h"
 #include "engine.h"
+#include "gc-stats.h"
 #include "gi/object.h"
 #include "jsapi-util.h"
+#include "module.h"
+#include "profiler-private.h"
 #include "util/log.h"
 
 #ifdef G_OS_WIN32
@@ -182,6 +188,56 @@ on_garbage_collect(JSContext *cx,
         gjs_object_clear_toggles();
 }
 
+static void
+on_gc_slice(JSContext               *cx,
+            JS::GCProgress           progress,
+            const JS::GCDescription& desc)
+{
+    auto js_context = static_cast<GjsContext *>(JS_GetContextPrivate(cx));
+    GjsGCStats *stats = _gjs_context_get_gc_stats(js_context);
+
+    switch (progress) {
+    case JS::GC_CYCLE_BEGIN:
+        stats->cycle_begin();
+        break;
+    case JS::GC_SLICE_BEGIN:
+        stats->slice_begin(desc.reason_, desc.isZone_,
+                           JS_GetGCParameter(cx, JSGC_BYTES));
+        break;
+    case JS::GC_SLICE_END: {
+        const GjsGCSlice& slice =
+            stats->slice_end(JS_GetGCParameter(cx, JSGC_BYTES));
+        gjs_debug(GJS_DEBUG_CONTEXT,
+                  "GC slice (%s) took %" G_GINT64_FORMAT " us, heap %zu -> "
+                  "%zu bytes", JS::gcreason::ExplainReason(slice.reason),
+                  slice.duration, slice.heap_bytes_before,
+                  slice.heap_bytes_after);
+
+        GjsProfiler *profiler = gjs_context_get_profiler(js_context);
+        if (profiler)
+            _gjs_profiler_add_gc_slice(profiler, slice);
+        break;
+    }
+    case JS::GC_CYCLE_END:
+        stats->cycle_end();
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/* Called for each compartment being swept, so it tells us which zones were
+ * actually collected. */
+static void
+on_gc_sweep_compartment(JSContext     *cx,
+                        JSCompartment *compartment,
+                        void          *data)
+{
+    auto js_context = static_cast<GjsContext *>(data);
+    _gjs_context_get_gc_stats(js_context)->note_zone_swept(
+        js::GetCompartmentZone(compartment));
+}
+
 static bool
 on_enqueue_promise_job(JSContext       *cx,
                        JS::HandleObject callback,
@@ -214,6 +270,201 @@ on_promise_unhandled_rejection(JSContext                    *cx,
                                                       std::move(stack));
 }
 
+/* Named GC tuning profiles. Each profile sets every tunable parameter, so
+ * that switching from one profile to another at runtime does not leave
+ * settings from the previous profile behind. Values not mentioned in the
+ * original hardcoded configuration are SpiderMonkey's defaults. */
+struct GjsGCProfile {
+    const char *name;
+    uint32_t max_bytes;  /* heap limit; G_MAXUINT32 for none */
+    uint32_t max_malloc_bytes;
+    uint32_t slice_time_budget;  /* ms */
+    bool dynamic_mark_slice;
+    bool dynamic_heap_growth;
+    uint32_t high_frequency_heap_growth_min;  /* percent */
+    uint32_t high_frequency_heap_growth_max;  /* percent */
+    uint32_t low_frequency_heap_growth;  /* percent */
+    uint32_t allocation_threshold;  /* MB */
+    uint32_t max_empty_chunk_count;
+    bool compacting_enabled;
+};
+
+static const GjsGCProfile gc_profiles[] = {
+    {GJS_GC_PROFILE_DEFAULT, G_MAXUINT32, 128 * 1024 * 1024, 10, true, true,
+     150, 300, 150, 30, 30, true},
+    /* Short slices that are never stretched under allocation pressure, and
+     * no compacting, since compaction is done in a single slice */
+    {"low-latency", G_MAXUINT32, 128 * 1024 * 1024, 5, false, true,
+     150, 300, 150, 30, 30, false},
+    /* Fewer, longer collections; the heap is allowed to grow more between
+     * them */
+    {"throughput", G_MAXUINT32, 256 * 1024 * 1024, 50, true, true,
+     200, 400, 200, 60, 30, true},
+    /* Collect early and often, and give empty chunks back to the system */
+    {"low-memory", G_MAXUINT32, 32 * 1024 * 1024, 10, true, false,
+     120, 150, 120, 10, 2, true},
+};
+
+/* Names follow the ones used by the gcparam() function in the SpiderMonkey
+ * shell. Read-only entries are statistics. */
+static const struct {
+    const char *name;
+    JSGCParamKey key;
+    bool writable;
+} gc_parameters[] = {
+    {"maxBytes", JSGC_MAX_BYTES, true},
+    {"maxMallocBytes", JSGC_MAX_MALLOC_BYTES, true},
+    {"gcBytes", JSGC_BYTES, false},
+    {"gcNumber", JSGC_NUMBER, false},
+    {"mode", JSGC_MODE, true},
+    {"unusedChunks", JSGC_UNUSED_CHUNKS, false},
+    {"totalChunks", JSGC_TOTAL_CHUNKS, false},
+    {"sliceTimeBudget", JSGC_SLICE_TIME_BUDGET, true},
+    {"markStackLimit", JSGC_MARK_STACK_LIMIT, true},
+    {"highFrequencyTimeLimit", JSGC_HIGH_FREQUENCY_TIME_LIMIT, true},
+    {"highFrequencyLowLimit", JSGC_HIGH_FREQUENCY_LOW_LIMIT, true},
+    {"highFrequencyHighLimit", JSGC_HIGH_FREQUENCY_HIGH_LIMIT, true},
+    {"highFrequencyHeapGrowthMax", JSGC_HIGH_FREQUENCY_HEAP_GROWTH_MAX, true},
+    {"highFrequencyHeapGrowthMin", JSGC_HIGH_FREQUENCY_HEAP_GROWTH_MIN, true},
+    {"lowFrequencyHeapGrowth", JSGC_LOW_FREQUENCY_HEAP_GROWTH, true},
+    {"dynamicHeapGrowth", JSGC_DYNAMIC_HEAP_GROWTH, true},
+    {"dynamicMarkSlice", JSGC_DYNAMIC_MARK_SLICE, true},
+    {"allocationThreshold", JSGC_ALLOCATION_THRESHOLD, true},
+    {"minEmptyChunkCount", JSGC_MIN_EMPTY_CHUNK_COUNT, true},
+    {"maxEmptyChunkCount", JSGC_MAX_EMPTY_CHUNK_COUNT, true},
+    {"compactingEnabled", JSGC_COMPACTING_ENABLED, true},
+};
+
+static const GjsGCProfile *
+find_gc_profile(const char *name)
+{
+    for (const GjsGCProfile& profile : gc_profiles) {
+        if (strcmp(profile.name, name) == 0)
+            return &profile;
+    }
+    return nullptr;
+}
+
+bool
+gjs_gc_profile_is_valid(const char *name)
+{
+    return name && find_gc_profile(name);
+}
+
+void
+gjs_gc_profile_apply(JSContext  *cx,
+                     const char *name)
+{
+    const GjsGCProfile *profile = find_gc_profile(name);
+    g_assert(profile);
+
+    gjs_debug(GJS_DEBUG_CONTEXT, "Applying GC profile '%s'", profile->name);
+
+    JS_SetGCParameter(cx, JSGC_MODE, JSGC_MODE_INCREMENTAL);
+    JS_SetGCParameter(cx, JSGC_MAX_BYTES, profile->max_bytes);
+    JS_SetGCParameter(cx, JSGC_MAX_MALLOC_BYTES, profile->max_malloc_bytes);
+    JS_SetGCParameter(cx, JSGC_SLICE_TIME_BUDGET, profile->slice_time_budget);
+    JS_SetGCParameter(cx, JSGC_DYNAMIC_MARK_SLICE, profile->dynamic_mark_slice);
+    JS_SetGCParameter(cx, JSGC_DYNAMIC_HEAP_GROWTH,
+                      profile->dynamic_heap_growth);
+    JS_SetGCParameter(cx, JSGC_HIGH_FREQUENCY_HEAP_GROWTH_MIN,
+                      profile->high_frequency_heap_growth_min);
+    JS_SetGCParameter(cx, JSGC_HIGH_FREQUENCY_HEAP_GROWTH_MAX,
+                      profile->high_frequency_heap_growth_max);
+    JS_SetGCParameter(cx, JSGC_LOW_FREQUENCY_HEAP_GROWTH,
+                      profile->low_frequency_heap_growth);
+    JS_SetGCParameter(cx, JSGC_ALLOCATION_THRESHOLD,
+                      profile->allocation_threshold);
+    JS_SetGCParameter(cx, JSGC_MAX_EMPTY_CHUNK_COUNT,
+                      profile->max_empty_chunk_count);
+    JS_SetGCParameter(cx, JSGC_COMPACTING_ENABLED,
+                      profile->compacting_enabled);
+}
+
+bool
+gjs_gc_parameter_lookup(const char   *name,
+                        JSGCParamKey *key_p,
+                        bool         *writable_p)
+{
+    for (auto& param : gc_parameters) {
+        if (strcmp(param.name, name) == 0) {
+            *key_p = param.key;
+            if (writable_p)
+                *writable_p = param.writable;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* SpiderMonkey asserts on some values rather than rejecting them, so check
+ * the ones that would crash a debug build before passing them on. */
+bool
+gjs_gc_parameter_value_is_valid(JSContext   *cx,
+                                JSGCParamKey key,
+                                uint32_t     value)
+{
+    switch (key) {
+    case JSGC_MODE:
+        return value <= JSGC_MODE_INCREMENTAL;
+    case JSGC_MARK_STACK_LIMIT:
+        return value > 0;
+    case JSGC_HIGH_FREQUENCY_HEAP_GROWTH_MIN:
+    case JSGC_HIGH_FREQUENCY_HEAP_GROWTH_MAX:
+    case JSGC_LOW_FREQUENCY_HEAP_GROWTH:
+        return value >= 100;
+    case JSGC_HIGH_FREQUENCY_LOW_LIMIT:
+        return value < JS_GetGCParameter(cx, JSGC_HIGH_FREQUENCY_HIGH_LIMIT);
+    case JSGC_HIGH_FREQUENCY_HIGH_LIMIT:
+        return value > JS_GetGCParameter(cx, JSGC_HIGH_FREQUENCY_LOW_LIMIT);
+    default:
+        return true;
+    }
+}
+
+/* GJS_GC_PARAMS is a comma-separated list of name=value pairs, applied on
+ * top of the selected profile, e.g. "sliceTimeBudget=5,compactingEnabled=0" */
+void
+gjs_gc_apply_env_overrides(JSContext *cx)
+{
+    const char *env_params = g_getenv("GJS_GC_PARAMS");
+    if (!env_params)
+        return;
+
+    char **pairs = g_strsplit(env_params, ",", -1);
+    for (char **pair = pairs; *pair; pair++) {
+        char *equals = strchr(*pair, '=');
+        char *end;
+        JSGCParamKey key;
+        bool writable;
+
+        if (!equals) {
+            g_warning("Ignoring malformed GJS_GC_PARAMS entry '%s'", *pair);
+            continue;
+        }
+        *equals = '\0';
+        const char *name = g_strstrip(*pair);
+
+        errno = 0;
+        guint64 value = g_ascii_strtoull(equals + 1, &end, 10);
+        if (errno != 0 || end == equals + 1 || value > G_MAXUINT32) {
+            g_warning("Ignoring invalid value for GC parameter '%s'", name);
+            continue;
+        }
+
+        if (!gjs_gc_parameter_lookup(name, &key, &writable) || !writable ||
+            !gjs_gc_parameter_value_is_valid(cx, key, value)) {
+            g_warning("Ignoring GC parameter '%s' from GJS_GC_PARAMS", name);
+            continue;
+        }
+
+        gjs_debug(GJS_DEBUG_CONTEXT, "Setting GC parameter %s=%" G_GUINT64_FORMAT,
+                  name, value);
+        JS_SetGCParameter(cx, key, value);
+    }
+    g_strfreev(pairs);
+}
+
 #ifdef G_OS_WIN32
 HMODULE gjs_dll;
 static bool gjs_is_inited = false;
@@ -266,36 +517,39 @@ JSContext *
 gjs_create_js_context(GjsContext *js_context)
 {
     g_assert(gjs_is_inited);
-    JSContext *cx = JS_NewContext(32 * 1024 * 1024 /* max bytes */);
+
+    const char *profile = _gjs_context_get_gc_profile(js_context);
+    if (!profile) {
+        profile = GJS_GC_PROFILE_DEFAULT;
+    } else if (!gjs_gc_profile_is_valid(profile)) {
+        g_warning("Unknown GC profile '%s', using '%s'", profile,
+                  GJS_GC_PROFILE_DEFAULT);
+        profile = GJS_GC_PROFILE_DEFAULT;
+    }
+
+    /* The heap limit comes from the profile, and can be changed later with
+     * the "maxBytes" GC parameter or GJS_GC_PARAMS */
+    JSContext *cx = JS_NewContext(find_gc_profile(profile)->max_bytes);
     if (!cx)
         return nullptr;
 
     if (!JS::InitSelfHostedCode(cx))
         return nullptr;
 
-    // commented are defaults in moz-24
     JS_SetNativeStackQuota(cx, 1024 * 1024);
-    JS_SetGCParameter(cx, JSGC_MAX_MALLOC_BYTES, 128 * 1024 * 1024);
-    JS_SetGCParameter(cx, JSGC_MAX_BYTES, -1);
-    JS_SetGCParameter(cx, JSGC_MODE, JSGC_MODE_INCREMENTAL);
-    JS_SetGCParameter(cx, JSGC_SLICE_TIME_BUDGET, 10); /* ms */
-    // JS_SetGCParameter(cx, JSGC_HIGH_FREQUENCY_TIME_LIMIT, 1000); /* ms */
-    JS_SetGCParameter(cx, JSGC_DYNAMIC_MARK_SLICE, true);
-    JS_SetGCParameter(cx, JSGC_DYNAMIC_HEAP_GROWTH, true);
-    // JS_SetGCParameter(cx, JSGC_LOW_FREQUENCY_HEAP_GROWTH, 150);
-    // JS_SetGCParameter(cx, JSGC_HIGH_FREQUENCY_HEAP_GROWTH_MIN, 150);
-    // JS_SetGCParameter(cx, JSGC_HIGH_FREQUENCY_HEAP_GROWTH_MAX, 300);
-    // JS_SetGCParameter(cx, JSGC_HIGH_FREQUENCY_LOW_LIMIT, 100);
-    // JS_SetGCParameter(cx, JSGC_HIGH_FREQUENCY_HIGH_LIMIT, 500);
-    // JS_SetGCParameter(cx, JSGC_ALLOCATION_THRESHOLD, 30);
-    // JS_SetGCParameter(cx, JSGC_DECOMMIT_THRESHOLD, 32);
+    gjs_gc_profile_apply(cx, profile);
+    gjs_gc_apply_env_overrides(cx);
 
     /* set ourselves as the private data */
     JS_SetContextPrivate(cx, js_context);
 
     JS_AddFinalizeCallback(cx, gjs_finalize_callback, js_context);
     JS_SetGCCallback(cx, on_garbage_collect, js_context);
+    JS::SetGCSliceCallback(cx, on_gc_slice);
+    JS_AddWeakPointerCompartmentCallback(cx, on_gc_sweep_compartment,
+                                         js_context);
     JS_SetLocaleCallbacks(cx, &gjs_locale_callbacks);
+    gjs_module_install_source_hook(cx);
     JS::SetWarningReporter(cx, gjs_warning_reporter);
     JS::SetGetIncumbentGlobalCallback(cx, gjs_get_import_global);
     JS::SetEnqueuePromiseJobCallback(cx, on_enqueue_promise_job, js_context);
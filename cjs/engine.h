@@ -27,6 +27,23 @@
 #include "context.h"
 #include "jsapi-wrapper.h"
 
+#define GJS_GC_PROFILE_DEFAULT "default"
+
 JSContext *gjs_create_js_context(GjsContext *js_context);
 
+bool gjs_gc_profile_is_valid(const char *name);
+
+void gjs_gc_profile_apply(JSContext  *cx,
+                          const char *name);
+
+bool gjs_gc_parameter_lookup(const char   *name,
+                             JSGCParamKey *key_p,
+                             bool         *writable_p);
+
+bool gjs_gc_parameter_value_is_valid(JSContext   *cx,
+                                     JSGCParamKey key,
+                                     uint32_t     value);
+
+void gjs_gc_apply_env_overrides(JSContext *cx);
+
 #endif  /* GJS_ENGINE_H */
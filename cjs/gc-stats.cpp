@@ -0,0 +1,142 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include <config.h>
+
+#include <algorithm>
+
+#include <glib.h>
+
+#include "gc-stats.h"
+
+constexpr int64_t GjsGCStats::histogram_bounds[];
+
+GjsGCStats::GjsGCStats()
+    : m_next(0), m_n_slices(0), m_n_cycles(0), m_current()
+{
+    m_histogram.fill(0);
+}
+
+void
+GjsGCStats::cycle_begin(void)
+{
+    m_n_cycles++;
+    m_cycle_zones.clear();
+}
+
+/* Zones are only known once they are swept, which happens in a later slice
+ * than the first ones of the cycle; fill in the count for the whole cycle
+ * retroactively. */
+void
+GjsGCStats::cycle_end(void)
+{
+    unsigned zone_count = m_cycle_zones.size();
+    size_t n_recorded = std::min<uint64_t>(m_n_slices, RING_SIZE);
+
+    for (size_t ix = 1; ix <= n_recorded; ix++) {
+        GjsGCSlice& slice = m_slices[(m_next + RING_SIZE - ix) % RING_SIZE];
+        if (slice.cycle != m_n_cycles)
+            break;
+        slice.zone_count = zone_count;
+    }
+}
+
+void
+GjsGCStats::slice_begin(JS::gcreason::Reason reason,
+                        bool                 is_zone_gc,
+                        size_t               heap_bytes)
+{
+    m_current.start_time = g_get_monotonic_time();
+    m_current.duration = 0;
+    m_current.cycle = m_n_cycles;
+    m_current.reason = reason;
+    m_current.zone_count = m_cycle_zones.size();
+    m_current.is_zone_gc = is_zone_gc;
+    m_current.heap_bytes_before = heap_bytes;
+    m_current.heap_bytes_after = heap_bytes;
+}
+
+const GjsGCSlice&
+GjsGCStats::slice_end(size_t heap_bytes)
+{
+    m_current.duration = g_get_monotonic_time() - m_current.start_time;
+    m_current.heap_bytes_after = heap_bytes;
+    m_current.zone_count = m_cycle_zones.size();
+
+    size_t bucket = 0;
+    while (bucket < G_N_ELEMENTS(histogram_bounds) &&
+           m_current.duration > histogram_bounds[bucket])
+        bucket++;
+    m_histogram[bucket]++;
+
+    GjsGCSlice& slot = m_slices[m_next];
+    slot = m_current;
+    m_next = (m_next + 1) % RING_SIZE;
+    m_n_slices++;
+    return slot;
+}
+
+void
+GjsGCStats::note_zone_swept(JS::Zone *zone)
+{
+    if (std::find(m_cycle_zones.begin(), m_cycle_zones.end(), zone) ==
+        m_cycle_zones.end())
+        m_cycle_zones.push_back(zone);
+}
+
+std::vector<GjsGCSlice>
+GjsGCStats::recent_slices(void) const
+{
+    size_t n_recorded = std::min<uint64_t>(m_n_slices, RING_SIZE);
+    size_t first = (m_next + RING_SIZE - n_recorded) % RING_SIZE;
+
+    std::vector<GjsGCSlice> retval;
+    retval.reserve(n_recorded);
+    for (size_t ix = 0; ix < n_recorded; ix++)
+        retval.push_back(m_slices[(first + ix) % RING_SIZE]);
+    return retval;
+}
+
+GjsGCPauseSummary
+GjsGCStats::summarize(void) const
+{
+    GjsGCPauseSummary summary = {0, 0, 0, 0, 0};
+    size_t n_recorded = std::min<uint64_t>(m_n_slices, RING_SIZE);
+    if (n_recorded == 0)
+        return summary;
+
+    std::vector<int64_t> durations;
+    durations.reserve(n_recorded);
+    for (size_t ix = 0; ix < n_recorded; ix++) {
+        durations.push_back(m_slices[ix].duration);
+        summary.total += m_slices[ix].duration;
+    }
+    std::sort(durations.begin(), durations.end());
+
+    summary.n_slices = n_recorded;
+    summary.p50 = durations[(n_recorded - 1) * 50 / 100];
+    summary.p95 = durations[(n_recorded - 1) * 95 / 100];
+    summary.max = durations.back();
+    return summary;
+}
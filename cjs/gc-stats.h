@@ -0,0 +1,112 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef GJS_GC_STATS_H
+#define GJS_GC_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <vector>
+
+#include <glib.h>
+
+#include "jsapi-wrapper.h"
+
+/* One incremental GC slice, as recorded by the slice callback in engine.cpp.
+ * Times are in microseconds of g_get_monotonic_time(). */
+struct GjsGCSlice {
+    int64_t start_time;
+    int64_t duration;
+    uint64_t cycle;
+    JS::gcreason::Reason reason;
+    unsigned zone_count;
+    bool is_zone_gc : 1;
+    size_t heap_bytes_before;
+    size_t heap_bytes_after;
+};
+
+struct GjsGCPauseSummary {
+    size_t n_slices;
+    int64_t p50;
+    int64_t p95;
+    int64_t max;
+    int64_t total;
+};
+
+/* Keeps the most recent GC slices in a fixed-size ring buffer, so that the
+ * memory used for telemetry does not grow with the lifetime of the process. */
+class GjsGCStats {
+ public:
+    static constexpr size_t RING_SIZE = 256;
+
+    /* Upper bounds, in microseconds, of the pause histogram buckets. The
+     * last bucket collects everything longer than the last bound. */
+    static constexpr int64_t histogram_bounds[] = {
+        1000, 2000, 5000, 10000, 20000, 50000, 100000,
+    };
+    static constexpr size_t N_HISTOGRAM_BUCKETS =
+        G_N_ELEMENTS(histogram_bounds) + 1;
+
+ private:
+    std::array<GjsGCSlice, RING_SIZE> m_slices;
+    size_t m_next;
+    uint64_t m_n_slices;
+    uint64_t m_n_cycles;
+    std::array<uint64_t, N_HISTOGRAM_BUCKETS> m_histogram;
+
+    /* State of the slice and cycle currently in progress */
+    GjsGCSlice m_current;
+    std::vector<JS::Zone *> m_cycle_zones;
+
+ public:
+    GjsGCStats();
+
+    void cycle_begin(void);
+    void cycle_end(void);
+    void slice_begin(JS::gcreason::Reason reason,
+                     bool                 is_zone_gc,
+                     size_t               heap_bytes);
+    const GjsGCSlice& slice_end(size_t heap_bytes);
+    void note_zone_swept(JS::Zone *zone);
+
+    /* Number of slices recorded since the context was created, including
+     * ones that have dropped out of the ring buffer */
+    uint64_t n_slices(void) const { return m_n_slices; }
+    uint64_t n_cycles(void) const { return m_n_cycles; }
+
+    /* Histogram of all slices recorded since the context was created */
+    const std::array<uint64_t, N_HISTOGRAM_BUCKETS>& histogram(void) const {
+        return m_histogram;
+    }
+
+    /* Copies the slices still in the ring buffer, oldest first */
+    std::vector<GjsGCSlice> recent_slices(void) const;
+
+    /* Percentiles of the slices still in the ring buffer */
+    GjsGCPauseSummary summarize(void) const;
+};
+
+#endif  /* GJS_GC_STATS_H */
@@ -29,6 +29,7 @@
 #include "importer.h"
 #include "jsapi-util.h"
 #include "jsapi-wrapper.h"
+#include "script-cache.h"
 
 static bool
 run_bootstrap(JSContext       *cx,
@@ -49,17 +50,22 @@ run_bootstrap(JSContext       *cx,
     JSAutoCompartment ac(cx, global);
 
     GjsAutoChar uri = g_strconcat("resource://", path.get(), nullptr);
-    JS::CompileOptions options(cx);
-    options.setUTF8(true)
-           .setFileAndLine(uri, 1)
-           .setSourceIsLazy(true);
-
-    JS::RootedScript compiled_script(cx);
     size_t script_len;
     auto script = static_cast<const char *>(g_bytes_get_data(script_bytes.get(),
                                             &script_len));
-    if (!JS::Compile(cx, options, script, script_len, &compiled_script))
-        return false;
+
+    JS::RootedScript compiled_script(cx);
+    GjsScriptCache cache(uri, 1, script, script_len, false);
+    if (!cache.lookup(cx, &compiled_script)) {
+        JS::CompileOptions options(cx);
+        options.setUTF8(true)
+               .setFileAndLine(uri, 1)
+               .setSourceIsLazy(true);
+
+        if (!JS::Compile(cx, options, script, script_len, &compiled_script))
+            return false;
+        cache.store(cx, compiled_script);
+    }
 
     JS::RootedValue ignored(cx);
     return JS::CloneAndExecuteScript(cx, compiled_script, &ignored);
@@ -206,14 +212,41 @@ gjs_printerr(JSContext *context,
 }
 
 class GjsGlobal {
+    /* The standard classes are defined lazily, the first time each of them
+     * is looked up, instead of all of them whenever a global is created. Most
+     * scripts only ever touch a fraction of them. */
+    static bool
+    enumerate(JSContext       *cx,
+              JS::HandleObject global)
+    {
+        return JS_EnumerateStandardClasses(cx, global);
+    }
+
+    static bool
+    resolve(JSContext       *cx,
+            JS::HandleObject global,
+            JS::HandleId     id,
+            bool            *resolved)
+    {
+        return JS_ResolveStandardClass(cx, global, id, resolved);
+    }
+
+    static bool
+    may_resolve(const JSAtomState& names,
+                jsid               id,
+                JSObject          *maybe_global)
+    {
+        return JS_MayResolveStandardClass(names, id, maybe_global);
+    }
+
     static constexpr JSClassOps class_ops = {
         nullptr,  /* addProperty */
         nullptr,  /* deleteProperty */
         nullptr,  /* getProperty */
         nullptr,  /* setProperty */
-        nullptr,  /* enumerate */
-        nullptr,  /* resolve */
-        nullptr,  /* mayResolve */
+        &GjsGlobal::enumerate,
+        &GjsGlobal::resolve,
+        &GjsGlobal::may_resolve,
         nullptr,  /* finalize */
         nullptr,  /* call */
         nullptr,  /* hasInstance */
@@ -250,8 +283,9 @@ public:
 
         JSAutoCompartment ac(cx, global);
 
-        if (!JS_InitStandardClasses(cx, global) ||
-            !JS_InitReflectParse(cx, global) ||
+        /* Reflect.parse() and Debugger are not standard classes, and are
+         * defined eagerly; Reflect itself is resolved on demand here */
+        if (!JS_InitReflectParse(cx, global) ||
             !JS_DefineDebuggerObject(cx, global))
             return nullptr;
 
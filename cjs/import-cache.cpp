@@ -0,0 +1,247 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "bundle.h"
+#include "import-cache.h"
+#include "jsapi-util.h"
+#include "util/log.h"
+
+/* Bumped by gjs_import_cache_clear(); listings from an earlier generation
+ * are dropped when they are next used */
+static unsigned generation;
+static GjsImportCacheStats stats;
+
+class GjsDirectoryListing {
+    std::string m_dirname;
+    std::unordered_map<std::string, GFileType> m_entries;
+    unsigned m_generation;
+    bool m_can_change;
+    bool m_exists;
+    time_t m_mtime;
+    time_t m_listed_at;
+
+    static bool
+    get_mtime(const char *dirname,
+              time_t     *mtime)
+    {
+        GStatBuf buf;
+        stats.syscalls_spent++;
+        if (g_stat(dirname, &buf) != 0)
+            return false;
+        *mtime = buf.st_mtime;
+        return true;
+    }
+
+public:
+    explicit GjsDirectoryListing(const char *dirname);
+
+    GFileType
+    lookup(const char *name)
+    {
+        auto iter = m_entries.find(name);
+        if (iter == m_entries.end())
+            return G_FILE_TYPE_UNKNOWN;
+        return iter->second;
+    }
+
+    bool is_current_generation(void) const { return m_generation == generation; }
+    bool can_change(void) const { return m_can_change; }
+
+    /* Whether the directory was modified after it was listed, as far as its
+     * modification time can tell */
+    bool
+    changed_on_disk(void)
+    {
+        time_t mtime = 0;
+        bool exists = get_mtime(m_dirname.c_str(), &mtime);
+        return exists != m_exists || mtime != m_mtime;
+    }
+
+    /* The directory was last modified in the same second as it was listed,
+     * so another change made in that second after the listing would not show
+     * up in its modification time */
+    bool
+    is_racy(void) const
+    {
+        return m_exists && m_mtime >= m_listed_at;
+    }
+
+    /* Whether listing the directory again would give a listing that is not
+     * racy, if the directory doesn't change in the meantime */
+    bool can_settle(void) const { return time(nullptr) > m_listed_at; }
+};
+
+GjsDirectoryListing::GjsDirectoryListing(const char *dirname) :
+    m_dirname(dirname),
+    m_generation(generation),
+    m_can_change(!g_str_has_prefix(dirname, "resource:")),
+    m_exists(false),
+    m_mtime(0),
+    m_listed_at(time(nullptr))
+{
+    /* Checked before listing, so that a change made while listing shows up
+     * as a different modification time later. A directory that doesn't
+     * exist gets an empty listing. */
+    if (m_can_change)
+        m_exists = get_mtime(dirname, &m_mtime);
+
+    /* new_for_commandline_arg handles resource:/// paths */
+    GjsAutoUnref<GFile> dir = g_file_new_for_commandline_arg(dirname);
+    GjsAutoUnref<GFileEnumerator> direnum =
+        g_file_enumerate_children(dir, "standard::name,standard::type",
+                                  G_FILE_QUERY_INFO_NONE, nullptr, nullptr);
+    while (direnum) {
+        GFileInfo *info;
+        GFile *file;
+        if (!g_file_enumerator_iterate(direnum, &info, &file, nullptr, nullptr) ||
+            !info || !file)
+            break;
+
+        GjsAutoChar basename = g_file_get_basename(file);
+        m_entries.emplace(basename.get(), g_file_info_get_file_type(info));
+    }
+
+    stats.listings++;
+    stats.syscalls_spent += 3;
+    gjs_debug(GJS_DEBUG_IMPORTER, "Listed %zu entries in search directory %s",
+              m_entries.size(), dirname);
+}
+
+static bool
+import_cache_enabled(void)
+{
+    static int enabled = -1;
+
+    if (enabled < 0)
+        enabled = !g_getenv("GJS_DISABLE_IMPORT_CACHE");
+
+    return enabled;
+}
+
+static GFileType
+query_file_type(const char *dirname,
+                const char *name)
+{
+    GjsAutoChar full_path = g_build_filename(dirname, name, nullptr);
+    GjsAutoUnref<GFile> file = g_file_new_for_commandline_arg(full_path);
+    return g_file_query_file_type(file, G_FILE_QUERY_INFO_NONE, nullptr);
+}
+
+GjsImportCache::GjsImportCache() {}
+
+GjsImportCache::~GjsImportCache() {}
+
+/**
+ * GjsImportCache::lookup:
+ * @dirname: a search path directory, a resource:// URI of one, or a path
+ *   into a module bundle
+ * @name: a file name inside @dirname
+ *
+ * Returns: the type of @name in @dirname, or %G_FILE_TYPE_UNKNOWN if it
+ * doesn't exist.
+ */
+GFileType
+GjsImportCache::lookup(const char *dirname,
+                       const char *name)
+{
+    /* Bundles are already indexed in memory */
+    const char *inner_path;
+    GjsBundle *bundle = GjsBundle::get(dirname, &inner_path);
+    if (bundle) {
+        GjsAutoChar bundle_path = *inner_path ?
+            g_strconcat(inner_path, "/", name, nullptr) : g_strdup(name);
+        stats.syscalls_avoided++;
+        return bundle->lookup(bundle_path);
+    }
+
+    if (!import_cache_enabled())
+        return query_file_type(dirname, name);
+
+    auto iter = m_listings.find(dirname);
+    if (iter == m_listings.end() || !iter->second->is_current_generation()) {
+        auto listing = new GjsDirectoryListing(dirname);
+        m_listings[dirname].reset(listing);
+        return listing->lookup(name);
+    }
+
+    GjsDirectoryListing *listing = iter->second.get();
+    GFileType type = listing->lookup(name);
+    if (type != G_FILE_TYPE_UNKNOWN) {
+        stats.syscalls_avoided++;
+        return type;
+    }
+
+    if (!listing->can_change()) {
+        stats.syscalls_avoided++;
+        return type;
+    }
+
+    /* A miss is only trusted if the directory hasn't changed since it was
+     * listed */
+    bool changed = listing->changed_on_disk();
+    if (!changed && listing->is_racy()) {
+        if (!listing->can_settle()) {
+            stats.syscalls_spent++;
+            return query_file_type(dirname, name);
+        }
+        changed = true;
+    }
+
+    if (changed) {
+        gjs_debug(GJS_DEBUG_IMPORTER, "Search directory %s may have changed, "
+                  "listing it again", dirname);
+        stats.invalidations++;
+        listing = new GjsDirectoryListing(dirname);
+        iter->second.reset(listing);
+        type = listing->lookup(name);
+    }
+
+    return type;
+}
+
+/**
+ * gjs_import_cache_clear:
+ *
+ * Drops the directory listings of all importers, so that the next imports
+ * see any changes in the search path directories, including new GResources.
+ */
+void
+gjs_import_cache_clear(void)
+{
+    generation++;
+}
+
+const GjsImportCacheStats *
+gjs_import_cache_get_stats(void)
+{
+    return &stats;
+}
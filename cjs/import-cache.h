@@ -0,0 +1,76 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GJS_IMPORT_CACHE_H
+#define GJS_IMPORT_CACHE_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <gio/gio.h>
+
+/* Directory listing cache for the importer.
+ *
+ * Resolving an import used to stat each candidate path in each search path
+ * directory: __init__.js, a subdirectory, and a .js file. Instead, each
+ * importer lists each of its search path directories once, and looks names up
+ * in the listing. A name found in a listing is trusted as is. A name missing
+ * from a listing is only trusted after checking that the directory's
+ * modification time is the one it had when it was listed, so a module written
+ * just before it is imported is always found; that is one stat() of the
+ * directory instead of one per candidate file. resource:// directories can't
+ * change on their own, so code registering new GResources at runtime should
+ * call gjs_import_cache_clear(). Setting GJS_DISABLE_IMPORT_CACHE in the
+ * environment turns the cache off. */
+
+struct GjsImportCacheStats {
+    unsigned listings;  /* directories listed */
+    unsigned invalidations;  /* listings dropped because the directory changed */
+    /* Estimates: each lookup answered from a listing replaces one stat() or
+     * open(), and each listing costs about three syscalls (open, getdents,
+     * close) */
+    unsigned syscalls_avoided;
+    unsigned syscalls_spent;
+};
+
+class GjsDirectoryListing;
+
+/* One per importer, keyed by search path directory */
+class GjsImportCache {
+    std::unordered_map<std::string, std::unique_ptr<GjsDirectoryListing>>
+        m_listings;
+
+public:
+    GjsImportCache();
+    ~GjsImportCache();
+
+    GFileType lookup(const char *dirname,
+                     const char *name);
+};
+
+void gjs_import_cache_clear(void);
+
+const GjsImportCacheStats *gjs_import_cache_get_stats(void);
+
+#endif  /* GJS_IMPORT_CACHE_H */
@@ -0,0 +1,268 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "context.h"
+#include "import-trace.h"
+#include "profiler-private.h"
+#include "util/log.h"
+
+static const char *phase_names[] = { "io", "compile", "execute" };
+G_STATIC_ASSERT(G_N_ELEMENTS(phase_names) == GJS_IMPORT_PHASE_LAST);
+
+struct GjsImportTraceNode {
+    std::string name;
+    std::string path;
+    const char *kind;
+    int64_t start;  /* monotonic time, µs */
+    int64_t end;
+    int64_t phases[GJS_IMPORT_PHASE_LAST];
+    bool phase_started;
+    bool failed;
+    std::vector<std::unique_ptr<GjsImportTraceNode>> children;
+
+    GjsImportTraceNode(const char *node_name,
+                       const char *node_kind) :
+        name(node_name),
+        kind(node_kind),
+        start(g_get_monotonic_time()),
+        end(0),
+        phases(),
+        phase_started(false),
+        failed(false)
+    {
+    }
+};
+
+static bool tracing = false;
+static int64_t trace_start;
+static std::vector<std::unique_ptr<GjsImportTraceNode>> roots;
+static std::vector<GjsImportTraceNode *> stack;
+
+void
+gjs_import_trace_start(void)
+{
+    tracing = true;
+    trace_start = g_get_monotonic_time();
+}
+
+void
+gjs_import_trace_stop(void)
+{
+    tracing = false;
+    if (stack.empty())
+        roots.clear();
+}
+
+GjsAutoImportTrace::GjsAutoImportTrace(JSContext  *cx,
+                                       const char *name,
+                                       const char *kind,
+                                       GFile      *file) :
+    m_cx(cx),
+    m_node(nullptr),
+    m_profiler(nullptr)
+{
+    auto gjs_context = static_cast<GjsContext *>(JS_GetContextPrivate(cx));
+    GjsProfiler *profiler = gjs_context_get_profiler(gjs_context);
+    if (profiler && _gjs_profiler_is_running(profiler))
+        m_profiler = profiler;
+
+    if (!tracing && !m_profiler)
+        return;
+
+    /* Still resolving the same import, nothing has been loaded yet */
+    GjsImportTraceNode *parent = stack.empty() ? nullptr : stack.back();
+    if (parent && parent->name == name && !parent->phase_started &&
+        parent->children.empty()) {
+        if (kind)
+            parent->kind = kind;
+        if (file) {
+            GjsAutoChar path = g_file_get_parse_name(file);
+            parent->path = path.get();
+        }
+        return;
+    }
+
+    m_node = new GjsImportTraceNode(name, kind);
+    if (file) {
+        GjsAutoChar path = g_file_get_parse_name(file);
+        m_node->path = path.get();
+    }
+
+    if (parent)
+        parent->children.emplace_back(m_node);
+    else
+        roots.emplace_back(m_node);
+    stack.push_back(m_node);
+}
+
+GjsAutoImportTrace::~GjsAutoImportTrace()
+{
+    if (!m_node)
+        return;
+
+    m_node->end = g_get_monotonic_time();
+    m_node->failed = JS_IsExceptionPending(m_cx);
+    g_assert(stack.back() == m_node);
+    stack.pop_back();
+
+    if (m_profiler) {
+        const int64_t *phases = m_node->phases;
+        GjsAutoChar message = g_strdup_printf("%s %s: I/O %" G_GINT64_FORMAT
+            " µs, compile %" G_GINT64_FORMAT " µs, execute %" G_GINT64_FORMAT
+            " µs%s", m_node->kind,
+            m_node->path.empty() ? m_node->name.c_str() : m_node->path.c_str(),
+            phases[GJS_IMPORT_PHASE_IO], phases[GJS_IMPORT_PHASE_COMPILE],
+            phases[GJS_IMPORT_PHASE_EXECUTE], m_node->failed ? " (failed)" : "");
+        _gjs_profiler_add_mark(m_profiler, m_node->start * 1000L,
+                               (m_node->end - m_node->start) * 1000L,
+                               "Import", m_node->name.c_str(), message);
+    }
+
+    /* Only the profiler is interested, which has its copy now */
+    if (!tracing && stack.empty())
+        roots.clear();
+}
+
+GjsAutoImportPhase::GjsAutoImportPhase(GjsImportPhase phase) :
+    m_node(stack.empty() ? nullptr : stack.back()),
+    m_phase(phase),
+    m_start(0)
+{
+    if (m_node) {
+        m_node->phase_started = true;
+        m_start = g_get_monotonic_time();
+    }
+}
+
+GjsAutoImportPhase::~GjsAutoImportPhase()
+{
+    if (m_node)
+        m_node->phases[m_phase] += g_get_monotonic_time() - m_start;
+}
+
+static void
+append_json_string(GString    *out,
+                   const char *str)
+{
+    g_string_append_c(out, '"');
+    for (const char *p = str; *p; p++) {
+        unsigned char c = *p;
+        if (c == '"' || c == '\\')
+            g_string_append_printf(out, "\\%c", c);
+        else if (c < 0x20)
+            g_string_append_printf(out, "\\u%04x", c);
+        else
+            g_string_append_c(out, c);
+    }
+    g_string_append_c(out, '"');
+}
+
+static void
+append_json_ms(GString    *out,
+               const char *key,
+               int64_t     usec)
+{
+    /* Not printf, which would use the locale's decimal separator */
+    char buf[G_ASCII_DTOSTR_BUF_SIZE];
+    g_string_append_printf(out, ", \"%s\": %s", key,
+                           g_ascii_formatd(buf, sizeof(buf), "%.3f",
+                                           usec / 1000.0));
+}
+
+static void
+append_json_nodes(GString                                                *out,
+                  const std::vector<std::unique_ptr<GjsImportTraceNode>>& nodes,
+                  unsigned                                                depth)
+{
+    g_string_append_c(out, '[');
+    bool first = true;
+    for (auto& node : nodes) {
+        /* Still running, for example the script calling System.exit() */
+        int64_t end = node->end ? node->end : g_get_monotonic_time();
+        int64_t children_total = 0;
+        for (auto& child : node->children)
+            children_total += (child->end ? child->end : end) - child->start;
+
+        g_string_append_printf(out, "%s\n%*s{\"name\": ", first ? "" : ",",
+                               int(depth * 2 + 2), "");
+        append_json_string(out, node->name.c_str());
+        g_string_append(out, ", \"kind\": ");
+        append_json_string(out, node->kind ? node->kind : "unknown");
+        if (!node->path.empty()) {
+            g_string_append(out, ", \"path\": ");
+            append_json_string(out, node->path.c_str());
+        }
+        append_json_ms(out, "start_ms", node->start - trace_start);
+        append_json_ms(out, "total_ms", end - node->start);
+        append_json_ms(out, "self_ms", end - node->start - children_total);
+        for (unsigned ix = 0; ix < GJS_IMPORT_PHASE_LAST; ix++) {
+            GjsAutoChar key = g_strdup_printf("%s_ms", phase_names[ix]);
+            append_json_ms(out, key, node->phases[ix]);
+        }
+        if (node->failed)
+            g_string_append(out, ", \"failed\": true");
+        if (!node->children.empty()) {
+            g_string_append(out, ", \"children\": ");
+            append_json_nodes(out, node->children, depth + 1);
+        }
+        g_string_append_c(out, '}');
+        first = false;
+    }
+    if (!nodes.empty())
+        g_string_append_printf(out, "\n%*s", int(depth * 2), "");
+    g_string_append_c(out, ']');
+}
+
+/**
+ * gjs_import_trace_write:
+ * @filename: file to write to
+ * @error: return location for a #GError
+ *
+ * Writes the import tree recorded since gjs_import_trace_start() to
+ * @filename as JSON. Times are in milliseconds; start_ms is relative to the
+ * start of tracing, and self_ms is total_ms minus the time spent in child
+ * imports.
+ */
+bool
+gjs_import_trace_write(const char *filename,
+                       GError    **error)
+{
+    GString *out = g_string_new("{\"imports\": ");
+    append_json_nodes(out, roots, 0);
+    g_string_append(out, "}\n");
+
+    bool ok = g_file_set_contents(filename, out->str, out->len, error);
+    g_string_free(out, true);
+
+    if (ok)
+        gjs_debug(GJS_DEBUG_IMPORTER, "Wrote import trace to %s", filename);
+    return ok;
+}
@@ -0,0 +1,91 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GJS_IMPORT_TRACE_H
+#define GJS_IMPORT_TRACE_H
+
+#include <stdint.h>
+
+#include <gio/gio.h>
+
+#include "jsapi-wrapper.h"
+#include "profiler.h"
+
+/* Per-module import timing.
+ *
+ * Each import is recorded as a node with its wall time split into file I/O,
+ * compilation, and execution of the module's top-level code. Imports
+ * started while another module's code runs become children of that module's
+ * node, so the result is a tree showing what pulled in what. Note that a
+ * module's execution time includes the time spent importing its children.
+ *
+ * Recording is active while tracing has been started with
+ * gjs_import_trace_start(), in which case the whole tree is kept for
+ * gjs_import_trace_write(), and while the profiler is running, in which case
+ * each import is added to the capture as a mark. Otherwise the timers below
+ * do nothing. */
+
+enum GjsImportPhase {
+    GJS_IMPORT_PHASE_IO,
+    GJS_IMPORT_PHASE_COMPILE,
+    GJS_IMPORT_PHASE_EXECUTE,
+    GJS_IMPORT_PHASE_LAST
+};
+
+struct GjsImportTraceNode;
+
+/* Scoped timer for one import. Several of these for the same name, nested
+ * directly inside each other (for example the importer's search, then the
+ * module it found), are merged into one node; the innermost one with a
+ * @kind or @file wins. */
+class GjsAutoImportTrace {
+    JSContext *m_cx;
+    GjsImportTraceNode *m_node;  /* null if not recording or merged */
+    GjsProfiler *m_profiler;
+
+public:
+    GjsAutoImportTrace(JSContext  *cx,
+                       const char *name,
+                       const char *kind,
+                       GFile      *file = nullptr);
+    ~GjsAutoImportTrace();
+};
+
+/* Scoped timer that adds its duration to a phase of the innermost import */
+class GjsAutoImportPhase {
+    GjsImportTraceNode *m_node;
+    GjsImportPhase m_phase;
+    int64_t m_start;
+
+public:
+    explicit GjsAutoImportPhase(GjsImportPhase phase);
+    ~GjsAutoImportPhase();
+};
+
+void gjs_import_trace_start(void);
+void gjs_import_trace_stop(void);
+
+bool gjs_import_trace_write(const char *filename,
+                            GError    **error);
+
+#endif  /* GJS_IMPORT_TRACE_H */
@@ -25,8 +25,13 @@
 
 #include <gio/gio.h>
 
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "bundle.h"
+#include "import-cache.h"
+#include "import-trace.h"
 #include "importer.h"
 #include "jsapi-class.h"
 #include "jsapi-wrapper.h"
@@ -49,6 +54,7 @@ static char **gjs_search_path = NULL;
 
 typedef struct {
     bool is_root;
+    GjsImportCache *cache;
 } Importer;
 
 typedef struct {
@@ -281,9 +287,14 @@ gjs_import_native_module(JSContext       *cx,
 {
     gjs_debug(GJS_DEBUG_IMPORTER, "Importing '%s'", name);
 
+    GjsAutoImportTrace trace(cx, name, "native");
     JS::RootedObject module(cx);
-    return gjs_load_native_module(cx, name, &module) &&
-           define_meta_properties(cx, module, nullptr, name, importer) &&
+    {
+        GjsAutoImportPhase phase(GJS_IMPORT_PHASE_EXECUTE);
+        if (!gjs_load_native_module(cx, name, &module))
+            return false;
+    }
+    return define_meta_properties(cx, module, nullptr, name, importer) &&
            JS_DefineProperty(cx, importer, name, module, GJS_MODULE_PROP_FLAGS);
 }
 
@@ -293,14 +304,13 @@ import_module_init(JSContext       *context,
                    JS::HandleObject module_obj)
 {
     bool ret = false;
-    char *script = NULL;
     char *full_path = NULL;
-    gsize script_len = 0;
+    GjsModuleSource source;
     GError *error = NULL;
 
     JS::RootedValue ignored(context);
 
-    if (!(g_file_load_contents(file, NULL, &script, &script_len, NULL, &error))) {
+    if (!source.load(file, &error)) {
         if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY) &&
             !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_DIRECTORY) &&
             !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
@@ -311,18 +321,15 @@ import_module_init(JSContext       *context,
         goto out;
     }
 
-    g_assert(script != NULL);
-
     full_path = g_file_get_parse_name (file);
 
-    if (!gjs_eval_with_scope(context, module_obj, script, script_len,
+    if (!gjs_eval_with_scope(context, module_obj, source.data(), source.len(),
                              full_path, &ignored))
         goto out;
 
     ret = true;
 
  out:
-    g_free(script);
     g_free(full_path);
     return ret;
 }
@@ -330,7 +337,7 @@ import_module_init(JSContext       *context,
 static JSObject *
 load_module_init(JSContext       *context,
                  JS::HandleObject in_object,
-                 const char      *full_path)
+                 const char      *dirname)
 {
     bool found;
 
@@ -346,6 +353,13 @@ load_module_init(JSContext       *context,
     }
 
     JS::RootedObject module_obj(context, JS_NewPlainObject(context));
+    Importer *priv = priv_from_js(context, in_object);
+    if (priv->cache->lookup(dirname, MODULE_INIT_FILENAME) ==
+        G_FILE_TYPE_UNKNOWN)
+        return module_obj;
+
+    GjsAutoChar full_path = g_build_filename(dirname, MODULE_INIT_FILENAME,
+                                             nullptr);
     GjsAutoUnref<GFile> file = g_file_new_for_commandline_arg(full_path);
     if (!import_module_init(context, file, module_obj))
         return module_obj;
@@ -361,10 +375,10 @@ static void
 load_module_elements(JSContext        *cx,
                      JS::HandleObject  in_object,
                      JS::AutoIdVector& prop_ids,
-                     const char       *init_path)
+                     const char       *dirname)
 {
     size_t ix, length;
-    JS::RootedObject module_obj(cx, load_module_init(cx, in_object, init_path));
+    JS::RootedObject module_obj(cx, load_module_init(cx, in_object, dirname));
 
     if (!module_obj)
         return;
@@ -389,10 +403,8 @@ import_symbol_from_init_js(JSContext       *cx,
                            bool            *result)
 {
     bool found;
-    GjsAutoChar full_path = g_build_filename(dirname, MODULE_INIT_FILENAME,
-                                             NULL);
 
-    JS::RootedObject module_obj(cx, load_module_init(cx, importer, full_path));
+    JS::RootedObject module_obj(cx, load_module_init(cx, importer, dirname));
     if (!module_obj || !JS_AlreadyHasOwnProperty(cx, module_obj, name, &found))
         return false;
 
@@ -424,6 +436,7 @@ import_file_on_module(JSContext       *context,
     bool retval = false;
     char *full_path = NULL;
 
+    GjsAutoImportTrace trace(context, name, "module", file);
     JS::RootedObject module_obj(context,
         gjs_module_import(context, obj, id, name, file));
     if (!module_obj)
@@ -458,6 +471,9 @@ do_import(JSContext       *context,
     guint32 i;
     bool exists, is_array;
 
+    /* Becomes a module or native import once one is found */
+    GjsAutoImportTrace trace(context, name, "directory");
+
     if (!gjs_object_require_property(context, obj, "importer",
                                      GJS_STRING_SEARCH_PATH, &search_path))
         return false;
@@ -524,9 +540,8 @@ do_import(JSContext       *context,
 
         /* Second try importing a directory (a sub-importer) */
         GjsAutoChar full_path = g_build_filename(dirname, name, nullptr);
-        GjsAutoUnref<GFile> gfile = g_file_new_for_commandline_arg(full_path);
 
-        if (g_file_query_file_type(gfile, (GFileQueryInfoFlags) 0, NULL) == G_FILE_TYPE_DIRECTORY) {
+        if (priv->cache->lookup(dirname, name) == G_FILE_TYPE_DIRECTORY) {
             gjs_debug(GJS_DEBUG_IMPORTER,
                       "Adding directory '%s' to child importer '%s'",
                       full_path.get(), name);
@@ -543,10 +558,7 @@ do_import(JSContext       *context,
             continue;
 
         /* Third, if it's not a directory, try importing a file */
-        full_path = g_build_filename(dirname, filename.get(), nullptr);
-        gfile = g_file_new_for_commandline_arg(full_path);
-        exists = g_file_query_exists(gfile, NULL);
-
+        exists = priv->cache->lookup(dirname, filename) != G_FILE_TYPE_UNKNOWN;
         if (!exists) {
             gjs_debug(GJS_DEBUG_IMPORTER,
                       "JS import '%s' not found in %s",
@@ -554,6 +566,8 @@ do_import(JSContext       *context,
             continue;
         }
 
+        full_path = g_build_filename(dirname, filename.get(), nullptr);
+        GjsAutoUnref<GFile> gfile = g_file_new_for_commandline_arg(full_path);
         if (import_file_on_module(context, obj, id, name, gfile)) {
             gjs_debug(GJS_DEBUG_IMPORTER,
                       "successfully imported module '%s'", name);
@@ -591,6 +605,76 @@ do_import(JSContext       *context,
     return false;
 }
 
+/**
+ * gjs_importer_preload:
+ * @cx: the JS context
+ * @importer: the root importer
+ * @name: dotted module name relative to @importer, e.g. "ui.main"
+ *
+ * Finds the file that importing @name would most likely load, by looking in
+ * each directory of @importer's search path in turn, and starts compiling it
+ * off the main thread with gjs_module_preload(). If the importer ends up
+ * resolving @name to a different file, the preloaded script is simply never
+ * used.
+ *
+ * Returns: false if an exception is pending, true otherwise, including when
+ * no file was found.
+ */
+bool
+gjs_importer_preload(JSContext       *cx,
+                     JS::HandleObject importer,
+                     const char      *name)
+{
+    Importer *priv = priv_from_js(cx, importer);
+    JS::RootedObject search_path(cx);
+    uint32_t search_path_len;
+    bool is_array;
+
+    if (!gjs_object_require_property(cx, importer, "importer",
+                                     GJS_STRING_SEARCH_PATH, &search_path) ||
+        !JS_IsArrayObject(cx, search_path, &is_array))
+        return false;
+    if (!is_array) {
+        gjs_throw(cx, "searchPath property on importer is not an array");
+        return false;
+    }
+    if (!JS_GetArrayLength(cx, search_path, &search_path_len))
+        return false;
+
+    GjsAutoChar relative_name = g_strdelimit(g_strdup(name), ".",
+                                             G_DIR_SEPARATOR);
+    GjsAutoChar relative_path = g_strconcat(relative_name.get(), ".js",
+                                            nullptr);
+
+    JS::RootedValue elem(cx);
+    for (uint32_t ix = 0; ix < search_path_len; ix++) {
+        if (!JS_GetElement(cx, search_path, ix, &elem))
+            return false;
+        if (!elem.isString())
+            continue;
+
+        JS::RootedString str(cx, elem.toString());
+        GjsAutoJSChar dirname = JS_EncodeStringToUTF8(cx, str);
+        if (!dirname)
+            return false;
+        if (dirname[0] == '\0')
+            continue;
+
+        GjsAutoChar full_path = g_build_filename(dirname, relative_path.get(),
+                                                 nullptr);
+        GjsAutoChar parent = g_path_get_dirname(full_path);
+        GjsAutoChar basename = g_path_get_basename(full_path);
+        if (priv->cache->lookup(parent, basename) != G_FILE_TYPE_UNKNOWN) {
+            GjsAutoUnref<GFile> file = g_file_new_for_commandline_arg(full_path);
+            gjs_module_preload(cx, file);
+            return true;
+        }
+    }
+
+    gjs_debug(GJS_DEBUG_IMPORTER, "Nothing to preload for '%s'", name);
+    return true;
+}
+
 /* Note that in a for ... in loop, this will be called first on the object,
  * then on its prototype.
  */
@@ -632,8 +716,6 @@ importer_enumerate(JSContext        *context,
     JS::RootedValue elem(context);
     JS::RootedString str(context);
     for (i = 0; i < search_path_len; ++i) {
-        char *init_path;
-
         elem.setUndefined();
         if (!JS_GetElement(context, search_path, i, &elem)) {
             /* this means there was an exception, while elem.isUndefined()
@@ -655,27 +737,36 @@ importer_enumerate(JSContext        *context,
         if (!dirname)
             return false;
 
-        init_path = g_build_filename(dirname, MODULE_INIT_FILENAME, NULL);
+        load_module_elements(context, object, properties, dirname);
 
-        load_module_elements(context, object, properties, init_path);
-
-        g_free(init_path);
-
-        /* new_for_commandline_arg handles resource:/// paths */
-        GjsAutoUnref<GFile> dir = g_file_new_for_commandline_arg(dirname);
-        GjsAutoUnref<GFileEnumerator> direnum =
-            g_file_enumerate_children(dir, "standard::name,standard::type",
-                                      G_FILE_QUERY_INFO_NONE, NULL, NULL);
-
-        while (true) {
-            GFileInfo *info;
-            GFile *file;
-            if (!g_file_enumerator_iterate(direnum, &info, &file, NULL, NULL))
-                break;
-            if (info == NULL || file == NULL)
-                break;
+        std::vector<std::pair<std::string, GFileType>> children;
+        const char *inner_path;
+        GjsBundle *bundle = GjsBundle::get(dirname, &inner_path);
+        if (bundle) {
+            bundle->list_directory(inner_path, children);
+        } else {
+            /* new_for_commandline_arg handles resource:/// paths */
+            GjsAutoUnref<GFile> dir = g_file_new_for_commandline_arg(dirname);
+            GjsAutoUnref<GFileEnumerator> direnum =
+                g_file_enumerate_children(dir, "standard::name,standard::type",
+                                          G_FILE_QUERY_INFO_NONE, NULL, NULL);
+
+            while (true) {
+                GFileInfo *info;
+                GFile *file;
+                if (!g_file_enumerator_iterate(direnum, &info, &file, NULL, NULL))
+                    break;
+                if (info == NULL || file == NULL)
+                    break;
+
+                GjsAutoChar basename = g_file_get_basename(file);
+                children.emplace_back(basename.get(),
+                                      g_file_info_get_file_type(info));
+            }
+        }
 
-            GjsAutoChar filename = g_file_get_basename(file);
+        for (auto& child : children) {
+            const char *filename = child.first.c_str();
 
             /* skip hidden files and directories (.svn, .git, ...) */
             if (filename[0] == '.')
@@ -685,7 +776,7 @@ importer_enumerate(JSContext        *context,
             if (strcmp(filename, MODULE_INIT_FILENAME) == 0)
                 continue;
 
-            if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY) {
+            if (child.second == G_FILE_TYPE_DIRECTORY) {
                 if (!properties.append(gjs_intern_string_to_id(context, filename)))
                     g_error("Unable to append to vector");
             } else if (g_str_has_suffix(filename, "." G_MODULE_SUFFIX) ||
@@ -772,6 +863,7 @@ importer_finalize(js::FreeOp *fop,
         return; /* we are the prototype, not a real instance */
 
     GJS_DEC_COUNTER(importer);
+    delete priv->cache;
     g_slice_free(Importer, priv);
 }
 
@@ -840,6 +932,7 @@ importer_new(JSContext *context,
 
     priv = g_slice_new0(Importer);
     priv->is_root = is_root;
+    priv->cache = new GjsImportCache();
 
     GJS_INC_COUNTER(importer);
 
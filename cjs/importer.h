@@ -37,6 +37,10 @@ bool gjs_import_native_module(JSContext       *cx,
                               JS::HandleObject importer,
                               const char      *name);
 
+bool gjs_importer_preload(JSContext       *cx,
+                          JS::HandleObject importer,
+                          const char      *name);
+
 G_END_DECLS
 
 #endif  /* __GJS_IMPORTER_H__ */
@@ -95,6 +95,50 @@ struct GjsHeapOperation<JSObject *> {
 template<>
 struct GjsHeapOperation<JS::Value> {};
 
+/* Free list of unregistered JS::PersistentRooted nodes. Objects are switched
+ * between rooted and unrooted mode every time their toggle reference goes up
+ * or down, and without this each switch would be a malloc and free. A node in
+ * the pool is not on any context's root list, so it can be handed out again to
+ * any context. Like the rest of this file, only use it on the main thread. */
+template<typename T>
+class GjsRootPool {
+    static constexpr unsigned MAX_FREE = 256;
+
+    static JS::PersistentRooted<T> *s_free[MAX_FREE];
+    static unsigned s_n_free;
+
+public:
+    static JS::PersistentRooted<T> *
+    acquire(JSContext *cx,
+            const T&   thing)
+    {
+        if (s_n_free == 0)
+            return new JS::PersistentRooted<T>(cx, thing);
+
+        JS::PersistentRooted<T> *root = s_free[--s_n_free];
+        root->init(cx, thing);
+        return root;
+    }
+
+    static void
+    release(JS::PersistentRooted<T> *root)
+    {
+        if (s_n_free == MAX_FREE) {
+            delete root;
+            return;
+        }
+
+        /* Removes the node from the root list */
+        root->reset();
+        s_free[s_n_free++] = root;
+    }
+};
+
+template<typename T>
+JS::PersistentRooted<T> *GjsRootPool<T>::s_free[GjsRootPool<T>::MAX_FREE];
+template<typename T>
+unsigned GjsRootPool<T>::s_n_free = 0;
+
 /* GjsMaybeOwned is intended only for use in heap allocation. Do not allocate it
  * on the stack, and do not allocate any instances of structures that have it as
  * a member on the stack either. Unfortunately we cannot enforce this at compile
@@ -138,7 +182,7 @@ private:
         debug("teardown_rooting()");
         g_assert(m_rooted);
 
-        delete m_root;
+        GjsRootPool<T>::release(m_root);
         m_root = nullptr;
         m_rooted = false;
 
@@ -246,7 +290,7 @@ public:
         m_cx = cx;
         m_notify = notify;
         m_data = data;
-        m_root = new JS::PersistentRooted<T>(m_cx, thing);
+        m_root = GjsRootPool<T>::acquire(m_cx, thing);
 
         if (notify) {
             auto gjs_cx = static_cast<GjsContext *>(JS_GetContextPrivate(m_cx));
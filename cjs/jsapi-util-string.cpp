@@ -31,6 +31,7 @@
 
 #include "jsapi-util.h"
 #include "jsapi-wrapper.h"
+#include "util/misc.h"
 
 /**
  * gjs_string_to_utf8:
@@ -86,8 +87,15 @@ gjs_string_from_utf8_n(JSContext             *cx,
 {
     JSAutoRequest ar(cx);
 
-    JS::UTF8Chars chars(utf8_chars, len);
-    JS::RootedString str(cx, JS_NewStringCopyUTF8N(cx, chars));
+    /* ASCII is the common case, and is much cheaper to copy into a Latin-1
+     * string than to decode */
+    JS::RootedString str(cx);
+    if (gjs_string_is_ascii(utf8_chars, len)) {
+        str = JS_NewStringCopyN(cx, utf8_chars, len);
+    } else {
+        JS::UTF8Chars chars(utf8_chars, len);
+        str = JS_NewStringCopyUTF8N(cx, chars);
+    }
     if (str)
         out.setString(str);
 
@@ -24,8 +24,6 @@
 
 #include <config.h>
 
-#include <codecvt>
-#include <locale>
 #include "jsapi-wrapper.h"
 #include <js/GCAPI.h>
 
@@ -37,6 +35,7 @@
 #include "jsapi-class.h"
 #include "jsapi-util.h"
 #include "context-private.h"
+#include "script-cache.h"
 #include <gi/boxed.h>
 
 #include <string.h>
@@ -797,6 +796,32 @@ gjs_strip_unix_shebang(const char  *script,
     return script;
 }
 
+/**
+ * gjs_compile_utf8_for_scope:
+ * @cx: the JS context
+ * @options: compile options, setUTF8() is overridden
+ * @script: UTF-8 source, not necessarily nul-terminated
+ * @script_len: length of @script in bytes
+ * @compiled_script: return location for the script
+ *
+ * Compiles @script to be run with a non-syntactic scope chain, such as a
+ * module object. SpiderMonkey only parses UTF-16, but when the source is pure
+ * ASCII it can be inflated directly as Latin-1, skipping the UTF-8 decoder.
+ *
+ * Returns: false if an exception is pending
+ */
+bool
+gjs_compile_utf8_for_scope(JSContext              *cx,
+                           JS::CompileOptions&     options,
+                           const char             *script,
+                           size_t                  script_len,
+                           JS::MutableHandleScript compiled_script)
+{
+    options.setUTF8(!gjs_string_is_ascii(script, script_len));
+    return JS::CompileForNonSyntacticScope(cx, options, script, script_len,
+                                           compiled_script);
+}
+
 bool
 gjs_eval_with_scope(JSContext             *context,
                     JS::HandleObject       object,
@@ -826,20 +851,24 @@ gjs_eval_with_scope(JSContext             *context,
     if (!eval_obj)
         eval_obj = JS_NewPlainObject(context);
 
-    JS::CompileOptions options(context);
-    options.setFileAndLine(filename, start_line_number)
-           .setSourceIsLazy(true);
-
-    std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> convert;
-    std::u16string utf16_string = convert.from_bytes(script);
-    JS::SourceBufferHolder buf(utf16_string.c_str(), utf16_string.size(),
-                               JS::SourceBufferHolder::NoOwnership);
+    JS::RootedScript compiled_script(context);
+    GjsScriptCache cache(filename, start_line_number, script, real_len, true);
+    if (!cache.lookup(context, &compiled_script)) {
+        JS::CompileOptions options(context);
+        options.setFileAndLine(filename, start_line_number)
+               .setSourceIsLazy(true);
+
+        if (!gjs_compile_utf8_for_scope(context, options, script, real_len,
+                                        &compiled_script))
+            return false;
+        cache.store(context, compiled_script);
+    }
 
     JS::AutoObjectVector scope_chain(context);
     if (!scope_chain.append(eval_obj))
         g_error("Unable to append to vector");
 
-    if (!JS::Evaluate(context, scope_chain, options, buf, retval))
+    if (!JS_ExecuteScript(context, scope_chain, compiled_script, retval))
         return false;
 
     gjs_schedule_gc_if_needed(context);
@@ -226,6 +226,12 @@ void gjs_maybe_gc (JSContext *context);
 void gjs_schedule_gc_if_needed(JSContext *cx);
 void gjs_gc_if_needed(JSContext *cx);
 
+bool gjs_compile_utf8_for_scope(JSContext              *cx,
+                                JS::CompileOptions&     options,
+                                const char             *script,
+                                size_t                  script_len,
+                                JS::MutableHandleScript compiled_script);
+
 bool gjs_eval_with_scope(JSContext             *context,
                          JS::HandleObject       object,
                          const char            *script,
@@ -248,7 +254,6 @@ typedef enum {
   GJS_STRING_GI_OVERRIDES,
   GJS_STRING_GOBJECT_INIT,
   GJS_STRING_INSTANCE_INIT,
-  GJS_STRING_NEW_INTERNAL,
   GJS_STRING_NEW,
   GJS_STRING_MESSAGE,
   GJS_STRING_CODE,
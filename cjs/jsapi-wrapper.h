@@ -41,5 +41,6 @@
 #include <jsapi.h>
 #include <jsfriendapi.h>
 #include <js/Conversions.h>
+#include <js/WeakMapPtr.h>
 
 #endif  /* GJS_JSAPI_WRAPPER_H */
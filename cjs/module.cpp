@@ -21,16 +21,273 @@
  * IN THE SOFTWARE.
  */
 
-#include <codecvt>
-#include <locale>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
 
 #include <gio/gio.h>
 
+#include "bundle.h"
+#include "context-private.h"
+#include "import-trace.h"
 #include "jsapi-util.h"
 #include "jsapi-wrapper.h"
 #include "module.h"
+#include "script-cache.h"
 #include "util/log.h"
 
+/* A module being compiled off the main thread, started by
+ * gjs_module_preload() and picked up by GjsModule::evaluate_import().
+ *
+ * SpiderMonkey only compiles UTF-16 off the main thread, so the source is
+ * first converted on a GIO worker thread. The compile itself has to be started
+ * from the main thread; that happens as soon as the main thread notices the
+ * conversion is done, either from the task's callback or when another module
+ * is preloaded or imported. */
+class GjsPreloadedScript {
+    enum State { CONVERTING, COMPILING, DONE };
+
+    JSContext *m_cx;
+    std::string m_filename;
+    GjsModuleSource m_source;
+    const char *m_script;
+    size_t m_script_len;
+    int m_line_number;
+    State m_state;  /* only used on the main thread */
+
+    /* Protected by m_lock */
+    GMutex m_lock;
+    GCond m_finished;
+    bool m_converted;
+    gunichar2 *m_utf16;
+    long m_utf16_len;
+    void *m_token;
+
+    /* Called on a GIO worker thread */
+    static void
+    convert(GTask        *task,
+            void         *source_object,
+            void         *task_data,
+            GCancellable *cancellable)
+    {
+        auto self = static_cast<std::shared_ptr<GjsPreloadedScript> *>(task_data)->get();
+
+        /* Invalid UTF-8 is reported when actually importing the module */
+        long utf16_len;
+        gunichar2 *utf16 = g_utf8_to_utf16(self->m_script, self->m_script_len,
+                                           nullptr, &utf16_len, nullptr);
+
+        g_mutex_lock(&self->m_lock);
+        self->m_utf16 = utf16;
+        self->m_utf16_len = utf16_len;
+        self->m_converted = true;
+        g_mutex_unlock(&self->m_lock);
+
+        g_task_return_boolean(task, true);
+    }
+
+    static void
+    on_converted(GObject      *source_object,
+                 GAsyncResult *result,
+                 void         *data)
+    {
+        void *task_data = g_task_get_task_data(G_TASK(result));
+        (*static_cast<std::shared_ptr<GjsPreloadedScript> *>(task_data))->maybe_start();
+    }
+
+    static void
+    free_task_data(void *task_data)
+    {
+        delete static_cast<std::shared_ptr<GjsPreloadedScript> *>(task_data);
+    }
+
+    /* Called on a SpiderMonkey helper thread */
+    static void
+    on_compiled(void *token,
+                void *data)
+    {
+        auto self = static_cast<GjsPreloadedScript *>(data);
+        g_mutex_lock(&self->m_lock);
+        self->m_token = token;
+        g_cond_signal(&self->m_finished);
+        g_mutex_unlock(&self->m_lock);
+    }
+
+    /* Blocks until the helper thread is done with the script. An off-thread
+     * compile is held back while an incremental GC is running, and only this
+     * thread can finish the GC, so it is finished first instead of waiting on
+     * it forever. */
+    void *
+    finish_compile(void)
+    {
+        g_assert(m_state == COMPILING);
+        m_state = DONE;
+
+        g_mutex_lock(&m_lock);
+        void *token = m_token;
+        g_mutex_unlock(&m_lock);
+        if (token)
+            return token;
+
+        if (JS::IsIncrementalGCInProgress(m_cx))
+            JS::FinishIncrementalGC(m_cx, JS::gcreason::API);
+
+        g_mutex_lock(&m_lock);
+        while (!m_token)
+            g_cond_wait(&m_finished, &m_lock);
+        token = m_token;
+        g_mutex_unlock(&m_lock);
+        return token;
+    }
+
+public:
+    GjsPreloadedScript(JSContext  *cx,
+                       const char *filename) :
+        m_cx(cx),
+        m_filename(filename),
+        m_script(nullptr),
+        m_script_len(0),
+        m_line_number(1),
+        m_state(CONVERTING),
+        m_converted(false),
+        m_utf16(nullptr),
+        m_utf16_len(0),
+        m_token(nullptr)
+    {
+        g_mutex_init(&m_lock);
+        g_cond_init(&m_finished);
+    }
+
+    ~GjsPreloadedScript()
+    {
+        g_free(m_utf16);
+        g_mutex_clear(&m_lock);
+        g_cond_clear(&m_finished);
+    }
+
+    int line_number(void) const { return m_line_number; }
+
+    /* Reads the source, returning false if there is no point in preloading
+     * it because it is already in the script cache; scripts compiled off the
+     * main thread are cached for the global scope, see
+     * GjsModule::evaluate_import() */
+    bool
+    load(GFile *file)
+    {
+        if (!m_source.load(file, nullptr))
+            return false;
+
+        m_script_len = m_source.len();
+        m_script = gjs_strip_unix_shebang(m_source.data(), &m_script_len,
+                                          &m_line_number);
+        if (!m_script)
+            return false;
+
+        GjsScriptCache cache(m_filename.c_str(), m_line_number, m_script,
+                             m_script_len, true);
+        GjsScriptCache global_cache(m_filename.c_str(), m_line_number,
+                                    m_script, m_script_len, false);
+        return !cache.probe() && !global_cache.probe();
+    }
+
+    static void
+    start_conversion(const std::shared_ptr<GjsPreloadedScript>& self)
+    {
+        GTask *task = g_task_new(nullptr, nullptr,
+                                 &GjsPreloadedScript::on_converted, nullptr);
+        g_task_set_task_data(task, new std::shared_ptr<GjsPreloadedScript>(self),
+                             &GjsPreloadedScript::free_task_data);
+        g_task_run_in_thread(task, &GjsPreloadedScript::convert);
+        g_object_unref(task);
+    }
+
+    /* Starts the compile if the source has been converted, and nothing was
+     * started or given up on yet */
+    void
+    maybe_start(void)
+    {
+        if (m_state != CONVERTING)
+            return;
+
+        g_mutex_lock(&m_lock);
+        bool converted = m_converted;
+        g_mutex_unlock(&m_lock);
+        if (!converted)
+            return;
+
+        m_state = DONE;
+        if (!m_utf16)
+            return;
+
+        JSAutoRequest ar(m_cx);
+        JSAutoCompartment ac(m_cx, gjs_get_import_global(m_cx));
+
+        JS::CompileOptions options(m_cx);
+        options.setFileAndLine(m_filename.c_str(), m_line_number)
+               .setSourceIsLazy(true);
+
+        if (!JS::CanCompileOffThread(m_cx, options, m_utf16_len))
+            return;
+
+        if (!JS::CompileOffThread(m_cx, options,
+                                  reinterpret_cast<char16_t *>(m_utf16),
+                                  m_utf16_len, &GjsPreloadedScript::on_compiled,
+                                  this)) {
+            if (JS_IsExceptionPending(m_cx))
+                JS_ClearPendingException(m_cx);
+            return;
+        }
+
+        gjs_debug(GJS_DEBUG_IMPORTER, "Started preloading %s",
+                  m_filename.c_str());
+        m_state = COMPILING;
+    }
+
+    /* Returns the compiled script, or null if the compile was never started,
+     * in which case it is cheaper for the caller to compile the script itself
+     * than to wait for the conversion */
+    JSScript *
+    finish(void)
+    {
+        maybe_start();
+        if (m_state != COMPILING) {
+            m_state = DONE;
+            return nullptr;
+        }
+
+        void *token = finish_compile();
+        return JS::FinishOffThreadScript(m_cx, token);
+    }
+
+    /* Gives up on the script; a conversion still running is left to finish
+     * on its own */
+    void
+    cancel(void)
+    {
+        if (m_state == COMPILING)
+            JS::CancelOffThreadScript(m_cx, finish_compile());
+        m_state = DONE;
+    }
+};
+
+static GjsModulePreloads *
+get_preloads(JSContext *cx)
+{
+    auto gjs_context = static_cast<GjsContext *>(JS_GetContextPrivate(cx));
+    return _gjs_context_get_module_preloads(gjs_context);
+}
+
+/* Starts compiling any preloads whose conversion is done, without waiting for
+ * the main loop to get to their callbacks */
+static void
+start_converted_preloads(GjsModulePreloads *preloads)
+{
+    for (auto& kv : *preloads)
+        kv.second->maybe_start();
+}
+
 class GjsModule {
     char *m_name;
 
@@ -79,6 +336,37 @@ class GjsModule {
         return true;
     }
 
+    /* If a preload was started for this module, waits for it and returns the
+     * script compiled off the main thread. Otherwise returns true, leaving
+     * @script null. The script is compiled for the global scope, and
+     * JS_ExecuteScript() clones it for the module's scope chain. */
+    static bool
+    finish_preload(JSContext              *cx,
+                   const char             *filename,
+                   int                     line_number,
+                   JS::MutableHandleScript script)
+    {
+        GjsModulePreloads *preloads = get_preloads(cx);
+        auto iter = preloads->find(filename);
+        if (iter == preloads->end())
+            return true;
+
+        std::shared_ptr<GjsPreloadedScript> preload(std::move(iter->second));
+        preloads->erase(iter);
+        start_converted_preloads(preloads);
+
+        if (preload->line_number() != line_number) {
+            preload->cancel();
+            return true;
+        }
+
+        script.set(preload->finish());
+        if (script)
+            gjs_debug(GJS_DEBUG_IMPORTER, "Using preloaded script for %s",
+                      filename);
+        return !JS_IsExceptionPending(cx);
+    }
+
     /* Carries out the actual execution of the module code */
     bool
     evaluate_import(JSContext       *cx,
@@ -88,22 +376,44 @@ class GjsModule {
                     const char      *filename,
                     int              line_number)
     {
-        JS::CompileOptions options(cx);
-        options.setFileAndLine(filename, line_number)
-               .setSourceIsLazy(true);
-
-        std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> convert;
-        std::u16string utf16_string = convert.from_bytes(script);
-        JS::SourceBufferHolder buf(utf16_string.c_str(), utf16_string.size(),
-                                   JS::SourceBufferHolder::NoOwnership);
+        JS::RootedScript compiled_script(cx);
+        {
+            GjsAutoImportPhase phase(GJS_IMPORT_PHASE_COMPILE);
+            if (!finish_preload(cx, filename, line_number, &compiled_script))
+                return false;
+
+            /* Scripts compiled off the main thread are compiled for the
+             * global scope, so they are cached separately */
+            GjsScriptCache cache(filename, line_number, script, script_len,
+                                 true);
+            GjsScriptCache global_cache(filename, line_number, script,
+                                        script_len, false);
+            if (compiled_script) {
+                global_cache.store(cx, compiled_script);
+            } else if (!cache.lookup(cx, &compiled_script) &&
+                       !global_cache.lookup(cx, &compiled_script)) {
+                JS::CompileOptions options(cx);
+                options.setFileAndLine(filename, line_number)
+                       .setSourceIsLazy(true);
+
+                if (!gjs_compile_utf8_for_scope(cx, options, script,
+                                                script_len, &compiled_script))
+                    return false;
+                cache.store(cx, compiled_script);
+            }
+        }
 
         JS::AutoObjectVector scope_chain(cx);
         if (!scope_chain.append(module))
             g_error("Unable to append to vector");
 
         JS::RootedValue ignored_retval(cx);
-        if (!JS::Evaluate(cx, scope_chain, options, buf, &ignored_retval))
-            return false;
+        {
+            GjsAutoImportPhase phase(GJS_IMPORT_PHASE_EXECUTE);
+            if (!JS_ExecuteScript(cx, scope_chain, compiled_script,
+                                  &ignored_retval))
+                return false;
+        }
 
         gjs_schedule_gc_if_needed(cx);
 
@@ -119,21 +429,21 @@ class GjsModule {
                 GFile           *file)
     {
         GError *error = nullptr;
-        char *unowned_script;
-        size_t script_len = 0;
+        GjsModuleSource source;
         int start_line_number = 1;
 
-        if (!(g_file_load_contents(file, nullptr, &unowned_script, &script_len,
-                                   nullptr, &error))) {
-            gjs_throw_g_error(cx, error);
-            return false;
+        {
+            GjsAutoImportPhase phase(GJS_IMPORT_PHASE_IO);
+            if (!source.load(file, &error)) {
+                gjs_throw_g_error(cx, error);
+                return false;
+            }
         }
 
-        GjsAutoChar script = unowned_script;  /* steals ownership */
-        g_assert(script != nullptr);
-
+        size_t script_len = source.len();
         const char *stripped_script =
-            gjs_strip_unix_shebang(script, &script_len, &start_line_number);
+            gjs_strip_unix_shebang(source.data(), &script_len,
+                                   &start_line_number);
 
         GjsAutoChar full_path = g_file_get_parse_name(file);
         return evaluate_import(cx, module, stripped_script, script_len,
@@ -220,6 +530,7 @@ public:
            const char      *name,
            GFile           *file)
     {
+        GjsAutoImportTrace trace(cx, name, "module", file);
         JS::RootedObject module(cx, GjsModule::create(cx, name));
         if (!module ||
             !priv(module)->define_import(cx, module, importer, id) ||
@@ -256,5 +567,168 @@ gjs_module_import(JSContext       *cx,
     return GjsModule::import(cx, importer, id, name, file);
 }
 
+/* Resource data is mapped along with the library or program that contains it,
+ * so the GBytes only references it */
+bool
+GjsModuleSource::load_resource(GFile   *file,
+                               GError **error)
+{
+    GjsAutoChar uri = g_file_get_uri(file);
+    GjsAutoChar path = g_uri_unescape_string(uri + strlen("resource://"),
+                                             nullptr);
+    m_bytes = g_resources_lookup_data(path, G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                      nullptr);
+    if (m_bytes) {
+        m_data = static_cast<const char *>(g_bytes_get_data(m_bytes, &m_len));
+        return true;
+    }
+
+    /* Callers expect the same errors as from g_file_load_contents() */
+    char **children = g_resources_enumerate_children(path,
+        G_RESOURCE_LOOKUP_FLAGS_NONE, nullptr);
+    if (children) {
+        g_strfreev(children);
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY,
+                    "%s is a directory", uri.get());
+    } else {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                    "The resource at '%s' does not exist", path.get());
+    }
+    return false;
+}
+
+/**
+ * GjsModuleSource::load:
+ * @file: location of a module file
+ * @error: return location for a #GError
+ *
+ * Reads @file, unless it is inside a GResource or a module bundle, in which
+ * case the source is used in place.
+ */
+bool
+GjsModuleSource::load(GFile   *file,
+                      GError **error)
+{
+    if (g_file_has_uri_scheme(file, "resource"))
+        return load_resource(file, error);
+
+    GjsAutoChar path = g_file_get_path(file);
+    const char *inner_path;
+    GjsBundle *bundle = path ? GjsBundle::get(path, &inner_path) : nullptr;
+
+    if (bundle) {
+        if (bundle->get_contents(inner_path, &m_data, &m_len))
+            return true;
+
+        if (bundle->lookup(inner_path) == G_FILE_TYPE_DIRECTORY)
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY,
+                        "%s is a directory", path.get());
+        else
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                        "%s does not exist in its bundle", path.get());
+        return false;
+    }
+
+    if (!g_file_load_contents(file, nullptr, &m_owned, &m_len, nullptr, error))
+        return false;
+    m_data = m_owned;
+    return true;
+}
+
+/* Modules are compiled with lazy source, so SpiderMonkey doesn't keep a copy
+ * of their source text. It asks for the source again when it needs it, for
+ * example for Function.prototype.toString(). This is only possible for
+ * modules whose source can't change while running: those in GResources and
+ * module bundles. */
+class GjsModuleSourceHook : public js::SourceHook {
+    bool
+    load(JSContext  *cx,
+         const char *filename,
+         char16_t  **src,
+         size_t     *length) override
+    {
+        *src = nullptr;
+        *length = 0;
+
+        const char *inner_path;
+        if (!g_str_has_prefix(filename, "resource://") &&
+            !GjsBundle::get(filename, &inner_path))
+            return true;
+
+        GjsAutoUnref<GFile> file = g_file_new_for_commandline_arg(filename);
+        GjsModuleSource source;
+        if (!source.load(file, nullptr))
+            return true;
+
+        /* Must be exactly what was compiled */
+        size_t script_len = source.len();
+        const char *script = gjs_strip_unix_shebang(source.data(), &script_len,
+                                                    nullptr);
+        if (!script)
+            return true;
+
+        JS::TwoByteCharsZ chars = JS::UTF8CharsToNewTwoByteCharsZ(cx,
+            JS::UTF8Chars(script, script_len), length);
+        if (!chars)
+            return false;
+        *src = chars.get();
+        return true;
+    }
+};
+
+void
+gjs_module_install_source_hook(JSContext *cx)
+{
+    js::SetSourceHook(cx, mozilla::MakeUnique<GjsModuleSourceHook>());
+}
+
+/**
+ * gjs_module_preload:
+ * @cx: the JS context
+ * @file: location of a module file
+ *
+ * Reads @file and starts compiling it off the main thread, so that a later
+ * gjs_module_import() of the same file doesn't have to compile it on the main
+ * thread. This is only a hint; nothing is done if the file can't be read, if
+ * it is already in the script cache, or if SpiderMonkey decides the script is
+ * not worth compiling off the main thread.
+ */
+void
+gjs_module_preload(JSContext *cx,
+                   GFile     *file)
+{
+    GjsModulePreloads *preloads = get_preloads(cx);
+    start_converted_preloads(preloads);
+
+    GjsAutoChar full_path = g_file_get_parse_name(file);
+    if (preloads->count(full_path.get()))
+        return;
+
+    auto preload = std::make_shared<GjsPreloadedScript>(cx, full_path);
+    if (!preload->load(file))
+        return;
+
+    GjsPreloadedScript::start_conversion(preload);
+    preloads->emplace(full_path.get(), std::move(preload));
+}
+
+/**
+ * gjs_module_cancel_preloads:
+ * @cx: the JS context
+ *
+ * Discards any scripts started by gjs_module_preload() on @cx that were never
+ * imported. Must be called before @cx is destroyed.
+ */
+void
+gjs_module_cancel_preloads(JSContext *cx)
+{
+    JSAutoRequest ar(cx);
+
+    GjsModulePreloads *preloads = get_preloads(cx);
+    for (auto& kv : *preloads)
+        kv.second->cancel();
+    preloads->clear();
+}
+
 decltype(GjsModule::klass) constexpr GjsModule::klass;
 decltype(GjsModule::class_ops) constexpr GjsModule::class_ops;
@@ -24,6 +24,10 @@
 #ifndef GJS_MODULE_H
 #define GJS_MODULE_H
 
+#include <memory>
+#include <string>
+#include <unordered_map>
+
 #include <gio/gio.h>
 
 #include "jsapi-wrapper.h"
@@ -37,6 +41,49 @@ gjs_module_import(JSContext       *cx,
                   const char      *name,
                   GFile           *file);
 
+void gjs_module_preload(JSContext *cx,
+                        GFile     *file);
+
+void gjs_module_cancel_preloads(JSContext *cx);
+
 G_END_DECLS
 
+/* The contents of a module file. Modules in GResources or in a module bundle
+ * are used in place, others are read into memory. The contents are always
+ * nul-terminated. */
+class GjsModuleSource {
+    char *m_owned;
+    GBytes *m_bytes;
+    const char *m_data;
+    size_t m_len;
+
+    bool load_resource(GFile *file, GError **error);
+
+public:
+    GjsModuleSource() :
+        m_owned(nullptr), m_bytes(nullptr), m_data(nullptr), m_len(0) {}
+    ~GjsModuleSource() {
+        g_free(m_owned);
+        if (m_bytes)
+            g_bytes_unref(m_bytes);
+    }
+
+    GjsModuleSource(const GjsModuleSource&) = delete;
+    GjsModuleSource& operator=(const GjsModuleSource&) = delete;
+
+    bool load(GFile *file, GError **error);
+
+    const char *data(void) const { return m_data; }
+    size_t len(void) const { return m_len; }
+};
+
+class GjsPreloadedScript;
+
+/* The modules being preloaded for one GjsContext, keyed by the filename they
+ * would be compiled with */
+class GjsModulePreloads :
+    public std::unordered_map<std::string, std::shared_ptr<GjsPreloadedScript>> {};
+
+void gjs_module_install_source_hook(JSContext *cx);
+
 #endif  /* GJS_MODULE_H */
@@ -36,6 +36,18 @@ bool _gjs_profiler_is_running(GjsProfiler *self);
 
 void _gjs_profiler_setup_signals(GjsProfiler *self, GjsContext *context);
 
+void _gjs_profiler_add_mark(GjsProfiler *self,
+                            int64_t      time_nsec,
+                            int64_t      duration_nsec,
+                            const char  *group,
+                            const char  *name,
+                            const char  *message);
+
 G_END_DECLS
 
+struct GjsGCSlice;
+
+void _gjs_profiler_add_gc_slice(GjsProfiler       *self,
+                                const GjsGCSlice&  slice);
+
 #endif  /* GJS_PROFILER_PRIVATE_H */
@@ -37,6 +37,7 @@
 #include <js/ProfilingStack.h>
 
 #include "context.h"
+#include "gc-stats.h"
 #include "jsapi-util.h"
 #include "profiler-private.h"
 #ifdef ENABLE_PROFILER
@@ -69,7 +70,11 @@
  *
  * As much of this code has to run from signal handlers, it is very
  * important that we don't use anything that can malloc() or lock, or
- * deadlocks are very likely. Most of GjsProfilerCapture is signal-safe.
+ * deadlocks are very likely. So the capture writer is used in its
+ * asynchronous mode: the signal handler only appends the sample, and any
+ * label it hasn't seen before, to a preallocated ring, and a thread of the
+ * writer's own writes them to the capture file. Samples are dropped, rather
+ * than blocking, if that thread falls behind.
  */
 
 #define SAMPLES_PER_SEC G_GUINT64_CONSTANT(1000)
@@ -110,6 +115,9 @@ struct _GjsProfiler {
 
     /* GLib signal handler ID for SIGUSR2 */
     unsigned sigusr2_id;
+
+    /* ID of the first of the GC counters, see gjs_profiler_define_gc_counters */
+    unsigned gc_counter_base;
 #endif  /* ENABLE_PROFILER */
 
     /* If we are currently sampling */
@@ -174,6 +182,64 @@ gjs_profiler_extract_maps(GjsProfiler *self)
 
     return true;
 }
+
+enum GjsGCCounter {
+    GJS_GC_COUNTER_SLICE_DURATION,
+    GJS_GC_COUNTER_HEAP_SIZE,
+    GJS_GC_COUNTER_ZONES,
+    GJS_GC_COUNTER_REASON,
+    GJS_GC_COUNTER_LAST
+};
+
+/*
+ * gjs_profiler_define_gc_counters:
+ *
+ * Registers counters for GC slice telemetry in the capture file, so that
+ * GC pauses can be lined up with the sampled stacks.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and the profile
+ *   should abort.
+ */
+static bool
+gjs_profiler_define_gc_counters(GjsProfiler *self)
+{
+    static const struct {
+        const char *name;
+        const char *description;
+        uint8_t type;
+    } gc_counters[] = {
+        {"GC slice", "Duration of incremental GC slices (ms)",
+         SP_CAPTURE_COUNTER_DOUBLE},
+        {"JS heap", "Size of the JS heap (bytes)", SP_CAPTURE_COUNTER_INT64},
+        {"GC zones", "Number of zones collected in the GC cycle",
+         SP_CAPTURE_COUNTER_INT64},
+        {"GC reason", "JS::gcreason::Reason for the GC slice",
+         SP_CAPTURE_COUNTER_INT64},
+    };
+    static_assert(G_N_ELEMENTS(gc_counters) == GJS_GC_COUNTER_LAST,
+                  "Keep gc_counters consistent with GjsGCCounter");
+
+    self->gc_counter_base =
+        sp_capture_writer_request_counter(self->capture, GJS_GC_COUNTER_LAST);
+    if (self->gc_counter_base == 0)
+        return false;
+
+    SpCaptureCounter counters[GJS_GC_COUNTER_LAST] = {};
+    for (size_t ix = 0; ix < GJS_GC_COUNTER_LAST; ix++) {
+        g_strlcpy(counters[ix].category, "GJS", sizeof counters[ix].category);
+        g_strlcpy(counters[ix].name, gc_counters[ix].name,
+                  sizeof counters[ix].name);
+        g_strlcpy(counters[ix].description, gc_counters[ix].description,
+                  sizeof counters[ix].description);
+        counters[ix].id = self->gc_counter_base + ix;
+        counters[ix].type = gc_counters[ix].type;
+    }
+
+    return sp_capture_writer_define_counters(self->capture,
+                                             g_get_monotonic_time() * 1000L,
+                                             -1, self->pid, counters,
+                                             GJS_GC_COUNTER_LAST);
+}
 #endif  /* ENABLE_PROFILER */
 
 /*
@@ -340,13 +406,14 @@ gjs_profiler_sigprof(int        signum,
          * everything will show up as [stack] when building callgraphs.
          */
         if (label)
-            addrs[flipped] = sp_capture_writer_add_jitmap(self->capture, label);
+            addrs[flipped] = sp_capture_writer_add_jitmap_async(self->capture, label);
         else
             addrs[flipped] = SpCaptureAddress(entry.stackAddress());
     }
 
-    if (!sp_capture_writer_add_sample(self->capture, now, -1, self->pid, addrs, depth))
-        gjs_profiler_stop(self);
+    /* If the ring is full, the sample is dropped and counted */
+    sp_capture_writer_add_sample_async(self->capture, now, -1, self->pid,
+                                       addrs, depth);
 }
 
 #endif  /* ENABLE_PROFILER */
@@ -386,7 +453,7 @@ gjs_profiler_start(GjsProfiler *self)
     if (!path)
         path = g_strdup_printf("gjs-%jd.syscap", intmax_t(self->pid));
 
-    self->capture = sp_capture_writer_new(path, 0);
+    self->capture = sp_capture_writer_new_async(path, 0, 0);
 
     if (!self->capture) {
         g_warning("Failed to open profile capture");
@@ -399,6 +466,12 @@ gjs_profiler_start(GjsProfiler *self)
         return;
     }
 
+    if (!gjs_profiler_define_gc_counters(self)) {
+        g_warning("Failed to define GC counters");
+        g_clear_pointer(&self->capture, sp_capture_writer_unref);
+        return;
+    }
+
     self->stack_depth = 0;
 
     /* Setup our signal handler for SIGPROF delivery */
@@ -500,6 +573,10 @@ gjs_profiler_stop(GjsProfiler *self)
 
     sp_capture_writer_flush(self->capture);
 
+    unsigned n_dropped = sp_capture_writer_get_n_dropped(self->capture);
+    if (n_dropped > 0)
+        g_message("Profiler dropped %u samples", n_dropped);
+
     g_clear_pointer(&self->capture, sp_capture_writer_unref);
 
     self->stack_depth = 0;
@@ -510,6 +587,77 @@ gjs_profiler_stop(GjsProfiler *self)
     self->running = false;
 }
 
+/*
+ * _gjs_profiler_add_gc_slice:
+ * @self: A #GjsProfiler
+ * @slice: a finished GC slice
+ *
+ * Records the GC slice as counter values in the capture, if the profiler is
+ * running.
+ */
+void
+_gjs_profiler_add_gc_slice(GjsProfiler       *self,
+                           const GjsGCSlice&  slice)
+{
+#ifdef ENABLE_PROFILER
+    if (!self->running)
+        return;
+
+    /* The SIGPROF handler only touches the writer's ring, so it may interrupt
+     * us here; the writer locks against its own thread */
+    unsigned heap_id = self->gc_counter_base + GJS_GC_COUNTER_HEAP_SIZE;
+    SpCaptureCounterValue heap_before;
+    heap_before.v64 = slice.heap_bytes_before;
+
+    unsigned ids[GJS_GC_COUNTER_LAST];
+    SpCaptureCounterValue values[GJS_GC_COUNTER_LAST];
+    for (unsigned ix = 0; ix < GJS_GC_COUNTER_LAST; ix++)
+        ids[ix] = self->gc_counter_base + ix;
+    values[GJS_GC_COUNTER_SLICE_DURATION].vdbl = slice.duration / 1000.0;
+    values[GJS_GC_COUNTER_HEAP_SIZE].v64 = slice.heap_bytes_after;
+    values[GJS_GC_COUNTER_ZONES].v64 = slice.zone_count;
+    values[GJS_GC_COUNTER_REASON].v64 = slice.reason;
+
+    int64_t start = slice.start_time * 1000L;
+    int64_t end = (slice.start_time + slice.duration) * 1000L;
+    if (!sp_capture_writer_set_counters(self->capture, start, -1, self->pid,
+                                        &heap_id, &heap_before, 1) ||
+        !sp_capture_writer_set_counters(self->capture, end, -1, self->pid,
+                                        ids, values, GJS_GC_COUNTER_LAST))
+        g_warning("Failed to record GC slice in profile");
+#endif  /* ENABLE_PROFILER */
+}
+
+/*
+ * _gjs_profiler_add_mark:
+ * @self: A #GjsProfiler
+ * @time_nsec: monotonic start time of the marked interval, in nanoseconds
+ * @duration_nsec: length of the marked interval, in nanoseconds
+ * @group: category of the mark, shown as a row in the profiler UI
+ * @name: name of the mark
+ * @message: (nullable): longer description of the mark
+ *
+ * Records an interval in the capture, if the profiler is running.
+ */
+void
+_gjs_profiler_add_mark(GjsProfiler *self,
+                       int64_t      time_nsec,
+                       int64_t      duration_nsec,
+                       const char  *group,
+                       const char  *name,
+                       const char  *message)
+{
+#ifdef ENABLE_PROFILER
+    if (!self->running)
+        return;
+
+    /* See _gjs_profiler_add_gc_slice() */
+    if (!sp_capture_writer_add_mark(self->capture, time_nsec, -1, self->pid,
+                                    duration_nsec, group, name, message))
+        g_warning("Failed to record mark in profile");
+#endif  /* ENABLE_PROFILER */
+}
+
 #ifdef ENABLE_PROFILER
 
 static gboolean
@@ -0,0 +1,389 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "bundle.h"
+#include "script-cache.h"
+#include "util/log.h"
+
+#define CACHE_MAGIC "CJSXDR2"
+
+/* Everything in here has to match for a cache file to be used, except
+ * xdr_len, which is the length of the XDR data following the header. */
+struct GjsScriptCacheHeader {
+    char magic[8];
+    uint8_t build_id[32];
+    uint64_t content_hash;
+    uint8_t reserved[24];
+    int64_t mtime;
+    uint64_t source_len;
+    uint32_t non_syntactic;
+    uint32_t xdr_len;
+};
+
+G_STATIC_ASSERT(sizeof(GjsScriptCacheHeader) == 96);
+
+/* SpiderMonkey refuses to decode XDR data from a different bytecode version
+ * by itself, but we also don't want to feed it data from a build with a
+ * different pointer size or from a different cjs */
+static const uint8_t *
+build_id(void)
+{
+    static uint8_t digest[32];
+    static bool initialized = false;
+
+    if (!initialized) {
+        GjsAutoChar build = g_strdup_printf("%s %s %zu %d",
+                                            JS_GetImplementationVersion(),
+                                            PACKAGE_STRING, sizeof(void *),
+                                            G_BYTE_ORDER);
+        GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+        gsize len = sizeof(digest);
+        g_checksum_update(checksum, reinterpret_cast<const guchar *>(build.get()),
+                          -1);
+        g_checksum_get_digest(checksum, digest, &len);
+        g_checksum_free(checksum);
+        initialized = true;
+    }
+
+    return digest;
+}
+
+static const char *
+cache_dir(void)
+{
+    static char *dir = nullptr;
+    static bool usable = false;
+
+    if (!dir) {
+        dir = g_build_filename(g_get_user_cache_dir(), "cjs", "bytecode",
+                               nullptr);
+        usable = g_mkdir_with_parents(dir, 0700) == 0;
+        if (!usable)
+            gjs_debug(GJS_DEBUG_IMPORTER, "Script cache disabled, cannot "
+                      "create %s: %s", dir, g_strerror(errno));
+    }
+
+    return usable ? dir : nullptr;
+}
+
+bool
+GjsScriptCache::enabled(void)
+{
+    static int enabled = -1;
+
+    if (enabled < 0)
+        enabled = !g_getenv("GJS_DISABLE_SCRIPT_CACHE") && cache_dir() != nullptr;
+
+    return enabled;
+}
+
+GjsScriptCache::GjsScriptCache(const char *filename,
+                               int         line_number,
+                               const char *source,
+                               size_t      source_len,
+                               bool        non_syntactic) :
+    m_source(source),
+    m_source_len(source_len),
+    m_mtime(0),
+    m_non_syntactic(non_syntactic),
+    m_have_content_hash(false)
+{
+    /* Only cache scripts that come from somewhere stable; not, for example,
+     * the lines typed into the interactive console */
+    if (!enabled() || !filename || source_len == 0)
+        return;
+
+    if (g_path_is_absolute(filename)) {
+        /* Files inside a bundle have no modification time of their own; the
+         * content hash is enough to validate them */
+        GStatBuf buf;
+        const char *inner_path;
+        if (g_stat(filename, &buf) == 0)
+            m_mtime = buf.st_mtime;
+        else if (!GjsBundle::get(filename, &inner_path))
+            return;
+    } else if (!g_str_has_prefix(filename, "resource://")) {
+        return;
+    }
+
+    GjsAutoChar key = g_strdup_printf("%s:%d:%s", filename, line_number,
+                                      non_syntactic ? "nonsyntactic" : "global");
+    GjsAutoChar name = g_compute_checksum_for_string(G_CHECKSUM_SHA256, key, -1);
+    m_cache_path = g_build_filename(cache_dir(), name.get(), nullptr);
+}
+
+/* XXH64. The hash only has to detect sources that changed since they were
+ * cached, by accident rather than by an attacker, since the cache directory
+ * belongs to the user; a cryptographic hash would cost most of the time saved
+ * for big scripts that are loaded at every startup. */
+static const uint64_t PRIME64_1 = G_GUINT64_CONSTANT(11400714785074694791);
+static const uint64_t PRIME64_2 = G_GUINT64_CONSTANT(14029467366897019727);
+static const uint64_t PRIME64_3 = G_GUINT64_CONSTANT(1609587929392839161);
+static const uint64_t PRIME64_4 = G_GUINT64_CONSTANT(9650029242287828579);
+static const uint64_t PRIME64_5 = G_GUINT64_CONSTANT(2870177450012600261);
+
+static inline uint64_t
+rotl64(uint64_t x,
+       int      r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+read64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t
+read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t
+xxh64_round(uint64_t acc,
+            uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t
+xxh64_merge(uint64_t acc,
+            uint64_t val)
+{
+    acc ^= xxh64_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+static uint64_t
+xxh64(const void *data,
+      size_t      len)
+{
+    auto p = static_cast<const uint8_t *>(data);
+    const uint8_t *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = PRIME64_1 + PRIME64_2, v2 = PRIME64_2, v3 = 0,
+            v4 = -PRIME64_1;
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = xxh64_round(v1, read64(p));
+            v2 = xxh64_round(v2, read64(p + 8));
+            v3 = xxh64_round(v3, read64(p + 16));
+            v4 = xxh64_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    } else {
+        h = PRIME64_5;
+    }
+
+    h += len;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh64_round(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        h ^= uint64_t(read32(p)) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* Hashing the source is much cheaper than parsing it, and guards against
+ * files being replaced within the mtime granularity */
+uint64_t
+GjsScriptCache::content_hash(void)
+{
+    if (!m_have_content_hash) {
+        m_content_hash = xxh64(m_source, m_source_len);
+        m_have_content_hash = true;
+    }
+
+    return m_content_hash;
+}
+
+bool
+GjsScriptCache::header_matches(const GjsScriptCacheHeader& header,
+                               size_t                      file_len)
+{
+    return memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+        memcmp(header.build_id, build_id(), sizeof(header.build_id)) == 0 &&
+        header.mtime == m_mtime &&
+        header.source_len == m_source_len &&
+        header.non_syntactic == m_non_syntactic &&
+        header.xdr_len == file_len - sizeof(header) &&
+        header.content_hash == content_hash();
+}
+
+/* Returns whether lookup() would probably succeed, reading only the header of
+ * the cache file. Used to avoid compiling scripts ahead of time that are
+ * cached anyway. */
+bool
+GjsScriptCache::probe(void)
+{
+    if (!m_cache_path)
+        return false;
+
+    int fd = open(m_cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    GjsScriptCacheHeader header;
+    struct stat buf;
+    bool retval = fstat(fd, &buf) == 0 &&
+        size_t(buf.st_size) >= sizeof(header) &&
+        read(fd, &header, sizeof(header)) == sizeof(header) &&
+        header_matches(header, buf.st_size);
+
+    close(fd);
+    return retval;
+}
+
+bool
+GjsScriptCache::lookup(JSContext              *cx,
+                       JS::MutableHandleScript script)
+{
+    if (!m_cache_path)
+        return false;
+
+    char *unowned_contents;
+    gsize len;
+    if (!g_file_get_contents(m_cache_path, &unowned_contents, &len, nullptr))
+        return false;
+    GjsAutoChar contents = unowned_contents;  /* steals ownership */
+
+    GjsScriptCacheHeader header;
+    if (len < sizeof(header))
+        goto stale;
+    memcpy(&header, contents.get(), sizeof(header));
+    if (!header_matches(header, len))
+        goto stale;
+
+    {
+        JS::TranscodeBuffer buffer;
+        if (!buffer.append(reinterpret_cast<uint8_t *>(contents.get()), len))
+            return false;
+
+        JS::TranscodeResult result = JS::DecodeScript(cx, buffer, script,
+                                                      sizeof(header));
+        if (result != JS::TranscodeResult_Ok) {
+            if (JS_IsExceptionPending(cx))
+                JS_ClearPendingException(cx);
+            gjs_debug(GJS_DEBUG_IMPORTER, "Failed to decode cached script %s "
+                      "(%d), discarding it", m_cache_path.get(), result);
+            g_unlink(m_cache_path);
+            return false;
+        }
+    }
+
+    gjs_debug(GJS_DEBUG_IMPORTER, "Using cached script %s",
+              m_cache_path.get());
+    return true;
+
+stale:
+    /* It will be overwritten when the script is stored again */
+    gjs_debug(GJS_DEBUG_IMPORTER, "Cached script %s is stale",
+              m_cache_path.get());
+    return false;
+}
+
+void
+GjsScriptCache::store(JSContext       *cx,
+                      JS::HandleScript script)
+{
+    if (!m_cache_path)
+        return;
+
+    /* Reserve space for the header, the XDR data is appended after it */
+    GjsScriptCacheHeader header;
+    JS::TranscodeBuffer buffer;
+    if (!buffer.appendN(0, sizeof(header)))
+        return;
+
+    JS::TranscodeResult result = JS::EncodeScript(cx, buffer, script);
+    if (result != JS::TranscodeResult_Ok) {
+        if (JS_IsExceptionPending(cx))
+            JS_ClearPendingException(cx);
+        gjs_debug(GJS_DEBUG_IMPORTER, "Failed to encode script for %s (%d)",
+                  m_cache_path.get(), result);
+        return;
+    }
+
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    memcpy(header.build_id, build_id(), sizeof(header.build_id));
+    header.content_hash = content_hash();
+    memset(header.reserved, 0, sizeof(header.reserved));
+    header.mtime = m_mtime;
+    header.source_len = m_source_len;
+    header.non_syntactic = m_non_syntactic;
+    header.xdr_len = buffer.length() - sizeof(header);
+    memcpy(buffer.begin(), &header, sizeof(header));
+
+    /* Written to a temporary file and renamed, so concurrent readers never
+     * see a partial file */
+    GError *error = nullptr;
+    if (!g_file_set_contents(m_cache_path,
+                             reinterpret_cast<const char *>(buffer.begin()),
+                             buffer.length(), &error)) {
+        gjs_debug(GJS_DEBUG_IMPORTER, "Failed to write cached script %s: %s",
+                  m_cache_path.get(), error->message);
+        g_error_free(error);
+    }
+}
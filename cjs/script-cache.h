@@ -0,0 +1,87 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GJS_SCRIPT_CACHE_H
+#define GJS_SCRIPT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jsapi-util.h"
+#include "jsapi-wrapper.h"
+
+/* On-disk cache of compiled scripts, encoded with SpiderMonkey's XDR format.
+ *
+ * There is one cache file per source filename, under
+ * $XDG_CACHE_HOME/cjs/bytecode. The file header records the engine build, the
+ * modification time and size of the source file, and a 64-bit hash of the
+ * source text; a cached script is only used if all of them match, and is
+ * otherwise replaced the next time the script is compiled. Setting
+ * GJS_DISABLE_SCRIPT_CACHE in the environment turns the cache off.
+ *
+ * Usage, on the stack:
+ *
+ *     GjsScriptCache cache(filename, line, source, source_len, true);
+ *     JS::RootedScript script(cx);
+ *     if (!cache.lookup(cx, &script)) {
+ *         if (!JS::CompileForNonSyntacticScope(..., &script))
+ *             return false;
+ *         cache.store(cx, script);
+ *     }
+ *
+ * Neither lookup() nor store() ever leave an exception pending.
+ */
+struct GjsScriptCacheHeader;
+
+class GjsScriptCache {
+    GjsAutoChar m_cache_path;  /* null if the script should not be cached */
+    const char *m_source;
+    size_t m_source_len;
+    int64_t m_mtime;
+    bool m_non_syntactic;
+
+    uint64_t m_content_hash;
+    bool m_have_content_hash;
+
+    uint64_t content_hash(void);
+    bool header_matches(const GjsScriptCacheHeader& header, size_t file_len);
+
+public:
+    /* @filename and @line_number are the ones the script is compiled with.
+     * If @filename is a local path, it is also used to find the modification
+     * time of the source. @non_syntactic must be true if the script will be
+     * compiled for a non-syntactic scope chain. */
+    GjsScriptCache(const char *filename,
+                   int         line_number,
+                   const char *source,
+                   size_t      source_len,
+                   bool        non_syntactic);
+
+    bool lookup(JSContext *cx, JS::MutableHandleScript script);
+    bool probe(void);
+    void store(JSContext *cx, JS::HandleScript script);
+
+    static bool enabled(void);
+};
+
+#endif  /* GJS_SCRIPT_CACHE_H */
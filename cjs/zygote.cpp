@@ -0,0 +1,751 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include <unordered_map>
+#include <vector>
+
+#include <girepository.h>
+#include <glib.h>
+#include <glib-unix.h>
+#include <gmodule.h>
+
+#include "zygote.h"
+
+extern char **environ;
+
+#define ZYGOTE_MAGIC 0x5a534a43  /* "CJSZ" in little-endian byte order */
+#define ZYGOTE_MAX_PAYLOAD (16 * 1024 * 1024)
+/* How long workers get to exit after SIGHUP when the zygote is terminated,
+ * before they are killed */
+#define ZYGOTE_SHUTDOWN_TIMEOUT_MS 5000
+
+/* Sent by the client, together with its stdin, stdout and stderr as
+ * SCM_RIGHTS ancillary data, followed by @payload_len bytes: the working
+ * directory, then @argc arguments, then @envc environment entries, each
+ * terminated by a NUL byte. Both ends are always on the same machine, so
+ * everything is in host byte order. */
+struct ZygoteRequest {
+    uint32_t magic;
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t payload_len;
+};
+
+enum ZygoteReplyType : uint32_t {
+    ZYGOTE_REPLY_PID = 1,   /* value is the worker's process ID */
+    ZYGOTE_REPLY_EXIT = 2,  /* value is the worker's exit status */
+};
+
+/* Sent by the zygote: first a PID reply as soon as the worker is forked, then
+ * an EXIT reply when it has been reaped. A worker killed by a signal exits
+ * with status 128 + the signal number, like in a shell. */
+struct ZygoteReply {
+    uint32_t magic;
+    uint32_t type;
+    int32_t value;
+};
+
+static char *socket_path = nullptr;
+static char **extra_typelibs = nullptr;
+
+static GOptionEntry zygote_entries[] = {
+    { "zygote", 0, 0, G_OPTION_ARG_FILENAME, &socket_path,
+        "Run as a zygote, forking a worker for each client that connects to "
+        "SOCKET", "SOCKET" },
+    { "zygote-typelib", 0, 0, G_OPTION_ARG_STRING_ARRAY, &extra_typelibs,
+        "Load the typelib NAMESPACE[-VERSION] and its libraries before "
+        "forking. GLib, GObject and Gio are always loaded", "NAMESPACE" },
+    { NULL }
+};
+
+static const char *default_typelibs[] = { "GLib-2.0", "GObject-2.0", "Gio-2.0" };
+
+static int signal_pipe[2] = { -1, -1 };
+
+static bool
+read_all(int     fd,
+         void   *buf,
+         size_t  len)
+{
+    char *p = static_cast<char *>(buf);
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool
+write_all(int         fd,
+          const void *buf,
+          size_t      len)
+{
+    const char *p = static_cast<const char *>(buf);
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void
+send_reply(int              fd,
+           ZygoteReplyType  type,
+           int32_t          value)
+{
+    ZygoteReply reply = { ZYGOTE_MAGIC, type, value };
+    /* The client may be gone already; nothing to do about it */
+    (void) write_all(fd, &reply, sizeof(reply));
+}
+
+/* "Gtk-3.0" requires version 3.0 of Gtk, "Gtk" the latest one */
+static void
+load_typelib(const char *spec)
+{
+    GError *error = nullptr;
+    const char *dash = strrchr(spec, '-');
+    char *ns, *version = nullptr;
+
+    if (dash && g_ascii_isdigit(dash[1])) {
+        ns = g_strndup(spec, dash - spec);
+        version = g_strdup(dash + 1);
+    } else {
+        ns = g_strdup(spec);
+    }
+
+    if (!g_irepository_require(nullptr, ns, version, GIRepositoryLoadFlags(0),
+                               &error)) {
+        g_warning("Zygote could not load typelib %s: %s", spec,
+                  error->message);
+        g_error_free(error);
+        goto out;
+    }
+
+    /* Loading the libraries now means the workers skip the dynamic linking
+     * and relocation that would otherwise happen on the first call into them */
+    const char *libraries;
+    libraries = g_irepository_get_shared_library(nullptr, ns);
+    if (libraries) {
+        char **names = g_strsplit(libraries, ",", -1);
+        for (char **name = names; *name; name++) {
+            GModule *module = g_module_open(*name, G_MODULE_BIND_LAZY);
+            if (!module) {
+                g_warning("Zygote could not load %s: %s", *name,
+                          g_module_error());
+                continue;
+            }
+            g_module_make_resident(module);
+        }
+        g_strfreev(names);
+    }
+
+ out:
+    g_free(ns);
+    g_free(version);
+}
+
+/* The worker reads the cache files itself, this only makes sure that the
+ * reads are served from memory. g_get_user_cache_dir() caches its result,
+ * and the workers must see the value from the client's environment, so the
+ * directory is worked out by hand here. */
+static void
+warm_script_cache(void)
+{
+    const char *cache_home = g_getenv("XDG_CACHE_HOME");
+    const char *home = g_getenv("HOME");
+    char *dir;
+
+    if (cache_home && *cache_home)
+        dir = g_build_filename(cache_home, "cjs", "bytecode", nullptr);
+    else if (home && *home)
+        dir = g_build_filename(home, ".cache", "cjs", "bytecode", nullptr);
+    else
+        return;
+
+    GDir *cache = g_dir_open(dir, 0, nullptr);
+    if (cache) {
+        const char *name;
+        while ((name = g_dir_read_name(cache))) {
+            char *path = g_build_filename(dir, name, nullptr);
+            int fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (fd >= 0) {
+#ifdef POSIX_FADV_WILLNEED
+                posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+                close(fd);
+            }
+            g_free(path);
+        }
+        g_dir_close(cache);
+    }
+    g_free(dir);
+}
+
+static void
+on_signal(int signum)
+{
+    int saved_errno = errno;
+    char byte = signum;
+    (void) write(signal_pipe[1], &byte, 1);
+    errno = saved_errno;
+}
+
+static void
+set_signal_handler(int    signum,
+                   void (*handler)(int))
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(signum, &action, nullptr);
+}
+
+static int
+listen_on(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        g_printerr("Zygote socket path is too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        g_printerr("Could not create zygote socket: %s\n", g_strerror(errno));
+        return -1;
+    }
+
+    /* Replace the socket of a previous zygote, but nothing else */
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    /* Only the user running the zygote may connect to it */
+    mode_t old_umask = umask(0077);
+    int status = bind(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                      sizeof(addr));
+    umask(old_umask);
+
+    if (status < 0 || listen(fd, 64) < 0) {
+        g_printerr("Could not listen on %s: %s\n", path, g_strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static bool
+peer_is_same_user(int fd)
+{
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+        return false;
+    return cred.uid == getuid();
+#else
+    (void) fd;
+    return true;  /* the socket is only accessible to its owner anyway */
+#endif
+}
+
+/* Reads the client's request in a freshly forked worker, and turns the worker
+ * into the process the client asked for. Exits on failure. */
+static void
+become_client(int      conn,
+              int     *argc,
+              char  ***argv)
+{
+    ZygoteRequest request;
+    int fds[3] = { -1, -1, -1 };
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { &request, sizeof(request) };
+    struct msghdr msg;
+    ssize_t n;
+
+    /* A client that connects and then says nothing must not leave the
+     * worker hanging around forever */
+    struct timeval timeout = { 10, 0 };
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    do
+        n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        _exit(1);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+        _exit(1);
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    if (size_t(n) < sizeof(request) &&
+        !read_all(conn, reinterpret_cast<char *>(&request) + n,
+                  sizeof(request) - n))
+        _exit(1);
+
+    if (request.magic != ZYGOTE_MAGIC || request.argc == 0 ||
+        request.payload_len == 0 || request.payload_len > ZYGOTE_MAX_PAYLOAD)
+        _exit(1);
+
+    char *payload = static_cast<char *>(g_malloc(request.payload_len));
+    if (!read_all(conn, payload, request.payload_len) ||
+        payload[request.payload_len - 1] != '\0')
+        _exit(1);
+
+    /* Split the payload; the strings stay in place and are never freed */
+    std::vector<char *> strings;
+    for (char *p = payload; p < payload + request.payload_len;
+         p += strlen(p) + 1)
+        strings.push_back(p);
+    if (strings.size() != 1 + size_t(request.argc) + request.envc)
+        _exit(1);
+
+    char **new_argv = g_new(char *, request.argc + 1);
+    memcpy(new_argv, &strings[1], request.argc * sizeof(char *));
+    new_argv[request.argc] = nullptr;
+
+    char **new_environ = g_new(char *, request.envc + 1);
+    memcpy(new_environ, &strings[1 + request.argc],
+           request.envc * sizeof(char *));
+    new_environ[request.envc] = nullptr;
+
+    for (int ix = 0; ix < 3; ix++) {
+        if (dup2(fds[ix], ix) < 0)
+            _exit(1);
+    }
+    for (int ix = 0; ix < 3; ix++) {
+        if (fds[ix] > 2)
+            close(fds[ix]);
+    }
+    close(conn);
+
+    environ = new_environ;
+
+    if (chdir(strings[0]) < 0) {
+        g_printerr("Could not change to directory %s: %s\n", strings[0],
+                   g_strerror(errno));
+        _exit(1);
+    }
+
+    *argc = request.argc;
+    *argv = new_argv;
+}
+
+/* Worker PID -> connection to its client, or -1 if the client is gone */
+typedef std::unordered_map<pid_t, int> ZygoteWorkers;
+
+/* Reaps the workers that have exited, and tells their clients */
+static void
+reap_workers(ZygoteWorkers& workers)
+{
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        auto worker = workers.find(pid);
+        if (worker == workers.end())
+            continue;
+        if (worker->second >= 0) {
+            int code = WIFEXITED(status) ? WEXITSTATUS(status)
+                                         : 128 + WTERMSIG(status);
+            send_reply(worker->second, ZYGOTE_REPLY_EXIT, code);
+            close(worker->second);
+        }
+        workers.erase(worker);
+    }
+}
+
+/* Hangs up on the workers as if their terminal had closed, and waits for them
+ * to exit, so that their clients still get an exit status. Workers that
+ * outlast ZYGOTE_SHUTDOWN_TIMEOUT_MS are killed. */
+static void
+stop_workers(ZygoteWorkers& workers)
+{
+    for (auto& worker : workers)
+        kill(worker.first, SIGHUP);
+
+    int64_t deadline = g_get_monotonic_time() +
+        int64_t(ZYGOTE_SHUTDOWN_TIMEOUT_MS) * 1000;
+    bool killed = false;
+
+    while (true) {
+        reap_workers(workers);
+        if (workers.empty())
+            return;
+
+        int timeout = -1;
+        if (!killed) {
+            int64_t remaining = deadline - g_get_monotonic_time();
+            if (remaining <= 0) {
+                for (auto& worker : workers)
+                    kill(worker.first, SIGKILL);
+                killed = true;
+                continue;
+            }
+            timeout = remaining / 1000 + 1;
+        }
+
+        /* Woken up by SIGCHLD */
+        struct pollfd pollfd = { signal_pipe[0], POLLIN, 0 };
+        if (poll(&pollfd, 1, timeout) > 0) {
+            char signum;
+            while (read(signal_pipe[0], &signum, 1) == 1)
+                ;
+        }
+    }
+}
+
+void
+gjs_zygote_serve(int    *argc,
+                 char ***argv)
+{
+    GOptionContext *context = g_option_context_new(NULL);
+    GError *error = nullptr;
+
+    g_option_context_add_main_entries(context, zygote_entries, NULL);
+    if (!g_option_context_parse(context, argc, argv, &error))
+        g_error("option parsing failed: %s", error->message);
+    g_option_context_free(context);
+
+    if (!socket_path || *argc > 1) {
+        g_printerr("Usage: %s --zygote=SOCKET [--zygote-typelib=NAMESPACE...]\n",
+                   g_get_prgname());
+        exit(1);
+    }
+
+    for (const char *spec : default_typelibs)
+        load_typelib(spec);
+    if (extra_typelibs) {
+        for (char **spec = extra_typelibs; *spec; spec++)
+            load_typelib(*spec);
+    }
+    warm_script_cache();
+
+    int listen_fd = listen_on(socket_path);
+    if (listen_fd < 0)
+        exit(1);
+
+    if (!g_unix_open_pipe(signal_pipe, FD_CLOEXEC, &error) ||
+        !g_unix_set_fd_nonblocking(signal_pipe[0], true, &error) ||
+        !g_unix_set_fd_nonblocking(signal_pipe[1], true, &error))
+        g_error("Could not create signal pipe: %s", error->message);
+
+    set_signal_handler(SIGCHLD, on_signal);
+    set_signal_handler(SIGTERM, on_signal);
+    set_signal_handler(SIGINT, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    ZygoteWorkers workers;
+    std::vector<struct pollfd> pollfds;
+    std::vector<pid_t> pollfd_pids;
+    bool quit = false;
+
+    while (!quit) {
+        pollfds.clear();
+        pollfd_pids.clear();
+        pollfds.push_back({ listen_fd, POLLIN, 0 });
+        pollfds.push_back({ signal_pipe[0], POLLIN, 0 });
+#ifdef POLLRDHUP
+        /* Only watch for hangups: the request itself is read by the worker,
+         * and may still be in flight */
+        for (auto& worker : workers) {
+            if (worker.second < 0)
+                continue;
+            pollfds.push_back({ worker.second, POLLRDHUP, 0 });
+            pollfd_pids.push_back(worker.first);
+        }
+#endif
+
+        if (poll(pollfds.data(), pollfds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            g_error("Zygote poll failed: %s", g_strerror(errno));
+        }
+
+        /* A client that hangs up is treated like a closed terminal */
+        for (size_t ix = 2; ix < pollfds.size(); ix++) {
+            if (!pollfds[ix].revents)
+                continue;
+            pid_t pid = pollfd_pids[ix - 2];
+            kill(pid, SIGHUP);
+            close(workers[pid]);
+            workers[pid] = -1;
+        }
+
+        if (pollfds[1].revents) {
+            char signum;
+            while (read(signal_pipe[0], &signum, 1) == 1) {
+                if (signum == SIGTERM || signum == SIGINT)
+                    quit = true;
+            }
+
+            reap_workers(workers);
+        }
+
+        if (quit || !pollfds[0].revents)
+            continue;
+
+        int conn = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0)
+            continue;
+        if (!peer_is_same_user(conn)) {
+            close(conn);
+            continue;
+        }
+
+        fflush(stdout);
+        fflush(stderr);
+        pid_t zygote_pid = getpid();
+        pid_t pid = fork();
+        if (pid < 0) {
+            g_warning("Zygote could not fork: %s", g_strerror(errno));
+            close(conn);
+            continue;
+        }
+
+        if (pid == 0) {
+#ifdef __linux__
+            /* A worker is not in its client's session, so nothing else would
+             * stop it if the zygote died without stop_workers() */
+            if (prctl(PR_SET_PDEATHSIG, SIGHUP) < 0 || getppid() != zygote_pid)
+                _exit(1);
+#endif
+            close(listen_fd);
+            close(signal_pipe[0]);
+            close(signal_pipe[1]);
+            for (auto& worker : workers) {
+                if (worker.second >= 0)
+                    close(worker.second);
+            }
+            set_signal_handler(SIGCHLD, SIG_DFL);
+            set_signal_handler(SIGTERM, SIG_DFL);
+            set_signal_handler(SIGINT, SIG_DFL);
+            signal(SIGPIPE, SIG_DFL);
+
+            become_client(conn, argc, argv);
+            return;
+        }
+
+        send_reply(conn, ZYGOTE_REPLY_PID, pid);
+        workers[pid] = conn;
+    }
+
+    /* Stop accepting clients before waiting for the workers */
+    close(listen_fd);
+    unlink(socket_path);
+    stop_workers(workers);
+    exit(0);
+}
+
+static volatile pid_t worker_pid = 0;
+
+/* Signals that arrived before the zygote told us the worker's PID */
+static volatile sig_atomic_t pending_signals[NSIG];
+
+static const int forwarded_signals[] = {
+    SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGTSTP, SIGCONT, SIGWINCH
+};
+
+static void
+forward_signal(int signum)
+{
+    if (worker_pid <= 0) {
+        pending_signals[signum] = 1;
+        return;
+    }
+
+    if (signum == SIGTSTP) {
+        /* The worker is outside the terminal's process groups, where
+         * SIGTSTP may be discarded, so it is stopped outright; then this
+         * process stops too, so the shell sees the job stop. SIGCONT from
+         * the shell is passed on in turn. */
+        kill(worker_pid, SIGSTOP);
+        kill(getpid(), SIGSTOP);
+        return;
+    }
+
+    kill(worker_pid, signum);
+}
+
+bool
+gjs_zygote_connect(int    argc,
+                   char **argv,
+                   int   *exit_code)
+{
+    const char *path = g_getenv("CJS_ZYGOTE_SOCKET");
+    struct sockaddr_un addr;
+
+    if (!path || !*path)
+        return false;
+
+    /* A worker can't join the terminal's session, so the terminal could not
+     * keep it from reading input while in the background, nor give the
+     * interactive console its own job control; such clients run here */
+    if (isatty(STDIN_FILENO))
+        return false;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return false;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                sizeof(addr)) < 0) {
+        close(fd);
+        return false;
+    }
+
+    GString *payload = g_string_new(NULL);
+    char *cwd = g_get_current_dir();
+    g_string_append_len(payload, cwd, strlen(cwd) + 1);
+    g_free(cwd);
+    for (int ix = 0; ix < argc; ix++)
+        g_string_append_len(payload, argv[ix], strlen(argv[ix]) + 1);
+    uint32_t envc = 0;
+    for (char **var = environ; *var; var++, envc++)
+        g_string_append_len(payload, *var, strlen(*var) + 1);
+
+    ZygoteRequest request = { ZYGOTE_MAGIC, uint32_t(argc), envc,
+                              uint32_t(payload->len) };
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { &request, sizeof(request) };
+    struct msghdr msg;
+    ssize_t n;
+
+    memset(control, 0, sizeof(control));
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    do
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    while (n < 0 && errno == EINTR);
+
+    bool sent = n > 0 &&
+        (size_t(n) == sizeof(request) ||
+         write_all(fd, reinterpret_cast<char *>(&request) + n,
+                   sizeof(request) - n)) &&
+        write_all(fd, payload->str, payload->len);
+    g_string_free(payload, true);
+
+    for (int signum : forwarded_signals)
+        set_signal_handler(signum, forward_signal);
+
+    ZygoteReply reply;
+    bool started = false;
+    while (sent && read_all(fd, &reply, sizeof(reply)) &&
+           reply.magic == ZYGOTE_MAGIC) {
+        if (reply.type == ZYGOTE_REPLY_PID) {
+            /* The handlers run on this thread, so once worker_pid is set no
+             * more signals can be left pending */
+            worker_pid = reply.value;
+            started = true;
+            for (int signum : forwarded_signals) {
+                if (pending_signals[signum]) {
+                    pending_signals[signum] = 0;
+                    forward_signal(signum);
+                }
+            }
+        } else if (reply.type == ZYGOTE_REPLY_EXIT) {
+            close(fd);
+            *exit_code = reply.value;
+            return true;
+        }
+    }
+    close(fd);
+
+    for (int signum : forwarded_signals)
+        set_signal_handler(signum, SIG_DFL);
+
+    /* If the zygote turned us away before forking, nothing has run yet, and
+     * signals meant for the script are meant for us */
+    if (!started) {
+        for (int signum : forwarded_signals) {
+            if (pending_signals[signum]) {
+                pending_signals[signum] = 0;
+                raise(signum);
+            }
+        }
+        return false;
+    }
+
+    g_printerr("Lost connection to the zygote at %s\n", path);
+    *exit_code = 1;
+    return true;
+}
@@ -0,0 +1,63 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GJS_ZYGOTE_H
+#define GJS_ZYGOTE_H
+
+/* A zygote is a resident cjs process that has already done the process-wide
+ * part of startup: loading and relocating the shared libraries, initializing
+ * the JS engine, mapping the commonly used typelibs and pulling the compiled
+ * script cache into the page cache. It listens on a Unix socket, and for each
+ * client forks a worker that takes over the client's arguments, environment,
+ * working directory and standard file descriptors, and then runs exactly like
+ * "cjs ARGS..." would have.
+ *
+ * No JSContext is created before forking, since SpiderMonkey's helper threads
+ * do not survive fork(). For the same reason the zygote never starts a GLib
+ * main loop or touches GIO. Typelib search paths are fixed when the zygote
+ * starts, so a client's GI_TYPELIB_PATH is ignored.
+ *
+ * Start a zygote with "cjs --zygote=SOCKET [--zygote-typelib=Gtk-3.0 ...]"; a
+ * cjs started with CJS_ZYGOTE_SOCKET=SOCKET in its environment then hands its
+ * command line to the zygote, relays signals to the worker, including job
+ * control and window size changes, and exits with the worker's exit status.
+ * If no zygote is listening, or standard input is a terminal, cjs runs the
+ * script itself. A terminated zygote hangs up on its workers and waits for
+ * them, so their clients still get an exit status; on Linux, workers are also
+ * sent SIGHUP if the zygote dies.
+ */
+
+/* Runs the zygote described by the --zygote options at the start of @argv.
+ * Only returns in a forked worker, with @argc and @argv replaced by the
+ * client's command line. */
+void gjs_zygote_serve(int    *argc,
+                      char ***argv);
+
+/* If CJS_ZYGOTE_SOCKET is set and a zygote is listening on it, runs @argv in
+ * a worker forked from that zygote, stores its exit status in @exit_code and
+ * returns true. Returns false if the caller should run the script itself. */
+bool gjs_zygote_connect(int   argc,
+                        char **argv,
+                        int   *exit_code);
+
+#endif  /* GJS_ZYGOTE_H */
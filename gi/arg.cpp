@@ -1670,6 +1670,14 @@ gjs_value_to_g_argument(JSContext      *context,
                     if (g_type_is_a(gtype, G_TYPE_BYTES)
                         && gjs_typecheck_bytearray(context, obj, false)) {
                         arg->v_pointer = gjs_byte_array_get_bytes(context, obj);
+                        if (!arg->v_pointer)
+                            wrong = true;
+                    } else if (g_type_is_a(gtype, G_TYPE_BYTES) &&
+                               gjs_typecheck_array_buffer(obj)) {
+                        /* Owned by obj, which the caller keeps alive */
+                        arg->v_pointer = gjs_array_buffer_peek_bytes(context, obj);
+                        if (!arg->v_pointer)
+                            wrong = true;
                     } else if (g_type_is_a(gtype, G_TYPE_ERROR)) {
                         if (!gjs_typecheck_gerror(context, obj, true)) {
                             arg->v_pointer = NULL;
@@ -1951,6 +1959,8 @@ gjs_value_to_g_argument(JSContext      *context,
             if (gjs_typecheck_bytearray(context, bytearray_obj, false)
                 && array_type == GI_ARRAY_TYPE_BYTE_ARRAY) {
                 arg->v_pointer = gjs_byte_array_get_byte_array(context, bytearray_obj);
+                if (!arg->v_pointer)
+                    return false;
                 break;
             } else {
                 /* Fall through, !handled */
@@ -35,6 +35,8 @@
 #include "proxyutils.h"
 #include "function.h"
 #include "gtype.h"
+#include "variant.h"
+#include "cjs/jsapi-util-args.h"
 
 #include <util/log.h>
 
@@ -325,11 +327,20 @@ boxed_new(JSContext             *context,
           JS::CallArgs&          args)
 {
     if (priv->gtype == G_TYPE_VARIANT) {
-        /* Short-circuit construction for GVariants by calling into the JS packing
-           function */
-        JS::HandleId constructor_name =
-            gjs_context_get_const_string(context, GJS_STRING_NEW_INTERNAL);
-        return boxed_invoke_constructor(context, obj, constructor_name, args);
+        /* Short-circuit construction for GVariants, which are packed from a
+           signature and a JS value */
+        GjsAutoJSChar signature;
+        GVariant *variant;
+
+        if (!gjs_parse_call_args(context, "Variant", args, "!s",
+                                 "signature", &signature))
+            return false;
+
+        if (!gjs_variant_pack(context, signature, args.get(1), &variant))
+            return false;
+
+        priv->gboxed = g_variant_ref_sink(variant);
+        return true;
     }
 
     /* If the structure is registered as a boxed, we can create a new instance by
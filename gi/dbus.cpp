@@ -0,0 +1,906 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <unordered_map>
+
+#include <gio/gio.h>
+
+#include "dbus.h"
+#include "boxed.h"
+#include "closure.h"
+#include "gerror.h"
+#include "object.h"
+#include "variant.h"
+#include "cjs/context-private.h"
+#include "cjs/jsapi-util-args.h"
+#include "cjs/jsapi-wrapper.h"
+#include "libgjs-private/gjs-gdbus-wrapper.h"
+#include <util/log.h>
+
+/* Method calls on JS objects exported with Gio.DBusExportedObject.wrapJSObject()
+ * are dispatched here by the GjsDBusImplementation, without a signal emission
+ * and without going through JS to unpack the arguments and pack the reply.
+ *
+ * The table is built once per exported object. Handlers are still looked up
+ * on the JS object for each call, as before, so they may be replaced after
+ * the object is exported; but the property keys and the reply types are only
+ * computed once. The JS object is kept in a property of the implementation's
+ * wrapper, so that it is traced along with the wrapper rather than rooted. */
+
+typedef struct {
+    /* Pinned atoms, which are never collected or moved */
+    jsid name;
+    jsid async_name;
+
+    GVariantType *out_type;
+    GVariantType *single_out_type;  /* if there is exactly one out arg */
+} DBusMethod;
+
+typedef struct {
+    GDBusInterfaceInfo *info;
+    GHashTable *methods;  /* method name, owned by @info -> DBusMethod */
+    jsid exported_object_name;
+} DBusDispatch;
+
+static void
+dbus_method_free(void *data)
+{
+    auto method = static_cast<DBusMethod *>(data);
+
+    if (method->out_type)
+        g_variant_type_free(method->out_type);
+    if (method->single_out_type)
+        g_variant_type_free(method->single_out_type);
+    g_slice_free(DBusMethod, method);
+}
+
+static void
+dbus_dispatch_free(void *data)
+{
+    auto dispatch = static_cast<DBusDispatch *>(data);
+
+    g_hash_table_unref(dispatch->methods);
+    g_dbus_interface_info_unref(dispatch->info);
+    g_slice_free(DBusDispatch, dispatch);
+}
+
+static DBusDispatch *
+dbus_dispatch_new(JSContext          *cx,
+                  GDBusInterfaceInfo *info)
+{
+    auto dispatch = g_slice_new0(DBusDispatch);
+    dispatch->info = g_dbus_interface_info_ref(info);
+    dispatch->methods = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              nullptr, dbus_method_free);
+    dispatch->exported_object_name =
+        gjs_intern_string_to_id(cx, "__gjsDBusExportedObject");
+
+    for (GDBusMethodInfo **methods = info->methods; methods && *methods;
+         methods++) {
+        GDBusMethodInfo *method_info = *methods;
+        GString *out_signature = g_string_new("(");
+        unsigned n_out_args = 0;
+
+        for (GDBusArgInfo **args = method_info->out_args; args && *args;
+             args++, n_out_args++)
+            g_string_append(out_signature, (*args)->signature);
+        g_string_append_c(out_signature, ')');
+
+        if (!g_variant_type_string_is_valid(out_signature->str)) {
+            gjs_throw(cx, "Invalid out signature %s for D-Bus method %s.%s",
+                      out_signature->str, info->name, method_info->name);
+            g_string_free(out_signature, true);
+            dbus_dispatch_free(dispatch);
+            return nullptr;
+        }
+
+        auto method = g_slice_new0(DBusMethod);
+        method->name = gjs_intern_string_to_id(cx, method_info->name);
+        GjsAutoChar async_name = g_strconcat(method_info->name, "Async",
+                                             nullptr);
+        method->async_name = gjs_intern_string_to_id(cx, async_name);
+        method->out_type = g_variant_type_new(out_signature->str);
+        if (n_out_args == 1)
+            method->single_out_type =
+                g_variant_type_new(method_info->out_args[0]->signature);
+
+        g_hash_table_replace(dispatch->methods, method_info->name, method);
+        g_string_free(out_signature, true);
+    }
+
+    return dispatch;
+}
+
+/* Unpacks the arguments tuple into one JS value per argument */
+static bool
+dbus_unpack_parameters(JSContext           *cx,
+                       GVariant            *parameters,
+                       JS::AutoValueVector& args)
+{
+    if (!args.resize(g_variant_n_children(parameters))) {
+        JS_ReportOutOfMemory(cx);
+        return false;
+    }
+
+    GVariantIter iter;
+    GVariant *child;
+    size_t ix = 0;
+    g_variant_iter_init(&iter, parameters);
+    while ((child = g_variant_iter_next_value(&iter))) {
+        bool ok = gjs_variant_unpack(cx, child, GJS_VARIANT_UNPACK_DEEP,
+                                     args[ix++]);
+        g_variant_unref(child);
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+/* Packs the return value of a handler: a GLib.Variant is returned as is,
+ * undefined is an empty tuple, and anything else is packed according to the
+ * method's out args; if there is only one, it need not be wrapped in an
+ * array. */
+static bool
+dbus_pack_reply(JSContext       *cx,
+                DBusMethod      *method,
+                JS::HandleValue  retval,
+                GVariant       **reply_out)
+{
+    if (retval.isUndefined()) {
+        *reply_out = g_variant_new_tuple(nullptr, 0);
+        return true;
+    }
+
+    if (retval.isObject()) {
+        JS::RootedObject obj(cx, &retval.toObject());
+        if (gjs_typecheck_boxed(cx, obj, nullptr, G_TYPE_VARIANT, false)) {
+            *reply_out = static_cast<GVariant *>(gjs_c_struct_from_boxed(cx, obj));
+            return true;
+        }
+    }
+
+    if (method->single_out_type) {
+        GVariant *child;
+        if (!gjs_variant_pack_type(cx, method->single_out_type, retval, &child))
+            return false;
+        *reply_out = g_variant_new_tuple(&child, 1);
+        return true;
+    }
+
+    return gjs_variant_pack_type(cx, method->out_type, retval, reply_out);
+}
+
+/* Returns the pending exception to the caller: GLib.Errors as themselves,
+ * anything else as a D-Bus error named after the JS error */
+static void
+dbus_return_exception(JSContext             *cx,
+                      GDBusMethodInvocation *invocation,
+                      const char            *method_name)
+{
+    JS::RootedValue exc(cx);
+    if (!JS_GetPendingException(cx, &exc)) {
+        g_dbus_method_invocation_return_dbus_error(invocation,
+            "org.gnome.gjs.JSError.Error", "Uncatchable exception");
+        return;
+    }
+    JS_ClearPendingException(cx);
+
+    JS::RootedObject exc_obj(cx, exc.isObject() ? &exc.toObject() : nullptr);
+    if (exc_obj && gjs_typecheck_gerror(cx, exc_obj, false)) {
+        g_dbus_method_invocation_return_gerror(invocation,
+                                               gjs_gerror_from_error(cx, exc_obj));
+        return;
+    }
+
+    GjsAutoChar log_message = g_strdup_printf("Exception in method call: %s",
+                                              method_name);
+    JS::RootedString log_message_str(cx, JS_NewStringCopyZ(cx, log_message));
+    gjs_log_exception_full(cx, exc, log_message_str);
+
+    GjsAutoJSChar name, message;
+    JS::RootedValue v(cx);
+    if (exc_obj) {
+        if (gjs_object_get_property(cx, exc_obj, GJS_STRING_NAME, &v) &&
+            v.isString())
+            gjs_string_to_utf8(cx, v, &name);
+        if (gjs_object_get_property(cx, exc_obj, GJS_STRING_MESSAGE, &v) &&
+            v.isString())
+            gjs_string_to_utf8(cx, v, &message);
+    } else {
+        JSString *str = JS::ToString(cx, exc);
+        if (str) {
+            v.setString(str);
+            gjs_string_to_utf8(cx, v, &message);
+        }
+    }
+    JS_ClearPendingException(cx);
+
+    GjsAutoChar error_name;
+    if (!name)
+        error_name = "org.gnome.gjs.JSError.Error";
+    else if (!strchr(name, '.'))
+        error_name = g_strconcat("org.gnome.gjs.JSError.", name.get(), nullptr);
+    else
+        error_name = name.copy();
+
+    g_dbus_method_invocation_return_dbus_error(invocation, error_name,
+                                               message ? message.get() : "");
+}
+
+static void
+dbus_method_call(GjsDBusImplementation *impl,
+                 const char            *method_name,
+                 GVariant              *parameters,
+                 GDBusMethodInvocation *invocation,
+                 void                  *user_data)
+{
+    auto dispatch = static_cast<DBusDispatch *>(user_data);
+    auto method = static_cast<DBusMethod *>(g_hash_table_lookup(dispatch->methods,
+                                                                method_name));
+    GjsContext *gjs_context = gjs_context_get_current();
+
+    if (!method || !gjs_context) {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                              G_DBUS_ERROR_UNKNOWN_METHOD,
+                                              "Method %s is not implemented",
+                                              method_name);
+        return;
+    }
+
+    auto cx = static_cast<JSContext *>(gjs_context_get_native_context(gjs_context));
+    JSAutoRequest ar(cx);
+    JSAutoCompartment ac(cx, gjs_get_import_global(cx));
+
+    JS::RootedObject impl_obj(cx, gjs_object_from_g_object(cx, G_OBJECT(impl)));
+    JS::RootedId id(cx, dispatch->exported_object_name);
+    JS::RootedValue this_value(cx), handler(cx), retval(cx);
+    if (!impl_obj || !JS_GetPropertyById(cx, impl_obj, id, &this_value) ||
+        !this_value.isObject()) {
+        dbus_return_exception(cx, invocation, method_name);
+        return;
+    }
+    JS::RootedObject this_obj(cx, &this_value.toObject());
+
+    /* Prefer a sync handler if there is one */
+    id = method->name;
+    if (!JS_GetPropertyById(cx, this_obj, id, &handler)) {
+        dbus_return_exception(cx, invocation, method_name);
+        return;
+    }
+
+    JS::AutoValueVector args(cx);
+    if (JS::ToBoolean(handler)) {
+        GVariant *reply;
+
+        if (!dbus_unpack_parameters(cx, parameters, args) ||
+            !gjs_call_function_value(cx, this_obj, handler, args, &retval)) {
+            dbus_return_exception(cx, invocation, method_name);
+            return;
+        }
+
+        if (!dbus_pack_reply(cx, method, retval, &reply)) {
+            /* If we don't do this, the other side will never see a reply */
+            JS_ClearPendingException(cx);
+            g_dbus_method_invocation_return_dbus_error(invocation,
+                "org.gnome.gjs.JSError.ValueError",
+                "Service implementation returned an incorrect value type");
+            return;
+        }
+
+        g_dbus_method_invocation_return_value(invocation, reply);
+        return;
+    }
+
+    id = method->async_name;
+    if (!JS_GetPropertyById(cx, this_obj, id, &handler)) {
+        dbus_return_exception(cx, invocation, method_name);
+        return;
+    }
+
+    if (!JS::ToBoolean(handler)) {
+        g_message("Missing handler for DBus method %s", method_name);
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                              G_DBUS_ERROR_UNKNOWN_METHOD,
+                                              "Method %s is not implemented",
+                                              method_name);
+        return;
+    }
+
+    /* The async handler gets the arguments as one array, and returns the
+     * reply itself through the invocation */
+    JS::AutoValueArray<2> async_args(cx);
+    JSObject *params;
+    JSObject *invocation_obj;
+    if (!dbus_unpack_parameters(cx, parameters, args) ||
+        !(params = JS_NewArrayObject(cx, args)) ||
+        !(invocation_obj = gjs_object_from_g_object(cx, G_OBJECT(invocation)))) {
+        dbus_return_exception(cx, invocation, method_name);
+        return;
+    }
+    async_args[0].setObject(*params);
+    async_args[1].setObject(*invocation_obj);
+
+    if (!gjs_call_function_value(cx, this_obj, handler, async_args, &retval))
+        gjs_log_exception(cx);
+
+    /* The wrapper holds its own reference for the handler to reply with */
+    g_object_unref(invocation);
+}
+
+static bool
+dbus_export_object_func(JSContext *cx,
+                        unsigned   argc,
+                        JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    JS::RootedObject impl_obj(cx), js_obj(cx);
+
+    if (!gjs_parse_call_args(cx, "dbus_export_object", args, "oo",
+                             "implementation", &impl_obj,
+                             "object", &js_obj))
+        return false;
+
+    if (!gjs_typecheck_object(cx, impl_obj, GJS_TYPE_DBUS_IMPLEMENTATION,
+                              true))
+        return false;
+
+    auto impl = GJS_DBUS_IMPLEMENTATION(gjs_g_object_from_object(cx, impl_obj));
+    GDBusInterfaceInfo *info =
+        g_dbus_interface_skeleton_get_info(G_DBUS_INTERFACE_SKELETON(impl));
+
+    DBusDispatch *dispatch = dbus_dispatch_new(cx, info);
+    if (!dispatch)
+        return false;
+
+    /* Setting rather than defining the property makes the wrapper keep it,
+     * for as long as the implementation is alive */
+    JS::RootedId id(cx, dispatch->exported_object_name);
+    JS::RootedValue js_obj_value(cx, JS::ObjectValue(*js_obj));
+    if (!JS_SetPropertyById(cx, impl_obj, id, js_obj_value)) {
+        dbus_dispatch_free(dispatch);
+        return false;
+    }
+
+    gjs_dbus_implementation_set_method_call_func(impl, dbus_method_call,
+                                                 dispatch, dbus_dispatch_free);
+
+    args.rval().setUndefined();
+    return true;
+}
+
+/* Queues a property change, packing @value for the property's type unless it
+ * is a GLib.Variant already; null or undefined invalidate the property */
+static bool
+dbus_emit_property_changed_func(JSContext *cx,
+                                unsigned   argc,
+                                JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    JS::RootedObject impl_obj(cx);
+    GjsAutoJSChar name;
+
+    if (!gjs_parse_call_args(cx, "dbus_emit_property_changed", args, "os",
+                             "implementation", &impl_obj,
+                             "name", &name))
+        return false;
+
+    if (!gjs_typecheck_object(cx, impl_obj, GJS_TYPE_DBUS_IMPLEMENTATION,
+                              true))
+        return false;
+
+    auto impl = GJS_DBUS_IMPLEMENTATION(gjs_g_object_from_object(cx, impl_obj));
+    JS::HandleValue value = args.get(2);
+    GVariant *variant = nullptr;
+
+    if (value.isObject()) {
+        JS::RootedObject obj(cx, &value.toObject());
+        if (gjs_typecheck_boxed(cx, obj, nullptr, G_TYPE_VARIANT, false))
+            variant = static_cast<GVariant *>(gjs_c_struct_from_boxed(cx, obj));
+    }
+
+    if (!variant && !value.isNullOrUndefined()) {
+        GDBusInterfaceInfo *info =
+            g_dbus_interface_skeleton_get_info(G_DBUS_INTERFACE_SKELETON(impl));
+        GDBusPropertyInfo *prop_info =
+            g_dbus_interface_info_lookup_property(info, name);
+        if (!prop_info) {
+            gjs_throw(cx, "No property %s on D-Bus interface %s", name.get(),
+                      info->name);
+            return false;
+        }
+
+        if (!g_variant_type_string_is_valid(prop_info->signature) ||
+            !g_variant_type_is_definite(G_VARIANT_TYPE(prop_info->signature))) {
+            gjs_throw(cx, "Invalid signature %s for D-Bus property %s.%s",
+                      prop_info->signature, info->name, name.get());
+            return false;
+        }
+
+        if (!gjs_variant_pack_type(cx, G_VARIANT_TYPE(prop_info->signature),
+                                   value, &variant))
+            return false;
+    }
+
+    /* Sinks a floating variant */
+    gjs_dbus_implementation_emit_property_changed(impl, name.get(), variant);
+
+    args.rval().setUndefined();
+    return true;
+}
+
+/* Proxies get their methods from a table compiled once per interface info:
+ * a JS object that owns the prebuilt argument types and holds one native
+ * function for each of the FooRemote() and FooSync() methods, which are then
+ * set on every proxy for the interface. The functions keep the table alive;
+ * the context's GjsDBusProxyTables only point weakly to it, so a table is
+ * compiled again if all the proxies using it have gone away. */
+
+typedef struct {
+    const char *name;  /* owned by the interface info */
+    jsid remote_name;
+    jsid sync_name;
+    unsigned n_in_args;
+    GVariantType **in_types;
+} DBusProxyMethod;
+
+typedef struct {
+    GDBusInterfaceInfo *info;
+    unsigned n_methods;
+    DBusProxyMethod *methods;
+} DBusProxyInterface;
+
+enum {
+    SLOT_PROXY_METHOD_INDEX,
+    SLOT_PROXY_METHOD_TABLE,
+};
+
+
+static void
+dbus_proxy_interface_finalize(JSFreeOp *fop,
+                              JSObject *obj)
+{
+    auto iface = static_cast<DBusProxyInterface *>(JS_GetPrivate(obj));
+    if (!iface)
+        return;
+
+    for (unsigned ix = 0; ix < iface->n_methods; ix++) {
+        DBusProxyMethod *method = &iface->methods[ix];
+        for (unsigned arg = 0; arg < method->n_in_args; arg++)
+            g_variant_type_free(method->in_types[arg]);
+        g_free(method->in_types);
+    }
+    g_free(iface->methods);
+    g_dbus_interface_info_unref(iface->info);
+    g_slice_free(DBusProxyInterface, iface);
+}
+
+static const struct JSClassOps dbus_proxy_interface_class_ops = {
+    nullptr,  /* addProperty */
+    nullptr,  /* deleteProperty */
+    nullptr,  /* getProperty */
+    nullptr,  /* setProperty */
+    nullptr,  /* enumerate */
+    nullptr,  /* resolve */
+    nullptr,  /* mayResolve */
+    dbus_proxy_interface_finalize
+};
+
+static const JSClass dbus_proxy_interface_class = {
+    "GjsDBusProxyInterface",
+    JSCLASS_HAS_PRIVATE | JSCLASS_FOREGROUND_FINALIZE,
+    &dbus_proxy_interface_class_ops
+};
+
+static void
+update_proxy_tables_weak_pointers(JSContext     *cx,
+                                  JSCompartment *compartment,
+                                  void          *data)
+{
+    auto proxy_tables = static_cast<GjsDBusProxyTables *>(data);
+    for (auto iter = proxy_tables->begin(); iter != proxy_tables->end(); ) {
+        JS_UpdateWeakPointerAfterGC(iter->second);
+
+        /* No read barriers are needed if the only thing we are doing with the
+         * pointer is comparing it to nullptr. */
+        if (iter->second->unbarrieredGet() == nullptr) {
+            delete iter->second;
+            iter = proxy_tables->erase(iter);
+        } else {
+            iter++;
+        }
+    }
+}
+
+static DBusProxyInterface *
+dbus_proxy_interface_from_call(JS::CallArgs&     args,
+                               DBusProxyMethod **method_out)
+{
+    JSObject *callee = &args.callee();
+    JSObject *table = &js::GetFunctionNativeReserved(callee,
+        SLOT_PROXY_METHOD_TABLE).toObject();
+    uint32_t index = js::GetFunctionNativeReserved(callee,
+        SLOT_PROXY_METHOD_INDEX).toPrivateUint32();
+
+    auto iface = static_cast<DBusProxyInterface *>(JS_GetPrivate(table));
+    *method_out = &iface->methods[index];
+    return iface;
+}
+
+/* Splits the arguments of a proxy method into the in args, packed into a
+ * tuple, and the optional trailing callback, call flags and cancellable */
+static bool
+dbus_proxy_parse_args(JSContext              *cx,
+                      DBusProxyMethod        *method,
+                      JS::CallArgs&           args,
+                      bool                    sync,
+                      GDBusProxy            **proxy_out,
+                      JS::MutableHandleObject callback,
+                      GDBusCallFlags         *flags,
+                      GCancellable          **cancellable,
+                      GVariant              **parameters)
+{
+    unsigned n_in_args = method->n_in_args;
+
+    if (!args.thisv().isObject()) {
+        gjs_throw(cx, "Method %s must be called on a Gio.DBusProxy",
+                  method->name);
+        return false;
+    }
+    JS::RootedObject proxy_obj(cx, &args.thisv().toObject());
+    if (!gjs_typecheck_object(cx, proxy_obj, G_TYPE_DBUS_PROXY, true))
+        return false;
+    *proxy_out = G_DBUS_PROXY(gjs_g_object_from_object(cx, proxy_obj));
+
+    if (args.length() < n_in_args) {
+        gjs_throw(cx, "Not enough arguments passed for method: %s. "
+                  "Expected %u, got %u", method->name, n_in_args,
+                  args.length());
+        return false;
+    }
+    if (args.length() > n_in_args + 3) {
+        gjs_throw(cx, "Too many arguments passed for method: %s. "
+                  "Maximum is %u + one callback and/or flags", method->name,
+                  n_in_args + 3);
+        return false;
+    }
+
+    JS::RootedObject obj(cx);
+    for (unsigned ix = args.length(); ix-- > n_in_args; ) {
+        JS::HandleValue arg = args[ix];
+
+        if (arg.isNumber()) {
+            *flags = GDBusCallFlags(JS::ToUint32(arg.toNumber()));
+            continue;
+        }
+
+        if (arg.isObject()) {
+            obj = &arg.toObject();
+            if (!sync && JS::IsCallable(obj)) {
+                callback.set(obj);
+                continue;
+            }
+            if (gjs_typecheck_object(cx, obj, G_TYPE_CANCELLABLE, false)) {
+                *cancellable = G_CANCELLABLE(gjs_g_object_from_object(cx, obj));
+                continue;
+            }
+        }
+
+        gjs_throw(cx, "Argument %u of method %s is %s. It should be a "
+                  "callback, flags or a Gio.Cancellable", ix, method->name,
+                  JS_GetTypeName(cx, JS_TypeOfValue(cx, arg)));
+        return false;
+    }
+
+    GVariant **children = g_newa(GVariant *, n_in_args);
+    for (unsigned ix = 0; ix < n_in_args; ix++) {
+        if (!gjs_variant_pack_type(cx, method->in_types[ix], args[ix],
+                                   &children[ix])) {
+            while (ix--)
+                g_variant_unref(g_variant_ref_sink(children[ix]));
+            return false;
+        }
+    }
+    *parameters = g_variant_new_tuple(children, n_in_args);
+    return true;
+}
+
+static bool
+dbus_proxy_call_sync_func(JSContext *cx,
+                          unsigned   argc,
+                          JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    DBusProxyMethod *method;
+    GDBusProxy *proxy;
+    JS::RootedObject callback(cx);
+    GDBusCallFlags flags = G_DBUS_CALL_FLAGS_NONE;
+    GCancellable *cancellable = nullptr;
+    GVariant *parameters;
+    GError *error = nullptr;
+
+    dbus_proxy_interface_from_call(args, &method);
+    if (!dbus_proxy_parse_args(cx, method, args, true, &proxy, &callback,
+                               &flags, &cancellable, &parameters))
+        return false;
+
+    GVariant *reply = g_dbus_proxy_call_sync(proxy, method->name, parameters,
+                                             flags, -1, cancellable, &error);
+    if (!reply) {
+        gjs_throw_g_error(cx, error);
+        return false;
+    }
+
+    bool ok = gjs_variant_unpack(cx, reply, GJS_VARIANT_UNPACK_DEEP,
+                                 args.rval());
+    g_variant_unref(reply);
+    return ok;
+}
+
+/* Calls the reply callback with the unpacked out args, or with an empty
+ * array and the error. Without a callback, errors are only logged. */
+static void
+dbus_proxy_call_done(GObject      *source,
+                     GAsyncResult *result,
+                     void         *data)
+{
+    auto closure = static_cast<GClosure *>(data);
+    GError *error = nullptr;
+    GVariant *reply = g_dbus_proxy_call_finish(G_DBUS_PROXY(source), result,
+                                               &error);
+
+    if (!closure) {
+        if (!reply)
+            g_message("Ignored exception from dbus method: %s",
+                      error->message);
+    } else if (gjs_closure_is_valid(closure)) {
+        JSContext *cx = gjs_closure_get_context(closure);
+        JSAutoRequest ar(cx);
+        JSAutoCompartment ac(cx, gjs_closure_get_callable(closure));
+
+        JS::AutoValueArray<2> reply_args(cx);
+        JS::RootedObject this_obj(cx);
+        JS::RootedValue rval(cx);
+        bool ok;
+
+        if (reply) {
+            ok = gjs_variant_unpack(cx, reply, GJS_VARIANT_UNPACK_DEEP,
+                                    reply_args[0]);
+            reply_args[1].setNull();
+        } else {
+            JSObject *empty = JS_NewArrayObject(cx, 0);
+            JSObject *error_obj = gjs_error_from_gerror(cx, error, true);
+            ok = empty && error_obj;
+            if (ok) {
+                reply_args[0].setObject(*empty);
+                reply_args[1].setObject(*error_obj);
+            }
+        }
+
+        if (ok)
+            gjs_closure_invoke(closure, this_obj, reply_args, &rval, false);
+        else
+            gjs_log_exception(cx);
+    }
+
+    if (reply)
+        g_variant_unref(reply);
+    g_clear_error(&error);
+    if (closure) {
+        g_closure_invalidate(closure);
+        g_closure_unref(closure);
+    }
+}
+
+static bool
+dbus_proxy_call_func(JSContext *cx,
+                     unsigned   argc,
+                     JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    DBusProxyMethod *method;
+    GDBusProxy *proxy;
+    JS::RootedObject callback(cx);
+    GDBusCallFlags flags = G_DBUS_CALL_FLAGS_NONE;
+    GCancellable *cancellable = nullptr;
+    GVariant *parameters;
+
+    dbus_proxy_interface_from_call(args, &method);
+    if (!dbus_proxy_parse_args(cx, method, args, false, &proxy, &callback,
+                               &flags, &cancellable, &parameters))
+        return false;
+
+    GClosure *closure = nullptr;
+    if (callback) {
+        closure = gjs_closure_new(cx, callback, method->name, true);
+        g_closure_ref(closure);
+        g_closure_sink(closure);
+    }
+
+    g_dbus_proxy_call(proxy, method->name, parameters, flags, -1, cancellable,
+                      dbus_proxy_call_done, closure);
+
+    args.rval().setUndefined();
+    return true;
+}
+
+static bool
+dbus_proxy_define_method(JSContext       *cx,
+                         JS::HandleObject table,
+                         unsigned         index,
+                         JSNative         call,
+                         const char      *name,
+                         unsigned         nargs,
+                         jsid            *id_out)
+{
+    JSFunction *func = js::NewFunctionWithReserved(cx, call, nargs, 0, name);
+    if (!func)
+        return false;
+
+    JS::RootedObject func_obj(cx, JS_GetFunctionObject(func));
+    js::SetFunctionNativeReserved(func_obj, SLOT_PROXY_METHOD_INDEX,
+                                  JS::PrivateUint32Value(index));
+    js::SetFunctionNativeReserved(func_obj, SLOT_PROXY_METHOD_TABLE,
+                                  JS::ObjectValue(*table));
+
+    *id_out = gjs_intern_string_to_id(cx, name);
+    JS::RootedId id(cx, *id_out);
+    return JS_DefinePropertyById(cx, table, id, func_obj,
+                                 GJS_MODULE_PROP_FLAGS);
+}
+
+static JSObject *
+dbus_proxy_interface_new(JSContext          *cx,
+                         GDBusInterfaceInfo *info)
+{
+    JS::RootedObject table(cx, JS_NewObject(cx, &dbus_proxy_interface_class));
+    if (!table)
+        return nullptr;
+
+    /* From here on, the finalizer frees whatever has been compiled */
+    auto iface = g_slice_new0(DBusProxyInterface);
+    iface->info = g_dbus_interface_info_ref(info);
+    JS_SetPrivate(table, iface);
+
+    unsigned n_methods = 0;
+    while (info->methods && info->methods[n_methods])
+        n_methods++;
+    iface->methods = g_new0(DBusProxyMethod, n_methods);
+    iface->n_methods = n_methods;
+
+    for (unsigned ix = 0; ix < n_methods; ix++) {
+        GDBusMethodInfo *method_info = info->methods[ix];
+        DBusProxyMethod *method = &iface->methods[ix];
+        method->name = method_info->name;
+
+        unsigned n_in_args = 0;
+        while (method_info->in_args && method_info->in_args[n_in_args])
+            n_in_args++;
+        method->in_types = g_new0(GVariantType *, n_in_args);
+
+        for (unsigned arg = 0; arg < n_in_args; arg++) {
+            const char *signature = method_info->in_args[arg]->signature;
+            if (!g_variant_type_string_is_valid(signature) ||
+                !g_variant_type_is_definite(G_VARIANT_TYPE(signature))) {
+                gjs_throw(cx, "Invalid signature %s for argument %u of D-Bus "
+                          "method %s.%s", signature, arg, info->name,
+                          method_info->name);
+                return nullptr;
+            }
+            method->in_types[arg] = g_variant_type_new(signature);
+            method->n_in_args++;
+        }
+
+        GjsAutoChar remote_name = g_strconcat(method->name, "Remote", nullptr);
+        GjsAutoChar sync_name = g_strconcat(method->name, "Sync", nullptr);
+        if (!dbus_proxy_define_method(cx, table, ix, dbus_proxy_call_func,
+                                      remote_name, n_in_args,
+                                      &method->remote_name) ||
+            !dbus_proxy_define_method(cx, table, ix, dbus_proxy_call_sync_func,
+                                      sync_name, n_in_args,
+                                      &method->sync_name))
+            return nullptr;
+    }
+
+    return table;
+}
+
+static bool
+dbus_proxy_add_methods_func(JSContext *cx,
+                            unsigned   argc,
+                            JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    JS::RootedObject proxy_obj(cx), table(cx);
+
+    if (!gjs_parse_call_args(cx, "dbus_proxy_add_methods", args, "o",
+                             "proxy", &proxy_obj))
+        return false;
+
+    if (!gjs_typecheck_object(cx, proxy_obj, G_TYPE_DBUS_PROXY, true))
+        return false;
+
+    auto proxy = G_DBUS_PROXY(gjs_g_object_from_object(cx, proxy_obj));
+    GDBusInterfaceInfo *info = g_dbus_proxy_get_interface_info(proxy);
+    args.rval().setUndefined();
+    if (!info)
+        return true;
+
+    auto gjs_cx = static_cast<GjsContext *>(JS_GetContextPrivate(cx));
+    GjsDBusProxyTables *proxy_tables = _gjs_context_get_dbus_proxy_tables(gjs_cx);
+    auto entry = proxy_tables->find(info);
+    if (entry != proxy_tables->end()) {
+        table = entry->second->get();
+    } else {
+        table = dbus_proxy_interface_new(cx, info);
+        if (!table)
+            return false;
+
+        if (!proxy_tables->weak_pointer_callback) {
+            JS_AddWeakPointerCompartmentCallback(cx,
+                update_proxy_tables_weak_pointers, proxy_tables);
+            proxy_tables->weak_pointer_callback = true;
+        }
+        (*proxy_tables)[info] = new JS::Heap<JSObject *>(table);
+    }
+
+    /* Setting the methods, like any other expando property, makes the proxy's
+     * wrapper keep them */
+    auto iface = static_cast<DBusProxyInterface *>(JS_GetPrivate(table));
+    JS::RootedId id(cx);
+    JS::RootedValue func(cx);
+    for (unsigned ix = 0; ix < iface->n_methods; ix++) {
+        id = iface->methods[ix].remote_name;
+        if (!JS_GetPropertyById(cx, table, id, &func) ||
+            !JS_SetPropertyById(cx, proxy_obj, id, func))
+            return false;
+
+        id = iface->methods[ix].sync_name;
+        if (!JS_GetPropertyById(cx, table, id, &func) ||
+            !JS_SetPropertyById(cx, proxy_obj, id, func))
+            return false;
+    }
+
+    return true;
+}
+
+static JSFunctionSpec dbus_funcs[] = {
+    JS_FS("dbus_export_object", dbus_export_object_func, 2,
+          GJS_MODULE_PROP_FLAGS),
+    JS_FS("dbus_emit_property_changed", dbus_emit_property_changed_func, 3,
+          GJS_MODULE_PROP_FLAGS),
+    JS_FS("dbus_proxy_add_methods", dbus_proxy_add_methods_func, 1,
+          GJS_MODULE_PROP_FLAGS),
+    JS_FS_END,
+};
+
+bool
+gjs_define_dbus_stuff(JSContext       *cx,
+                      JS::HandleObject module)
+{
+    return JS_DefineFunctions(cx, module, dbus_funcs);
+}
@@ -0,0 +1,51 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_DBUS_H__
+#define __GJS_DBUS_H__
+
+#include <stdbool.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <unordered_map>
+
+#include "cjs/jsapi-util.h"
+
+G_BEGIN_DECLS
+
+bool gjs_define_dbus_stuff(JSContext       *cx,
+                           JS::HandleObject module);
+
+G_END_DECLS
+
+/* The proxy method tables of one GjsContext, keyed by the interface info they
+ * were built from. They are weak pointers, updated after each GC by a
+ * callback that is added when the first table is stored. */
+class GjsDBusProxyTables :
+    public std::unordered_map<GDBusInterfaceInfo *, JS::Heap<JSObject *> *> {
+public:
+    bool weak_pointer_callback = false;
+};
+
+#endif  /* __GJS_DBUS_H__ */
@@ -25,6 +25,7 @@
 #include <config.h>
 
 #include <set>
+#include <unordered_map>
 
 #include "gtype.h"
 #include "cjs/jsapi-class.h"
@@ -33,7 +34,9 @@
 #include <girepository.h>
 
 static bool weak_pointer_callback = false;
-static std::set<GType> weak_pointer_list;
+/* GTypes with wrappers, keyed by the compartment the wrapper lives in, so the
+ * weak pointer callback only looks at the compartment being swept */
+static std::unordered_map<JSCompartment *, std::set<GType>> weak_pointer_lists;
 
 static JSObject *gjs_gtype_get_proto(JSContext *) G_GNUC_UNUSED;
 static bool gjs_gtype_define_proto(JSContext *, JS::HandleObject,
@@ -62,6 +65,11 @@ update_gtype_weak_pointers(JSContext     *cx,
                            JSCompartment *compartment,
                            void          *data)
 {
+    auto list = weak_pointer_lists.find(compartment);
+    if (list == weak_pointer_lists.end())
+        return;
+
+    std::set<GType>& weak_pointer_list = list->second;
     for (auto iter = weak_pointer_list.begin(); iter != weak_pointer_list.end(); ) {
         auto heap_wrapper = static_cast<JS::Heap<JSObject *> *>(g_type_get_qdata(*iter, gjs_get_gtype_wrapper_quark()));
         JS_UpdateWeakPointerAfterGC(heap_wrapper);
@@ -95,7 +103,10 @@ gjs_gtype_finalize(JSFreeOp *fop,
     if (G_UNLIKELY(gtype == 0))
         return;
 
-    weak_pointer_list.erase(gtype);
+    /* The wrapper's compartment may not be safe to query during
+     * finalization, and there are only ever a handful of compartments */
+    for (auto& kv : weak_pointer_lists)
+        kv.second.erase(gtype);
     g_type_set_qdata(gtype, gjs_get_gtype_wrapper_quark(), NULL);
 }
 
@@ -177,7 +188,7 @@ gjs_gtype_create_gtype_wrapper (JSContext *context,
     JS_SetPrivate(*heap_wrapper, GSIZE_TO_POINTER(gtype));
     ensure_weak_pointer_callback(context);
     g_type_set_qdata(gtype, gjs_get_gtype_wrapper_quark(), heap_wrapper);
-    weak_pointer_list.insert(gtype);
+    weak_pointer_lists[js::GetObjectCompartment(*heap_wrapper)].insert(gtype);
 
     return *heap_wrapper;
 }
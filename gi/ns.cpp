@@ -35,11 +35,18 @@
 
 #include <string.h>
 
+#include <string>
+#include <vector>
+
 typedef struct {
     char *gi_namespace;
+    GjsNamespaceIndex *index;  /* null until the namespace is loaded */
 } Ns;
 
-extern struct JSClass gjs_ns_class;
+extern const js::Class gjs_ns_real_class;
+
+/* See importer.cpp */
+static const JSClass gjs_ns_class = *js::Jsvalify(&gjs_ns_real_class);
 
 GJS_DEFINE_PRIV_FROM_JS(Ns, gjs_ns_class)
 
@@ -85,9 +92,14 @@ ns_resolve(JSContext       *context,
         return true;  /* not resolved, but no error */
     }
 
-    repo = g_irepository_get_default();
-
-    info = g_irepository_find_by_name(repo, priv->gi_namespace, name);
+    if (!priv->index)
+        priv->index = GjsNamespaceIndex::get(priv->gi_namespace);
+    if (priv->index) {
+        info = priv->index->find(name);
+    } else {
+        repo = g_irepository_get_default();
+        info = g_irepository_find_by_name(repo, priv->gi_namespace, name);
+    }
     if (info == NULL) {
         *resolved = false; /* No property defined, but no error either */
         return true;
@@ -116,6 +128,33 @@ ns_resolve(JSContext       *context,
     return true;
 }
 
+/* Lists every name in the namespace that ns_resolve() can define; each is
+ * defined when it is first accessed */
+static bool
+ns_enumerate(JSContext        *cx,
+             JS::HandleObject  obj,
+             JS::AutoIdVector& properties,
+             bool              enumerable_only)
+{
+    Ns *priv = priv_from_js(cx, obj);
+    if (!priv)
+        return true;  /* we are the prototype */
+
+    if (!priv->index)
+        priv->index = GjsNamespaceIndex::get(priv->gi_namespace);
+    if (!priv->index)
+        return true;
+
+    const std::vector<std::string>& names = priv->index->names();
+    if (!properties.reserve(properties.length() + names.size()))
+        g_error("Unable to reserve space in vector");
+
+    for (const std::string& name : names)
+        properties.infallibleAppend(gjs_intern_string_to_id(cx, name.c_str()));
+
+    return true;
+}
+
 static bool
 get_name (JSContext *context,
           unsigned   argc,
@@ -154,21 +193,38 @@ ns_finalize(JSFreeOp *fop,
  * instances of the object, and to the prototype that instances of the
  * class have.
  */
-static const struct JSClassOps gjs_ns_class_ops = {
+static const js::ClassOps gjs_ns_class_ops = {
     NULL,  /* addProperty */
     NULL,  /* deleteProperty */
     NULL,  /* getProperty */
     NULL,  /* setProperty */
-    NULL,  /* enumerate */
+    NULL,  /* enumerate (see below) */
     ns_resolve,
     nullptr,  /* mayResolve */
     ns_finalize
 };
 
-struct JSClass gjs_ns_class = {
+static const js::ObjectOps gjs_ns_object_ops = {
+    NULL,  /* lookupProperty */
+    NULL,  /* defineProperty */
+    NULL,  /* hasProperty */
+    NULL,  /* getProperty */
+    NULL,  /* setProperty */
+    NULL,  /* getOwnPropertyDescriptor */
+    NULL,  /* deleteProperty */
+    NULL,  /* watch */
+    NULL,  /* unwatch */
+    NULL,  /* getElements */
+    ns_enumerate
+};
+
+const js::Class gjs_ns_real_class = {
     "GIRepositoryNamespace",
     JSCLASS_HAS_PRIVATE | JSCLASS_FOREGROUND_FINALIZE,
-    &gjs_ns_class_ops
+    &gjs_ns_class_ops,
+    nullptr,
+    nullptr,
+    &gjs_ns_object_ops
 };
 
 static JSPropertySpec gjs_ns_proto_props[] = {
@@ -208,6 +264,7 @@ ns_new(JSContext    *context,
 
     priv = priv_from_js(context, ns);
     priv->gi_namespace = g_strdup(ns_name);
+    priv->index = GjsNamespaceIndex::get(ns_name);
     return ns;
 }
 
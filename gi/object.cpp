@@ -44,6 +44,8 @@
 #include "toggle.h"
 #include "value.h"
 #include "closure.h"
+#include "dbus.h"
+#include "variant.h"
 #include "gjs_gi_trace.h"
 #include "cjs/jsapi-class.h"
 #include "cjs/jsapi-util-root.h"
@@ -56,6 +58,7 @@
 
 typedef class GjsListLink GjsListLink;
 typedef struct ObjectInstance ObjectInstance;
+typedef struct WrapperLists WrapperLists;
 
 static GjsListLink* object_instance_get_link(ObjectInstance *priv);
 
@@ -98,19 +101,17 @@ class GjsListLink {
         m_prev = m_next = NULL;
     }
 
-    size_t size() {
-        GjsListLink *elem = this;
-        size_t count = 0;
-
-        do {
-            count++;
-            if (!elem->m_next)
-                break;
-            elem = object_instance_get_link(elem->m_next);
-        } while (elem);
+};
 
-        return count;
-    }
+/* Wrappers are kept in per-compartment lists, so that the weak pointer
+ * callback, which SpiderMonkey calls once for each compartment being swept,
+ * only looks at wrappers that could have been collected in that GC. Rooted
+ * wrappers can't be collected at all, so they are kept in a separate list
+ * that is only walked at shutdown, and move between the two lists when
+ * their GObject is toggled up or down. */
+struct WrapperLists {
+    ObjectInstance *rooted;
+    ObjectInstance *weak;
 };
 
 struct ObjectInstance {
@@ -129,6 +130,11 @@ struct ObjectInstance {
 
     GjsListLink instance_link;
 
+    /* Lists for the compartment of the wrapper, and the head of the list
+     * that instance_link is currently part of (NULL if none) */
+    WrapperLists *lists;
+    ObjectInstance **list_head;
+
     unsigned js_object_finalized : 1;
     unsigned g_object_finalized  : 1;
 
@@ -145,7 +151,12 @@ using ParamRefArray = std::vector<ParamRef>;
 static std::unordered_map<GType, ParamRefArray> class_init_properties;
 
 static bool weak_pointer_callback = false;
-ObjectInstance *wrapped_gobject_list;
+/* Element addresses in an unordered_map are stable, so instances can keep
+ * pointers to their WrapperLists. Those pointers are only followed while the
+ * instance is in one of the lists, so an entry whose lists are both empty is
+ * erased after each sweep of its compartment, which is also how the entries
+ * of compartments that have been destroyed go away. */
+static std::unordered_map<JSCompartment *, WrapperLists> wrapped_gobject_lists;
 
 extern struct JSClass gjs_object_instance_class;
 GJS_DEFINE_PRIV_FROM_JS(ObjectInstance, gjs_object_instance_class)
@@ -1014,17 +1025,35 @@ object_instance_get_link(ObjectInstance *priv)
 static void
 object_instance_unlink(ObjectInstance *priv)
 {
-    if (wrapped_gobject_list == priv)
-        wrapped_gobject_list = priv->instance_link.next();
+    if (priv->list_head && *priv->list_head == priv)
+        *priv->list_head = priv->instance_link.next();
     priv->instance_link.unlink();
+    priv->list_head = nullptr;
 }
 
 static void
 object_instance_link(ObjectInstance *priv)
 {
-    if (wrapped_gobject_list)
-        priv->instance_link.prepend(priv, wrapped_gobject_list);
-    wrapped_gobject_list = priv;
+    g_assert(priv->lists);
+    g_assert(!priv->list_head);
+
+    ObjectInstance **head = priv->keep_alive.rooted() ?
+        &priv->lists->rooted : &priv->lists->weak;
+    if (*head)
+        priv->instance_link.prepend(priv, *head);
+    *head = priv;
+    priv->list_head = head;
+}
+
+/* Moves the instance into the list matching whether it is rooted, if it is
+ * in a list at all */
+static void
+object_instance_relink(ObjectInstance *priv)
+{
+    if (!priv->list_head)
+        return;
+    object_instance_unlink(priv);
+    object_instance_link(priv);
 }
 
 static void
@@ -1043,20 +1072,21 @@ void
 gjs_object_context_dispose_notify(void    *data,
                                   GObject *where_the_object_was)
 {
-    ObjectInstance *priv = wrapped_gobject_list;
-    while (priv) {
-        ObjectInstance *next = priv->instance_link.next();
+    for (auto& kv : wrapped_gobject_lists) {
+        ObjectInstance *priv = kv.second.rooted;
+        while (priv) {
+            ObjectInstance *next = priv->instance_link.next();
 
-        if (priv->keep_alive.rooted()) {
+            g_assert(priv->keep_alive.rooted());
             gjs_debug_lifecycle(GJS_DEBUG_GOBJECT, "GObject wrapper %p for GObject "
                                 "%p (%s) was rooted but is now unrooted due to "
                                 "GjsContext dispose", priv->keep_alive.get(),
                                 priv->gobj, G_OBJECT_TYPE_NAME(priv->gobj));
             priv->keep_alive.reset();
             object_instance_unlink(priv);
-        }
 
-        priv = next;
+            priv = next;
+        }
     }
 }
 
@@ -1077,6 +1107,7 @@ handle_toggle_down(GObject *gobj)
 
         gjs_debug_lifecycle(GJS_DEBUG_GOBJECT, "Unrooting object");
         priv->keep_alive.switch_to_unrooted();
+        object_instance_relink(priv);
 
         /* During a GC, the collector asks each object which other
          * objects that it wants to hold on to so if there's an entire
@@ -1126,6 +1157,7 @@ handle_toggle_up(GObject   *gobj)
         gjs_debug_lifecycle(GJS_DEBUG_GOBJECT, "Rooting object");
         auto cx = static_cast<JSContext *>(gjs_context_get_native_context(context));
         priv->keep_alive.switch_to_rooted(cx);
+        object_instance_relink(priv);
     }
 }
 
@@ -1267,15 +1299,14 @@ gjs_object_prepare_shutdown(void)
      *   toggle ref removal -> gobj dispose -> toggle ref notify
      * by emptying the toggle queue earlier in the shutdown sequence. */
     std::vector<ObjectInstance *> to_be_released;
-    ObjectInstance *link = wrapped_gobject_list;
-    while (link) {
-        ObjectInstance *next = link->instance_link.next();
-        if (link->keep_alive.rooted()) {
+    for (auto& kv : wrapped_gobject_lists) {
+        ObjectInstance *link = kv.second.rooted;
+        while (link) {
+            ObjectInstance *next = link->instance_link.next();
             to_be_released.push_back(link);
             object_instance_unlink(link);
+            link = next;
         }
-
-        link = next;
     }
     for (ObjectInstance *priv : to_be_released)
         release_native_object(priv);
@@ -1319,18 +1350,20 @@ update_heap_wrapper_weak_pointers(JSContext     *cx,
                                   JSCompartment *compartment,
                                   gpointer       data)
 {
-    gjs_debug_lifecycle(GJS_DEBUG_GOBJECT, "Weak pointer update callback, "
-                        "%zu wrapped GObject(s) to examine",
-                        wrapped_gobject_list->instance_link.size());
+    auto lists = wrapped_gobject_lists.find(compartment);
+    if (lists == wrapped_gobject_lists.end())
+        return;
 
     std::vector<ObjectInstance *> to_be_disassociated;
-    ObjectInstance *priv = wrapped_gobject_list;
+    ObjectInstance *priv = lists->second.weak;
+    size_t n_examined = 0;
 
     while (priv) {
         ObjectInstance *next = priv->instance_link.next();
+        n_examined++;
 
-        if (!priv->keep_alive.rooted() &&
-            priv->keep_alive != nullptr &&
+        g_assert(!priv->keep_alive.rooted());
+        if (priv->keep_alive != nullptr &&
             priv->keep_alive.update_after_gc()) {
             /* Ouch, the JS object is dead already. Disassociate the
              * GObject and hope the GObject dies too. (Remove it from
@@ -1348,8 +1381,18 @@ update_heap_wrapper_weak_pointers(JSContext     *cx,
         priv = next;
     }
 
+    gjs_debug_lifecycle(GJS_DEBUG_GOBJECT, "Weak pointer update callback, "
+                        "examined %zu unrooted wrapper(s), %zu dead",
+                        n_examined, to_be_disassociated.size());
+
     for (ObjectInstance *ex_object : to_be_disassociated)
         disassociate_js_gobject(ex_object);
+
+    /* Looked up again, in case disassociating changed the map */
+    lists = wrapped_gobject_lists.find(compartment);
+    if (lists != wrapped_gobject_lists.end() &&
+        !lists->second.weak && !lists->second.rooted)
+        wrapped_gobject_lists.erase(lists);
 }
 
 static void
@@ -1380,6 +1423,7 @@ associate_js_gobject (JSContext       *context,
 
     priv->keep_alive = object;
     ensure_weak_pointer_callback(context);
+    priv->lists = &wrapped_gobject_lists[js::GetObjectCompartment(object)];
     object_instance_link(priv);
 
     g_object_weak_ref(gobj, wrapped_gobj_dispose_notify, priv);
@@ -1407,6 +1451,7 @@ ensure_uses_toggle_ref(JSContext      *cx,
      */
     priv->uses_toggle_ref = true;
     priv->keep_alive.switch_to_rooted(cx);
+    object_instance_relink(priv);
     g_object_add_toggle_ref(priv->gobj, wrapped_gobj_toggle_notify, nullptr);
 
     /* We now have both a ref and a toggle ref, we only want the toggle ref.
@@ -3199,7 +3244,9 @@ gjs_define_private_gi_stuff(JSContext              *cx,
                             JS::MutableHandleObject module)
 {
     module.set(JS_NewPlainObject(cx));
-    return JS_DefineFunctions(cx, module, &module_funcs[0]);
+    return JS_DefineFunctions(cx, module, &module_funcs[0]) &&
+        gjs_define_variant_stuff(cx, module) &&
+        gjs_define_dbus_stuff(cx, module);
 }
 
 bool
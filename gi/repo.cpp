@@ -45,6 +45,8 @@
 #include <girepository.h>
 #include <string.h>
 
+#include <memory>
+
 typedef struct {
     void *dummy;
 
@@ -55,8 +57,102 @@ extern struct JSClass gjs_repo_class;
 GJS_DEFINE_PRIV_FROM_JS(Repo, gjs_repo_class)
 
 static bool lookup_override_function(JSContext *, JS::HandleId,
+                                     GjsNamespaceIndex *,
                                      JS::MutableHandleValue);
 
+/* Namespaces are never unloaded, so neither are their indices */
+static std::unordered_map<std::string, std::unique_ptr<GjsNamespaceIndex>>
+    namespace_indices;
+
+/* Whether gjs_define_info() can define @info, without initializing its
+ * GType */
+static bool
+info_is_definable(GIBaseInfo *info)
+{
+    switch (g_base_info_get_type(info)) {
+    case GI_INFO_TYPE_FUNCTION:
+    case GI_INFO_TYPE_BOXED:
+    case GI_INFO_TYPE_UNION:
+    case GI_INFO_TYPE_ENUM:
+    case GI_INFO_TYPE_FLAGS:
+    case GI_INFO_TYPE_CONSTANT:
+    case GI_INFO_TYPE_INTERFACE:
+        return true;
+    case GI_INFO_TYPE_STRUCT:
+        return !g_struct_info_is_gtype_struct((GIStructInfo *) info);
+    case GI_INFO_TYPE_OBJECT:
+        /* Without a get_type function the GType is G_TYPE_NONE, which
+         * gjs_define_info() throws on */
+        return g_registered_type_info_get_type_init((GIRegisteredTypeInfo *) info) != nullptr;
+    default:
+        return false;
+    }
+}
+
+GjsNamespaceIndex::GjsNamespaceIndex(const char *ns) :
+    m_namespace(ns)
+{
+    GIRepository *repo = g_irepository_get_default();
+    int n_infos = g_irepository_get_n_infos(repo, ns);
+    m_infos.reserve(n_infos);
+
+    for (int ix = 0; ix < n_infos; ix++) {
+        GIBaseInfo *info = g_irepository_get_info(repo, ns, ix);
+        const char *name = g_base_info_get_name(info);
+        if (info_is_definable(info))
+            m_names.push_back(name);
+        if (!m_infos.emplace(name, info).second)
+            g_base_info_unref(info);
+    }
+
+    gjs_debug(GJS_DEBUG_GNAMESPACE, "Indexed %d names in namespace '%s', "
+              "%zu of them definable", n_infos, ns, m_names.size());
+}
+
+GjsNamespaceIndex::~GjsNamespaceIndex()
+{
+    for (auto& kv : m_infos)
+        g_base_info_unref(kv.second);
+}
+
+/**
+ * GjsNamespaceIndex::get:
+ * @ns: name of a GI namespace
+ *
+ * Returns: the index for @ns, creating it if necessary, or %NULL if @ns has
+ * not been loaded into the repository yet or the index is disabled.
+ */
+GjsNamespaceIndex *
+GjsNamespaceIndex::get(const char *ns)
+{
+    static int enabled = -1;
+    if (enabled < 0)
+        enabled = !g_getenv("GJS_DISABLE_NS_INDEX");
+    if (!enabled)
+        return nullptr;
+
+    auto iter = namespace_indices.find(ns);
+    if (iter != namespace_indices.end())
+        return iter->second.get();
+
+    if (!g_irepository_is_registered(g_irepository_get_default(), ns, nullptr))
+        return nullptr;
+
+    auto index = new GjsNamespaceIndex(ns);
+    namespace_indices.emplace(ns, std::unique_ptr<GjsNamespaceIndex>(index));
+    return index;
+}
+
+/* Like g_irepository_find_by_name(), returns a new reference or %NULL */
+GIBaseInfo *
+GjsNamespaceIndex::find(const char *name)
+{
+    auto iter = m_infos.find(name);
+    if (iter == m_infos.end())
+        return nullptr;
+    return g_base_info_ref(iter->second);
+}
+
 static bool
 get_version_for_ns (JSContext       *context,
                     JS::HandleObject repo_obj,
@@ -119,6 +215,8 @@ resolve_namespace_object(JSContext       *context,
         return false;
     }
 
+    GjsNamespaceIndex *index = GjsNamespaceIndex::get(ns_name);
+
     /* Defines a property on "obj" (the javascript repo object)
      * with the given namespace name, pointing to that namespace
      * in the repo.
@@ -132,7 +230,7 @@ resolve_namespace_object(JSContext       *context,
         g_error("no memory to define ns property");
 
     JS::RootedValue override(context);
-    if (!lookup_override_function(context, ns_id, &override))
+    if (!lookup_override_function(context, ns_id, index, &override))
         return false;
 
     JS::RootedValue result(context);
@@ -572,9 +670,50 @@ out:
     return retval;
 }
 
+/* Joins the elements of @importer's search path into @key, or leaves it
+ * empty if the search path isn't an array of strings */
+static bool
+get_search_path_key(JSContext       *cx,
+                    JS::HandleObject importer,
+                    std::string     *key)
+{
+    JS::RootedValue search_path(cx);
+    if (!gjs_object_get_property(cx, importer, GJS_STRING_SEARCH_PATH,
+                                 &search_path))
+        return false;
+
+    bool is_array;
+    if (!search_path.isObject() ||
+        !JS_IsArrayObject(cx, search_path, &is_array) || !is_array)
+        return true;
+
+    JS::RootedObject search_path_obj(cx, &search_path.toObject());
+    uint32_t len;
+    if (!JS_GetArrayLength(cx, search_path_obj, &len))
+        return false;
+
+    JS::RootedValue elem(cx);
+    std::string joined;
+    for (uint32_t ix = 0; ix < len; ix++) {
+        if (!JS_GetElement(cx, search_path_obj, ix, &elem))
+            return false;
+        if (!elem.isString())
+            return true;
+
+        GjsAutoJSChar dirname = JS_EncodeStringToUTF8(cx, elem.toString());
+        if (!dirname)
+            return false;
+        joined += dirname.get();
+        joined += '\n';
+    }
+    *key = std::move(joined);
+    return true;
+}
+
 static bool
 lookup_override_function(JSContext             *cx,
                          JS::HandleId           ns_name,
+                         GjsNamespaceIndex     *index,
                          JS::MutableHandleValue function)
 {
     JSAutoRequest ar(cx);
@@ -585,12 +724,31 @@ lookup_override_function(JSContext             *cx,
 
     JS::RootedObject overridespkg(cx), module(cx);
     JS::RootedObject importer_obj(cx, &importer.toObject());
+    std::string search_path;
+    bool already_imported;
 
     if (!gjs_object_require_property(cx, importer_obj, "importer",
                                      GJS_STRING_GI_OVERRIDES,
                                      &overridespkg))
         goto fail;
 
+    /* Most namespaces have no override module, and finding that out means
+     * searching the overrides importer's path and throwing an ImportError.
+     * The namespace's index remembers the search paths where that happened,
+     * so other contexts don't repeat it. */
+    if (index) {
+        if (!JS_AlreadyHasOwnPropertyById(cx, overridespkg, ns_name,
+                                          &already_imported) ||
+            !get_search_path_key(cx, overridespkg, &search_path))
+            goto fail;
+
+        if (!already_imported && !search_path.empty() &&
+            index->has_no_override_in(search_path)) {
+            function.setUndefined();
+            return true;
+        }
+    }
+
     if (!gjs_object_require_property(cx, overridespkg,
                                      "GI repository object", ns_name,
                                      &module)) {
@@ -600,6 +758,8 @@ lookup_override_function(JSContext             *cx,
         /* If the exception was an ImportError (i.e., module not found) then
          * we simply didn't have an override, don't throw an exception */
         if (error_has_name(cx, exc, JS_AtomizeAndPinString(cx, "ImportError"))) {
+            if (index && !search_path.empty())
+                index->set_no_override_in(search_path);
             saved_exc.restore();
             return true;
         }
@@ -27,6 +27,11 @@
 #include <stdbool.h>
 #include <glib.h>
 
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include <girepository.h>
 
 #include "cjs/jsapi-wrapper.h"
@@ -65,4 +70,39 @@ void _gjs_log_info_usage(GIBaseInfo *info);
 
 G_END_DECLS
 
+/* Hash index of the top-level names in a loaded GI namespace, shared by all
+ * contexts. It is built in one pass over the typelib when the namespace is
+ * first imported, mapping each name to a reference to its info, so that
+ * lookups, including misses, don't need g_irepository_find_by_name()'s binary
+ * search over the typelib with string comparisons. Names that aren't in the
+ * namespace are not stored, so the index never grows after it is built.
+ * Setting GJS_DISABLE_NS_INDEX in the environment turns the index off. */
+class GjsNamespaceIndex {
+    std::string m_namespace;
+    std::unordered_map<std::string, GIBaseInfo *> m_infos;
+    std::vector<std::string> m_names;  /* the definable ones, in order */
+    std::unordered_set<std::string> m_searched_override_paths;
+
+    explicit GjsNamespaceIndex(const char *ns);
+
+public:
+    ~GjsNamespaceIndex();
+
+    static GjsNamespaceIndex *get(const char *ns);
+
+    GIBaseInfo *find(const char *name);
+    /* The names that resolve on the namespace object, leaving out callback
+     * types and GType class structs */
+    const std::vector<std::string>& names(void) const { return m_names; }
+
+    /* Overrides search paths, joined into one string, that were already
+     * found not to contain an override module for this namespace */
+    bool has_no_override_in(const std::string& search_path) const {
+        return m_searched_override_paths.count(search_path) > 0;
+    }
+    void set_no_override_in(const std::string& search_path) {
+        m_searched_override_paths.insert(search_path);
+    }
+};
+
 #endif  /* __GJS_REPO_H__ */
@@ -0,0 +1,953 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string.h>
+
+#include "variant.h"
+#include "boxed.h"
+#include "cjs/byteArray.h"
+#include "cjs/jsapi-wrapper.h"
+#include <util/log.h>
+#include <girepository.h>
+
+/* Packing and unpacking of GLib.Variant. The signature is validated once, and
+ * the value or the variant is then walked in a single pass, without making an
+ * introspected call for each child. */
+
+static const int64_t MAX_SAFE_INT64 =
+    int64_t(1) << std::numeric_limits<double>::digits;
+
+static bool variant_to_value(JSContext             *cx,
+                             GVariant              *variant,
+                             GjsVariantUnpack       mode,
+                             JS::MutableHandleValue value_p);
+
+static bool variant_from_value(JSContext          *cx,
+                               const GVariantType *type,
+                               JS::HandleValue     value,
+                               GVariant          **variant_out);
+
+/* Wraps @variant in a GLib.Variant object, which takes its own reference */
+static bool
+variant_wrap(JSContext             *cx,
+             GVariant              *variant,
+             JS::MutableHandleValue value_p)
+{
+    GIBaseInfo *info = g_irepository_find_by_gtype(nullptr, G_TYPE_VARIANT);
+    if (!info) {
+        gjs_throw(cx, "GLib.Variant is not available; import GLib first");
+        return false;
+    }
+
+    JSObject *obj = gjs_boxed_from_c_struct(cx, (GIStructInfo *) info, variant,
+                                            GJS_BOXED_CREATION_NONE);
+    g_base_info_unref(info);
+    if (!obj)
+        return false;
+
+    value_p.setObject(*obj);
+    return true;
+}
+
+template<typename T>
+static double
+to_number(T v)
+{
+    return v;
+}
+
+template<>
+double
+to_number(int64_t v)
+{
+    if (v == G_MININT64 || std::abs(v) > MAX_SAFE_INT64)
+        g_warning("Value %" G_GINT64_FORMAT " cannot be safely stored in "
+                  "a JS Number and may be rounded", v);
+    return static_cast<double>(v);
+}
+
+template<>
+double
+to_number(uint64_t v)
+{
+    if (v > uint64_t(MAX_SAFE_INT64))
+        g_warning("Value %" G_GUINT64_FORMAT " cannot be safely stored in "
+                  "a JS Number and may be rounded", v);
+    return static_cast<double>(v);
+}
+
+static bool
+variant_basic_to_value(JSContext             *cx,
+                       GVariant              *variant,
+                       JS::MutableHandleValue value_p)
+{
+    switch (g_variant_classify(variant)) {
+    case G_VARIANT_CLASS_BOOLEAN:
+        value_p.setBoolean(g_variant_get_boolean(variant));
+        return true;
+    case G_VARIANT_CLASS_BYTE:
+        value_p.setInt32(g_variant_get_byte(variant));
+        return true;
+    case G_VARIANT_CLASS_INT16:
+        value_p.setInt32(g_variant_get_int16(variant));
+        return true;
+    case G_VARIANT_CLASS_UINT16:
+        value_p.setInt32(g_variant_get_uint16(variant));
+        return true;
+    case G_VARIANT_CLASS_INT32:
+        value_p.setInt32(g_variant_get_int32(variant));
+        return true;
+    case G_VARIANT_CLASS_UINT32:
+        value_p.setNumber(g_variant_get_uint32(variant));
+        return true;
+    case G_VARIANT_CLASS_INT64:
+        value_p.setNumber(to_number<int64_t>(g_variant_get_int64(variant)));
+        return true;
+    case G_VARIANT_CLASS_UINT64:
+        value_p.setNumber(to_number<uint64_t>(g_variant_get_uint64(variant)));
+        return true;
+    case G_VARIANT_CLASS_HANDLE:
+        value_p.setInt32(g_variant_get_handle(variant));
+        return true;
+    case G_VARIANT_CLASS_DOUBLE:
+        value_p.setNumber(g_variant_get_double(variant));
+        return true;
+    case G_VARIANT_CLASS_STRING:
+    case G_VARIANT_CLASS_OBJECT_PATH:
+    case G_VARIANT_CLASS_SIGNATURE: {
+        gsize len;
+        const char *str = g_variant_get_string(variant, &len);
+        return gjs_string_from_utf8_n(cx, str, len, value_p);
+    }
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/* In SHALLOW mode, the children of containers are only wrapped */
+static bool
+variant_child_to_value(JSContext             *cx,
+                       GVariant              *child,
+                       GjsVariantUnpack       mode,
+                       JS::MutableHandleValue value_p)
+{
+    if (mode == GJS_VARIANT_UNPACK_SHALLOW)
+        return variant_wrap(cx, child, value_p);
+    return variant_to_value(cx, child, mode, value_p);
+}
+
+/* Arrays, tuples and dictionary entries all become JS arrays */
+static bool
+variant_children_to_array(JSContext             *cx,
+                          GVariant              *variant,
+                          GjsVariantUnpack       mode,
+                          JS::MutableHandleValue value_p)
+{
+    JS::AutoValueVector elems(cx);
+    if (!elems.resize(g_variant_n_children(variant))) {
+        JS_ReportOutOfMemory(cx);
+        return false;
+    }
+
+    GVariantIter iter;
+    GVariant *child;
+    size_t ix = 0;
+    g_variant_iter_init(&iter, variant);
+    while ((child = g_variant_iter_next_value(&iter))) {
+        bool ok = variant_child_to_value(cx, child, mode, elems[ix++]);
+        g_variant_unref(child);
+        if (!ok)
+            return false;
+    }
+
+    JSObject *array = JS_NewArrayObject(cx, elems);
+    if (!array)
+        return false;
+
+    value_p.setObject(*array);
+    return true;
+}
+
+template<typename T>
+static void
+append_fixed_elements(JS::AutoValueVector& elems,
+                      const void          *data,
+                      size_t               n_elements)
+{
+    auto values = static_cast<const T *>(data);
+    for (size_t ix = 0; ix < n_elements; ix++)
+        elems.infallibleAppend(JS::NumberValue(to_number<T>(values[ix])));
+}
+
+/* Arrays of numbers are read straight out of the serialized data */
+static bool
+variant_fixed_array_to_value(JSContext             *cx,
+                             GVariant              *variant,
+                             char                   element,
+                             JS::MutableHandleValue value_p)
+{
+    JS::AutoValueVector elems(cx);
+    const void *data;
+    gsize n_elements;
+
+    switch (element) {
+    case 'b': {
+        data = g_variant_get_fixed_array(variant, &n_elements, sizeof(guint8));
+        if (!elems.reserve(n_elements))
+            break;
+        auto values = static_cast<const guint8 *>(data);
+        for (size_t ix = 0; ix < n_elements; ix++)
+            elems.infallibleAppend(JS::BooleanValue(values[ix]));
+        break;
+    }
+    case 'n':
+        data = g_variant_get_fixed_array(variant, &n_elements, sizeof(gint16));
+        if (elems.reserve(n_elements))
+            append_fixed_elements<gint16>(elems, data, n_elements);
+        break;
+    case 'q':
+        data = g_variant_get_fixed_array(variant, &n_elements, sizeof(guint16));
+        if (elems.reserve(n_elements))
+            append_fixed_elements<guint16>(elems, data, n_elements);
+        break;
+    case 'i':
+    case 'h':
+        data = g_variant_get_fixed_array(variant, &n_elements, sizeof(gint32));
+        if (elems.reserve(n_elements))
+            append_fixed_elements<gint32>(elems, data, n_elements);
+        break;
+    case 'u':
+        data = g_variant_get_fixed_array(variant, &n_elements, sizeof(guint32));
+        if (elems.reserve(n_elements))
+            append_fixed_elements<guint32>(elems, data, n_elements);
+        break;
+    case 'x':
+        data = g_variant_get_fixed_array(variant, &n_elements, sizeof(int64_t));
+        if (elems.reserve(n_elements))
+            append_fixed_elements<int64_t>(elems, data, n_elements);
+        break;
+    case 't':
+        data = g_variant_get_fixed_array(variant, &n_elements, sizeof(uint64_t));
+        if (elems.reserve(n_elements))
+            append_fixed_elements<uint64_t>(elems, data, n_elements);
+        break;
+    case 'd':
+        data = g_variant_get_fixed_array(variant, &n_elements, sizeof(double));
+        if (elems.reserve(n_elements))
+            append_fixed_elements<double>(elems, data, n_elements);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    if (elems.length() != n_elements) {
+        JS_ReportOutOfMemory(cx);
+        return false;
+    }
+
+    JSObject *array = JS_NewArrayObject(cx, elems);
+    if (!array)
+        return false;
+
+    value_p.setObject(*array);
+    return true;
+}
+
+/* 'as' and 'ao' only need one vector of pointers into the serialized data */
+static bool
+variant_strv_to_value(JSContext             *cx,
+                      GVariant              *variant,
+                      char                   element,
+                      JS::MutableHandleValue value_p)
+{
+    gsize n_elements;
+    const char **strv = element == 's' ?
+        g_variant_get_strv(variant, &n_elements) :
+        g_variant_get_objv(variant, &n_elements);
+
+    JS::AutoValueVector elems(cx);
+    if (!elems.resize(n_elements)) {
+        g_free(strv);
+        JS_ReportOutOfMemory(cx);
+        return false;
+    }
+
+    for (size_t ix = 0; ix < n_elements; ix++) {
+        if (!gjs_string_from_utf8_n(cx, strv[ix], strlen(strv[ix]),
+                                    elems[ix])) {
+            g_free(strv);
+            return false;
+        }
+    }
+    g_free(strv);
+
+    JSObject *array = JS_NewArrayObject(cx, elems);
+    if (!array)
+        return false;
+
+    value_p.setObject(*array);
+    return true;
+}
+
+/* Dictionaries become plain objects; the keys are always unpacked, or they
+ * could not be property names */
+static bool
+variant_dict_to_value(JSContext             *cx,
+                      GVariant              *variant,
+                      GjsVariantUnpack       mode,
+                      JS::MutableHandleValue value_p)
+{
+    JS::RootedObject obj(cx, JS_NewPlainObject(cx));
+    if (!obj)
+        return false;
+
+    JS::RootedValue key_js(cx), value_js(cx);
+    JS::RootedId key_id(cx);
+    GVariantIter iter;
+    GVariant *entry;
+    g_variant_iter_init(&iter, variant);
+    while ((entry = g_variant_iter_next_value(&iter))) {
+        GVariant *key = g_variant_get_child_value(entry, 0);
+        GVariant *value = g_variant_get_child_value(entry, 1);
+        g_variant_unref(entry);
+
+        bool ok = variant_basic_to_value(cx, key, &key_js) &&
+            JS_ValueToId(cx, key_js, &key_id) &&
+            variant_child_to_value(cx, value, mode, &value_js) &&
+            JS_DefinePropertyById(cx, obj, key_id, value_js, JSPROP_ENUMERATE);
+
+        g_variant_unref(key);
+        g_variant_unref(value);
+        if (!ok)
+            return false;
+    }
+
+    value_p.setObject(*obj);
+    return true;
+}
+
+static bool
+variant_array_to_value(JSContext             *cx,
+                       GVariant              *variant,
+                       GjsVariantUnpack       mode,
+                       JS::MutableHandleValue value_p)
+{
+    const GVariantType *element_type =
+        g_variant_type_element(g_variant_get_type(variant));
+    char element = g_variant_type_peek_string(element_type)[0];
+
+    if (element == 'y') {
+        /* Shares the variant's data until the ByteArray is written to */
+        GBytes *bytes = g_variant_get_data_as_bytes(variant);
+        JSObject *byte_array = gjs_byte_array_from_bytes(cx, bytes);
+        g_bytes_unref(bytes);
+        if (!byte_array)
+            return false;
+
+        value_p.setObject(*byte_array);
+        return true;
+    }
+
+    if (element == '{')
+        return variant_dict_to_value(cx, variant, mode, value_p);
+
+    if (mode != GJS_VARIANT_UNPACK_SHALLOW) {
+        if (strchr("bnqihuxtd", element))
+            return variant_fixed_array_to_value(cx, variant, element, value_p);
+        if (element == 's' || element == 'o')
+            return variant_strv_to_value(cx, variant, element, value_p);
+    }
+
+    return variant_children_to_array(cx, variant, mode, value_p);
+}
+
+static bool
+variant_to_value(JSContext             *cx,
+                 GVariant              *variant,
+                 GjsVariantUnpack       mode,
+                 JS::MutableHandleValue value_p)
+{
+    JS_CHECK_RECURSION(cx, return false);
+
+    switch (g_variant_classify(variant)) {
+    case G_VARIANT_CLASS_VARIANT: {
+        GVariant *child = g_variant_get_variant(variant);
+        bool ok = mode == GJS_VARIANT_UNPACK_RECURSIVE ?
+            variant_to_value(cx, child, mode, value_p) :
+            variant_wrap(cx, child, value_p);
+        g_variant_unref(child);
+        return ok;
+    }
+    case G_VARIANT_CLASS_MAYBE: {
+        GVariant *child = g_variant_get_maybe(variant);
+        if (!child) {
+            value_p.setNull();
+            return true;
+        }
+        bool ok = variant_child_to_value(cx, child, mode, value_p);
+        g_variant_unref(child);
+        return ok;
+    }
+    case G_VARIANT_CLASS_ARRAY:
+        return variant_array_to_value(cx, variant, mode, value_p);
+    case G_VARIANT_CLASS_TUPLE:
+    case G_VARIANT_CLASS_DICT_ENTRY:
+        return variant_children_to_array(cx, variant, mode, value_p);
+    default:
+        return variant_basic_to_value(cx, variant, value_p);
+    }
+}
+
+bool
+gjs_variant_unpack(JSContext             *cx,
+                   GVariant              *variant,
+                   GjsVariantUnpack       mode,
+                   JS::MutableHandleValue value_p)
+{
+    JSAutoRequest ar(cx);
+
+    return variant_to_value(cx, variant, mode, value_p);
+}
+
+static void
+throw_type_mismatch(JSContext          *cx,
+                    const GVariantType *type,
+                    JS::HandleValue     value)
+{
+    gjs_throw_custom(cx, JSProto_TypeError, nullptr,
+                     "Expected a value for GVariant type '%.*s' but got type '%s'",
+                     int(g_variant_type_get_string_length(type)),
+                     g_variant_type_peek_string(type),
+                     JS::InformalValueTypeName(value));
+}
+
+static void
+throw_out_of_range(JSContext          *cx,
+                   const GVariantType *type)
+{
+    gjs_throw(cx, "value is out of range for GVariant type '%c'",
+              g_variant_type_peek_string(type)[0]);
+}
+
+/* Integers are converted like introspected arguments of the same type */
+static bool
+variant_basic_from_value(JSContext          *cx,
+                         const GVariantType *type,
+                         JS::HandleValue     value,
+                         GVariant          **variant_out)
+{
+    int32_t i;
+    uint32_t u;
+    double d;
+
+    switch (g_variant_type_peek_string(type)[0]) {
+    case 'b':
+        *variant_out = g_variant_new_boolean(JS::ToBoolean(value));
+        return true;
+    case 'y':
+        if (!JS::ToUint32(cx, value, &u))
+            return false;
+        if (u > G_MAXUINT8) {
+            throw_out_of_range(cx, type);
+            return false;
+        }
+        *variant_out = g_variant_new_byte(u);
+        return true;
+    case 'n':
+        if (!JS::ToInt32(cx, value, &i))
+            return false;
+        if (i > G_MAXINT16 || i < G_MININT16) {
+            throw_out_of_range(cx, type);
+            return false;
+        }
+        *variant_out = g_variant_new_int16(i);
+        return true;
+    case 'q':
+        if (!JS::ToUint32(cx, value, &u))
+            return false;
+        if (u > G_MAXUINT16) {
+            throw_out_of_range(cx, type);
+            return false;
+        }
+        *variant_out = g_variant_new_uint16(u);
+        return true;
+    case 'i':
+        if (!JS::ToInt32(cx, value, &i))
+            return false;
+        *variant_out = g_variant_new_int32(i);
+        return true;
+    case 'u':
+        if (!JS::ToNumber(cx, value, &d))
+            return false;
+        if (std::isnan(d) || d > G_MAXUINT32 || d < 0) {
+            throw_out_of_range(cx, type);
+            return false;
+        }
+        *variant_out = g_variant_new_uint32(d);
+        return true;
+    case 'x':
+        if (!JS::ToNumber(cx, value, &d))
+            return false;
+        /* G_MAXINT64 isn't representable as a double; it rounds up to
+         * 2^63, which would be out of range */
+        if (std::isnan(d) || d >= 9223372036854775808.0 || d < G_MININT64) {
+            throw_out_of_range(cx, type);
+            return false;
+        }
+        *variant_out = g_variant_new_int64(d);
+        return true;
+    case 't':
+        if (!JS::ToNumber(cx, value, &d))
+            return false;
+        if (std::isnan(d) || d >= 18446744073709551616.0 || d < 0) {
+            throw_out_of_range(cx, type);
+            return false;
+        }
+        *variant_out = g_variant_new_uint64(d);
+        return true;
+    case 'h':
+        if (!JS::ToInt32(cx, value, &i))
+            return false;
+        *variant_out = g_variant_new_handle(i);
+        return true;
+    case 'd':
+        if (!JS::ToNumber(cx, value, &d))
+            return false;
+        *variant_out = g_variant_new_double(d);
+        return true;
+    case 's':
+    case 'o':
+    case 'g': {
+        if (!value.isString()) {
+            throw_type_mismatch(cx, type, value);
+            return false;
+        }
+
+        GjsAutoJSChar str;
+        if (!gjs_string_to_utf8(cx, value, &str))
+            return false;
+
+        if (g_variant_type_equal(type, G_VARIANT_TYPE_STRING)) {
+            *variant_out = g_variant_new_string(str);
+        } else if (g_variant_type_equal(type, G_VARIANT_TYPE_OBJECT_PATH)) {
+            if (!g_variant_is_object_path(str)) {
+                gjs_throw(cx, "'%s' is not a valid D-Bus object path",
+                          str.get());
+                return false;
+            }
+            *variant_out = g_variant_new_object_path(str);
+        } else {
+            if (!g_variant_is_signature(str)) {
+                gjs_throw(cx, "'%s' is not a valid D-Bus signature",
+                          str.get());
+                return false;
+            }
+            *variant_out = g_variant_new_signature(str);
+        }
+        return true;
+    }
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/* 'ay' is packed in one go from a ByteArray, GLib.Bytes, Uint8Array, string
+ * (as UTF-8) or array of numbers */
+static bool
+variant_bytes_from_value(JSContext      *cx,
+                         JS::HandleValue value,
+                         GBytes        **bytes_out)
+{
+    if (value.isString()) {
+        GjsAutoJSChar str;
+        if (!gjs_string_to_utf8(cx, value, &str))
+            return false;
+        *bytes_out = g_bytes_new(str, strlen(str));
+        return true;
+    }
+
+    if (!value.isObject()) {
+        throw_type_mismatch(cx, G_VARIANT_TYPE_BYTESTRING, value);
+        return false;
+    }
+
+    JS::RootedObject obj(cx, &value.toObject());
+    if (gjs_typecheck_bytearray(cx, obj, false)) {
+        *bytes_out = gjs_byte_array_get_bytes(cx, obj);
+        return *bytes_out != nullptr;
+    }
+
+    if (gjs_typecheck_boxed(cx, obj, nullptr, G_TYPE_BYTES, false)) {
+        *bytes_out = g_bytes_ref((GBytes *) gjs_c_struct_from_boxed(cx, obj));
+        return true;
+    }
+
+    JS::RootedObject typed_array(cx, js::UnwrapUint8Array(obj));
+    if (typed_array) {
+        bool is_shared;
+        JS::AutoCheckCannotGC nogc;
+        *bytes_out = g_bytes_new(JS_GetUint8ArrayData(typed_array, &is_shared,
+                                                      nogc),
+                                 JS_GetTypedArrayLength(typed_array));
+        return true;
+    }
+
+    uint32_t length;
+    if (!JS_GetArrayLength(cx, obj, &length))
+        return false;
+
+    guint8 *data = (guint8 *) g_malloc(length);
+    JS::RootedValue elem(cx);
+    for (uint32_t ix = 0; ix < length; ix++) {
+        uint32_t byte;
+        if (!JS_GetElement(cx, obj, ix, &elem) ||
+            !JS::ToUint32(cx, elem, &byte)) {
+            g_free(data);
+            return false;
+        }
+        if (byte > G_MAXUINT8) {
+            g_free(data);
+            throw_out_of_range(cx, G_VARIANT_TYPE_BYTE);
+            return false;
+        }
+        data[ix] = byte;
+    }
+
+    *bytes_out = g_bytes_new_take(data, length);
+    return true;
+}
+
+static bool
+variant_dict_from_value(JSContext          *cx,
+                        const GVariantType *type,
+                        JS::HandleValue     value,
+                        GVariant          **variant_out)
+{
+    if (!value.isObject()) {
+        throw_type_mismatch(cx, type, value);
+        return false;
+    }
+
+    JS::RootedObject obj(cx, &value.toObject());
+    JS::Rooted<JS::IdVector> ids(cx, cx);
+    if (!JS_Enumerate(cx, obj, &ids))
+        return false;
+
+    const GVariantType *entry_type = g_variant_type_element(type);
+    const GVariantType *key_type = g_variant_type_key(entry_type);
+    const GVariantType *value_type = g_variant_type_value(entry_type);
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, type);
+
+    JS::RootedId id(cx);
+    JS::RootedValue key_js(cx), value_js(cx);
+    for (size_t ix = 0; ix < ids.length(); ix++) {
+        GVariant *key, *child;
+
+        id = ids[ix];
+        if (!JS_IdToValue(cx, id, &key_js))
+            goto fail;
+
+        /* Property names are strings, even if they look like indices */
+        if (!key_js.isString()) {
+            JSString *key_str = JS::ToString(cx, key_js);
+            if (!key_str)
+                goto fail;
+            key_js.setString(key_str);
+        }
+
+        if (!variant_from_value(cx, key_type, key_js, &key))
+            goto fail;
+
+        if (!JS_GetPropertyById(cx, obj, id, &value_js) ||
+            !variant_from_value(cx, value_type, value_js, &child)) {
+            g_variant_unref(key);
+            goto fail;
+        }
+
+        g_variant_builder_add_value(&builder,
+                                    g_variant_new_dict_entry(key, child));
+    }
+
+    *variant_out = g_variant_builder_end(&builder);
+    return true;
+
+fail:
+    g_variant_builder_clear(&builder);
+    return false;
+}
+
+static bool
+variant_array_from_value(JSContext          *cx,
+                         const GVariantType *type,
+                         JS::HandleValue     value,
+                         GVariant          **variant_out)
+{
+    const GVariantType *element_type = g_variant_type_element(type);
+
+    if (g_variant_type_equal(element_type, G_VARIANT_TYPE_BYTE)) {
+        GBytes *bytes;
+        if (!variant_bytes_from_value(cx, value, &bytes))
+            return false;
+        *variant_out = g_variant_new_from_bytes(G_VARIANT_TYPE_BYTESTRING,
+                                                bytes, true);
+        g_bytes_unref(bytes);
+        return true;
+    }
+
+    if (g_variant_type_is_dict_entry(element_type))
+        return variant_dict_from_value(cx, type, value, variant_out);
+
+    if (!value.isObject()) {
+        throw_type_mismatch(cx, type, value);
+        return false;
+    }
+
+    JS::RootedObject obj(cx, &value.toObject());
+    uint32_t length;
+    if (!JS_GetArrayLength(cx, obj, &length))
+        return false;
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, type);
+
+    JS::RootedValue elem(cx);
+    for (uint32_t ix = 0; ix < length; ix++) {
+        GVariant *child;
+        if (!JS_GetElement(cx, obj, ix, &elem) ||
+            !variant_from_value(cx, element_type, elem, &child)) {
+            g_variant_builder_clear(&builder);
+            return false;
+        }
+        g_variant_builder_add_value(&builder, child);
+    }
+
+    *variant_out = g_variant_builder_end(&builder);
+    return true;
+}
+
+/* Tuples and dictionary entries are packed from arrays; extra elements are
+ * ignored */
+static bool
+variant_tuple_from_value(JSContext          *cx,
+                         const GVariantType *type,
+                         JS::HandleValue     value,
+                         GVariant          **variant_out)
+{
+    if (!value.isObject()) {
+        throw_type_mismatch(cx, type, value);
+        return false;
+    }
+
+    JS::RootedObject obj(cx, &value.toObject());
+    uint32_t length;
+    if (!JS_GetArrayLength(cx, obj, &length))
+        return false;
+
+    gsize n_items = g_variant_type_n_items(type);
+    if (length < n_items) {
+        gjs_throw_custom(cx, JSProto_TypeError, nullptr,
+                         "GVariant type '%.*s' needs %" G_GSIZE_FORMAT
+                         " elements but got %u",
+                         int(g_variant_type_get_string_length(type)),
+                         g_variant_type_peek_string(type), n_items, length);
+        return false;
+    }
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, type);
+
+    JS::RootedValue elem(cx);
+    uint32_t ix = 0;
+    for (const GVariantType *member = g_variant_type_first(type); member;
+         member = g_variant_type_next(member), ix++) {
+        GVariant *child;
+        if (!JS_GetElement(cx, obj, ix, &elem) ||
+            !variant_from_value(cx, member, elem, &child)) {
+            g_variant_builder_clear(&builder);
+            return false;
+        }
+        g_variant_builder_add_value(&builder, child);
+    }
+
+    *variant_out = g_variant_builder_end(&builder);
+    return true;
+}
+
+/* Returns a floating reference in @variant_out */
+static bool
+variant_from_value(JSContext          *cx,
+                   const GVariantType *type,
+                   JS::HandleValue     value,
+                   GVariant          **variant_out)
+{
+    JS_CHECK_RECURSION(cx, return false);
+
+    if (g_variant_type_is_basic(type))
+        return variant_basic_from_value(cx, type, value, variant_out);
+
+    if (g_variant_type_is_variant(type)) {
+        if (!value.isObject()) {
+            throw_type_mismatch(cx, type, value);
+            return false;
+        }
+        JS::RootedObject obj(cx, &value.toObject());
+        if (!gjs_typecheck_boxed(cx, obj, nullptr, G_TYPE_VARIANT, true))
+            return false;
+        *variant_out = g_variant_new_variant(
+            (GVariant *) gjs_c_struct_from_boxed(cx, obj));
+        return true;
+    }
+
+    if (g_variant_type_is_maybe(type)) {
+        const GVariantType *element_type = g_variant_type_element(type);
+        GVariant *child = nullptr;
+        if (!value.isNullOrUndefined() &&
+            !variant_from_value(cx, element_type, value, &child))
+            return false;
+        *variant_out = g_variant_new_maybe(element_type, child);
+        return true;
+    }
+
+    if (g_variant_type_is_array(type))
+        return variant_array_from_value(cx, type, value, variant_out);
+
+    return variant_tuple_from_value(cx, type, value, variant_out);
+}
+
+bool
+gjs_variant_pack(JSContext      *cx,
+                 const char     *signature,
+                 JS::HandleValue value,
+                 GVariant      **variant_out)
+{
+    JSAutoRequest ar(cx);
+    const char *end;
+
+    if (*signature == '\0') {
+        gjs_throw_custom(cx, JSProto_TypeError, nullptr,
+                         "GVariant signature cannot be empty");
+        return false;
+    }
+
+    if (!g_variant_type_string_scan(signature, nullptr, &end)) {
+        gjs_throw_custom(cx, JSProto_TypeError, nullptr,
+                         "Invalid GVariant signature '%s'", signature);
+        return false;
+    }
+
+    if (*end != '\0') {
+        gjs_throw_custom(cx, JSProto_TypeError, nullptr,
+                         "Invalid GVariant signature '%s' (more than one "
+                         "single complete type)", signature);
+        return false;
+    }
+
+    const GVariantType *type = G_VARIANT_TYPE(signature);
+    if (!g_variant_type_is_definite(type)) {
+        gjs_throw_custom(cx, JSProto_TypeError, nullptr,
+                         "Invalid GVariant signature '%s' (a value can only "
+                         "be packed into a definite type)", signature);
+        return false;
+    }
+
+    gjs_debug_marshal(GJS_DEBUG_GBOXED, "Packing GVariant of type %s",
+                      signature);
+
+    return variant_from_value(cx, type, value, variant_out);
+}
+
+bool
+gjs_variant_pack_type(JSContext          *cx,
+                      const GVariantType *type,
+                      JS::HandleValue     value,
+                      GVariant          **variant_out)
+{
+    JSAutoRequest ar(cx);
+
+    g_return_val_if_fail(g_variant_type_is_definite(type), false);
+
+    return variant_from_value(cx, type, value, variant_out);
+}
+
+static bool
+unpack_this(JSContext       *cx,
+            unsigned         argc,
+            JS::Value       *vp,
+            GjsVariantUnpack mode)
+{
+    GJS_GET_THIS(cx, argc, vp, args, obj);
+
+    if (!gjs_typecheck_boxed(cx, obj, nullptr, G_TYPE_VARIANT, true))
+        return false;
+
+    auto variant = static_cast<GVariant *>(gjs_c_struct_from_boxed(cx, obj));
+    return gjs_variant_unpack(cx, variant, mode, args.rval());
+}
+
+static bool
+variant_unpack_func(JSContext *cx,
+                    unsigned   argc,
+                    JS::Value *vp)
+{
+    return unpack_this(cx, argc, vp, GJS_VARIANT_UNPACK_SHALLOW);
+}
+
+static bool
+variant_deep_unpack_func(JSContext *cx,
+                         unsigned   argc,
+                         JS::Value *vp)
+{
+    return unpack_this(cx, argc, vp, GJS_VARIANT_UNPACK_DEEP);
+}
+
+static bool
+variant_recursive_unpack_func(JSContext *cx,
+                              unsigned   argc,
+                              JS::Value *vp)
+{
+    return unpack_this(cx, argc, vp, GJS_VARIANT_UNPACK_RECURSIVE);
+}
+
+/* These are installed as methods of GLib.Variant by the GLib overrides */
+static JSFunctionSpec variant_funcs[] = {
+    JS_FS("variant_unpack", variant_unpack_func, 0, GJS_MODULE_PROP_FLAGS),
+    JS_FS("variant_deep_unpack", variant_deep_unpack_func, 0,
+          GJS_MODULE_PROP_FLAGS),
+    JS_FS("variant_recursive_unpack", variant_recursive_unpack_func, 0,
+          GJS_MODULE_PROP_FLAGS),
+    JS_FS_END,
+};
+
+bool
+gjs_define_variant_stuff(JSContext       *cx,
+                         JS::HandleObject module)
+{
+    return JS_DefineFunctions(cx, module, variant_funcs);
+}
@@ -0,0 +1,72 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_VARIANT_H__
+#define __GJS_VARIANT_H__
+
+#include <stdbool.h>
+#include <glib.h>
+
+#include "cjs/jsapi-util.h"
+
+G_BEGIN_DECLS
+
+/* How far gjs_variant_unpack() converts the children of a container:
+ *
+ * SHALLOW: children stay GLib.Variant objects; this is Variant.unpack()
+ * DEEP: children are unpacked too, except for the contents of 'v' values;
+ *   this is Variant.deepUnpack()
+ * RECURSIVE: everything is unpacked, including the contents of 'v' values;
+ *   this is Variant.recursiveUnpack()
+ *
+ * Dictionary keys are always unpacked, and 'ay' is always a ByteArray sharing
+ * the variant's data until it is written to. */
+typedef enum {
+    GJS_VARIANT_UNPACK_SHALLOW,
+    GJS_VARIANT_UNPACK_DEEP,
+    GJS_VARIANT_UNPACK_RECURSIVE,
+} GjsVariantUnpack;
+
+bool gjs_variant_pack(JSContext      *cx,
+                      const char     *signature,
+                      JS::HandleValue value,
+                      GVariant      **variant_out);
+
+/* Like gjs_variant_pack(), for callers that have validated the type already;
+ * @type must be definite */
+bool gjs_variant_pack_type(JSContext          *cx,
+                           const GVariantType *type,
+                           JS::HandleValue     value,
+                           GVariant          **variant_out);
+
+bool gjs_variant_unpack(JSContext             *cx,
+                        GVariant              *variant,
+                        GjsVariantUnpack       mode,
+                        JS::MutableHandleValue value_p);
+
+bool gjs_define_variant_stuff(JSContext       *cx,
+                              JS::HandleObject module);
+
+G_END_DECLS
+
+#endif  /* __GJS_VARIANT_H__ */
@@ -3,11 +3,21 @@ module_console_srcs =		\
 	modules/console.cpp	\
 	$(NULL)
 
+module_io_srcs =		\
+	modules/io.h		\
+	modules/io.cpp		\
+	$(NULL)
+
 module_resource_srcs =		\
 	modules-resources.c	\
 	modules-resources.h	\
 	$(NULL)
 
+module_serialize_srcs =		\
+	modules/serialize.h	\
+	modules/serialize.cpp	\
+	$(NULL)
+
 module_system_srcs =		\
 	modules/system.h	\
 	modules/system.cpp	\
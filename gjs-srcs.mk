@@ -18,6 +18,8 @@ gjs_srcs =				\
 	gi/boxed.h			\
 	gi/closure.cpp			\
 	gi/closure.h			\
+	gi/dbus.cpp			\
+	gi/dbus.h			\
 	gi/enumeration.cpp		\
 	gi/enumeration.h		\
 	gi/foreign.cpp			\
@@ -49,6 +51,10 @@ gjs_srcs =				\
 	gi/union.h			\
 	gi/value.cpp			\
 	gi/value.h			\
+	gi/variant.cpp			\
+	gi/variant.h			\
+	cjs/bundle.cpp			\
+	cjs/bundle.h			\
 	cjs/byteArray.cpp		\
 	cjs/byteArray.h			\
 	cjs/context.cpp			\
@@ -56,8 +62,14 @@ gjs_srcs =				\
 	cjs/coverage.cpp 		\
 	cjs/engine.cpp			\
 	cjs/engine.h			\
+	cjs/gc-stats.cpp		\
+	cjs/gc-stats.h			\
 	cjs/global.cpp			\
 	cjs/global.h			\
+	cjs/import-cache.cpp		\
+	cjs/import-cache.h		\
+	cjs/import-trace.cpp		\
+	cjs/import-trace.h		\
 	cjs/importer.cpp		\
 	cjs/importer.h			\
 	cjs/jsapi-class.h		\
@@ -77,6 +89,8 @@ gjs_srcs =				\
 	cjs/native.h			\
 	cjs/profiler.cpp		\
 	cjs/profiler-private.h		\
+	cjs/script-cache.cpp		\
+	cjs/script-cache.h		\
 	cjs/stack.cpp			\
 	modules/modules.cpp		\
 	modules/modules.h		\
@@ -104,6 +118,13 @@ gjs_gtk_private_srcs =			\
 
 gjs_console_srcs =	\
 	cjs/console.cpp	\
+	cjs/zygote.cpp	\
+	cjs/zygote.h	\
+	$(NULL)
+
+gjs_bundle_tool_srcs =		\
+	cjs/bundle.h		\
+	cjs/bundle-tool.cpp	\
 	$(NULL)
 
 gjs_sysprof_srcs =			\
@@ -0,0 +1,3 @@
+// simple test module (used by testImporter.js)
+
+var preloaded = true;
@@ -118,6 +118,101 @@ describe('Byte array', function () {
         [1, 2, 3, 4].forEach((val, ix) => expect(a[ix]).toEqual(val));
     });
 
+    it('can be created from a Uint8Array', function () {
+        let a = ByteArray.fromArray(new Uint8Array([1, 2, 3, 4]));
+        expect(a.length).toEqual(4);
+        [1, 2, 3, 4].forEach((val, ix) => expect(a[ix]).toEqual(val));
+    });
+
+    it('keeps its contents when growing one byte at a time', function () {
+        let a = new ByteArray.ByteArray();
+        for (let i = 0; i < 1000; i++)
+            a[i] = i % 256;
+        expect(a.length).toEqual(1000);
+        for (let i = 0; i < 1000; i++)
+            expect(a[i]).toEqual(i % 256);
+    });
+
+    it('zeroes bytes that come back after shrinking', function () {
+        let a = ByteArray.fromArray([1, 2, 3, 4]);
+        a.length = 2;
+        a.length = 4;
+        expect(a[2]).toEqual(0);
+        expect(a[3]).toEqual(0);
+    });
+
+    describe('Uint8Array view', function () {
+        let a, view;
+        beforeEach(function () {
+            a = ByteArray.fromArray([1, 2, 3, 4]);
+            view = a.toUint8Array();
+        });
+
+        it('shares memory with the ByteArray', function () {
+            expect(view instanceof Uint8Array).toBeTruthy();
+            expect(view.length).toEqual(4);
+            view[0] = 42;
+            expect(a[0]).toEqual(42);
+            a[1] = 43;
+            expect(view[1]).toEqual(43);
+        });
+
+        it('is detached when the ByteArray is converted to GBytes', function () {
+            let bytes = a.toGBytes();
+            expect(view.length).toEqual(0);
+            expect(bytes.get_size()).toEqual(4);
+            expect(a[3]).toEqual(4);
+        });
+    });
+
+    it('can be converted to GBytes and back without changing', function () {
+        let a = ByteArray.fromString('abcd');
+        let b = ByteArray.fromGBytes(a.toGBytes());
+        expect(b.toString()).toEqual('abcd');
+        b[0] = 65;
+        expect(b.toString()).toEqual('Abcd');
+        expect(a.toString()).toEqual('abcd');
+    });
+
+    describe('UTF-8 conversion', function () {
+        const strings = {
+            'ASCII': 'The quick brown fox jumps over the lazy dog. '.repeat(10),
+            'Latin-1': 'Crème brûlée, ½ portion, déjà vu. '.repeat(10),
+            'CJK': '天地玄黃，宇宙洪荒。日月盈昃，辰宿列張。'.repeat(10),
+            'astral': 'emoji 😀 and 𝄞 music '.repeat(10),
+            'embedded NUL': 'before\0after',
+        };
+
+        Object.keys(strings).forEach(kind => {
+            it(`round-trips ${kind} text`, function () {
+                let s = strings[kind];
+                let a = ByteArray.fromString(s);
+                expect(a.toString()).toEqual(s);
+                expect(a.toString('utf8')).toEqual(s);
+                expect(ByteArray.fromString(s, 'utf-8').length).toEqual(a.length);
+            });
+        });
+
+        it('encodes lone surrogates as U+FFFD', function () {
+            let a = ByteArray.fromString('a\ud800b');
+            expect(a.length).toEqual(5);
+            expect(a.toString()).toEqual('a\ufffdb');
+        });
+
+        it('throws on invalid UTF-8', function () {
+            let a = ByteArray.fromArray([0x61, 0xc3, 0x28]);
+            expect(() => a.toString()).toThrow();
+        });
+    });
+
+    it('converts Latin-1 without iconv', function () {
+        let a = ByteArray.fromArray([0x63, 0x61, 0x66, 0xe9]);
+        expect(a.toString('ISO-8859-1')).toEqual('café');
+        let b = ByteArray.fromString('café', 'latin1');
+        expect(b.length).toEqual(4);
+        expect(b[3]).toEqual(0xe9);
+    });
+
     it('can be converted to a string of ASCII characters', function () {
         let a = new ByteArray.ByteArray();
         a[0] = 97;
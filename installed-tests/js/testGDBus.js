@@ -293,6 +293,19 @@ describe('Exported DBus object', function () {
         loop.run();
     });
 
+    it('names the D-Bus error after the exception thrown by a remote method', function () {
+        GLib.test_expect_message('Cjs', GLib.LogLevelFlags.LEVEL_WARNING,
+            'JS ERROR: Exception in method call: alwaysThrowException: *');
+
+        proxy.alwaysThrowExceptionRemote({}, function(result, excp) {
+            expect(Gio.DBusError.get_remote_error(excp))
+                .toEqual('org.gnome.gjs.JSError.Error');
+            expect(excp.message).toMatch('Exception!');
+            loop.quit();
+        });
+        loop.run();
+    });
+
     it('can still destructure the return value when an exception is thrown', function () {
         GLib.test_expect_message('Cjs', GLib.LogLevelFlags.LEVEL_WARNING,
             'JS ERROR: Exception in method call: alwaysThrowException: *');
@@ -484,4 +497,61 @@ describe('Exported DBus object', function () {
         });
         loop.run();
     });
+
+    it('shares the methods of proxies for the same interface', function () {
+        let otherProxy = null;
+        Gio.DBusProxy.new(Gio.DBus.session,
+            Gio.DBusProxyFlags.DO_NOT_LOAD_PROPERTIES,
+            proxy.g_interface_info,
+            'org.gnome.gjs.Test',
+            '/org/gnome/gjs/Test',
+            'org.gnome.gjs.Test',
+            null,
+            (o, res) => {
+                otherProxy = Gio.DBusProxy.new_finish(res);
+                loop.quit();
+            });
+        loop.run();
+
+        expect(otherProxy.frobateStuffRemote).toBe(proxy.frobateStuffRemote);
+        expect(otherProxy.frobateStuffSync).toBe(proxy.frobateStuffSync);
+    });
+
+    it('checks the arguments passed to a proxy method', function () {
+        expect(() => proxy.multipleInArgsRemote(1, 2))
+            .toThrowError(/Not enough arguments passed for method: multipleInArgs/);
+        expect(() => proxy.noInParameterRemote(() => {}, 0, null, 'extra', 'args'))
+            .toThrowError(/Too many arguments/);
+        expect(() => proxy.noInParameterRemote('foo'))
+            .toThrowError(/Argument 0 of method noInParameter is string/);
+    });
+
+    it('coalesces property changes into one PropertiesChanged signal', function () {
+        let impl = test._impl;
+        let nChanges = impl.n_property_changes;
+        let nSignals = impl.n_properties_changed_signals;
+
+        let id = proxy.connect('g-properties-changed', (proxy_, changed, invalidated) => {
+            expect(changed.deep_unpack().PropReadOnly.deep_unpack()).toBe(true);
+            expect(invalidated).toEqual(['PropReadWrite']);
+            loop.quit();
+        });
+
+        impl.flush_interval = 10;
+        impl.emit_property_changed('PropReadOnly', false);
+        impl.emit_property_changed('PropReadOnly', new GLib.Variant('b', false));
+        impl.emit_property_changed('PropReadOnly', true);
+        impl.emit_property_changed('PropReadWrite', null);
+        loop.run();
+        proxy.disconnect(id);
+        impl.flush_interval = 0;
+
+        expect(impl.n_property_changes - nChanges).toEqual(4);
+        expect(impl.n_properties_changed_signals - nSignals).toEqual(1);
+    });
+
+    it('throws when changing a property that is not on the interface', function () {
+        expect(() => test._impl.emit_property_changed('NoSuchProperty', 5))
+            .toThrowError(/NoSuchProperty/);
+    });
 });
@@ -230,6 +230,18 @@ describe('GByteArray', function () {
         expect(() => GIMarshallingTests.bytearray_none_in([0, 49, 0xFF, 51]))
             .not.toThrow();
     });
+
+    it('keeps a ByteArray usable after passing it in', function () {
+        let array = ByteArray.fromArray([0, 49, 0xFF, 51]);
+        let view = array.toUint8Array();
+        GIMarshallingTests.bytearray_none_in(array);
+        expect(view.length).toEqual(0);
+
+        GIMarshallingTests.bytearray_none_in(array);
+        array[4] = 52;
+        array.length = 6;
+        expect(Array.from(array.toUint8Array())).toEqual([0, 49, 0xFF, 51, 52, 0]);
+    });
 });
 
 describe('GBytes', function () {
@@ -251,6 +263,15 @@ describe('GBytes', function () {
             .not.toThrow();
     });
 
+    it('does not take the memory of a ByteArray passed as a Uint8Array', function () {
+        let array = ByteArray.fromArray([0, 49, 0xFF, 51]);
+        expect(() => GIMarshallingTests.gbytes_none_in(array.toUint8Array()))
+            .not.toThrow();
+        expect(array.length).toEqual(4);
+        expect(array[0]).toEqual(0);
+        expect(array[1]).toEqual(49);
+    });
+
     it('can be created from a string and is encoded in UTF-8', function () {
         let bytes = GLib.Bytes.new("const \u2665 utf8");
         expect(() => GIMarshallingTests.utf8_as_uint8array_in(bytes.toArray()))
@@ -269,6 +290,44 @@ describe('GBytes', function () {
             .not.toThrow();
     });
 
+    it('can be converted to a Uint8Array', function () {
+        let bytes = GIMarshallingTests.gbytes_full_return();
+        let array = bytes.toUint8Array();
+        expect(array instanceof Uint8Array).toBeTruthy();
+        expect(Array.from(array)).toEqual([0, 49, 0xFF, 51]);
+        expect(() => GIMarshallingTests.gbytes_none_in(array)).not.toThrow();
+        // Passing the memory of the Uint8Array back doesn't detach it
+        expect(array.length).toEqual(4);
+    });
+
+    it('is not written to through a Uint8Array', function () {
+        let bytes = GIMarshallingTests.gbytes_full_return();
+        let array = bytes.toUint8Array();
+        array[1] = 42;
+        expect(bytes.toArray()).toEqual(refByteArray);
+    });
+
+    it('can be implicitly converted from a Uint8Array', function () {
+        let array = new Uint8Array([7, 0, 49, 0xFF, 51, 7]);
+        let view = new Uint8Array(array.buffer, 1, 4);
+        expect(() => GIMarshallingTests.gbytes_none_in(view)).not.toThrow();
+        // The memory is copied, and stays the caller's
+        expect(array.length).toEqual(6);
+        expect(() => GIMarshallingTests.gbytes_none_in(view)).not.toThrow();
+    });
+
+    it('can be implicitly converted from an ArrayBuffer', function () {
+        let buffer = new Uint8Array([0, 49, 0xFF, 51]).buffer;
+        expect(() => GIMarshallingTests.gbytes_none_in(buffer)).not.toThrow();
+        expect(buffer.byteLength).toEqual(4);
+    });
+
+    it('can be implicitly converted from a non-extensible Uint8Array', function () {
+        let view = Object.preventExtensions(new Uint8Array([0, 49, 0xFF, 51]));
+        expect(() => GIMarshallingTests.gbytes_none_in(view)).not.toThrow();
+        expect(() => GIMarshallingTests.gbytes_none_in(view)).not.toThrow();
+    });
+
     it('cannot be passed to a function expecting a byte array', function () {
         let bytes = GLib.Bytes.new([97, 98, 99, 100]);
         expect(() => GIMarshallingTests.array_uint8_in(bytes.toArray())).not.toThrow();
@@ -41,3 +41,118 @@ describe('GVariant constructor', function () {
         expect(maybe_variant.deep_unpack()).toEqual('string');
     });
 });
+
+describe('GVariant unpack', function () {
+    let v;
+    beforeEach(function () {
+        v = new GLib.Variant('a{sv}', {
+            foo: new GLib.Variant('s', 'bar'),
+            nested: new GLib.Variant('v', new GLib.Variant('ai', [1, 2])),
+        });
+    });
+
+    it('keeps children as variants with unpack()', function () {
+        let unpacked = v.unpack();
+        expect(unpacked.foo instanceof GLib.Variant).toBeTruthy();
+        expect(unpacked.foo.unpack()).toEqual('bar');
+
+        let array = new GLib.Variant('as', ['a', 'b']).unpack();
+        expect(array.length).toEqual(2);
+        expect(array[0] instanceof GLib.Variant).toBeTruthy();
+    });
+
+    it('keeps variants as variants with deepUnpack()', function () {
+        let unpacked = v.deepUnpack();
+        expect(unpacked.foo instanceof GLib.Variant).toBeTruthy();
+        expect(unpacked.nested.deepUnpack() instanceof GLib.Variant).toBeTruthy();
+        expect(v.deep_unpack().foo.deep_unpack()).toEqual('bar');
+    });
+
+    it('unpacks variants too with recursiveUnpack()', function () {
+        expect(v.recursiveUnpack()).toEqual({ foo: 'bar', nested: [1, 2] });
+    });
+
+    it('unpacks arrays of numbers and strings', function () {
+        expect(new GLib.Variant('ai', [1, -2, 3]).deepUnpack()).toEqual([1, -2, 3]);
+        expect(new GLib.Variant('ad', [0.5, 2]).deepUnpack()).toEqual([0.5, 2]);
+        expect(new GLib.Variant('ab', [true, false]).deepUnpack()).toEqual([true, false]);
+        expect(new GLib.Variant('at', [0, 4294967296]).deepUnpack()).toEqual([0, 4294967296]);
+        expect(new GLib.Variant('as', ['a', 'ü', '']).deepUnpack()).toEqual(['a', 'ü', '']);
+        expect(new GLib.Variant('ao', ['/a', '/b']).deepUnpack()).toEqual(['/a', '/b']);
+        expect(new GLib.Variant('ai', []).deepUnpack()).toEqual([]);
+    });
+
+    it('unpacks byte arrays into a ByteArray', function () {
+        let bytes = new GLib.Variant('ay', [0, 1, 255]).deepUnpack();
+        expect(bytes instanceof imports.byteArray.ByteArray).toBeTruthy();
+        expect(bytes.length).toEqual(3);
+        expect(bytes[2]).toEqual(255);
+
+        bytes = new GLib.Variant('ay', imports.byteArray.fromString('hello')).deepUnpack();
+        expect(bytes.toString()).toEqual('hello');
+        bytes = new GLib.Variant('ay', new Uint8Array([4, 5])).deepUnpack();
+        expect(bytes[1]).toEqual(5);
+    });
+
+    it('does not write to the variant through an unpacked byte array', function () {
+        let variant = new GLib.Variant('ay', imports.byteArray.fromString('abc'));
+        let bytes = variant.deepUnpack();
+        bytes[0] = 65;
+        expect(bytes.toString()).toEqual('Abc');
+        expect(variant.deepUnpack().toString()).toEqual('abc');
+    });
+
+    it('unpacks dictionaries with non-string keys', function () {
+        let dict = new GLib.Variant('a{ib}', { 1: true, 2: false }).deepUnpack();
+        expect(dict).toEqual({ 1: true, 2: false });
+    });
+
+    it('round-trips nested containers', function () {
+        let value = [[['x', 1], ['y', 2]], null, { k: [true, 'v'] }, {}, 'é'];
+        let variant = new GLib.Variant('(a(si)mia{s(bs)}a{sv}s)', value);
+        expect(variant.deepUnpack()).toEqual(value);
+        expect(variant.get_child_value(0).n_children()).toEqual(2);
+        expect(new GLib.Variant('mi', 5).deepUnpack()).toEqual(5);
+        expect(new GLib.Variant('()', []).deepUnpack()).toEqual([]);
+    });
+
+    it('converts numbers like introspected arguments', function () {
+        expect(new GLib.Variant('i', 10.5).deepUnpack()).toEqual(10);
+        expect(new GLib.Variant('u', 4294967295).deepUnpack()).toEqual(4294967295);
+        expect(new GLib.Variant('b', 1).deepUnpack()).toBe(true);
+        expect(() => new GLib.Variant('y', 256)).toThrow();
+        expect(() => new GLib.Variant('n', 40000)).toThrow();
+        expect(() => new GLib.Variant('u', -1)).toThrow();
+    });
+
+    it('rejects NaN and numbers just past the 64-bit limits', function () {
+        expect(() => new GLib.Variant('u', NaN)).toThrow();
+        expect(() => new GLib.Variant('x', NaN)).toThrow();
+        expect(() => new GLib.Variant('t', NaN)).toThrow();
+        expect(() => new GLib.Variant('x', Math.pow(2, 63))).toThrow();
+        expect(() => new GLib.Variant('t', Math.pow(2, 64))).toThrow();
+        expect(new GLib.Variant('x', -Math.pow(2, 63)).deepUnpack()).toEqual(-Math.pow(2, 63));
+    });
+});
+
+describe('GVariant constructor errors', function () {
+    it('rejects invalid signatures', function () {
+        expect(() => new GLib.Variant('', 1)).toThrowError(TypeError);
+        expect(() => new GLib.Variant('(s', ['a'])).toThrowError(TypeError);
+        expect(() => new GLib.Variant('ss', 'a')).toThrowError(TypeError);
+        expect(() => new GLib.Variant('a{vs}', {})).toThrowError(TypeError);
+        expect(() => new GLib.Variant('r', [])).toThrowError(TypeError);
+    });
+
+    it('rejects values of the wrong type', function () {
+        expect(() => new GLib.Variant('s', 5)).toThrowError(TypeError);
+        expect(() => new GLib.Variant('v', 'not a variant')).toThrowError(TypeError);
+        expect(() => new GLib.Variant('(si)', ['a'])).toThrowError(TypeError);
+        expect(() => new GLib.Variant('as', ['a', 5])).toThrowError(TypeError);
+    });
+
+    it('rejects invalid object paths and signatures', function () {
+        expect(() => new GLib.Variant('o', 'not/a/path')).toThrow();
+        expect(() => new GLib.Variant('g', '(s')).toThrow();
+    });
+});
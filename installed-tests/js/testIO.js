@@ -0,0 +1,151 @@
+const ByteArray = imports.byteArray;
+const GLib = imports.gi.GLib;
+const Gio = imports.gi.Gio;
+const IO = imports.io;
+
+describe('IO.mapFile()', function () {
+    let file;
+
+    beforeEach(function () {
+        [file] = Gio.File.new_tmp('cjs-test-io-XXXXXX');
+    });
+
+    afterEach(function () {
+        file.delete(null);
+    });
+
+    it('maps the contents of a file', function () {
+        file.replace_contents('mapped', null, false, 0, null);
+        let buffer = IO.mapFile(file.get_path());
+        expect(buffer.byteLength).toEqual(6);
+        expect(String.fromCharCode(...new Uint8Array(buffer))).toEqual('mapped');
+    });
+
+    it('accepts a Gio.File', function () {
+        file.replace_contents('abc', null, false, 0, null);
+        expect(IO.mapFile(file).byteLength).toEqual(3);
+    });
+
+    it('maps an empty file', function () {
+        expect(IO.mapFile(file).byteLength).toEqual(0);
+    });
+
+    it('throws a GLib.FileError for a missing file', function () {
+        expect(() => IO.mapFile('/nonexistent/cjs-test-io'))
+            .toThrow(jasmine.objectContaining({domain: GLib.FileError}));
+    });
+});
+
+describe('IO.readInto()', function () {
+    function streamOf(text) {
+        return Gio.MemoryInputStream.new_from_bytes(new GLib.Bytes(text));
+    }
+
+    it('reads a stream in chunks', function (done) {
+        let buffer = new ArrayBuffer(16);
+        IO.readInto(streamOf('hello world'), buffer, {chunkSize: 3}).then(view => {
+            expect(buffer.byteLength).toEqual(0);
+            expect(view.byteLength).toEqual(11);
+            expect(view.buffer.byteLength).toEqual(16);
+            expect(String.fromCharCode(...view)).toEqual('hello world');
+            done();
+        });
+    });
+
+    it('stops when a typed array is full', function (done) {
+        let array = new Uint8Array(new ArrayBuffer(8), 2, 4);
+        IO.readInto(streamOf('hello world'), array).then(view => {
+            expect(view.byteOffset).toEqual(2);
+            expect(String.fromCharCode(...view)).toEqual('hell');
+            done();
+        });
+    });
+
+    it('rejects a cancelled read', function (done) {
+        let cancellable = new Gio.Cancellable();
+        cancellable.cancel();
+        IO.readInto(streamOf('hello'), new ArrayBuffer(8), {cancellable})
+        .catch(e => {
+            expect(e.matches(Gio.IOErrorEnum, Gio.IOErrorEnum.CANCELLED)).toBeTruthy();
+            done();
+        });
+    });
+});
+
+describe('IO.writev()', function () {
+    it('writes chunks of different kinds in order', function (done) {
+        let stream = Gio.MemoryOutputStream.new_resizable();
+        let buffer = new Uint8Array([104, 101, 108, 108, 111, 32]).buffer;
+        let view = new Uint8Array(new Uint8Array([0, 119, 111, 0]).buffer, 1, 2);
+        let chunks = [
+            buffer,
+            view,
+            new GLib.Bytes('rld'),
+            ByteArray.fromString('!'),
+        ];
+        IO.writev(stream, chunks).then(buffers => {
+            stream.close(null);
+            let bytes = stream.steal_as_bytes();
+            expect(ByteArray.fromGBytes(bytes).toString()).toEqual('hello world!');
+            expect(buffer.byteLength).toEqual(0);
+            expect(buffers.length).toEqual(4);
+            expect(buffers[0].byteLength).toEqual(6);
+            expect(buffers[1].byteLength).toEqual(4);
+            expect(buffers[2]).toBeNull();
+            expect(buffers[3]).toBeNull();
+            done();
+        });
+    });
+
+    it('writes chunks sharing an ArrayBuffer', function (done) {
+        let stream = Gio.MemoryOutputStream.new_resizable();
+        let buffer = new Uint8Array(200000).fill(97).buffer;
+        let chunks = [new Uint8Array(buffer, 0, 100000), new Uint8Array(buffer, 100000)];
+        IO.writev(stream, chunks).then(buffers => {
+            expect(stream.get_data_size()).toEqual(200000);
+            expect(buffers[0]).toBe(buffers[1]);
+            done();
+        });
+    });
+
+    it('writes a mapped file without detaching it', function (done) {
+        let [file] = Gio.File.new_tmp('cjs-test-io-XXXXXX');
+        file.replace_contents('mapped', null, false, 0, null);
+        let buffer = IO.mapFile(file);
+        let stream = Gio.MemoryOutputStream.new_resizable();
+        IO.writev(stream, [new Uint8Array(buffer, 1, 4)]).then(buffers => {
+            stream.close(null);
+            let bytes = stream.steal_as_bytes();
+            expect(ByteArray.fromGBytes(bytes).toString()).toEqual('appe');
+            expect(buffer.byteLength).toEqual(6);
+            expect(buffers[0]).toBe(buffer);
+            file.delete(null);
+            done();
+        });
+    });
+
+    it('copies rather than detaches the memory of a ByteArray', function (done) {
+        let stream = Gio.MemoryOutputStream.new_resizable();
+        let array = ByteArray.fromString('hello');
+        let view = array.toUint8Array();
+        IO.writev(stream, [view]).then(buffers => {
+            stream.close(null);
+            let bytes = stream.steal_as_bytes();
+            expect(ByteArray.fromGBytes(bytes).toString()).toEqual('hello');
+            expect(buffers[0]).not.toBe(view.buffer);
+            expect(array[0]).toEqual(104);
+            expect(array.toString()).toEqual('hello');
+            done();
+        });
+        expect(view.length).toEqual(5);
+        expect(array[0]).toEqual(104);
+    });
+
+    it('rejects chunks it cannot write', function (done) {
+        let stream = Gio.MemoryOutputStream.new_resizable();
+        IO.writev(stream, ['text']).catch(e => {
+            expect(e.message).toMatch(/Chunk 0/);
+            done();
+        });
+    });
+});
@@ -4,6 +4,23 @@ describe('GI importer', function () {
         expect(GLib.MAJOR_VERSION).toEqual(2);
     });
 
+    it('enumerates the names in a namespace', function () {
+        const GLib = imports.gi.GLib;
+        let names = Object.keys(GLib);
+        expect(names).toContain('MainLoop');
+        expect(names).toContain('PRIORITY_DEFAULT');
+        expect(names).toContain('get_monotonic_time');
+        expect(names.every(name => name in GLib)).toBeTruthy();
+        expect(names).not.toContain('SourceFunc');
+    });
+
+    it('leaves GType class structs out of a namespace\'s names', function () {
+        const GObject = imports.gi.GObject;
+        let names = Object.keys(GObject);
+        expect(names).toContain('Object');
+        expect(names).not.toContain('ObjectClass');
+    });
+
     describe('on failure', function () {
         // For these tests, we provide special overrides files to sabotage the
         // import, at the path resource:///org/gjs/jsunit/modules/overrides.
@@ -162,6 +179,12 @@ describe('Importer', function () {
         expect(ModUnicode.uval).toEqual('const \u2665 utf8');
     });
 
+    it('keeps the source of modules loaded from resources available', function () {
+        const Lang = imports.lang;
+        expect(Lang.countProperties.toString())
+            .toMatch(/^function countProperties\(obj\) \{/);
+    });
+
     describe("properties defined in the module's lexical scope", function () {
         let LexicalScope;
 
@@ -222,6 +245,132 @@ describe('Importer', function () {
         });
     });
 
+    describe('search path cache', function () {
+        const Gio = imports.gi.Gio;
+        const GLib = imports.gi.GLib;
+        const System = imports.system;
+        let tmpdir;
+
+        beforeAll(function () {
+            tmpdir = GLib.dir_make_tmp('cjs-import-cache-XXXXXX');
+            // A directory modified within the last second is checked more
+            // often, since later changes in that second can't be detected
+            Gio.File.new_for_path(tmpdir).set_attribute_uint64(
+                Gio.FILE_ATTRIBUTE_TIME_MODIFIED, 1000000,
+                Gio.FileQueryInfoFlags.NONE, null);
+            imports.searchPath.push(tmpdir);
+        });
+
+        afterAll(function () {
+            GLib.unlink(GLib.build_filenamev([tmpdir, 'lateModule.js']));
+            GLib.unlink(GLib.build_filenamev([tmpdir, 'sameTickModule.js']));
+            GLib.rmdir(tmpdir);
+            imports.searchPath.pop();
+        });
+
+        it('lists each search directory once', function () {
+            expect(() => imports.notThereEither).toThrow();
+            let before = System.importCacheStats();
+            expect(() => imports.notThereEither).toThrow();
+            let after = System.importCacheStats();
+            expect(after.listings).toEqual(before.listings);
+            expect(after.syscallsAvoided).toBeGreaterThan(before.syscallsAvoided);
+        });
+
+        it('finds a module added later once the cache is cleared', function () {
+            expect(() => imports.lateModule).toThrow();
+            GLib.file_set_contents(GLib.build_filenamev([tmpdir, 'lateModule.js']),
+                'var late = true;');
+            System.clearImportCache();
+            expect(imports.lateModule.late).toBeTruthy();
+        });
+
+        it('finds a module written just before it is imported', function () {
+            expect(() => imports.sameTickModule).toThrow();
+            GLib.file_set_contents(GLib.build_filenamev([tmpdir, 'sameTickModule.js']),
+                'var sameTick = true;');
+            expect(imports.sameTickModule.sameTick).toBeTruthy();
+        });
+    });
+
+    describe('preloading', function () {
+        const GLib = imports.gi.GLib;
+        const System = imports.system;
+        let tmpdir;
+
+        // Big enough for JS::CanCompileOffThread(), which turns down scripts
+        // under 5000 characters, and under 100000 while a GC is pending
+        function writeLargeModule(name) {
+            let source = [];
+            for (let ix = 0; ix < 4000; ix++)
+                source.push(`function add${ix}(x) { return x + ${ix}; }`);
+            source.push('var count = 4000;');
+            GLib.file_set_contents(GLib.build_filenamev([tmpdir, `${name}.js`]),
+                source.join('\n'));
+        }
+
+        beforeAll(function () {
+            tmpdir = GLib.dir_make_tmp('cjs-preload-XXXXXX');
+            writeLargeModule('largePreloadNow');
+            writeLargeModule('largePreloadLater');
+            imports.searchPath.push(tmpdir);
+        });
+
+        afterAll(function () {
+            GLib.unlink(GLib.build_filenamev([tmpdir, 'largePreloadNow.js']));
+            GLib.unlink(GLib.build_filenamev([tmpdir, 'largePreloadLater.js']));
+            GLib.rmdir(tmpdir);
+            imports.searchPath.pop();
+        });
+
+        it('can preload modules that are imported right away', function () {
+            expect(() => System.preloadModules(['subA.subB.baz'])).not.toThrow();
+            expect(imports.subA.subB.baz).toBeDefined();
+        });
+
+        it('can preload modules that are imported later', function (done) {
+            System.preloadModules(['preloaded']);
+            GLib.timeout_add(GLib.PRIORITY_DEFAULT, 100, () => {
+                expect(imports.preloaded.preloaded).toBeTruthy();
+                done();
+                return GLib.SOURCE_REMOVE;
+            });
+        });
+
+        it('finishes compiling a large module imported right away', function () {
+            System.preloadModules(['largePreloadNow']);
+            let module = imports.largePreloadNow;
+            expect(module.count).toEqual(4000);
+            expect(module.add3999(1)).toEqual(4000);
+        });
+
+        it('compiles a large module in the background', function (done) {
+            System.preloadModules(['largePreloadLater']);
+            GLib.timeout_add(GLib.PRIORITY_DEFAULT, 500, () => {
+                let module = imports.largePreloadLater;
+                expect(module.count).toEqual(4000);
+                expect(module.add0(1)).toEqual(1);
+                expect(module.add3999(1)).toEqual(4000);
+                done();
+                return GLib.SOURCE_REMOVE;
+            });
+        });
+
+        it('ignores modules that are not found', function () {
+            expect(() => System.preloadModules(['nonexistentModuleName']))
+                .not.toThrow();
+        });
+
+        it('requires an array of module names', function () {
+            expect(() => System.preloadModules('foobar')).toThrow();
+            expect(() => System.preloadModules([42])).toThrow();
+        });
+
+        it('does not take a name on the root importer', function () {
+            expect(Object.getOwnPropertyNames(imports)).not.toContain('preload');
+        });
+    });
+
     it("doesn't crash when resolving a non-string property", function () {
         expect(imports[0]).not.toBeDefined();
         expect(imports.foobar[0]).not.toBeDefined();
@@ -0,0 +1,97 @@
+const ByteArray = imports.byteArray;
+const Gio = imports.gi.Gio;
+const Serialize = imports.serialize;
+
+function roundTrip(value, sameProcess = false) {
+    return Serialize.decode(Serialize.encode(value, sameProcess), sameProcess);
+}
+
+describe('Serialize', function () {
+    it('encodes into an ArrayBuffer', function () {
+        expect(Serialize.encode({a: 1}) instanceof ArrayBuffer).toBeTruthy();
+    });
+
+    it('round-trips plain values', function () {
+        let value = {num: 4.5, str: 'ünïcödé', list: [1, null, true], nested: {x: 'y'}};
+        expect(roundTrip(value)).toEqual(value);
+    });
+
+    it('keeps typed arrays, Maps, Sets and Dates', function () {
+        let value = {
+            floats: new Float64Array([0.5, -1]),
+            map: new Map([['k', 1], [2, 'v']]),
+            set: new Set([1, 2, 3]),
+            date: new Date(2018, 5, 1),
+        };
+        let copy = roundTrip(value);
+        expect(copy.floats instanceof Float64Array).toBeTruthy();
+        expect(Array.from(copy.floats)).toEqual([0.5, -1]);
+        expect(copy.map.get(2)).toEqual('v');
+        expect(copy.set.has(3)).toBeTruthy();
+        expect(copy.date.getTime()).toEqual(value.date.getTime());
+    });
+
+    it('keeps cyclic references', function () {
+        let value = {};
+        value.self = value;
+        let copy = roundTrip(value);
+        expect(copy.self).toBe(copy);
+    });
+
+    it('encodes ByteArrays by value', function () {
+        let copy = roundTrip({bytes: ByteArray.fromString('bytes')});
+        expect(copy.bytes instanceof ByteArray.ByteArray).toBeTruthy();
+        expect(copy.bytes.toString()).toEqual('bytes');
+    });
+
+    it('decodes from a typed array', function () {
+        let view = new Uint8Array(Serialize.encode([1, 2]));
+        expect(Serialize.decode(view)).toEqual([1, 2]);
+    });
+
+    it('encodes GObjects by handle in the same process', function () {
+        let cancellable = new Gio.Cancellable();
+        expect(roundTrip({cancellable}, true).cancellable).toBe(cancellable);
+    });
+
+    it('refuses GObjects in data for another process', function () {
+        expect(() => Serialize.encode(new Gio.Cancellable()))
+            .toThrowError(/same process/);
+    });
+
+    it('refuses functions', function () {
+        expect(() => Serialize.encode({f() {}})).toThrow();
+    });
+
+    it('rejects data that is not serialized', function () {
+        expect(() => Serialize.decode(new ArrayBuffer(3))).toThrow();
+    });
+
+    it('rejects a ByteArray longer than the data', function () {
+        const SCTAG_GJS_BYTE_ARRAY = 0xFFFF8000;  // JS_SCTAG_USER_MIN
+        let words = new Uint32Array(Serialize.encode(ByteArray.fromString('x')));
+        // Pairs are little-endian: the length comes before the tag
+        let index = words.findIndex((word, ix) =>
+            ix % 2 === 1 && word === SCTAG_GJS_BYTE_ARRAY);
+        expect(index).toBeGreaterThan(0);
+        words[index - 1] = 0xFFFFFFF0;
+        expect(() => Serialize.decode(words))
+            .toThrowError(/longer than the data/);
+    });
+
+    it('rejects data with a transfer map', function () {
+        const SCTAG_HEADER = 0xFFF10000;
+        const SCTAG_TRANSFER_MAP_HEADER = 0xFFFF0200;
+        let words = new Uint32Array(Serialize.encode(1));
+        expect(() => Serialize.decode(new Uint32Array([0, SCTAG_TRANSFER_MAP_HEADER, ...words])))
+            .toThrowError(/pointers/);
+        if (words[1] === SCTAG_HEADER) {
+            let withMap = Uint32Array.from(words);
+            withMap.set([0, SCTAG_TRANSFER_MAP_HEADER], 2);
+            expect(() => Serialize.decode(withMap)).toThrowError(/pointers/);
+            let sameThread = Uint32Array.from(words);
+            sameThread[0] = 0;
+            expect(() => Serialize.decode(sameThread)).toThrowError(/pointers/);
+        }
+    });
+});
@@ -28,3 +28,89 @@ describe('System.gc()', function () {
         expect(System.gc).not.toThrow();
     });
 });
+
+describe('System GC tuning', function () {
+    let originalProfile;
+
+    beforeEach(function () {
+        originalProfile = System.getGCProfile();
+    });
+
+    afterEach(function () {
+        System.setGCProfile(originalProfile);
+    });
+
+    it('switches between GC profiles', function () {
+        System.setGCProfile('low-latency');
+        expect(System.getGCProfile()).toEqual('low-latency');
+        expect(System.getGCParameter('sliceTimeBudget')).toEqual(5);
+        System.setGCProfile('throughput');
+        expect(System.getGCParameter('sliceTimeBudget')).toEqual(50);
+    });
+
+    it('throws on an unknown GC profile', function () {
+        expect(() => System.setGCProfile('nonexistent')).toThrow();
+    });
+
+    it('overrides individual GC parameters', function () {
+        System.setGCParameter('sliceTimeBudget', 7);
+        expect(System.getGCParameter('sliceTimeBudget')).toEqual(7);
+    });
+
+    it('has no heap limit by default, but allows setting one', function () {
+        expect(System.getGCParameter('maxBytes')).toEqual(0xffffffff);
+        System.setGCParameter('maxBytes', 1024 * 1024 * 1024);
+        expect(System.getGCParameter('maxBytes')).toEqual(1024 * 1024 * 1024);
+        System.setGCProfile(originalProfile);
+        expect(System.getGCParameter('maxBytes')).toEqual(0xffffffff);
+    });
+
+    it('reads GC statistics', function () {
+        expect(System.getGCParameter('gcBytes')).toBeGreaterThan(0);
+    });
+
+    it('refuses to set read-only or unknown GC parameters', function () {
+        expect(() => System.setGCParameter('gcBytes', 0)).toThrow();
+        expect(() => System.setGCParameter('nonexistent', 0)).toThrow();
+    });
+});
+
+describe('System.gcStats()', function () {
+    it('records GC slices', function () {
+        System.gc();
+        let stats = System.gcStats();
+        expect(stats.cycles).toBeGreaterThan(0);
+        expect(stats.slices).toBeGreaterThan(0);
+        expect(stats.recent.length).toBeGreaterThan(0);
+        let slice = stats.recent[stats.recent.length - 1];
+        expect(slice.duration).not.toBeLessThan(0);
+        expect(typeof slice.reason).toEqual('string');
+        expect(slice.heapBefore).toBeGreaterThan(0);
+    });
+
+    it('summarizes pause times', function () {
+        System.gc();
+        let {pauses, histogram} = System.gcStats();
+        expect(pauses.p50).not.toBeGreaterThan(pauses.p95);
+        expect(pauses.p95).not.toBeGreaterThan(pauses.max);
+        expect(histogram[histogram.length - 1].upTo).toEqual(Infinity);
+        let total = histogram.reduce((sum, bucket) => sum + bucket.count, 0);
+        expect(total).not.toBeLessThan(pauses.count);
+    });
+});
+
+describe('System.jobQueueStats()', function () {
+    it('counts queued promise callbacks', function (done) {
+        let before = System.jobQueueStats();
+        Promise.resolve().then(() => {});
+        Promise.resolve().then(() => {});
+        expect(System.jobQueueStats().pending).not.toBeLessThan(2);
+        Promise.resolve().then(() => {
+            let after = System.jobQueueStats();
+            expect(after.drains).toBeGreaterThan(before.drains);
+            expect(after.maxDepth).not.toBeLessThan(2);
+            expect(after.longestDrain).not.toBeLessThan(0);
+            done();
+        });
+    });
+});
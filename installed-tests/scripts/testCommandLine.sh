@@ -2,8 +2,10 @@
 
 if test "$GJS_USE_UNINSTALLED_FILES" = "1"; then
     gjs="$LOG_COMPILER $LOG_FLAGS $TOP_BUILDDIR/cjs-console"
+    bundle="$TOP_BUILDDIR/cjs-bundle"
 else
     gjs="$LOG_COMPILER $LOG_FLAGS cjs-console"
+    bundle="cjs-bundle"
 fi
 
 # Avoid interference in the profiler tests from stray environment variable
@@ -212,6 +214,82 @@ report "main program exceptions are not swallowed by queued promise jobs"
 $gjs -c 'new imports.gi.Gio.Subprocess({argv: ["true"]}).init(null);'
 report "object unref from other thread after shutdown should not race"
 
+# --zygote
+rm -f zygote.sock
+# Defines procStat(), returning the script's process ID and parent's process ID
+# Clients only use the zygote if their standard input is not a terminal
+procstat='function procStat() { let [, stat] = imports.gi.GLib.file_get_contents("/proc/self/stat"); stat = stat.toString(); return [stat.split(" ")[0], stat.slice(stat.lastIndexOf(")") + 2).split(" ")[1]]; }'
+$gjs --zygote=$PWD/zygote.sock &
+zygote_pid=$!
+for i in $(seq 50); do test -S zygote.sock && break; sleep 0.1; done
+test -S zygote.sock
+report "--zygote should listen on the given socket"
+CJS_ZYGOTE_SOCKET=$PWD/zygote.sock $gjs -c 'imports.system.exit(42)' </dev/null
+test $? -eq 42
+report "a zygote worker should pass on the exit code of the script"
+test "$(CJS_ZYGOTE_SOCKET=$PWD/zygote.sock $gjs -c "$procstat; print(procStat()[1])" </dev/null)" = "$zygote_pid"
+report "a zygote client's script should run in a worker forked from the zygote"
+runworker="$procstat; imports.gi.GLib.file_set_contents('worker.pid', procStat()[0]); new imports.gi.GLib.MainLoop(null, false).run()"
+# Prints the state letter of a process, T when stopped
+procstate () { sed 's/.*) //' /proc/$1/stat | cut -d' ' -f1; }
+CJS_ZYGOTE_SOCKET=$PWD/zygote.sock $gjs -c "$runworker" </dev/null &
+client_pid=$!
+for i in $(seq 50); do test -s worker.pid && break; sleep 0.1; done
+kill -TERM $client_pid
+wait $client_pid
+test $? -eq 143 && ! kill -0 "$(cat worker.pid)" 2>/dev/null
+report "a zygote client should forward signals to the worker"
+rm -f worker.pid
+test "$(cd / && CJS_ZYGOTE_SOCKET=$OLDPWD/zygote.sock FOO=bar $gjs -c 'print(ARGV.join(","), imports.gi.GLib.getenv("FOO"), imports.gi.GLib.get_current_dir())' a 'b c' </dev/null)" = "a,b c bar /"
+report "a zygote worker should use the client's arguments, environment and directory"
+CJS_ZYGOTE_SOCKET=$PWD/zygote.sock $gjs -c "$runworker" </dev/null &
+client_pid=$!
+for i in $(seq 50); do test -s worker.pid && break; sleep 0.1; done
+worker_pid=$(cat worker.pid)
+kill -TSTP $client_pid
+for i in $(seq 50); do test "$(procstate $worker_pid)" = T && break; sleep 0.1; done
+test "$(procstate $worker_pid)" = T && test "$(procstate $client_pid)" = T
+report "a zygote client should stop the worker when it is stopped"
+kill -CONT $client_pid
+for i in $(seq 50); do test "$(procstate $worker_pid)" != T && break; sleep 0.1; done
+test "$(procstate $worker_pid)" != T
+report "a zygote client should continue the worker when it is continued"
+kill $zygote_pid
+wait $zygote_pid
+test ! -e zygote.sock
+report "a zygote should remove its socket when terminated"
+wait $client_pid
+test $? -eq 129 && ! kill -0 $worker_pid 2>/dev/null
+report "a terminated zygote should hang up on its workers and report their exit"
+rm -f worker.pid
+CJS_ZYGOTE_SOCKET=$PWD/zygote.sock $gjs -c 'imports.system.exit(42)'
+test $? -eq 42
+report "cjs should run the script itself if no zygote is listening"
+test "$(CJS_ZYGOTE_SOCKET=$PWD/zygote.sock $gjs -c "$procstat; print(procStat()[1])")" != "$zygote_pid"
+report "cjs should not be forked from the zygote if it is not listening"
+
+# cjs-bundle
+rm -rf bundlesrc test.cjsbundle test2.cjsbundle
+mkdir -p bundlesrc/sub
+echo 'var answer = 42;' >bundlesrc/top.js
+echo 'var nested = "yes";' >bundlesrc/sub/inner.js
+echo 'not a module' >bundlesrc/README
+$bundle -o test.cjsbundle bundlesrc
+report "cjs-bundle should pack a directory"
+$gjs -c "imports.searchPath.unshift('$PWD/test.cjsbundle'); imports.system.exit(imports.top.answer);"
+test $? -eq 42
+report "modules should be importable from a bundle"
+$gjs -c "imports.searchPath.unshift('$PWD/test.cjsbundle'); imports.system.exit(imports.sub.inner.nested === 'yes' ? 0 : 1);"
+report "modules in subdirectories of a bundle should be importable"
+$gjs -c "imports.searchPath.unshift('$PWD/test.cjsbundle'); imports.system.exit(Object.keys(imports).includes('README') ? 1 : 0);"
+report "cjs-bundle should only pack modules and directories"
+touch bundlesrc/top.js
+$bundle -o test2.cjsbundle bundlesrc && cmp -s test.cjsbundle test2.cjsbundle
+report "cjs-bundle output should only depend on names and contents"
+$bundle bundlesrc 2>/dev/null
+report_xfail "cjs-bundle should require an output file"
+rm -rf bundlesrc test.cjsbundle test2.cjsbundle
+
 rm -f exit.js help.js promise.js awaitcatch.js
 
 echo "1..$total"
@@ -9,6 +9,9 @@
 enum {
     PROP_0,
     PROP_G_INTERFACE_INFO,
+    PROP_FLUSH_INTERVAL,
+    PROP_N_PROPERTY_CHANGES,
+    PROP_N_PROPERTIES_CHANGED_SIGNALS,
     PROP_LAST
 };
 
@@ -25,9 +28,18 @@ struct _GjsDBusImplementationPrivate {
     GDBusInterfaceVTable  vtable;
     GDBusInterfaceInfo   *ifaceinfo;
 
-    // from gchar* to GVariant*
+    // from gchar* to GVariant*, or NULL if the property was invalidated
     GHashTable           *outstanding_properties;
     guint                 idle_id;
+    unsigned              flush_interval;  /* ms, or 0 for the next idle */
+
+    /* Their ratio is how many changes each PropertiesChanged signal carries */
+    guint64               n_property_changes;
+    guint64               n_properties_changed_signals;
+
+    GjsDBusMethodCallFunc method_call_func;
+    void                 *method_call_data;
+    GDestroyNotify        method_call_destroy;
 };
 
 /* Temporary workaround for https://bugzilla.gnome.org/show_bug.cgi?id=793175 */
@@ -53,6 +65,12 @@ gjs_dbus_implementation_method_call(GDBusConnection       *connection,
 {
     GjsDBusImplementation *self = GJS_DBUS_IMPLEMENTATION (user_data);
 
+    if (self->priv->method_call_func) {
+        self->priv->method_call_func(self, method_name, parameters, invocation,
+                                     self->priv->method_call_data);
+        return;
+    }
+
     g_signal_emit(self, signals[SIGNAL_HANDLE_METHOD], 0, method_name, parameters, invocation);
     g_object_unref (invocation);
 }
@@ -96,6 +114,13 @@ gjs_dbus_implementation_property_set(GDBusConnection       *connection,
     return true;
 }
 
+static void
+variant_unref_if_set(void *value)
+{
+    if (value)
+        g_variant_unref(static_cast<GVariant *>(value));
+}
+
 static void
 gjs_dbus_implementation_init(GjsDBusImplementation *self) {
     GjsDBusImplementationPrivate *priv = G_TYPE_INSTANCE_GET_PRIVATE (self, GJS_TYPE_DBUS_IMPLEMENTATION, GjsDBusImplementationPrivate);
@@ -106,15 +131,19 @@ gjs_dbus_implementation_init(GjsDBusImplementation *self) {
     priv->vtable.get_property = gjs_dbus_implementation_property_get;
     priv->vtable.set_property = gjs_dbus_implementation_property_set;
 
-    priv->outstanding_properties = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+    priv->outstanding_properties = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, variant_unref_if_set);
 }
 
 static void
 gjs_dbus_implementation_finalize(GObject *object) {
     GjsDBusImplementation *self = GJS_DBUS_IMPLEMENTATION (object);
 
+    if (self->priv->idle_id)
+        g_source_remove(self->priv->idle_id);
     g_dbus_interface_info_unref (self->priv->ifaceinfo);
     g_hash_table_unref (self->priv->outstanding_properties);
+    if (self->priv->method_call_destroy)
+        self->priv->method_call_destroy(self->priv->method_call_data);
 
     G_OBJECT_CLASS(gjs_dbus_implementation_parent_class)->finalize(object);
 }
@@ -128,6 +157,29 @@ gjs_dbus_implementation_set_property(GObject *object, guint property_id, const G
     case PROP_G_INTERFACE_INFO:
         self->priv->ifaceinfo = (GDBusInterfaceInfo*) g_value_dup_boxed (value);
         break;
+    case PROP_FLUSH_INTERVAL:
+        self->priv->flush_interval = g_value_get_uint (value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+gjs_dbus_implementation_get_property(GObject *object, guint property_id, GValue *value, GParamSpec *pspec)
+{
+    GjsDBusImplementation *self = GJS_DBUS_IMPLEMENTATION (object);
+
+    switch (property_id) {
+    case PROP_FLUSH_INTERVAL:
+        g_value_set_uint (value, self->priv->flush_interval);
+        break;
+    case PROP_N_PROPERTY_CHANGES:
+        g_value_set_uint64 (value, self->priv->n_property_changes);
+        break;
+    case PROP_N_PROPERTIES_CHANGED_SIGNALS:
+        g_value_set_uint64 (value, self->priv->n_properties_changed_signals);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -177,6 +229,7 @@ gjs_dbus_implementation_get_properties (GDBusInterfaceSkeleton *skeleton) {
 static void
 gjs_dbus_implementation_flush (GDBusInterfaceSkeleton *skeleton) {
     GjsDBusImplementation *self = GJS_DBUS_IMPLEMENTATION (skeleton);
+    GDBusConnection *connection = g_dbus_interface_skeleton_get_connection(skeleton);
 
     GVariantBuilder changed_props;
     GVariantBuilder invalidated_props;
@@ -184,6 +237,19 @@ gjs_dbus_implementation_flush (GDBusInterfaceSkeleton *skeleton) {
     GVariant *val;
     gchar *prop_name;
 
+    if (self->priv->idle_id) {
+        g_source_remove(self->priv->idle_id);
+        self->priv->idle_id = 0;
+    }
+
+    /* Nothing to tell, or nobody to tell it to */
+    if (g_hash_table_size(self->priv->outstanding_properties) == 0)
+        return;
+    if (!connection) {
+        g_hash_table_remove_all(self->priv->outstanding_properties);
+        return;
+    }
+
     g_variant_builder_init(&changed_props, G_VARIANT_TYPE_VARDICT);
     g_variant_builder_init(&invalidated_props, G_VARIANT_TYPE_STRING_ARRAY);
 
@@ -195,7 +261,7 @@ gjs_dbus_implementation_flush (GDBusInterfaceSkeleton *skeleton) {
             g_variant_builder_add(&invalidated_props, "s", prop_name);
     }
 
-    g_dbus_connection_emit_signal(g_dbus_interface_skeleton_get_connection(skeleton),
+    g_dbus_connection_emit_signal(connection,
                                   NULL, /* bus name */
                                   g_dbus_interface_skeleton_get_object_path(skeleton),
                                   "org.freedesktop.DBus.Properties",
@@ -205,12 +271,9 @@ gjs_dbus_implementation_flush (GDBusInterfaceSkeleton *skeleton) {
                                                 g_variant_builder_end(&changed_props),
                                                 g_variant_builder_end(&invalidated_props)),
                                    NULL /* error */);
+    self->priv->n_properties_changed_signals++;
 
     g_hash_table_remove_all(self->priv->outstanding_properties);
-    if (self->priv->idle_id) {
-        g_source_remove(self->priv->idle_id);
-        self->priv->idle_id = 0;
-    }
 }
 
 void
@@ -220,6 +283,7 @@ gjs_dbus_implementation_class_init(GjsDBusImplementationClass *klass) {
 
     gobject_class->finalize = gjs_dbus_implementation_finalize;
     gobject_class->set_property = gjs_dbus_implementation_set_property;
+    gobject_class->get_property = gjs_dbus_implementation_get_property;
 
     skeleton_class->get_info = gjs_dbus_implementation_get_info;
     skeleton_class->get_vtable = gjs_dbus_implementation_get_vtable;
@@ -233,6 +297,35 @@ gjs_dbus_implementation_class_init(GjsDBusImplementationClass *klass) {
                                                        G_TYPE_DBUS_INTERFACE_INFO,
                                                        (GParamFlags) (G_PARAM_STATIC_STRINGS | G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
 
+    /**
+     * GjsDBusImplementation:flush-interval:
+     *
+     * How long property changes are collected before they are emitted, in
+     * milliseconds, as one PropertiesChanged signal. 0 means until the main
+     * loop is next idle. A change to the interval applies from the next
+     * batch.
+     */
+    g_object_class_install_property(gobject_class, PROP_FLUSH_INTERVAL,
+                                    g_param_spec_uint("flush-interval",
+                                                      "Flush interval",
+                                                      "Time in milliseconds to collect property changes for, or 0 for the next idle",
+                                                      0, G_MAXUINT, 0,
+                                                      (GParamFlags) (G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE)));
+
+    g_object_class_install_property(gobject_class, PROP_N_PROPERTY_CHANGES,
+                                    g_param_spec_uint64("n-property-changes",
+                                                        "Property changes",
+                                                        "Number of property changes queued for emission",
+                                                        0, G_MAXUINT64, 0,
+                                                        (GParamFlags) (G_PARAM_STATIC_STRINGS | G_PARAM_READABLE)));
+
+    g_object_class_install_property(gobject_class, PROP_N_PROPERTIES_CHANGED_SIGNALS,
+                                    g_param_spec_uint64("n-properties-changed-signals",
+                                                        "PropertiesChanged signals",
+                                                        "Number of PropertiesChanged signals emitted",
+                                                        0, G_MAXUINT64, 0,
+                                                        (GParamFlags) (G_PARAM_STATIC_STRINGS | G_PARAM_READABLE)));
+
     signals[SIGNAL_HANDLE_METHOD] = g_signal_new("handle-method-call",
                                                  G_TYPE_FROM_CLASS(klass),
                                                  (GSignalFlags) 0, /* flags */
@@ -273,9 +366,11 @@ gjs_dbus_implementation_class_init(GjsDBusImplementationClass *klass) {
 
 static gboolean
 idle_cb (gpointer data) {
-    GDBusInterfaceSkeleton *skeleton = G_DBUS_INTERFACE_SKELETON (data);
+    GjsDBusImplementation *self = GJS_DBUS_IMPLEMENTATION (data);
 
-    g_dbus_interface_skeleton_flush(skeleton);
+    /* The source is finished either way, don't let flush remove it */
+    self->priv->idle_id = 0;
+    g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON (self));
     return G_SOURCE_REMOVE;
 }
 
@@ -286,17 +381,28 @@ idle_cb (gpointer data) {
  * @newvalue: (allow-none): the new value, or %NULL to just invalidate it
  *
  * Queue a PropertyChanged signal for emission, or update the one queued
- * adding @property
+ * adding @property. Changes are collected for #GjsDBusImplementation:flush-interval
+ * and emitted together, with the last value of each property; use
+ * g_dbus_interface_skeleton_flush() to emit them right away.
  */
 void
 gjs_dbus_implementation_emit_property_changed (GjsDBusImplementation *self,
                                                gchar                 *property,
                                                GVariant              *newvalue)
 {
-    g_hash_table_replace (self->priv->outstanding_properties, g_strdup (property), g_variant_ref (newvalue));
+    GjsDBusImplementationPrivate *priv = self->priv;
 
-    if (!self->priv->idle_id)
-        self->priv->idle_id = g_idle_add(idle_cb, self);
+    g_hash_table_replace (priv->outstanding_properties, g_strdup (property),
+                          newvalue ? g_variant_ref_sink (newvalue) : NULL);
+    priv->n_property_changes++;
+
+    if (priv->idle_id)
+        return;
+
+    if (priv->flush_interval)
+        priv->idle_id = g_timeout_add(priv->flush_interval, idle_cb, self);
+    else
+        priv->idle_id = g_idle_add(idle_cb, self);
 }
 
 /**
@@ -323,3 +429,30 @@ gjs_dbus_implementation_emit_signal (GjsDBusImplementation *self,
                                   parameters,
                                   NULL);
 }
+
+/**
+ * gjs_dbus_implementation_set_method_call_func: (skip)
+ * @self: a #GjsDBusImplementation
+ * @func: (allow-none): function to handle method calls, or %NULL to emit
+ *   #GjsDBusImplementation::handle-method-call again
+ * @user_data: data for @func
+ * @destroy: (allow-none): called on @user_data when it is no longer needed
+ *
+ * Routes method calls on @self straight to @func, skipping the signal
+ * emission. Used by the JS bindings to dispatch calls on exported objects.
+ */
+void
+gjs_dbus_implementation_set_method_call_func (GjsDBusImplementation *self,
+                                              GjsDBusMethodCallFunc  func,
+                                              void                  *user_data,
+                                              GDestroyNotify         destroy)
+{
+    GjsDBusImplementationPrivate *priv = self->priv;
+
+    if (priv->method_call_destroy)
+        priv->method_call_destroy(priv->method_call_data);
+
+    priv->method_call_func = func;
+    priv->method_call_data = user_data;
+    priv->method_call_destroy = destroy;
+}
@@ -52,12 +52,31 @@ struct _GjsDBusImplementationClass {
     GDBusInterfaceSkeletonClass parent_class;
 };
 
+/**
+ * GjsDBusMethodCallFunc: (skip)
+ *
+ * Handles a method call on a #GjsDBusImplementation, instead of the
+ * #GjsDBusImplementation::handle-method-call signal. The function owns
+ * @invocation, like a #GDBusInterfaceMethodCallFunc does: it must return a
+ * value or an error on it, or otherwise release it.
+ */
+typedef void (*GjsDBusMethodCallFunc) (GjsDBusImplementation *self,
+                                       const char            *method_name,
+                                       GVariant              *parameters,
+                                       GDBusMethodInvocation *invocation,
+                                       void                  *user_data);
+
 GJS_EXPORT
 GType                  gjs_dbus_implementation_get_type (void);
 
 void                   gjs_dbus_implementation_emit_property_changed (GjsDBusImplementation *self, gchar *property, GVariant *newvalue);
 void                   gjs_dbus_implementation_emit_signal           (GjsDBusImplementation *self, gchar *signal_name, GVariant *parameters);
 
+void                   gjs_dbus_implementation_set_method_call_func  (GjsDBusImplementation *self,
+                                                                      GjsDBusMethodCallFunc  func,
+                                                                      void                  *user_data,
+                                                                      GDestroyNotify         destroy);
+
 G_END_DECLS
 
 #endif  /* __GJS_UTIL_DBUS_H__ */
@@ -0,0 +1,785 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+
+#include "cjs/jsapi-wrapper.h"
+
+#include "gi/boxed.h"
+#include "gi/closure.h"
+#include "gi/gerror.h"
+#include "gi/object.h"
+#include "cjs/byteArray.h"
+#include "cjs/jsapi-util-args.h"
+#include "io.h"
+
+/* Native side of imports.io, see modules/io.js.
+ *
+ * Memory handed to GIO for an asynchronous read or write must stay put until
+ * the operation is done, but JS code could detach an ArrayBuffer at any time
+ * in the meantime. So the ArrayBuffers are transferred instead: their
+ * contents are stolen, which detaches them, and are given back to the
+ * callback in new ArrayBuffers once GIO is done with them. That doesn't copy
+ * the bytes, except for small ArrayBuffers whose bytes are stored inline in
+ * the object, and for the ArrayBuffer of a ByteArray's toUint8Array() view,
+ * which is copied so as not to take the bytes away from the ByteArray.
+ *
+ * Stealing the contents of an ArrayBuffer from mapFile() would copy the whole
+ * file, so writev() writes straight from the mapping instead, keeping the
+ * ArrayBuffer rooted meanwhile. The mapping belongs to the ArrayBuffer object
+ * until it is finalized, even if JS detaches it, so it stays valid. */
+
+/* Slices smaller than IO_SMALL_SLICE are gathered into one write of up to
+ * IO_BATCH_SIZE bytes. GLib only has writev since 2.60. */
+#define IO_BATCH_SIZE (64 * 1024)
+#define IO_SMALL_SLICE (IO_BATCH_SIZE / 4)
+
+/* Takes ownership of @contents, which must have been allocated with
+ * js_malloc() and friends, or be null if @capacity is 0 */
+static JSObject *
+io_buffer_new(JSContext *cx,
+              void      *contents,
+              size_t     capacity)
+{
+    if (!contents)
+        return JS_NewArrayBuffer(cx, 0);
+
+    JSObject *buffer = JS_NewArrayBufferWithContents(cx, capacity, contents);
+    if (!buffer)
+        js_free(contents);
+    return buffer;
+}
+
+/* Detaches @buffer, unless a ByteArray keeps its bytes in it; the contents
+ * are null if it was empty */
+static bool
+io_steal_buffer(JSContext       *cx,
+                JS::HandleObject buffer,
+                void           **contents_out,
+                size_t          *capacity_out)
+{
+    if (JS_IsDetachedArrayBufferObject(buffer)) {
+        gjs_throw(cx, "ArrayBuffer is detached");
+        return false;
+    }
+
+    *capacity_out = JS_GetArrayBufferByteLength(buffer);
+    if (*capacity_out == 0) {
+        *contents_out = nullptr;
+        return true;
+    }
+
+    if (gjs_array_buffer_backs_byte_array(cx, buffer)) {
+        *contents_out = js_malloc(*capacity_out);
+        if (!*contents_out) {
+            JS_ReportOutOfMemory(cx);
+            return false;
+        }
+
+        bool is_shared;
+        JS::AutoCheckCannotGC nogc;
+        memcpy(*contents_out, JS_GetArrayBufferData(buffer, &is_shared, nogc),
+               *capacity_out);
+        return true;
+    }
+
+    *contents_out = JS_StealArrayBufferContents(cx, buffer);
+    return *contents_out != nullptr;
+}
+
+/* Finds the ArrayBuffer and the byte range covered by an ArrayBuffer or a
+ * typed array */
+static bool
+io_get_buffer_range(JSContext              *cx,
+                    JS::HandleObject        obj,
+                    JS::MutableHandleObject buffer,
+                    size_t                 *offset,
+                    size_t                 *length)
+{
+    if (JS_IsArrayBufferObject(obj)) {
+        buffer.set(obj);
+        *offset = 0;
+        *length = JS_GetArrayBufferByteLength(obj);
+        return true;
+    }
+
+    if (JS_IsTypedArrayObject(obj)) {
+        bool is_shared;
+        *offset = JS_GetTypedArrayByteOffset(obj);
+        *length = JS_GetTypedArrayByteLength(obj);
+        buffer.set(JS_GetArrayBufferViewBuffer(cx, obj, &is_shared));
+        if (!buffer)
+            return false;
+        if (is_shared) {
+            gjs_throw(cx, "SharedArrayBuffers are not supported");
+            return false;
+        }
+        return true;
+    }
+
+    gjs_throw(cx, "Expected an ArrayBuffer or a typed array");
+    return false;
+}
+
+static GClosure *
+io_callback_new(JSContext       *cx,
+                JS::HandleObject callback,
+                const char      *description)
+{
+    GClosure *closure = gjs_closure_new(cx, callback, description, true);
+    g_closure_ref(closure);
+    g_closure_sink(closure);
+    return closure;
+}
+
+static void
+io_callback_free(GClosure *closure)
+{
+    g_closure_invalidate(closure);
+    g_closure_unref(closure);
+}
+
+static bool
+io_check_stream_args(JSContext       *cx,
+                     JS::HandleObject stream,
+                     GType            stream_type,
+                     JS::HandleObject cancellable,
+                     JS::HandleObject callback)
+{
+    if (!gjs_typecheck_object(cx, stream, stream_type, true))
+        return false;
+    if (cancellable &&
+        !gjs_typecheck_object(cx, cancellable, G_TYPE_CANCELLABLE, true))
+        return false;
+    if (!JS::IsCallable(callback)) {
+        gjs_throw(cx, "Callback is not a function");
+        return false;
+    }
+    return true;
+}
+
+static bool
+io_map_file(JSContext *cx,
+            unsigned   argc,
+            JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    GjsAutoChar path;
+
+    if (!args.requireAtLeast(cx, "mapFile", 1))
+        return false;
+
+    if (args[0].isObject()) {
+        JS::RootedObject file_obj(cx, &args[0].toObject());
+        if (!gjs_typecheck_object(cx, file_obj, G_TYPE_FILE, true))
+            return false;
+        path = g_file_get_path(G_FILE(gjs_g_object_from_object(cx, file_obj)));
+        if (!path) {
+            gjs_throw(cx, "Only local files can be mapped");
+            return false;
+        }
+    } else if (!gjs_string_to_filename(cx, args[0], &path)) {
+        return false;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        int errsv = errno;
+        if (fd >= 0)
+            close(fd);
+        gjs_throw_g_error(cx, g_error_new(G_FILE_ERROR,
+                                          g_file_error_from_errno(errsv),
+                                          "Failed to open file “%s”: %s",
+                                          path.get(), g_strerror(errsv)));
+        return false;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        gjs_throw(cx, "“%s” is not a regular file", path.get());
+        return false;
+    }
+
+    /* Mapping nothing fails */
+    if (st.st_size == 0) {
+        close(fd);
+        JSObject *empty = JS_NewArrayBuffer(cx, 0);
+        if (!empty)
+            return false;
+        args.rval().setObject(*empty);
+        return true;
+    }
+
+    size_t size = st.st_size;
+    void *contents = JS_CreateMappedArrayBufferContents(fd, 0, size);
+    close(fd);
+    if (!contents) {
+        gjs_throw(cx, "Failed to map file “%s”", path.get());
+        return false;
+    }
+
+    JSObject *buffer = JS_NewMappedArrayBufferWithContents(cx, size, contents);
+    if (!buffer) {
+        JS_ReleaseMappedArrayBufferContents(contents, size);
+        return false;
+    }
+
+    args.rval().setObject(*buffer);
+    return true;
+}
+
+typedef struct {
+    GClosure *callback;
+    GInputStream *stream;
+    GCancellable *cancellable;
+    int priority;
+    size_t chunk_size;
+
+    void *contents;  /* stolen from the ArrayBuffer */
+    size_t capacity;
+    size_t offset;
+    size_t length;
+    size_t pos;
+} IoReadOp;
+
+static void
+io_read_op_free(IoReadOp *op)
+{
+    js_free(op->contents);
+    io_callback_free(op->callback);
+    g_object_unref(op->stream);
+    g_clear_object(&op->cancellable);
+    g_slice_free(IoReadOp, op);
+}
+
+/* Calls back with (error, buffer, offset, bytesRead) */
+static void
+io_read_op_finish(IoReadOp *op,
+                  GError   *error)
+{
+    if (gjs_closure_is_valid(op->callback)) {
+        JSContext *cx = gjs_closure_get_context(op->callback);
+        JSAutoRequest ar(cx);
+        JSAutoCompartment ac(cx, gjs_closure_get_callable(op->callback));
+
+        JS::AutoValueArray<4> cb_args(cx);
+        JS::RootedObject this_obj(cx);
+        JS::RootedValue rval(cx);
+        JS::RootedObject buffer(cx, io_buffer_new(cx, op->contents,
+                                                  op->capacity));
+        JS::RootedObject error_obj(cx);
+        op->contents = nullptr;
+
+        if (error)
+            error_obj = gjs_error_from_gerror(cx, error, true);
+
+        if (!buffer || (error && !error_obj)) {
+            gjs_log_exception(cx);
+        } else {
+            cb_args[0].setObjectOrNull(error_obj);
+            cb_args[1].setObject(*buffer);
+            cb_args[2].setNumber(double(op->offset));
+            cb_args[3].setNumber(double(op->pos));
+            gjs_closure_invoke(op->callback, this_obj, cb_args, &rval, false);
+        }
+    }
+
+    io_read_op_free(op);
+}
+
+static void io_on_read_done(GObject      *source,
+                            GAsyncResult *result,
+                            void         *data);
+
+static void
+io_read_next_chunk(IoReadOp *op)
+{
+    size_t count = MIN(op->chunk_size, op->length - op->pos);
+    g_input_stream_read_async(op->stream,
+                              static_cast<char *>(op->contents) + op->offset + op->pos,
+                              count, op->priority, op->cancellable,
+                              io_on_read_done, op);
+}
+
+static void
+io_on_read_done(GObject      *source,
+                GAsyncResult *result,
+                void         *data)
+{
+    auto op = static_cast<IoReadOp *>(data);
+    GError *error = nullptr;
+
+    gssize n_read = g_input_stream_read_finish(G_INPUT_STREAM(source), result,
+                                               &error);
+    if (n_read < 0) {
+        io_read_op_finish(op, error);
+        g_error_free(error);
+        return;
+    }
+
+    op->pos += n_read;
+    if (n_read == 0 || op->pos == op->length)
+        io_read_op_finish(op, nullptr);
+    else
+        io_read_next_chunk(op);
+}
+
+/* readInto(stream, buffer, chunkSize, priority, cancellable, callback):
+ * reads into @buffer, an ArrayBuffer or a typed array, until it is full or
+ * the stream ends, at most @chunkSize bytes at a time */
+static bool
+io_read_into(JSContext *cx,
+             unsigned   argc,
+             JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    JS::RootedObject stream(cx), target(cx), cancellable(cx), callback(cx);
+    JS::RootedObject buffer(cx);
+    uint32_t chunk_size;
+    int32_t priority;
+    size_t offset, length;
+
+    if (!gjs_parse_call_args(cx, "readInto", args, "oou i?oo",
+                             "stream", &stream,
+                             "buffer", &target,
+                             "chunkSize", &chunk_size,
+                             "priority", &priority,
+                             "cancellable", &cancellable,
+                             "callback", &callback))
+        return false;
+
+    if (!io_check_stream_args(cx, stream, G_TYPE_INPUT_STREAM, cancellable,
+                              callback) ||
+        !io_get_buffer_range(cx, target, &buffer, &offset, &length))
+        return false;
+
+    if (chunk_size == 0) {
+        gjs_throw(cx, "Chunk size must be positive");
+        return false;
+    }
+
+    auto op = g_slice_new0(IoReadOp);
+    if (!io_steal_buffer(cx, buffer, &op->contents, &op->capacity)) {
+        g_slice_free(IoReadOp, op);
+        return false;
+    }
+
+    op->callback = io_callback_new(cx, callback, "readInto");
+    op->stream = G_INPUT_STREAM(g_object_ref(gjs_g_object_from_object(cx, stream)));
+    if (cancellable)
+        op->cancellable = G_CANCELLABLE(g_object_ref(gjs_g_object_from_object(cx, cancellable)));
+    op->priority = priority;
+    op->chunk_size = chunk_size;
+    op->offset = offset;
+    op->length = length;
+
+    io_read_next_chunk(op);
+
+    args.rval().setUndefined();
+    return true;
+}
+
+typedef struct {
+    void *contents;  /* stolen from an ArrayBuffer, or in @mapped */
+    size_t capacity;
+    JS::PersistentRootedObject *mapped;  /* a mapped ArrayBuffer, not stolen */
+} IoBuffer;
+
+typedef struct {
+    const void *data;
+    size_t size;
+} IoSlice;
+
+typedef struct {
+    GClosure *callback;
+    GOutputStream *stream;
+    GCancellable *cancellable;
+    int priority;
+
+    GArray *buffers;        /* IoBuffer */
+    GArray *chunk_buffers;  /* int, index into @buffers for each chunk, or -1 */
+    GPtrArray *bytes;       /* GBytes written from */
+    GPtrArray *batches;     /* copies of small slices, written together */
+
+    GArray *slices;         /* IoSlice, what to write */
+    unsigned slice_ix;
+    size_t slice_pos;
+    size_t bytes_written;
+} IoWriteOp;
+
+static void
+io_write_op_free(IoWriteOp *op)
+{
+    for (unsigned ix = 0; ix < op->buffers->len; ix++) {
+        IoBuffer *buffer = &g_array_index(op->buffers, IoBuffer, ix);
+        if (buffer->mapped)
+            delete buffer->mapped;
+        else
+            js_free(buffer->contents);
+    }
+    g_array_free(op->buffers, true);
+    g_array_free(op->chunk_buffers, true);
+    g_ptr_array_unref(op->bytes);
+    g_ptr_array_unref(op->batches);
+    g_array_free(op->slices, true);
+
+    if (op->callback)
+        io_callback_free(op->callback);
+    g_clear_object(&op->stream);
+    g_clear_object(&op->cancellable);
+    g_slice_free(IoWriteOp, op);
+}
+
+/* Calls back with (error, bytesWritten, buffers), where buffers holds the new
+ * ArrayBuffer for each chunk that was an ArrayBuffer or a typed array, and
+ * null for the others */
+static void
+io_write_op_finish(IoWriteOp *op,
+                   GError    *error)
+{
+    if (gjs_closure_is_valid(op->callback)) {
+        JSContext *cx = gjs_closure_get_context(op->callback);
+        JSAutoRequest ar(cx);
+        JSAutoCompartment ac(cx, gjs_closure_get_callable(op->callback));
+
+        JS::AutoValueArray<3> cb_args(cx);
+        JS::AutoValueVector buffers(cx), chunks(cx);
+        JS::RootedObject this_obj(cx), error_obj(cx), array(cx);
+        JS::RootedValue rval(cx);
+        bool ok = buffers.reserve(op->buffers->len) &&
+            chunks.resize(op->chunk_buffers->len);
+
+        for (unsigned ix = 0; ok && ix < op->buffers->len; ix++) {
+            IoBuffer *buffer = &g_array_index(op->buffers, IoBuffer, ix);
+            JSObject *obj;
+            if (buffer->mapped) {
+                obj = *buffer->mapped;
+            } else {
+                obj = io_buffer_new(cx, buffer->contents, buffer->capacity);
+                buffer->contents = nullptr;
+            }
+            if (!obj)
+                ok = false;
+            else
+                buffers.infallibleAppend(JS::ObjectValue(*obj));
+        }
+
+        for (unsigned ix = 0; ok && ix < op->chunk_buffers->len; ix++) {
+            int buffer_ix = g_array_index(op->chunk_buffers, int, ix);
+            if (buffer_ix < 0)
+                chunks[ix].setNull();
+            else
+                chunks[ix].set(buffers[buffer_ix]);
+        }
+
+        if (ok)
+            ok = !!(array = JS_NewArrayObject(cx, chunks));
+        if (ok && error)
+            ok = !!(error_obj = gjs_error_from_gerror(cx, error, true));
+
+        if (!ok) {
+            gjs_log_exception(cx);
+        } else {
+            cb_args[0].setObjectOrNull(error_obj);
+            cb_args[1].setNumber(double(op->bytes_written));
+            cb_args[2].setObject(*array);
+            gjs_closure_invoke(op->callback, this_obj, cb_args, &rval, false);
+        }
+    }
+
+    io_write_op_free(op);
+}
+
+static void io_on_write_done(GObject      *source,
+                             GAsyncResult *result,
+                             void         *data);
+
+static void
+io_write_next(IoWriteOp *op)
+{
+    while (op->slice_ix < op->slices->len) {
+        IoSlice *slice = &g_array_index(op->slices, IoSlice, op->slice_ix);
+        if (op->slice_pos < slice->size) {
+            g_output_stream_write_async(op->stream,
+                                        static_cast<const char *>(slice->data) + op->slice_pos,
+                                        slice->size - op->slice_pos,
+                                        op->priority, op->cancellable,
+                                        io_on_write_done, op);
+            return;
+        }
+        op->slice_ix++;
+        op->slice_pos = 0;
+    }
+
+    io_write_op_finish(op, nullptr);
+}
+
+static void
+io_on_write_done(GObject      *source,
+                 GAsyncResult *result,
+                 void         *data)
+{
+    auto op = static_cast<IoWriteOp *>(data);
+    GError *error = nullptr;
+
+    gssize n_written = g_output_stream_write_finish(G_OUTPUT_STREAM(source),
+                                                    result, &error);
+    if (n_written < 0) {
+        io_write_op_finish(op, error);
+        g_error_free(error);
+        return;
+    }
+
+    op->slice_pos += n_written;
+    op->bytes_written += n_written;
+    io_write_next(op);
+}
+
+/* Replaces runs of small slices with one copy of them each */
+static GArray *
+io_batch_slices(GArray    *slices,
+                GPtrArray *batches)
+{
+    GArray *batched = g_array_sized_new(false, false, sizeof(IoSlice),
+                                        slices->len);
+    unsigned ix = 0;
+
+    while (ix < slices->len) {
+        size_t total = 0;
+        unsigned end = ix;
+        while (end < slices->len) {
+            IoSlice *slice = &g_array_index(slices, IoSlice, end);
+            if (slice->size >= IO_SMALL_SLICE ||
+                total + slice->size > IO_BATCH_SIZE)
+                break;
+            total += slice->size;
+            end++;
+        }
+
+        if (end - ix < 2) {
+            IoSlice *slice = &g_array_index(slices, IoSlice, ix);
+            if (slice->size > 0)
+                g_array_append_val(batched, *slice);
+            ix++;
+            continue;
+        }
+
+        char *batch = static_cast<char *>(g_malloc(total));
+        IoSlice batch_slice = { batch, total };
+        for (; ix < end; ix++) {
+            IoSlice *slice = &g_array_index(slices, IoSlice, ix);
+            memcpy(batch, slice->data, slice->size);
+            batch += slice->size;
+        }
+        g_ptr_array_add(batches, batch_slice.data);
+        g_array_append_val(batched, batch_slice);
+    }
+
+    g_array_free(slices, true);
+    return batched;
+}
+
+/* Collects the slices to write from an array of ArrayBuffers, typed arrays,
+ * GLib.Bytes and ByteArrays, stealing the contents of the ArrayBuffers that
+ * aren't mapped */
+static bool
+io_write_op_add_chunks(JSContext       *cx,
+                       IoWriteOp       *op,
+                       JS::HandleObject chunks)
+{
+    JS::AutoObjectVector buffer_objs(cx);
+    JS::RootedObject chunk(cx), buffer(cx);
+    JS::RootedValue v(cx);
+    GArray *ranges = g_array_new(false, false, sizeof(IoSlice));
+    uint32_t n_chunks;
+
+    if (!JS_GetArrayLength(cx, chunks, &n_chunks))
+        return false;
+
+    /* IoSlice::data is the offset into the buffer for ArrayBuffer chunks,
+     * until the buffers are stolen */
+    for (uint32_t ix = 0; ix < n_chunks; ix++) {
+        int buffer_ix = -1;
+        IoSlice slice;
+
+        if (!JS_GetElement(cx, chunks, ix, &v))
+            goto out;
+        if (!v.isObject()) {
+            gjs_throw(cx, "Chunk %u is not an ArrayBuffer, a typed array, "
+                      "GLib.Bytes or a ByteArray", ix);
+            goto out;
+        }
+        chunk = &v.toObject();
+
+        if (gjs_typecheck_bytearray(cx, chunk, false)) {
+            GBytes *bytes = gjs_byte_array_get_bytes(cx, chunk);
+            if (!bytes)
+                goto out;
+            g_ptr_array_add(op->bytes, bytes);
+            slice.data = g_bytes_get_data(bytes, &slice.size);
+        } else if (gjs_typecheck_boxed(cx, chunk, nullptr, G_TYPE_BYTES, false)) {
+            auto bytes = static_cast<GBytes *>(gjs_c_struct_from_boxed(cx, chunk));
+            g_ptr_array_add(op->bytes, g_bytes_ref(bytes));
+            slice.data = g_bytes_get_data(bytes, &slice.size);
+        } else {
+            size_t offset;
+            if (!io_get_buffer_range(cx, chunk, &buffer, &offset, &slice.size))
+                goto out;
+            slice.data = GSIZE_TO_POINTER(offset);
+
+            for (unsigned other = 0; other < buffer_objs.length(); other++) {
+                if (buffer_objs[other] == buffer) {
+                    buffer_ix = other;
+                    break;
+                }
+            }
+            if (buffer_ix < 0) {
+                buffer_ix = buffer_objs.length();
+                if (!buffer_objs.append(buffer)) {
+                    JS_ReportOutOfMemory(cx);
+                    goto out;
+                }
+            }
+        }
+
+        g_array_append_val(op->chunk_buffers, buffer_ix);
+        g_array_append_val(ranges, slice);
+    }
+
+    for (unsigned ix = 0; ix < buffer_objs.length(); ix++) {
+        IoBuffer stolen = { nullptr, 0, nullptr };
+        buffer = buffer_objs[ix];
+        if (JS_IsMappedArrayBufferObject(buffer) &&
+            !JS_IsDetachedArrayBufferObject(buffer)) {
+            stolen.mapped = new JS::PersistentRootedObject(cx, buffer);
+            stolen.capacity = JS_GetArrayBufferByteLength(buffer);
+
+            bool is_shared;
+            JS::AutoCheckCannotGC nogc;
+            stolen.contents = JS_GetArrayBufferData(buffer, &is_shared, nogc);
+        } else if (!io_steal_buffer(cx, buffer, &stolen.contents,
+                                    &stolen.capacity)) {
+            goto out;
+        }
+        g_array_append_val(op->buffers, stolen);
+    }
+
+    for (unsigned ix = 0; ix < ranges->len; ix++) {
+        int buffer_ix = g_array_index(op->chunk_buffers, int, ix);
+        if (buffer_ix < 0)
+            continue;
+
+        IoSlice *slice = &g_array_index(ranges, IoSlice, ix);
+        auto contents = static_cast<char *>(g_array_index(op->buffers,
+                                                          IoBuffer,
+                                                          buffer_ix).contents);
+        slice->data = contents + GPOINTER_TO_SIZE(slice->data);
+    }
+
+    g_array_free(op->slices, true);
+    op->slices = io_batch_slices(ranges, op->batches);
+    return true;
+
+out:
+    g_array_free(ranges, true);
+    return false;
+}
+
+/* writev(stream, chunks, priority, cancellable, callback): writes all of
+ * @chunks, in order */
+static bool
+io_writev(JSContext *cx,
+          unsigned   argc,
+          JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    JS::RootedObject stream(cx), chunks(cx), cancellable(cx), callback(cx);
+    int32_t priority;
+    bool is_array;
+
+    if (!gjs_parse_call_args(cx, "writev", args, "ooi?oo",
+                             "stream", &stream,
+                             "chunks", &chunks,
+                             "priority", &priority,
+                             "cancellable", &cancellable,
+                             "callback", &callback))
+        return false;
+
+    if (!io_check_stream_args(cx, stream, G_TYPE_OUTPUT_STREAM, cancellable,
+                              callback))
+        return false;
+
+    if (!JS_IsArrayObject(cx, chunks, &is_array))
+        return false;
+    if (!is_array) {
+        gjs_throw(cx, "Chunks must be an array");
+        return false;
+    }
+
+    auto op = g_slice_new0(IoWriteOp);
+    op->buffers = g_array_new(false, false, sizeof(IoBuffer));
+    op->chunk_buffers = g_array_new(false, false, sizeof(int));
+    op->bytes = g_ptr_array_new_with_free_func(GDestroyNotify(g_bytes_unref));
+    op->batches = g_ptr_array_new_with_free_func(g_free);
+    op->slices = g_array_new(false, false, sizeof(IoSlice));
+
+    if (!io_write_op_add_chunks(cx, op, chunks)) {
+        io_write_op_free(op);
+        return false;
+    }
+
+    op->callback = io_callback_new(cx, callback, "writev");
+    op->stream = G_OUTPUT_STREAM(g_object_ref(gjs_g_object_from_object(cx, stream)));
+    if (cancellable)
+        op->cancellable = G_CANCELLABLE(g_object_ref(gjs_g_object_from_object(cx, cancellable)));
+    op->priority = priority;
+
+    io_write_next(op);
+
+    args.rval().setUndefined();
+    return true;
+}
+
+static JSFunctionSpec module_funcs[] = {
+    JS_FS("mapFile", io_map_file, 1, GJS_MODULE_PROP_FLAGS),
+    JS_FS("readInto", io_read_into, 6, GJS_MODULE_PROP_FLAGS),
+    JS_FS("writev", io_writev, 5, GJS_MODULE_PROP_FLAGS),
+    JS_FS_END
+};
+
+bool
+gjs_define_io_stuff(JSContext              *cx,
+                    JS::MutableHandleObject module)
+{
+    module.set(JS_NewPlainObject(cx));
+    return JS_DefineFunctions(cx, module, &module_funcs[0]);
+}
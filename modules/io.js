@@ -0,0 +1,118 @@
+// Copyright 2018 Linux Mint
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+/**
+ * This module provides helpers to move data between files or GIO streams and
+ * ArrayBuffers without copying it through intermediate buffers.
+ *
+ * readInto() and writev() transfer the ArrayBuffers they are given: the
+ * buffers are detached until the operation is done, and their contents are
+ * then handed back in new ArrayBuffers. The exception is writev() with an
+ * ArrayBuffer from mapFile(), which is written from directly, left attached,
+ * and handed back as is.
+ */
+
+const GLib = imports.gi.GLib;
+const Native = imports.ioNative;
+
+var DEFAULT_CHUNK_SIZE = 65536;
+
+function _callbackToPromise(resolve, reject) {
+    return function(error, ...results) {
+        if (error)
+            reject(error);
+        else
+            resolve(results);
+    };
+}
+
+/**
+ * mapFile:
+ * @file: a path, or a local Gio.File
+ *
+ * Maps @file into memory, read-only.
+ * The pages are only read from disk when they are first accessed.
+ * Changes made to the file afterwards may or may not show up in the buffer,
+ * and truncating the file while the buffer is in use crashes the process.
+ *
+ * Returns: an ArrayBuffer with the contents of @file
+ */
+function mapFile(file) {
+    return Native.mapFile(file);
+}
+
+/**
+ * readInto:
+ * @stream: a Gio.InputStream
+ * @buffer: an ArrayBuffer or a typed array to read into
+ * @params: optional object with the following keys:
+ *  - chunkSize: the most bytes to request from @stream at a time
+ *    (default DEFAULT_CHUNK_SIZE)
+ *  - priority: the I/O priority (default GLib.PRIORITY_DEFAULT)
+ *  - cancellable: a Gio.Cancellable, or null
+ *
+ * Reads from @stream into the memory of @buffer until it is full or the end of
+ * the stream is reached. The ArrayBuffer behind @buffer is detached
+ * meanwhile.
+ *
+ * Returns: a promise for a Uint8Array over the bytes that were read, backed
+ * by a new ArrayBuffer holding the memory of the original one
+ */
+function readInto(stream, buffer, params = {}) {
+    let {
+        chunkSize = DEFAULT_CHUNK_SIZE,
+        priority = GLib.PRIORITY_DEFAULT,
+        cancellable = null,
+    } = params;
+
+    return new Promise((resolve, reject) => {
+        Native.readInto(stream, buffer, chunkSize, priority, cancellable,
+            _callbackToPromise(resolve, reject));
+    }).then(([newBuffer, offset, bytesRead]) =>
+        new Uint8Array(newBuffer, offset, bytesRead));
+}
+
+/**
+ * writev:
+ * @stream: a Gio.OutputStream
+ * @chunks: an array of ArrayBuffers, typed arrays, GLib.Bytes or ByteArrays
+ * @params: optional object with the following keys:
+ *  - priority: the I/O priority (default GLib.PRIORITY_DEFAULT)
+ *  - cancellable: a Gio.Cancellable, or null
+ *
+ * Writes all of @chunks to @stream, in order. Small chunks are gathered into
+ * fewer, larger writes. The ArrayBuffers of @chunks are detached meanwhile,
+ * except for those returned by mapFile().
+ *
+ * Returns: a promise for an array holding, for each chunk, the new ArrayBuffer
+ * with the memory of its original one, or the original one if it was mapped,
+ * or null for GLib.Bytes and ByteArrays
+ */
+function writev(stream, chunks, params = {}) {
+    let {
+        priority = GLib.PRIORITY_DEFAULT,
+        cancellable = null,
+    } = params;
+
+    return new Promise((resolve, reject) => {
+        Native.writev(stream, chunks, priority, cancellable,
+            _callbackToPromise(resolve, reject));
+    }).then(([, buffers]) => buffers);
+}
@@ -30,6 +30,8 @@
 #include "cairo-module.h"
 #endif
 
+#include "io.h"
+#include "serialize.h"
 #include "system.h"
 #include "console.h"
 
@@ -39,6 +41,8 @@ gjs_register_static_modules (void)
 #ifdef ENABLE_CAIRO
     gjs_register_native_module("cairoNative", gjs_js_define_cairo_stuff);
 #endif
+    gjs_register_native_module("ioNative", gjs_define_io_stuff);
+    gjs_register_native_module("serialize", gjs_define_serialize_stuff);
     gjs_register_native_module("system", gjs_js_define_system_stuff);
     gjs_register_native_module("console", gjs_define_console_stuff);
 }
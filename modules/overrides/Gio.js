@@ -20,99 +20,11 @@
 
 var GLib = imports.gi.GLib;
 var CjsPrivate = imports.gi.CjsPrivate;
+var Gi = imports._gi;
 var Lang = imports.lang;
 var Signals = imports.signals;
 var Gio;
 
-function _proxyInvoker(methodName, sync, inSignature, arg_array) {
-    var replyFunc;
-    var flags = 0;
-    var cancellable = null;
-
-    /* Convert arg_array to a *real* array */
-    arg_array = Array.prototype.slice.call(arg_array);
-
-    /* The default replyFunc only logs the responses */
-    replyFunc = _logReply;
-
-    var signatureLength = inSignature.length;
-    var minNumberArgs = signatureLength;
-    var maxNumberArgs = signatureLength + 3;
-
-    if (arg_array.length < minNumberArgs) {
-        throw new Error("Not enough arguments passed for method: " + methodName +
-                       ". Expected " + minNumberArgs + ", got " + arg_array.length);
-    } else if (arg_array.length > maxNumberArgs) {
-        throw new Error("Too many arguments passed for method: " + methodName +
-                       ". Maximum is " + maxNumberArgs +
-                        " + one callback and/or flags");
-    }
-
-    while (arg_array.length > signatureLength) {
-        var argNum = arg_array.length - 1;
-        var arg = arg_array.pop();
-        if (typeof(arg) == "function" && !sync) {
-            replyFunc = arg;
-        } else if (typeof(arg) == "number") {
-            flags = arg;
-        } else if (arg instanceof Gio.Cancellable) {
-            cancellable = arg;
-        } else {
-            throw new Error("Argument " + argNum + " of method " + methodName +
-                            " is " + typeof(arg) + ". It should be a callback, flags or a Gio.Cancellable");
-        }
-    }
-
-    var inVariant = new GLib.Variant('(' + inSignature.join('') + ')', arg_array);
-
-    var asyncCallback = function (proxy, result) {
-        var outVariant = null, succeeded = false;
-        try {
-            outVariant = proxy.call_finish(result);
-            succeeded = true;
-        } catch (e) {
-            replyFunc([], e);
-        }
-
-        if (succeeded)
-            replyFunc(outVariant.deep_unpack(), null);
-    };
-
-    if (sync) {
-        return this.call_sync(methodName,
-                              inVariant,
-                              flags,
-                              -1,
-                              cancellable).deep_unpack();
-    } else {
-        return this.call(methodName,
-                         inVariant,
-                         flags,
-                         -1,
-                         cancellable,
-                         asyncCallback);
-    }
-}
-
-function _logReply(result, exc) {
-    if (exc != null) {
-        log("Ignored exception from dbus method: " + exc.toString());
-    }
-}
-
-function _makeProxyMethod(method, sync) {
-    var i;
-    var name = method.name;
-    var inArgs = method.in_args;
-    var inSignature = [ ];
-    for (i = 0; i < inArgs.length; i++)
-        inSignature.push(inArgs[i].signature);
-
-    return function() {
-        return _proxyInvoker.call(this, name, sync, inSignature, arguments);
-    };
-}
-
 function _convertToNativeSignal(proxy, sender_name, signal_name, parameters) {
     Signals._emit.call(proxy, signal_name, sender_name, parameters.deep_unpack());
 }
@@ -149,14 +61,11 @@ function _addDBusConvenience() {
     if (info.signals.length > 0)
         this.connect('g-signal', _convertToNativeSignal);
 
-    let i, methods = info.methods;
-    for (i = 0; i < methods.length; i++) {
-        var method = methods[i];
-        this[method.name + 'Remote'] = _makeProxyMethod(methods[i], false);
-        this[method.name + 'Sync'] = _makeProxyMethod(methods[i], true);
-    }
+    // FooRemote() and FooSync() for each method, compiled natively once per
+    // interface info and shared between proxies
+    Gi.dbus_proxy_add_methods(this);
 
-    let properties = info.properties;
+    let i, properties = info.properties;
     for (i = 0; i < properties.length; i++) {
         let name = properties[i].name;
         let signature = properties[i].signature;
@@ -240,66 +149,6 @@ function _wrapFunction(klass, method, addition) {
     };
 }
 
-function _makeOutSignature(args) {
-    var ret = '(';
-    for (var i = 0; i < args.length; i++)
-        ret += args[i].signature;
-
-    return ret + ')';
-}
-
-function _handleMethodCall(info, impl, method_name, parameters, invocation) {
-    // prefer a sync version if available
-    if (this[method_name]) {
-        let retval;
-        try {
-            retval = this[method_name].apply(this, parameters.deep_unpack());
-        } catch (e) {
-            if (e instanceof GLib.Error) {
-                invocation.return_gerror(e);
-            } else {
-                let name = e.name;
-                if (name.indexOf('.') == -1) {
-                    // likely to be a normal JS error
-                    name = 'org.gnome.gjs.JSError.' + name;
-                }
-                logError(e, "Exception in method call: " + method_name);
-                invocation.return_dbus_error(name, e.message);
-            }
-            return;
-        }
-        if (retval === undefined) {
-            // undefined (no return value) is the empty tuple
-            retval = new GLib.Variant('()', []);
-        }
-        try {
-            if (!(retval instanceof GLib.Variant)) {
-                // attempt packing according to out signature
-                let methodInfo = info.lookup_method(method_name);
-                let outArgs = methodInfo.out_args;
-                let outSignature = _makeOutSignature(outArgs);
-                if (outArgs.length == 1) {
-                    // if one arg, we don't require the handler wrapping it
-                    // into an Array
-                    retval = [retval];
-                }
-                retval = new GLib.Variant(outSignature, retval);
-            }
-            invocation.return_value(retval);
-        } catch(e) {
-            // if we don't do this, the other side will never see a reply
-            invocation.return_dbus_error('org.gnome.gjs.JSError.ValueError',
-                                         "Service implementation returned an incorrect value type");
-        }
-    } else if (this[method_name + 'Async']) {
-        this[method_name + 'Async'](parameters.deep_unpack(), invocation);
-    } else {
-        log('Missing handler for DBus method ' + method_name);
-        invocation.return_gerror(new Gio.DBusError({ code: Gio.DBusError.UNKNOWN_METHOD,
-                                                     message: 'Method ' + method_name + ' is not implemented' }));
-    }
-}
-
 function _handlePropertyGet(info, impl, property_name) {
     let propInfo = info.lookup_property(property_name);
     let jsval = this[property_name];
@@ -313,6 +162,13 @@ function _handlePropertySet(info, impl, property_name, new_value) {
     this[property_name] = new_value.deep_unpack();
 }
 
+// Accepts a plain JS value, packed natively according to the property's
+// signature, as well as a GLib.Variant; null invalidates the property. Changes
+// are batched according to the flush_interval property and emitted together.
+function _emitPropertyChanged(name, value) {
+    Gi.dbus_emit_property_changed(this, name, value);
+}
+
 function _wrapJSObject(interfaceInfo, jsObj) {
     var info;
     if (interfaceInfo instanceof Gio.DBusInterfaceInfo)
@@ -322,9 +178,8 @@ function _wrapJSObject(interfaceInfo, jsObj) {
     info.cache_build();
 
     var impl = new CjsPrivate.DBusImplementation({ g_interface_info: info });
-    impl.connect('handle-method-call', function(impl, method_name, parameters, invocation) {
-        return _handleMethodCall.call(jsObj, info, impl, method_name, parameters, invocation);
-    });
+    // Method calls are unpacked, dispatched to jsObj and replied to natively
+    Gi.dbus_export_object(impl, jsObj);
     impl.connect('handle-property-get', function(impl, property_name) {
         return _handlePropertyGet.call(jsObj, info, impl, property_name);
     });
@@ -398,6 +253,7 @@ function _init() {
 
     Gio.DBusExportedObject = CjsPrivate.DBusImplementation;
     Gio.DBusExportedObject.wrapJSObject = _wrapJSObject;
+    Gio.DBusExportedObject.prototype.emit_property_changed = _emitPropertyChanged;
 
     // ListStore
     Gio.ListStore.prototype[Symbol.iterator] = _listModelIterator;
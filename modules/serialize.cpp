@@ -0,0 +1,383 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2018 Linux Mint
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "cjs/jsapi-wrapper.h"
+#include <js/StructuredClone.h>
+
+#include "gi/object.h"
+#include "cjs/byteArray.h"
+#include "cjs/jsapi-util-args.h"
+#include "serialize.h"
+
+/* imports.serialize encodes JS values into ArrayBuffers with SpiderMonkey's
+ * structured clone format, which unlike JSON keeps typed arrays, Maps, Sets,
+ * Dates, RegExps and cyclic references.
+ *
+ * On top of that, ByteArrays are encoded by value, and GObjects by handle if
+ * the data is meant to be decoded again in the same process. A handle is a
+ * number identifying the GObject in a table of live objects; it is dropped
+ * from the table when the GObject is finalized, so decoding a GObject that is
+ * gone fails instead of resurrecting it. Encoding does not keep the GObject
+ * alive.
+ *
+ * The data to decode may come from anywhere, so it is always read with the
+ * DifferentProcess scope, under which SpiderMonkey never takes a pointer from
+ * it; data with a transfer map, which holds pointers, is refused before it
+ * gets there. */
+
+enum {
+    SCTAG_GJS_BYTE_ARRAY = JS_SCTAG_USER_MIN,
+    SCTAG_GJS_GOBJECT,
+};
+
+/* Tags of SpiderMonkey's own, which it doesn't export, from
+ * js/src/vm/StructuredClone.cpp */
+#define SCTAG_HEADER 0xFFF10000
+#define SCTAG_TRANSFER_MAP_HEADER 0xFFFF0200
+
+typedef struct {
+    bool same_process;
+    size_t input_len;  /* when decoding */
+} SerializeClosure;
+
+/* Written along with each handle, so that a handle is only looked up in the
+ * process that made it. Unlike the pid, it isn't reused by a later process. */
+static uint64_t
+serialize_process_nonce(void)
+{
+    static gsize nonce = 0;
+    static uint64_t value;
+
+    if (g_once_init_enter(&nonce)) {
+        value = (uint64_t(g_random_int()) << 32) | g_random_int();
+        g_once_init_leave(&nonce, 1);
+    }
+    return value;
+}
+
+static GMutex handles_lock;
+static GHashTable *handles;  /* handle -> unowned GObject */
+static unsigned next_handle = 1;
+
+static void
+serialize_drop_handle(void *data)
+{
+    g_mutex_lock(&handles_lock);
+    g_hash_table_remove(handles, data);
+    g_mutex_unlock(&handles_lock);
+}
+
+static unsigned
+serialize_get_handle(GObject *gobj)
+{
+    static GQuark handle_quark = g_quark_from_static_string("cjs-serialize-handle");
+
+    unsigned handle = GPOINTER_TO_UINT(g_object_get_qdata(gobj, handle_quark));
+    if (handle != 0)
+        return handle;
+
+    g_mutex_lock(&handles_lock);
+    if (!handles)
+        handles = g_hash_table_new(nullptr, nullptr);
+    handle = next_handle++;
+    g_hash_table_insert(handles, GUINT_TO_POINTER(handle), gobj);
+    g_mutex_unlock(&handles_lock);
+
+    g_object_set_qdata_full(gobj, handle_quark, GUINT_TO_POINTER(handle),
+                            serialize_drop_handle);
+    return handle;
+}
+
+/* Returns a new reference, or null if the GObject is gone */
+static GObject *
+serialize_lookup_handle(unsigned handle)
+{
+    GObject *gobj = nullptr;
+
+    g_mutex_lock(&handles_lock);
+    if (handles)
+        gobj = G_OBJECT(g_hash_table_lookup(handles, GUINT_TO_POINTER(handle)));
+    if (gobj)
+        g_object_ref(gobj);
+    g_mutex_unlock(&handles_lock);
+
+    return gobj;
+}
+
+static bool
+serialize_write_op(JSContext               *cx,
+                   JSStructuredCloneWriter *writer,
+                   JS::HandleObject         obj,
+                   void                    *data)
+{
+    auto closure = static_cast<SerializeClosure *>(data);
+
+    if (gjs_typecheck_bytearray(cx, obj, false)) {
+        guint8 *bytes;
+        gsize len;
+        gjs_byte_array_peek_data(cx, obj, &bytes, &len);
+        if (len > G_MAXUINT32) {
+            gjs_throw(cx, "ByteArray is too large to serialize");
+            return false;
+        }
+        return JS_WriteUint32Pair(writer, SCTAG_GJS_BYTE_ARRAY, len) &&
+            JS_WriteBytes(writer, bytes, len);
+    }
+
+    if (gjs_typecheck_is_object(cx, obj, false)) {
+        if (!closure->same_process) {
+            gjs_throw(cx, "GObjects can only be serialized to be decoded "
+                      "in the same process");
+            return false;
+        }
+
+        GObject *gobj = gjs_g_object_from_object(cx, obj);
+        if (!gobj) {
+            gjs_throw(cx, "Cannot serialize a GObject that was already "
+                      "disposed");
+            return false;
+        }
+
+        uint64_t nonce = serialize_process_nonce();
+        return JS_WriteUint32Pair(writer, SCTAG_GJS_GOBJECT,
+                                  serialize_get_handle(gobj)) &&
+            JS_WriteUint32Pair(writer, uint32_t(nonce >> 32), uint32_t(nonce));
+    }
+
+    gjs_throw(cx, "Cannot serialize an object of class %s",
+              JS_GetClass(obj)->name);
+    return false;
+}
+
+static JSObject *
+serialize_read_op(JSContext               *cx,
+                  JSStructuredCloneReader *reader,
+                  uint32_t                 tag,
+                  uint32_t                 data,
+                  void                    *data_ptr)
+{
+    auto closure = static_cast<SerializeClosure *>(data_ptr);
+
+    if (tag == SCTAG_GJS_BYTE_ARRAY) {
+        /* The reader doesn't say how much is left, but the length can't be
+         * more than the whole input, which bounds the allocation */
+        if (data > closure->input_len) {
+            gjs_throw(cx, "Serialized ByteArray is longer than the data");
+            return nullptr;
+        }
+
+        JS::RootedObject obj(cx, gjs_byte_array_new(cx, data));
+        if (!obj)
+            return nullptr;
+
+        guint8 *bytes;
+        gsize len;
+        gjs_byte_array_peek_data(cx, obj, &bytes, &len);
+        if (!JS_ReadBytes(reader, bytes, len))
+            return nullptr;
+        return obj;
+    }
+
+    if (tag == SCTAG_GJS_GOBJECT) {
+        uint32_t nonce_high, nonce_low;
+        if (!JS_ReadUint32Pair(reader, &nonce_high, &nonce_low))
+            return nullptr;
+        uint64_t nonce = (uint64_t(nonce_high) << 32) | nonce_low;
+        if (!closure->same_process || nonce != serialize_process_nonce()) {
+            gjs_throw(cx, "Cannot decode a GObject serialized in another "
+                      "process");
+            return nullptr;
+        }
+
+        GObject *gobj = serialize_lookup_handle(data);
+        if (!gobj) {
+            gjs_throw(cx, "The serialized GObject no longer exists");
+            return nullptr;
+        }
+
+        JSObject *obj = gjs_object_from_g_object(cx, gobj);
+        g_object_unref(gobj);
+        return obj;
+    }
+
+    gjs_throw(cx, "Unknown tag %x in serialized data", tag);
+    return nullptr;
+}
+
+static const JSStructuredCloneCallbacks serialize_callbacks = {
+    serialize_read_op,
+    serialize_write_op,
+    nullptr,  /* reportError, use the default DataCloneError */
+    nullptr,  /* readTransfer */
+    nullptr,  /* writeTransfer */
+    nullptr,  /* freeTransfer */
+};
+
+/* Whether the structured clone header at the start of @bytes, if any, asks
+ * for anything that reading with the DifferentProcess scope wouldn't do */
+static bool
+serialize_check_header(const uint8_t *bytes,
+                       size_t         length)
+{
+    uint64_t pair;
+
+    if (length < sizeof(pair))
+        return true;  /* too short to be valid, left to SpiderMonkey */
+
+    memcpy(&pair, bytes, sizeof(pair));
+    pair = GUINT64_FROM_LE(pair);
+    if (uint32_t(pair >> 32) == SCTAG_HEADER) {
+        if (uint32_t(pair) !=
+            uint32_t(JS::StructuredCloneScope::DifferentProcess))
+            return false;
+        if (length < 2 * sizeof(pair))
+            return true;
+        memcpy(&pair, bytes + sizeof(pair), sizeof(pair));
+        pair = GUINT64_FROM_LE(pair);
+    }
+
+    return uint32_t(pair >> 32) != SCTAG_TRANSFER_MAP_HEADER;
+}
+
+/* encode(value, sameProcess = false) */
+static bool
+serialize_encode(JSContext *cx,
+                 unsigned   argc,
+                 JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    SerializeClosure closure = { false, 0 };
+
+    if (!args.requireAtLeast(cx, "encode", 1))
+        return false;
+    if (args.length() > 1)
+        closure.same_process = JS::ToBoolean(args[1]);
+
+    /* Even for the same process, since decode() only reads that scope */
+    JSAutoStructuredCloneBuffer buffer(JS::StructuredCloneScope::DifferentProcess,
+                                       &serialize_callbacks, &closure);
+    if (!buffer.write(cx, args[0], &serialize_callbacks, &closure))
+        return false;
+
+    /* The clone data is a list of segments; flatten it into the
+     * ArrayBuffer's contents */
+    size_t size = buffer.nbytes();
+    auto contents = static_cast<char *>(js_malloc(size));
+    if (!contents) {
+        JS_ReportOutOfMemory(cx);
+        return false;
+    }
+
+    auto iter = buffer.data().Iter();
+    if (!buffer.data().ReadBytes(iter, contents, size)) {
+        js_free(contents);
+        gjs_throw(cx, "Failed to read back serialized data");
+        return false;
+    }
+
+    JSObject *array_buffer = JS_NewArrayBufferWithContents(cx, size, contents);
+    if (!array_buffer) {
+        js_free(contents);
+        return false;
+    }
+
+    args.rval().setObject(*array_buffer);
+    return true;
+}
+
+/* decode(buffer, sameProcess = false), where @buffer is an ArrayBuffer or a
+ * typed array */
+static bool
+serialize_decode(JSContext *cx,
+                 unsigned   argc,
+                 JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    JS::RootedObject buffer_obj(cx);
+    SerializeClosure closure = { false, 0 };
+
+    if (!gjs_parse_call_args(cx, "decode", args, "o|b",
+                             "buffer", &buffer_obj,
+                             "sameProcess", &closure.same_process))
+        return false;
+
+    /* Copy the data out before anything can GC and move it */
+    JSStructuredCloneData data;
+    bool is_buffer, copied = false, header_ok = false;
+    uint32_t length = 0;
+    {
+        JS::AutoCheckCannotGC nogc;
+        uint8_t *bytes;
+        bool is_shared;
+
+        is_buffer = JS_GetObjectAsArrayBuffer(buffer_obj, &length, &bytes) ||
+            JS_GetObjectAsArrayBufferView(buffer_obj, &length, &is_shared,
+                                          &bytes);
+        if (is_buffer && length % sizeof(uint64_t) == 0) {
+            header_ok = serialize_check_header(bytes, length);
+            if (header_ok)
+                copied = data.WriteBytes(reinterpret_cast<char *>(bytes),
+                                         length);
+        }
+    }
+
+    if (!is_buffer) {
+        gjs_throw(cx, "Expected an ArrayBuffer or a typed array");
+        return false;
+    }
+    if (length % sizeof(uint64_t) != 0) {
+        gjs_throw(cx, "Serialized data has an invalid length");
+        return false;
+    }
+    if (!header_ok) {
+        gjs_throw(cx, "Serialized data must not hold pointers");
+        return false;
+    }
+    if (!copied) {
+        JS_ReportOutOfMemory(cx);
+        return false;
+    }
+
+    closure.input_len = length;
+    return JS_ReadStructuredClone(cx, data, JS_STRUCTURED_CLONE_VERSION,
+                                  JS::StructuredCloneScope::DifferentProcess,
+                                  args.rval(), &serialize_callbacks, &closure);
+}
+
+static JSFunctionSpec module_funcs[] = {
+    JS_FS("encode", serialize_encode, 1, GJS_MODULE_PROP_FLAGS),
+    JS_FS("decode", serialize_decode, 1, GJS_MODULE_PROP_FLAGS),
+    JS_FS_END
+};
+
+bool
+gjs_define_serialize_stuff(JSContext              *cx,
+                           JS::MutableHandleObject module)
+{
+    module.set(JS_NewPlainObject(cx));
+    return JS_DefineFunctions(cx, module, &module_funcs[0]);
+}
@@ -27,6 +27,9 @@
 #include <sys/types.h>
 #include <time.h>
 
+#include <limits>
+#include <vector>
+
 #include "cjs/jsapi-wrapper.h"
 #include <js/Date.h>
 
@@ -34,6 +37,10 @@
 
 #include "gi/object.h"
 #include "cjs/context-private.h"
+#include "cjs/gc-stats.h"
+#include "cjs/global.h"
+#include "cjs/import-cache.h"
+#include "cjs/importer.h"
 #include "cjs/jsapi-util-args.h"
 #include "system.h"
 
@@ -164,6 +171,316 @@ gjs_clear_date_caches(JSContext *context,
     return true;
 }
 
+static bool
+gjs_set_gc_profile(JSContext *cx,
+                   unsigned   argc,
+                   JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    GjsAutoJSChar profile;
+    if (!gjs_parse_call_args(cx, "setGCProfile", args, "s",
+                             "profile", &profile))
+        return false;
+
+    auto gjs_context = static_cast<GjsContext *>(JS_GetContextPrivate(cx));
+    GError *error = nullptr;
+    if (!gjs_context_set_gc_profile(gjs_context, profile, &error)) {
+        gjs_throw_g_error(cx, error);
+        return false;
+    }
+
+    args.rval().setUndefined();
+    return true;
+}
+
+static bool
+gjs_get_gc_profile(JSContext *cx,
+                   unsigned   argc,
+                   JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    if (!gjs_parse_call_args(cx, "getGCProfile", args, ""))
+        return false;
+
+    auto gjs_context = static_cast<GjsContext *>(JS_GetContextPrivate(cx));
+    return gjs_string_from_utf8(cx, _gjs_context_get_gc_profile(gjs_context),
+                                args.rval());
+}
+
+static bool
+gjs_set_gc_parameter(JSContext *cx,
+                     unsigned   argc,
+                     JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    GjsAutoJSChar name;
+    uint32_t value;
+    if (!gjs_parse_call_args(cx, "setGCParameter", args, "su",
+                             "name", &name,
+                             "value", &value))
+        return false;
+
+    auto gjs_context = static_cast<GjsContext *>(JS_GetContextPrivate(cx));
+    GError *error = nullptr;
+    if (!gjs_context_set_gc_parameter(gjs_context, name, value, &error)) {
+        gjs_throw_g_error(cx, error);
+        return false;
+    }
+
+    args.rval().setUndefined();
+    return true;
+}
+
+static bool
+gjs_get_gc_parameter(JSContext *cx,
+                     unsigned   argc,
+                     JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    GjsAutoJSChar name;
+    if (!gjs_parse_call_args(cx, "getGCParameter", args, "s",
+                             "name", &name))
+        return false;
+
+    auto gjs_context = static_cast<GjsContext *>(JS_GetContextPrivate(cx));
+    GError *error = nullptr;
+    uint32_t value;
+    if (!gjs_context_get_gc_parameter(gjs_context, name, &value, &error)) {
+        gjs_throw_g_error(cx, error);
+        return false;
+    }
+
+    args.rval().setNumber(value);
+    return true;
+}
+
+static JSObject *
+gc_slice_to_object(JSContext         *cx,
+                   const GjsGCSlice&  slice)
+{
+    JS::RootedObject obj(cx, JS_NewPlainObject(cx));
+    if (!obj)
+        return nullptr;
+
+    JS::RootedValue reason(cx);
+    if (!gjs_string_from_utf8(cx, JS::gcreason::ExplainReason(slice.reason),
+                              &reason))
+        return nullptr;
+
+    if (!JS_DefineProperty(cx, obj, "start", slice.start_time / 1000.0,
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, obj, "duration", slice.duration / 1000.0,
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, obj, "reason", reason, JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, obj, "zones", slice.zone_count,
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, obj, "zoneGC",
+                           slice.is_zone_gc ? JS::TrueHandleValue :
+                                              JS::FalseHandleValue,
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, obj, "heapBefore",
+                           double(slice.heap_bytes_before), JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, obj, "heapAfter",
+                           double(slice.heap_bytes_after), JSPROP_ENUMERATE))
+        return nullptr;
+
+    return obj;
+}
+
+/* Returns statistics about recent GC slices. Pause times are in ms. */
+static bool
+gjs_gc_stats(JSContext *cx,
+             unsigned   argc,
+             JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    if (!gjs_parse_call_args(cx, "gcStats", args, ""))
+        return false;
+
+    auto gjs_context = static_cast<GjsContext *>(JS_GetContextPrivate(cx));
+    const GjsGCStats *stats = _gjs_context_get_gc_stats(gjs_context);
+    GjsGCPauseSummary summary = stats->summarize();
+
+    JS::RootedObject pauses(cx, JS_NewPlainObject(cx));
+    if (!pauses ||
+        !JS_DefineProperty(cx, pauses, "count", uint32_t(summary.n_slices),
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, pauses, "p50", summary.p50 / 1000.0,
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, pauses, "p95", summary.p95 / 1000.0,
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, pauses, "max", summary.max / 1000.0,
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, pauses, "total", summary.total / 1000.0,
+                           JSPROP_ENUMERATE))
+        return false;
+
+    JS::RootedObject histogram(cx,
+        JS_NewArrayObject(cx, GjsGCStats::N_HISTOGRAM_BUCKETS));
+    if (!histogram)
+        return false;
+    JS::RootedObject bucket(cx);
+    for (size_t ix = 0; ix < GjsGCStats::N_HISTOGRAM_BUCKETS; ix++) {
+        double up_to = ix < G_N_ELEMENTS(GjsGCStats::histogram_bounds) ?
+            GjsGCStats::histogram_bounds[ix] / 1000.0 :
+            std::numeric_limits<double>::infinity();
+        bucket = JS_NewPlainObject(cx);
+        if (!bucket ||
+            !JS_DefineProperty(cx, bucket, "upTo", up_to, JSPROP_ENUMERATE) ||
+            !JS_DefineProperty(cx, bucket, "count",
+                               double(stats->histogram()[ix]),
+                               JSPROP_ENUMERATE) ||
+            !JS_DefineElement(cx, histogram, ix, bucket, JSPROP_ENUMERATE))
+            return false;
+    }
+
+    std::vector<GjsGCSlice> slices = stats->recent_slices();
+    JS::RootedObject recent(cx, JS_NewArrayObject(cx, slices.size()));
+    if (!recent)
+        return false;
+    JS::RootedObject slice_obj(cx);
+    for (size_t ix = 0; ix < slices.size(); ix++) {
+        slice_obj = gc_slice_to_object(cx, slices[ix]);
+        if (!slice_obj ||
+            !JS_DefineElement(cx, recent, ix, slice_obj, JSPROP_ENUMERATE))
+            return false;
+    }
+
+    JS::RootedObject retval(cx, JS_NewPlainObject(cx));
+    if (!retval ||
+        !JS_DefineProperty(cx, retval, "cycles", double(stats->n_cycles()),
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, retval, "slices", double(stats->n_slices()),
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, retval, "pauses", pauses, JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, retval, "histogram", histogram,
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, retval, "recent", recent, JSPROP_ENUMERATE))
+        return false;
+
+    args.rval().setObject(*retval);
+    return true;
+}
+
+/* Returns instrumentation for the promise job queue. Times are in ms. */
+static bool
+gjs_job_queue_stats(JSContext *cx,
+                    unsigned   argc,
+                    JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    if (!gjs_parse_call_args(cx, "jobQueueStats", args, ""))
+        return false;
+
+    auto gjs_context = static_cast<GjsContext *>(JS_GetContextPrivate(cx));
+    const GjsJobQueueStats *stats =
+        _gjs_context_get_job_queue_stats(gjs_context);
+
+    JS::RootedObject retval(cx, JS_NewPlainObject(cx));
+    if (!retval ||
+        !JS_DefineProperty(cx, retval, "pending", double(stats->pending),
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, retval, "maxDepth", double(stats->max_depth),
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, retval, "longestDrain",
+                           stats->longest_drain / 1000.0, JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, retval, "drains", double(stats->drains),
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, retval, "yields", double(stats->yields),
+                           JSPROP_ENUMERATE))
+        return false;
+
+    args.rval().setObject(*retval);
+    return true;
+}
+
+static bool
+gjs_clear_import_cache(JSContext *cx,
+                       unsigned   argc,
+                       JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    if (!gjs_parse_call_args(cx, "clearImportCache", args, ""))
+        return false;
+
+    gjs_import_cache_clear();
+    args.rval().setUndefined();
+    return true;
+}
+
+/* Returns counters for the importer's directory listing cache. The syscall
+ * counts are estimates, see import-cache.h. */
+static bool
+gjs_import_cache_stats(JSContext *cx,
+                       unsigned   argc,
+                       JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+    if (!gjs_parse_call_args(cx, "importCacheStats", args, ""))
+        return false;
+
+    const GjsImportCacheStats *stats = gjs_import_cache_get_stats();
+
+    JS::RootedObject retval(cx, JS_NewPlainObject(cx));
+    if (!retval ||
+        !JS_DefineProperty(cx, retval, "listings", double(stats->listings),
+                           JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, retval, "invalidations",
+                           double(stats->invalidations), JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, retval, "syscallsAvoided",
+                           double(stats->syscalls_avoided), JSPROP_ENUMERATE) ||
+        !JS_DefineProperty(cx, retval, "syscallsSpent",
+                           double(stats->syscalls_spent), JSPROP_ENUMERATE))
+        return false;
+
+    args.rval().setObject(*retval);
+    return true;
+}
+
+/* Takes an array of dotted module names, as they would be imported from the
+ * root importer, and starts compiling them off the main thread */
+static bool
+gjs_preload_modules(JSContext *cx,
+                    unsigned   argc,
+                    JS::Value *vp)
+{
+    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+
+    bool is_array;
+    uint32_t length;
+    if (!args.get(0).isObject() ||
+        !JS_IsArrayObject(cx, args[0], &is_array) || !is_array) {
+        if (!JS_IsExceptionPending(cx))
+            gjs_throw(cx, "preloadModules() takes an array of module names");
+        return false;
+    }
+
+    JS::RootedObject names(cx, &args[0].toObject());
+    if (!JS_GetArrayLength(cx, names, &length))
+        return false;
+
+    JS::RootedObject importer(cx,
+        &gjs_get_global_slot(cx, GJS_GLOBAL_SLOT_IMPORTS).toObject());
+    JS::RootedValue elem(cx);
+    for (uint32_t ix = 0; ix < length; ix++) {
+        if (!JS_GetElement(cx, names, ix, &elem))
+            return false;
+
+        GjsAutoJSChar name;
+        if (!elem.isString() || !gjs_string_to_utf8(cx, elem, &name)) {
+            if (!JS_IsExceptionPending(cx))
+                gjs_throw(cx, "preloadModules() takes an array of module names");
+            return false;
+        }
+
+        if (!gjs_importer_preload(cx, importer, name))
+            return false;
+    }
+
+    args.rval().setUndefined();
+    return true;
+}
+
 static JSFunctionSpec module_funcs[] = {
     JS_FS("addressOf", gjs_address_of, 1, GJS_MODULE_PROP_FLAGS),
     JS_FS("refcount", gjs_refcount, 1, GJS_MODULE_PROP_FLAGS),
@@ -172,6 +489,15 @@ static JSFunctionSpec module_funcs[] = {
     JS_FS("gc", gjs_gc, 0, GJS_MODULE_PROP_FLAGS),
     JS_FS("exit", gjs_exit, 0, GJS_MODULE_PROP_FLAGS),
     JS_FS("clearDateCaches", gjs_clear_date_caches, 0, GJS_MODULE_PROP_FLAGS),
+    JS_FS("setGCProfile", gjs_set_gc_profile, 1, GJS_MODULE_PROP_FLAGS),
+    JS_FS("getGCProfile", gjs_get_gc_profile, 0, GJS_MODULE_PROP_FLAGS),
+    JS_FS("setGCParameter", gjs_set_gc_parameter, 2, GJS_MODULE_PROP_FLAGS),
+    JS_FS("getGCParameter", gjs_get_gc_parameter, 1, GJS_MODULE_PROP_FLAGS),
+    JS_FS("gcStats", gjs_gc_stats, 0, GJS_MODULE_PROP_FLAGS),
+    JS_FS("jobQueueStats", gjs_job_queue_stats, 0, GJS_MODULE_PROP_FLAGS),
+    JS_FS("clearImportCache", gjs_clear_import_cache, 0, GJS_MODULE_PROP_FLAGS),
+    JS_FS("importCacheStats", gjs_import_cache_stats, 0, GJS_MODULE_PROP_FLAGS),
+    JS_FS("preloadModules", gjs_preload_modules, 1, GJS_MODULE_PROP_FLAGS),
     JS_FS_END
 };
 
@@ -218,6 +218,29 @@ test_maybe_owned_switch_to_unrooted_allows_collection(GjsRootingFixture *fx,
     delete obj;
 }
 
+static void
+test_maybe_owned_repeated_switching_keeps_alive(GjsRootingFixture *fx,
+                                                gconstpointer      unused)
+{
+    auto obj = new GjsMaybeOwned<JSObject *>();
+    *obj = test_obj_new(fx);
+
+    /* Enough times to go through recycled root nodes */
+    for (unsigned ix = 0; ix < 5; ix++) {
+        obj->switch_to_rooted(PARENT(fx)->cx);
+        wait_for_gc(fx);
+        g_assert_false(fx->finalized);
+        obj->switch_to_unrooted();
+        obj->switch_to_rooted(PARENT(fx)->cx);
+        obj->switch_to_unrooted();
+    }
+
+    wait_for_gc(fx);
+    g_assert_true(fx->finalized);
+
+    delete obj;
+}
+
 static void
 context_destroyed(JS::HandleObject obj,
                   void            *data)
@@ -277,6 +300,8 @@ gjs_test_add_tests_for_rooting(void)
                      test_maybe_owned_switch_to_rooted_prevents_collection);
     ADD_ROOTING_TEST("maybe-owned/switch-to-unrooted-allows-collection",
                      test_maybe_owned_switch_to_unrooted_allows_collection);
+    ADD_ROOTING_TEST("maybe-owned/repeated-switching-keeps-alive",
+                     test_maybe_owned_repeated_switching_keeps_alive);
 
 #undef ADD_ROOTING_TEST
 
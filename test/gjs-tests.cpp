@@ -23,17 +23,29 @@
 
 #include <config.h>
 
+#include <string.h>
+
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <glib.h>
 #include <glib-object.h>
+#include <glib/gstdio.h>
 #include <util/glib.h>
 
 #include <cjs/gjs.h>
+#include "cjs/bundle.h"
 #include "cjs/jsapi-util.h"
 #include "cjs/jsapi-wrapper.h"
 #include "gjs-test-utils.h"
 #include "util/error.h"
+#include "util/misc.h"
+
+#ifdef ENABLE_PROFILER
+#    include <unistd.h>
+#    include "util/sp-capture-writer.h"
+#endif
 
 #define VALID_UTF8_STRING "\303\211\303\226 foobar \343\203\237"
 
@@ -376,6 +388,401 @@ gjstest_test_strip_shebang_return_null_for_just_shebang(void)
     g_assert(line_number == -1);
 }
 
+static void
+gjstest_test_func_util_misc_string_is_ascii(void)
+{
+    /* Long enough to exercise the vectorized loops as well as the tail */
+    const char *ascii = "The quick brown fox jumps over the lazy dog, twice.";
+    g_assert_true(gjs_string_is_ascii(ascii, strlen(ascii)));
+    g_assert_true(gjs_string_is_ascii("", 0));
+
+    std::string non_ascii(ascii);
+    for (size_t ix = 0; ix < non_ascii.size(); ix++) {
+        std::string copy(non_ascii);
+        copy[ix] = '\303';
+        g_assert_false(gjs_string_is_ascii(copy.c_str(), copy.size()));
+    }
+
+    g_assert_false(gjs_string_is_ascii(VALID_UTF8_STRING,
+                                       strlen(VALID_UTF8_STRING)));
+}
+
+static void
+gjstest_test_func_util_misc_utf8_round_trip(void)
+{
+    /* ASCII long enough for the vectorized loops, then Latin-1, BMP and
+     * astral characters */
+    const char *utf8 = "The quick brown fox jumps over the lazy dog, twice. "
+        "\303\251t\303\251 \342\205\234 \360\237\230\200";
+    size_t len = strlen(utf8), utf16_len;
+    bool is_latin1;
+
+    g_assert_true(gjs_utf8_validate(utf8, len, &utf16_len, &is_latin1));
+    g_assert_false(is_latin1);
+    g_assert_cmpuint(utf16_len, ==, len - 6);
+
+    std::u16string utf16(utf16_len, u'\0');
+    gjs_utf8_to_utf16(utf8, len, &utf16[0]);
+    g_assert_true(utf16[utf16_len - 8] == 0xe9);
+    g_assert_true(utf16[utf16_len - 4] == 0x215c);
+    g_assert_true(utf16[utf16_len - 2] == 0xd83d);
+    g_assert_true(utf16[utf16_len - 1] == 0xde00);
+
+    g_assert_cmpuint(gjs_utf16_utf8_length(utf16.data(), utf16_len), ==, len);
+    std::string encoded(len, '\0');
+    gjs_utf16_to_utf8(utf16.data(), utf16_len, &encoded[0]);
+    g_assert_cmpstr(encoded.c_str(), ==, utf8);
+
+    /* Text that fits in Latin-1 */
+    const char *latin1_utf8 = "caf\303\251 cr\303\250me br\303\273l\303\251e";
+    len = strlen(latin1_utf8);
+    g_assert_true(gjs_utf8_validate(latin1_utf8, len, &utf16_len, &is_latin1));
+    g_assert_true(is_latin1);
+    std::string latin1(utf16_len, '\0');
+    gjs_utf8_to_latin1(latin1_utf8, len, &latin1[0]);
+    g_assert_cmpstr(latin1.c_str(), ==, "caf\351 cr\350me br\373l\351e");
+    g_assert_cmpuint(gjs_latin1_utf8_length(latin1.data(), utf16_len), ==, len);
+    std::string latin1_encoded(len, '\0');
+    gjs_latin1_to_utf8(latin1.data(), utf16_len, &latin1_encoded[0]);
+    g_assert_cmpstr(latin1_encoded.c_str(), ==, latin1_utf8);
+}
+
+static void
+gjstest_test_func_util_misc_utf8_reject_invalid(void)
+{
+    const char *invalid[] = {
+        "\200",              /* lone continuation byte */
+        "\303",              /* truncated sequence */
+        "\303(",             /* bad continuation byte */
+        "\300\200",          /* overlong NUL */
+        "\340\200\257",      /* overlong slash */
+        "\355\240\200",      /* UTF-16 surrogate */
+        "\364\220\200\200",  /* above U+10FFFF */
+        "\377",              /* never valid */
+    };
+    size_t utf16_len;
+    bool is_latin1;
+
+    for (const char *str : invalid) {
+        std::string padded = std::string("padding to 16 bytes ") + str;
+        g_assert_false(gjs_utf8_validate(str, strlen(str), &utf16_len,
+                                         &is_latin1));
+        g_assert_false(gjs_utf8_validate(padded.c_str(), padded.size(),
+                                         &utf16_len, &is_latin1));
+    }
+
+    /* Lone surrogates are encoded as U+FFFD */
+    const char16_t lone[] = { u'a', 0xd800, u'b', 0xdc00 };
+    g_assert_cmpuint(gjs_utf16_utf8_length(lone, 4), ==, 8);
+    std::string encoded(8, '\0');
+    gjs_utf16_to_utf8(lone, 4, &encoded[0]);
+    g_assert_cmpstr(encoded.c_str(), ==, "a\357\277\275b\357\277\275");
+}
+
+static void
+add_bundle_entry(std::string& bundle,
+                 unsigned     ix,
+                 uint32_t     path_offset,
+                 uint32_t     path_len,
+                 GFileType    type,
+                 uint32_t     data_len,
+                 uint64_t     data_offset)
+{
+    GjsBundleEntry entry = { GUINT32_TO_LE(path_offset),
+                             GUINT32_TO_LE(path_len),
+                             GUINT32_TO_LE(type), GUINT32_TO_LE(data_len),
+                             GUINT64_TO_LE(data_offset) };
+    memcpy(&bundle[sizeof(GjsBundleHeader) + ix * sizeof(entry)], &entry,
+           sizeof(entry));
+}
+
+static void
+gjstest_test_func_bundle_lookup(void)
+{
+    GjsBundleHeader header = { {}, GUINT32_TO_LE(3), 0 };
+    memcpy(header.magic, GJS_BUNDLE_MAGIC, sizeof(header.magic));
+
+    /* Header, 3 entries, 11 bytes of paths, then two 8-byte aligned files */
+    std::string bundle(120, '\0');
+    memcpy(&bundle[0], &header, sizeof(header));
+    add_bundle_entry(bundle, 0, 88, 1, G_FILE_TYPE_DIRECTORY, 0, 0);
+    add_bundle_entry(bundle, 1, 89, 6, G_FILE_TYPE_REGULAR, 1, 104);
+    add_bundle_entry(bundle, 2, 95, 4, G_FILE_TYPE_REGULAR, 2, 112);
+    memcpy(&bundle[88], "aa/b.jsc.js", 11);
+    memcpy(&bundle[104], "x", 1);
+    memcpy(&bundle[112], "yy", 2);
+
+    GjsAutoChar tmpdir = g_dir_make_tmp("cjs-test-bundle-XXXXXX", nullptr);
+    g_assert_nonnull(tmpdir.get());
+    GjsAutoChar bundle_path = g_build_filename(tmpdir, "test" GJS_BUNDLE_SUFFIX,
+                                               nullptr);
+    g_assert_true(g_file_set_contents(bundle_path, bundle.data(),
+                                      bundle.size(), nullptr));
+
+    GjsAutoChar module_path = g_build_filename(bundle_path, "a", "b.js",
+                                               nullptr);
+    const char *inner_path;
+    GjsBundle *opened = GjsBundle::get(module_path, &inner_path);
+    g_assert_nonnull(opened);
+    g_assert_cmpstr(inner_path, ==, "a/b.js");
+    g_assert_true(GjsBundle::get(bundle_path, &inner_path) == opened);
+    g_assert_cmpstr(inner_path, ==, "");
+
+    g_assert_cmpint(opened->lookup(""), ==, G_FILE_TYPE_DIRECTORY);
+    g_assert_cmpint(opened->lookup("a"), ==, G_FILE_TYPE_DIRECTORY);
+    g_assert_cmpint(opened->lookup("c.js"), ==, G_FILE_TYPE_REGULAR);
+    g_assert_cmpint(opened->lookup("b.js"), ==, G_FILE_TYPE_UNKNOWN);
+
+    const char *data;
+    size_t len;
+    g_assert_true(opened->get_contents("a/b.js", &data, &len));
+    g_assert_cmpuint(len, ==, 1);
+    g_assert_cmpstr(data, ==, "x");
+    g_assert_false(opened->get_contents("a", &data, &len));
+
+    std::vector<std::pair<std::string, GFileType>> children;
+    opened->list_directory("", children);
+    g_assert_cmpuint(children.size(), ==, 2);
+    g_assert_cmpstr(children[0].first.c_str(), ==, "a");
+    g_assert_cmpstr(children[1].first.c_str(), ==, "c.js");
+
+    /* Not a bundle at all */
+    g_assert_null(GjsBundle::get("/nonexistent" GJS_BUNDLE_SUFFIX "x/a.js",
+                                 &inner_path));
+
+    g_unlink(bundle_path);
+    g_rmdir(tmpdir);
+}
+
+static void
+gjstest_test_func_bundle_reject_corrupt(void)
+{
+    GjsBundleHeader header = { {}, GUINT32_TO_LE(1), 0 };
+    memcpy(header.magic, GJS_BUNDLE_MAGIC, sizeof(header.magic));
+
+    /* The file's contents point past the end of the bundle, either plainly
+     * or by an offset that wraps around to the NUL at 44 when the length is
+     * added */
+    const uint64_t bad_offsets[] = { 44, G_MAXUINT64 - 55 };
+
+    GjsAutoChar tmpdir = g_dir_make_tmp("cjs-test-bundle-XXXXXX", nullptr);
+    for (size_t ix = 0; ix < G_N_ELEMENTS(bad_offsets); ix++) {
+        std::string bundle(48, '\0');
+        memcpy(&bundle[0], &header, sizeof(header));
+        add_bundle_entry(bundle, 0, 40, 4, G_FILE_TYPE_REGULAR, 100,
+                         bad_offsets[ix]);
+        memcpy(&bundle[40], "a.js", 4);
+
+        GjsAutoChar name = g_strdup_printf("bad%zu" GJS_BUNDLE_SUFFIX, ix);
+        GjsAutoChar bundle_path = g_build_filename(tmpdir, name.get(), nullptr);
+        g_assert_true(g_file_set_contents(bundle_path, bundle.data(),
+                                          bundle.size(), nullptr));
+
+        const char *inner_path;
+        g_test_expect_message(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING,
+                              "*is not a valid module bundle");
+        g_assert_null(GjsBundle::get(bundle_path, &inner_path));
+        g_test_assert_expected_messages();
+
+        g_unlink(bundle_path);
+    }
+    g_rmdir(tmpdir);
+}
+
+static void
+gjstest_test_func_bundle_import(void)
+{
+    GjsBundleHeader header = { {}, GUINT32_TO_LE(2), 0 };
+    memcpy(header.magic, GJS_BUNDLE_MAGIC, sizeof(header.magic));
+
+    /* Header, 2 entries, 11 bytes of paths, then one 8-byte aligned file */
+    static const char source[] = "var answer = 42;";
+    std::string bundle(80 + sizeof(source), '\0');
+    memcpy(&bundle[0], &header, sizeof(header));
+    add_bundle_entry(bundle, 0, 64, 3, G_FILE_TYPE_DIRECTORY, 0, 0);
+    add_bundle_entry(bundle, 1, 67, 8, G_FILE_TYPE_REGULAR,
+                     sizeof(source) - 1, 80);
+    memcpy(&bundle[64], "subsub/m.js", 11);
+    memcpy(&bundle[80], source, sizeof(source));
+
+    GjsAutoChar tmpdir = g_dir_make_tmp("cjs-test-bundle-XXXXXX", nullptr);
+    GjsAutoChar bundle_path = g_build_filename(tmpdir, "import" GJS_BUNDLE_SUFFIX,
+                                               nullptr);
+    g_assert_true(g_file_set_contents(bundle_path, bundle.data(),
+                                      bundle.size(), nullptr));
+
+    GjsAutoUnref<GjsContext> context = gjs_context_new();
+    GjsAutoChar script = g_strdup_printf(
+        "imports.searchPath.unshift('%s');"
+        "imports.sub.m.answer;", bundle_path.get());
+    int estatus;
+    GError *error = nullptr;
+    bool ok = gjs_context_eval(context, script, -1, "<input>", &estatus,
+                               &error);
+    g_assert_no_error(error);
+    g_assert_true(ok);
+    g_assert_cmpint(estatus, ==, 42);
+
+    g_unlink(bundle_path);
+    g_rmdir(tmpdir);
+}
+
+static void
+gjstest_test_func_gjs_context_lazy_standard_classes(void)
+{
+    GjsAutoUnref<GjsContext> context = gjs_context_new();
+    int estatus;
+    GError *error = nullptr;
+
+#define TESTJS                                                               \
+    "const names = Object.getOwnPropertyNames(window);"                      \
+    "for (const name of ['Object', 'Uint8Array', 'Proxy', 'Promise', 'Map'," \
+    "                    'WeakSet', 'Symbol', 'JSON', 'Reflect'])"            \
+    "    if (!names.includes(name) || !(name in window))"                     \
+    "        throw new Error(name + ' missing from global');"                 \
+    "if (typeof Reflect.parse !== 'function' || typeof Debugger !== 'function')" \
+    "    throw new Error('non-standard globals missing');"
+
+    bool ok = gjs_context_eval(context, TESTJS, -1, "<input>", &estatus,
+                               &error);
+    g_assert_no_error(error);
+    g_assert_true(ok);
+
+#undef TESTJS
+}
+
+static void
+gjstest_test_func_gjs_context_job_queue_budget(void)
+{
+    GjsAutoUnref<GjsContext> context =
+        static_cast<GjsContext *>(g_object_new(GJS_TYPE_CONTEXT,
+                                               "job-queue-budget", 1,
+                                               nullptr));
+    int estatus;
+    GError *error = nullptr;
+
+    /* Each job takes longer than the budget, so the queue yields after every
+     * job; a low-priority idle queued at the same time must get to run
+     * before the queue is empty, and the jobs must still run in order */
+#define TESTJS                                                                \
+    "const GLib = imports.gi.GLib;"                                           \
+    "const loop = new GLib.MainLoop(null, false);"                            \
+    "const log = [];"                                                         \
+    "function record(what) {"                                                 \
+    "    log.push(what);"                                                     \
+    "    if (log.length === 6)"                                               \
+    "        loop.quit();"                                                    \
+    "}"                                                                       \
+    "GLib.idle_add(GLib.PRIORITY_DEFAULT, () => {"                            \
+    "    for (let i = 0; i < 5; i++) {"                                       \
+    "        Promise.resolve().then(() => {"                                  \
+    "            const end = GLib.get_monotonic_time() + 3000;"               \
+    "            while (GLib.get_monotonic_time() < end);"                    \
+    "            record(i);"                                                  \
+    "        });"                                                             \
+    "    }"                                                                   \
+    "    GLib.idle_add(GLib.PRIORITY_LOW, () => record('idle'));"             \
+    "    return GLib.SOURCE_REMOVE;"                                          \
+    "});"                                                                     \
+    "loop.run();"                                                             \
+    "const jobs = log.filter(x => x !== 'idle');"                             \
+    "jobs.join() === '0,1,2,3,4' && log.indexOf('idle') < 5 ? 0 : 1;"
+
+    bool ok = gjs_context_eval(context, TESTJS, -1, "<input>", &estatus,
+                               &error);
+    g_assert_no_error(error);
+    g_assert_true(ok);
+    g_assert_cmpint(estatus, ==, 0);
+
+#undef TESTJS
+}
+
+static void
+gjstest_test_func_gjs_context_job_queue_enqueue_after_yield(void)
+{
+    GjsAutoUnref<GjsContext> context =
+        static_cast<GjsContext *>(g_object_new(GJS_TYPE_CONTEXT,
+                                               "job-queue-budget", 1,
+                                               nullptr));
+    int estatus;
+    GError *error = nullptr;
+
+    /* The queue yields after the first job and drops to low priority; the
+     * job queued by the timeout that runs meanwhile must bring the queue back
+     * to its own priority, ahead of an idle at default idle priority */
+#define TESTJS                                                                \
+    "const GLib = imports.gi.GLib;"                                           \
+    "const loop = new GLib.MainLoop(null, false);"                            \
+    "const log = [];"                                                         \
+    "function record(what) {"                                                 \
+    "    log.push(what);"                                                     \
+    "    if (log.length === 7)"                                               \
+    "        loop.quit();"                                                    \
+    "}"                                                                       \
+    "function slowJob(i) {"                                                   \
+    "    const end = GLib.get_monotonic_time() + 3000;"                       \
+    "    while (GLib.get_monotonic_time() < end);"                            \
+    "    record(i);"                                                          \
+    "}"                                                                       \
+    "GLib.idle_add(GLib.PRIORITY_DEFAULT, () => {"                            \
+    "    Promise.resolve().then(() => {"                                      \
+    "        GLib.timeout_add(GLib.PRIORITY_DEFAULT, 0, () => {"              \
+    "            record('timeout');"                                          \
+    "            Promise.resolve().then(() => record('new'));"                \
+    "            GLib.idle_add(GLib.PRIORITY_DEFAULT_IDLE,"                   \
+    "                () => record('idle'));"                                  \
+    "            return GLib.SOURCE_REMOVE;"                                  \
+    "        });"                                                             \
+    "        slowJob(0);"                                                     \
+    "    });"                                                                 \
+    "    for (let i = 1; i < 4; i++)"                                         \
+    "        Promise.resolve().then(() => slowJob(i));"                       \
+    "    return GLib.SOURCE_REMOVE;"                                          \
+    "});"                                                                     \
+    "loop.run();"                                                             \
+    "log.indexOf(1) === log.indexOf('timeout') + 1 &&"                        \
+    "    log.indexOf('new') > log.indexOf(3) ? 0 : 1;"
+
+    bool ok = gjs_context_eval(context, TESTJS, -1, "<input>", &estatus,
+                               &error);
+    g_assert_no_error(error);
+    g_assert_true(ok);
+    g_assert_cmpint(estatus, ==, 0);
+
+#undef TESTJS
+}
+
+static void
+gjstest_test_func_gjs_context_import_trace(void)
+{
+    GjsAutoChar tmpdir = g_dir_make_tmp("cjs-test-trace-XXXXXX", nullptr);
+    g_assert_nonnull(tmpdir.get());
+    GjsAutoChar trace_path = g_build_filename(tmpdir, "trace.json", nullptr);
+
+    auto context = static_cast<GjsContext *>(g_object_new(GJS_TYPE_CONTEXT,
+        "import-trace-file", trace_path.get(), nullptr));
+    int estatus;
+    GError *error = nullptr;
+    bool ok = gjs_context_eval(context, "imports.system; imports.lang;", -1,
+                               "<input>", &estatus, &error);
+    g_assert_no_error(error);
+    g_assert_true(ok);
+    g_object_unref(context);
+
+    char *contents;
+    g_assert_true(g_file_get_contents(trace_path, &contents, nullptr, nullptr));
+    g_assert_true(g_str_has_prefix(contents, "{\"imports\": ["));
+    g_assert_nonnull(strstr(contents,
+                            "{\"name\": \"system\", \"kind\": \"native\""));
+    g_assert_nonnull(strstr(contents,
+                            "{\"name\": \"lang\", \"kind\": \"module\""));
+    g_assert_nonnull(strstr(contents, "\"compile_ms\": "));
+    g_free(contents);
+
+    g_unlink(trace_path);
+    g_rmdir(tmpdir);
+}
+
 static void
 gjstest_test_profiler_start_stop(void)
 {
@@ -402,6 +809,199 @@ gjstest_test_profiler_start_stop(void)
     gjs_profiler_stop(profiler);
 }
 
+#ifdef ENABLE_PROFILER
+struct CaptureContents {
+    std::vector<std::vector<SpCaptureAddress>> samples;
+    std::vector<std::pair<SpCaptureAddress, std::string>> labels;
+};
+
+/* Reads back the samples and jitmap entries from a capture file */
+static CaptureContents
+read_capture(const char *path)
+{
+    CaptureContents contents;
+    char *data;
+    size_t len;
+
+    g_assert_true(g_file_get_contents(path, &data, &len, nullptr));
+
+    size_t pos = sizeof(SpCaptureFileHeader);
+    while (pos < len) {
+        SpCaptureFrame frame;
+        g_assert_cmpuint(pos + sizeof(frame), <=, len);
+        memcpy(&frame, data + pos, sizeof(frame));
+        g_assert_cmpuint(frame.len, >=, sizeof(frame));
+        g_assert_cmpuint(pos + frame.len, <=, len);
+
+        if (frame.type == SP_CAPTURE_FRAME_SAMPLE) {
+            SpCaptureSample sample;
+            memcpy(&sample, data + pos, sizeof(sample));
+            std::vector<SpCaptureAddress> addrs(sample.n_addrs);
+            memcpy(addrs.data(), data + pos + sizeof(sample),
+                   sample.n_addrs * sizeof(SpCaptureAddress));
+            contents.samples.push_back(std::move(addrs));
+        } else if (frame.type == SP_CAPTURE_FRAME_JITMAP) {
+            SpCaptureJitmap jitmap;
+            memcpy(&jitmap, data + pos, sizeof(jitmap));
+            const char *entry = data + pos + sizeof(jitmap);
+            for (unsigned ix = 0; ix < jitmap.n_jitmaps; ix++) {
+                SpCaptureAddress addr;
+                memcpy(&addr, entry, sizeof(addr));
+                std::string name(entry + sizeof(addr));
+                entry += sizeof(addr) + name.size() + 1;
+                contents.labels.emplace_back(addr, std::move(name));
+            }
+        }
+
+        pos += frame.len;
+    }
+
+    g_free(data);
+    return contents;
+}
+
+static void
+gjstest_test_func_capture_writer_async_wraparound(void)
+{
+    GjsAutoChar tmpdir = g_dir_make_tmp("gjs-capture-XXXXXX", nullptr);
+    GjsAutoChar path = g_build_filename(tmpdir, "capture.syscap", nullptr);
+
+    /* 7-word records don't divide the 64-word ring, so reaching its end
+     * takes a PAD record every time it wraps around */
+    SpCaptureWriter *writer = sp_capture_writer_new_async(path, 0, 64);
+    g_assert_nonnull(writer);
+
+    for (SpCaptureAddress ix = 0; ix < 100; ix++) {
+        SpCaptureAddress addrs[] = {ix, ix + 1, ix + 2, ix + 3};
+        g_assert_true(sp_capture_writer_add_sample_async(writer, ix, -1,
+                                                         getpid(), addrs, 4));
+        if (ix % 5 == 4)
+            g_assert_true(sp_capture_writer_flush(writer));
+    }
+
+    g_assert_cmpuint(sp_capture_writer_get_n_dropped(writer), ==, 0);
+    sp_capture_writer_unref(writer);
+
+    CaptureContents contents = read_capture(path);
+    g_assert_cmpuint(contents.samples.size(), ==, 100);
+    for (SpCaptureAddress ix = 0; ix < 100; ix++) {
+        g_assert_cmpuint(contents.samples[ix].size(), ==, 4);
+        g_assert_cmpuint(contents.samples[ix][0], ==, ix);
+        g_assert_cmpuint(contents.samples[ix][3], ==, ix + 3);
+    }
+
+    g_unlink(path);
+    g_rmdir(tmpdir);
+}
+
+static void
+gjstest_test_func_capture_writer_async_dropped(void)
+{
+    GjsAutoChar tmpdir = g_dir_make_tmp("gjs-capture-XXXXXX", nullptr);
+    GjsAutoChar path = g_build_filename(tmpdir, "capture.syscap", nullptr);
+    SpCaptureWriter *writer = sp_capture_writer_new_async(path, 0, 64);
+    g_assert_nonnull(writer);
+
+    /* More than half of the ring never fits */
+    SpCaptureAddress addrs[40] = {};
+    g_assert_false(sp_capture_writer_add_sample_async(writer, 0, -1, getpid(),
+                                                      addrs, 40));
+    g_assert_cmpuint(sp_capture_writer_get_n_dropped(writer), ==, 1);
+
+    /* Whether these fit depends on the drain thread, but every one that
+     * doesn't is counted, and every one that does is written */
+    unsigned n_added = 0, n_dropped = 1;
+    for (unsigned ix = 0; ix < 50; ix++) {
+        if (sp_capture_writer_add_sample_async(writer, ix, -1, getpid(),
+                                               addrs, 4))
+            n_added++;
+        else
+            n_dropped++;
+    }
+
+    g_assert_cmpuint(sp_capture_writer_get_n_dropped(writer), ==, n_dropped);
+    sp_capture_writer_unref(writer);
+
+    CaptureContents contents = read_capture(path);
+    g_assert_cmpuint(contents.samples.size(), ==, n_added);
+
+    g_unlink(path);
+    g_rmdir(tmpdir);
+}
+
+static void
+gjstest_test_func_capture_writer_async_labels(void)
+{
+    GjsAutoChar tmpdir = g_dir_make_tmp("gjs-capture-XXXXXX", nullptr);
+    GjsAutoChar path = g_build_filename(tmpdir, "capture.syscap", nullptr);
+    SpCaptureWriter *writer = sp_capture_writer_new_async(path, 0, 0);
+    g_assert_nonnull(writer);
+
+    char label[] = "fn (file.js:123)";
+    GjsAutoChar copy = g_strdup(label);
+
+    SpCaptureAddress first = sp_capture_writer_add_jitmap_async(writer, label);
+    g_assert_cmpuint(first, !=, 0);
+    g_assert_cmpuint(sp_capture_writer_add_jitmap_async(writer, label), ==,
+                     first);
+
+    /* The same label elsewhere is sent again, under a new address */
+    SpCaptureAddress dup = sp_capture_writer_add_jitmap_async(writer, copy);
+    g_assert_cmpuint(dup, !=, first);
+
+    /* Another label where the first one was must not get its address */
+    memcpy(label + 12, "456", 3);
+    SpCaptureAddress other = sp_capture_writer_add_jitmap_async(writer, label);
+    g_assert_cmpuint(other, !=, first);
+
+    /* More labels than the cache holds, twice, so that some are evicted and
+     * sent again */
+    std::vector<std::string> names;
+    for (unsigned ix = 0; ix < 2000; ix++)
+        names.push_back("label " + std::to_string(ix));
+    std::vector<SpCaptureAddress> addrs(names.size());
+    for (unsigned round = 0; round < 2; round++) {
+        for (size_t ix = 0; ix < names.size(); ix++)
+            addrs[ix] = sp_capture_writer_add_jitmap_async(writer,
+                                                           names[ix].c_str());
+    }
+    addrs.insert(addrs.end(), {first, dup, other});
+    g_assert_true(sp_capture_writer_add_sample_async(writer, 0, -1, getpid(),
+                                                     addrs.data(),
+                                                     addrs.size()));
+    sp_capture_writer_unref(writer);
+
+    CaptureContents contents = read_capture(path);
+    GHashTable *names_by_addr = g_hash_table_new(g_int64_hash, g_int64_equal);
+    GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+    for (auto& entry : contents.labels) {
+        g_assert_false(g_hash_table_contains(seen, entry.second.c_str()));
+        g_hash_table_add(seen, const_cast<char *>(entry.second.c_str()));
+        g_hash_table_insert(names_by_addr, &entry.first,
+                            const_cast<char *>(entry.second.c_str()));
+    }
+    g_assert_cmpuint(g_hash_table_size(seen), ==, names.size() + 2);
+
+    g_assert_cmpuint(contents.samples.size(), ==, 1);
+    std::vector<SpCaptureAddress>& sample = contents.samples[0];
+    g_assert_cmpuint(sample.size(), ==, names.size() + 3);
+    for (size_t ix = 0; ix < names.size(); ix++)
+        g_assert_cmpstr(static_cast<char *>(g_hash_table_lookup(
+                            names_by_addr, &sample[ix])),
+                        ==, names[ix].c_str());
+    g_assert_cmpuint(sample[names.size()], ==, first);
+    g_assert_cmpuint(sample[names.size() + 1], ==, first);
+    g_assert_cmpstr(static_cast<char *>(g_hash_table_lookup(
+                        names_by_addr, &sample[names.size() + 2])),
+                    ==, "fn (file.js:456)");
+
+    g_hash_table_unref(names_by_addr);
+    g_hash_table_unref(seen);
+    g_unlink(path);
+    g_rmdir(tmpdir);
+}
+#endif  /* ENABLE_PROFILER */
+
 int
 main(int    argc,
      char **argv)
@@ -424,7 +1024,26 @@ main(int    argc,
     g_test_add_func("/gjs/jsutil/strip_shebang/have_shebang", gjstest_test_strip_shebang_advance_for_shebang);
     g_test_add_func("/gjs/jsutil/strip_shebang/only_shebang", gjstest_test_strip_shebang_return_null_for_just_shebang);
     g_test_add_func("/gjs/profiler/start_stop", gjstest_test_profiler_start_stop);
+#ifdef ENABLE_PROFILER
+    g_test_add_func("/util/capture_writer/async/wraparound",
+                    gjstest_test_func_capture_writer_async_wraparound);
+    g_test_add_func("/util/capture_writer/async/dropped",
+                    gjstest_test_func_capture_writer_async_dropped);
+    g_test_add_func("/util/capture_writer/async/labels",
+                    gjstest_test_func_capture_writer_async_labels);
+#endif
+    g_test_add_func("/gjs/context/import_trace", gjstest_test_func_gjs_context_import_trace);
+    g_test_add_func("/gjs/context/lazy_standard_classes", gjstest_test_func_gjs_context_lazy_standard_classes);
+    g_test_add_func("/gjs/context/job_queue_budget", gjstest_test_func_gjs_context_job_queue_budget);
+    g_test_add_func("/gjs/context/job_queue_enqueue_after_yield",
+                    gjstest_test_func_gjs_context_job_queue_enqueue_after_yield);
     g_test_add_func("/util/glib/strv/concat/null", gjstest_test_func_util_glib_strv_concat_null);
+    g_test_add_func("/util/misc/string_is_ascii", gjstest_test_func_util_misc_string_is_ascii);
+    g_test_add_func("/util/misc/utf8_round_trip", gjstest_test_func_util_misc_utf8_round_trip);
+    g_test_add_func("/util/misc/utf8_reject_invalid", gjstest_test_func_util_misc_utf8_reject_invalid);
+    g_test_add_func("/gjs/bundle/lookup", gjstest_test_func_bundle_lookup);
+    g_test_add_func("/gjs/bundle/reject_corrupt", gjstest_test_func_bundle_reject_corrupt);
+    g_test_add_func("/gjs/bundle/import", gjstest_test_func_bundle_import);
     g_test_add_func("/util/glib/strv/concat/pointers", gjstest_test_func_util_glib_strv_concat_pointers);
 
 #define ADD_JSAPI_UTIL_TEST(path, func)                            \
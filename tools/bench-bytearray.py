@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+
+# bench-bytearray.py - Measure ByteArray.toString() and fromString() throughput
+#
+# Converts payloads of a given size between ByteArray and string, inside a
+# single cjs process, and reports the median throughput in MB/s of the UTF-8
+# bytes for three kinds of text:
+#
+#   ascii:  plain ASCII, like most logs and JSON
+#   mixed:  mostly ASCII with some accented Latin-1 and other BMP characters
+#   cjk:    Chinese text, three bytes per character in UTF-8
+#
+# Passing --baseline runs the same payloads with a second cjs executable, to
+# compare two builds.
+
+import sys
+
+import benchutil
+
+parser = benchutil.make_parser('Benchmark ByteArray string conversions.', runs=10,
+                               runs_help='conversions per payload and direction')
+parser.add_argument('--size', type=int, default=4,
+                    help='payload size in MiB (default: 4)')
+
+DRIVER = '''
+const ByteArray = imports.byteArray;
+const GLib = imports.gi.GLib;
+
+const UNITS = {
+    ascii: '{"level": "info", "msg": "request served", "status": 200}\\n',
+    mixed: 'Crème brûlée à la carte — ½ price, déjà vu ✓ ok\\n',
+    cjk: '天地玄黃，宇宙洪荒。日月盈昃，辰宿列張。\\n',
+};
+
+for (let kind of ['ascii', 'mixed', 'cjk']) {
+    let unit = UNITS[kind];
+    let unitBytes = ByteArray.fromString(unit).length;
+    let text = unit.repeat(Math.ceil(%(size)d * 1024 * 1024 / unitBytes));
+    let bytes = ByteArray.fromString(text);
+
+    let decode = [], encode = [];
+    for (let i = 0; i < %(runs)d; i++) {
+        let start = GLib.get_monotonic_time();
+        bytes.toString();
+        decode.push(GLib.get_monotonic_time() - start);
+
+        start = GLib.get_monotonic_time();
+        ByteArray.fromString(text);
+        encode.push(GLib.get_monotonic_time() - start);
+    }
+
+    print(`${kind} ${bytes.length} ${median(decode)} ${median(encode)}`);
+}
+'''
+
+
+def measure(cjs, args):
+    script = benchutil.JS_PRELUDE + DRIVER % {'size': args.size, 'runs': args.runs}
+    results = {}
+    for kind, n_bytes, decode_usec, encode_usec in benchutil.run_driver([cjs, '-c', script]):
+        mb = int(n_bytes) / 1e6
+        results[kind] = (mb / (int(decode_usec) / 1e6),
+                         mb / (int(encode_usec) / 1e6))
+    return results
+
+
+def main():
+    args = parser.parse_args()
+    print('%d MiB payloads, median of %d runs, MB/s of UTF-8' % (args.size, args.runs))
+    print('%-10s %-8s %12s %12s' % ('', '', 'toString', 'fromString'))
+    for label, cjs in benchutil.builds(args):
+        results = measure(cjs, args)
+        for kind in ('ascii', 'mixed', 'cjk'):
+            decode, encode = results[kind]
+            print('%-10s %-8s %12.1f %12.1f' % (label, kind, decode, encode))
+
+
+if __name__ == '__main__':
+    sys.exit(main())
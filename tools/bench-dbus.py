@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+
+# bench-dbus.py - Measure D-Bus proxy creation and method call round trips
+#
+# Exports an object on the session bus and talks to it from the same cjs
+# process, reporting the median time over --runs runs of:
+#
+#   proxies: creating --proxies proxies with Gio.DBusProxy.new_sync(), which
+#            adds the FooRemote() and FooSync() methods to each of them
+#   calls:   --calls concurrent EchoRemote() calls, from packing the arguments
+#            on the proxy side, through dispatching on the exported object,
+#            to unpacking the replies
+#
+# If there is no session bus, the benchmark is run inside dbus-run-session.
+# Passing --baseline runs the same operations with a second cjs executable.
+
+import os
+import shutil
+import sys
+
+import benchutil
+
+parser = benchutil.make_parser('Benchmark D-Bus proxies and exported objects.', runs=10,
+                               runs_help='runs per operation')
+parser.add_argument('--proxies', type=int, default=200,
+                    help='proxies to create per run (default: 200)')
+parser.add_argument('--calls', type=int, default=2000,
+                    help='method calls per run (default: 2000)')
+
+DRIVER = '''
+const Gio = imports.gi.Gio;
+const GLib = imports.gi.GLib;
+
+const Iface = `<node>
+<interface name="org.cinnamon.cjs.Bench">
+<method name="Echo">
+    <arg type="s" direction="in"/>
+    <arg type="a{sv}" direction="in"/>
+    <arg type="s" direction="out"/>
+    <arg type="a{sv}" direction="out"/>
+</method>
+<method name="Nothing"/>
+<method name="Sum">
+    <arg type="ai" direction="in"/>
+    <arg type="x" direction="out"/>
+</method>
+</interface>
+</node>`;
+
+class Service {
+    Echo(s, dict) {
+        return [s, dict];
+    }
+
+    Nothing() {
+    }
+
+    Sum(values) {
+        return values.reduce((a, b) => a + b, 0);
+    }
+}
+
+let bus = Gio.DBus.session;
+let impl = Gio.DBusExportedObject.wrapJSObject(Iface, new Service());
+impl.export(bus, '/org/cinnamon/cjs/Bench');
+let info = Gio.DBusInterfaceInfo.new_for_xml(Iface);
+let flags = Gio.DBusProxyFlags.DO_NOT_LOAD_PROPERTIES |
+    Gio.DBusProxyFlags.DO_NOT_CONNECT_SIGNALS |
+    Gio.DBusProxyFlags.DO_NOT_AUTO_START;
+
+function makeProxy() {
+    return Gio.DBusProxy.new_sync(bus, flags, info, bus.unique_name,
+        '/org/cinnamon/cjs/Bench', 'org.cinnamon.cjs.Bench', null);
+}
+
+let proxyTimes = [], callTimes = [];
+let proxy = makeProxy();
+let dict = {
+    Name: new GLib.Variant('s', 'benchmark'),
+    Count: new GLib.Variant('u', 42),
+};
+for (let run = 0; run < %(runs)d; run++) {
+    let start = GLib.get_monotonic_time();
+    for (let i = 0; i < %(proxies)d; i++)
+        makeProxy();
+    proxyTimes.push(GLib.get_monotonic_time() - start);
+
+    let loop = new GLib.MainLoop(null, false);
+    let pending = %(calls)d;
+    start = GLib.get_monotonic_time();
+    for (let i = 0; i < %(calls)d; i++) {
+        proxy.EchoRemote(`call ${i}`, dict, (result, error) => {
+            if (error)
+                throw error;
+            if (--pending === 0)
+                loop.quit();
+        });
+    }
+    loop.run();
+    callTimes.push(GLib.get_monotonic_time() - start);
+}
+print(`proxies ${median(proxyTimes)}`);
+print(`calls ${median(callTimes)}`);
+'''
+
+
+def measure(cjs, args):
+    script = benchutil.JS_PRELUDE + DRIVER % {'proxies': args.proxies, 'calls': args.calls,
+                       'runs': args.runs}
+    command = [cjs, '-c', script]
+    if not os.environ.get('DBUS_SESSION_BUS_ADDRESS'):
+        if not shutil.which('dbus-run-session'):
+            sys.exit('No session bus, and dbus-run-session was not found')
+        command = ['dbus-run-session', '--'] + command
+    return {name: int(usec) / 1000 for name, usec in benchutil.run_driver(command)}
+
+
+def main():
+    args = parser.parse_args()
+    print('%d proxies, %d calls, median of %d runs, ms' %
+          (args.proxies, args.calls, args.runs))
+    print('%-10s%12s%12s' % ('', 'proxies', 'calls'))
+    for label, cjs in benchutil.builds(args):
+        results = measure(cjs, args)
+        print('%-10s%12.2f%12.2f' % (label, results['proxies'], results['calls']))
+
+
+if __name__ == '__main__':
+    sys.exit(main())
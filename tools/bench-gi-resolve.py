@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+
+# bench-gi-resolve.py - Compare GI namespace property resolution with and
+# without the namespace index
+#
+# For each namespace, a cjs process imports it, which builds the index, lists
+# its top-level names with GIRepository, and then accesses every one of them on
+# the namespace object, which resolves and defines it. Then it accesses the
+# same number of distinct missing names, each once, so that no miss is helped
+# by an earlier lookup of the same name. This is done once with
+# GJS_DISABLE_NS_INDEX set, which falls back to g_irepository_find_by_name()
+# for each lookup, and once with the index. The import time is reported too,
+# since it includes building the index.
+#
+# Each configuration is run --runs times, and the median is reported.
+# Namespaces that are not installed are skipped.
+
+import os
+import sys
+import tempfile
+
+import benchutil
+
+parser = benchutil.make_parser('Benchmark resolving all names in GI namespaces.', runs=10,
+                               baseline=False)
+parser.add_argument('namespaces', nargs='*', default=['Gtk', 'Clutter', 'St'],
+                    metavar='NAMESPACE',
+                    help='namespaces to resolve (default: Gtk Clutter St)')
+
+# Lookups that miss are included, since without the index each one is a full
+# search of the typelib
+DRIVER = '''
+const GLib = imports.gi.GLib;
+const GIRepository = imports.gi.GIRepository;
+const nsName = ARGV[0];
+let ns;
+let start = GLib.get_monotonic_time();
+try {
+    ns = imports.gi[nsName];
+} catch (e) {
+    print('skip');
+    imports.system.exit(0);
+}
+let importTime = GLib.get_monotonic_time() - start;
+let repo = GIRepository.Repository.get_default();
+let names = [];
+for (let ix = 0; ix < repo.get_n_infos(nsName); ix++)
+    names.push(repo.get_info(nsName, ix).get_name());
+let misses = names.map(name => name + '_missing');
+
+start = GLib.get_monotonic_time();
+for (let name of names) {
+    try {
+        ns[name];
+    } catch (e) {
+        // some infos can't be defined, that is not what we measure
+    }
+}
+let hits = GLib.get_monotonic_time() - start;
+
+start = GLib.get_monotonic_time();
+for (let name of misses)
+    ns[name];
+let missTime = GLib.get_monotonic_time() - start;
+
+print(`${names.length} ${importTime} ${hits} ${missTime}`);
+'''
+
+
+def run_once(args, driver, namespace, use_index):
+    env = dict(os.environ)
+    if use_index:
+        env.pop('GJS_DISABLE_NS_INDEX', None)
+    else:
+        env['GJS_DISABLE_NS_INDEX'] = '1'
+
+    fields = benchutil.run_driver([args.cjs, driver, namespace], env)[-1]
+    if fields == ['skip']:
+        return None
+    n_names, import_time, hits, misses = (int(field) for field in fields)
+    return n_names, import_time / 1000, hits / 1000, misses / 1000
+
+
+def main():
+    args = parser.parse_args()
+    with tempfile.NamedTemporaryFile('w', suffix='.js', prefix='cjs-bench-gi-') as driver:
+        driver.write(DRIVER)
+        driver.flush()
+
+        print('%d runs each, median ms' % args.runs)
+        print('%-10s %6s %12s %12s %12s %12s %12s %12s' % (
+            '', 'names', 'import', 'import index', 'hits', 'hits index',
+            'misses', 'misses index'))
+        for namespace in args.namespaces:
+            results = {False: [], True: []}
+            for _ in range(args.runs):
+                for use_index in (False, True):
+                    result = run_once(args, driver.name, namespace, use_index)
+                    if result is None:
+                        break
+                    results[use_index].append(result)
+
+            if not results[True]:
+                print('%-10s not available, skipped' % namespace)
+                continue
+
+            n_names = results[True][0][0]
+            row = [benchutil.median((r[field] for r in results[use_index]), namespace)
+                   for field in (1, 2, 3) for use_index in (False, True)]
+            print('%-10s %6d %12.2f %12.2f %12.2f %12.2f %12.2f %12.2f' % (
+                namespace, n_names, *row))
+
+
+if __name__ == '__main__':
+    sys.exit(main())
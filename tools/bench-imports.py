@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+
+# bench-imports.py - Compare module import times with and without the
+# compiled script cache
+#
+# Generates a tree of synthetic modules, then times a cjs process importing
+# all of them in three configurations:
+#
+#   cold:   script cache disabled, every module is compiled from source
+#   warm:   script cache enabled but empty, so modules are compiled and then
+#           encoded and written to the cache
+#   cached: script cache populated by the previous run
+#
+# Each configuration is run --runs times, and the median is reported, both for
+# the imports alone (measured inside cjs) and for the whole process.
+
+import os
+import shutil
+import sys
+import tempfile
+
+import benchutil
+
+parser = benchutil.make_parser('Benchmark cjs module imports with and without the script cache.',
+                               runs=10, baseline=False)
+parser.add_argument('--modules', type=int, default=200,
+                    help='number of modules to generate (default: 200)')
+parser.add_argument('--functions', type=int, default=50,
+                    help='functions per generated module (default: 50)')
+parser.add_argument('--search-path', metavar='DIR',
+                    help='import every .js file from DIR instead of generated modules')
+
+DRIVER = '''
+const GLib = imports.gi.GLib;
+imports.searchPath.unshift('%(dir)s');
+let start = GLib.get_monotonic_time();
+%(imports)s
+print(GLib.get_monotonic_time() - start);
+'''
+
+
+def generate_modules(dest, n_modules, n_functions):
+    names = []
+    for ix in range(n_modules):
+        name = 'benchmod%d' % ix
+        with open(os.path.join(dest, name + '.js'), 'w') as f:
+            for fn in range(n_functions):
+                f.write('''var f%(fn)d = function (a, b) {
+    let result = [];
+    for (let i = 0; i < a; i++)
+        result.push({ index: i, value: `${b}-${i}`, nested: { fn: %(fn)d } });
+    return result.filter(x => x.index %% 2).map(x => x.value).join(',');
+};
+''' % {'fn': fn})
+        names.append(name)
+    return names
+
+
+def run_once(args, driver, cache_home, use_cache):
+    elapsed, output = benchutil.run_timed([args.cjs, driver],
+                                          benchutil.cache_env(cache_home, use_cache))
+    if elapsed is None:
+        return None
+    import_usec = int(output.strip().splitlines()[-1])
+    return import_usec / 1000, elapsed
+
+
+def main():
+    args = parser.parse_args()
+    workdir = tempfile.mkdtemp(prefix='cjs-bench-imports-')
+    try:
+        if args.search_path:
+            module_dir = os.path.abspath(args.search_path)
+            names = [f[:-3] for f in sorted(os.listdir(module_dir))
+                     if f.endswith('.js')]
+        else:
+            module_dir = os.path.join(workdir, 'modules')
+            os.mkdir(module_dir)
+            names = generate_modules(module_dir, args.modules, args.functions)
+
+        driver = os.path.join(workdir, 'driver.js')
+        with open(driver, 'w') as f:
+            f.write(DRIVER % {
+                'dir': module_dir,
+                'imports': '\n'.join('imports.%s;' % n for n in names),
+            })
+
+        cache_home = os.path.join(workdir, 'cache')
+        results = {'cold': [], 'warm': [], 'cached': []}
+        for _ in range(args.runs):
+            results['cold'].append(run_once(args, driver, cache_home, False))
+
+            shutil.rmtree(cache_home, ignore_errors=True)
+            results['warm'].append(run_once(args, driver, cache_home, True))
+            results['cached'].append(run_once(args, driver, cache_home, True))
+
+        print('%d modules, %d runs each' % (len(names), args.runs))
+        print('%-8s %12s %12s' % ('', 'imports ms', 'process ms'))
+        for config in ('cold', 'warm', 'cached'):
+            runs = benchutil.successful(results[config], config)
+            imports = benchutil.median((r[0] for r in runs), config)
+            process = benchutil.median((r[1] for r in runs), config)
+            print('%-8s %s %s' % (config, benchutil.cell(imports, 12),
+                                  benchutil.cell(process, 12)))
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+
+# bench-serialize.py - Compare imports.serialize with JSON
+#
+# Encodes and decodes a few kinds of values inside a single cjs process, with
+# imports.serialize and with JSON.stringify()/JSON.parse(), and reports the
+# median time of each in milliseconds, along with the encoded sizes:
+#
+#   records:  an array of small objects with strings and numbers, like cached
+#             applet state
+#   numbers:  a large Float64Array, which JSON has to go through a plain array
+#             for
+#   map:      a Map with string keys, which JSON has to go through entries for
+#
+# Passing --baseline runs the same values with a second cjs executable, to
+# compare two builds.
+
+import sys
+
+import benchutil
+
+parser = benchutil.make_parser('Benchmark imports.serialize against JSON.', runs=10,
+                               runs_help='runs per value and method')
+parser.add_argument('--count', type=int, default=100000,
+                    help='number of records, numbers and map entries (default: 100000)')
+
+DRIVER = '''
+const ByteArray = imports.byteArray;
+const GLib = imports.gi.GLib;
+const Serialize = imports.serialize;
+
+const COUNT = %(count)d;
+
+function time(fn) {
+    let start = GLib.get_monotonic_time();
+    let result = fn();
+    return [GLib.get_monotonic_time() - start, result];
+}
+
+let records = [];
+for (let i = 0; i < COUNT; i++)
+    records.push({id: i, name: `item ${i}`, score: i / 7, tags: ['a', 'b']});
+
+let numbers = new Float64Array(COUNT).map((x, i) => Math.sin(i));
+
+let map = new Map();
+for (let i = 0; i < COUNT; i++)
+    map.set(`key${i}`, i);
+
+const VALUES = {
+    records: {
+        value: records,
+        toJSON: v => v,
+        fromJSON: v => v,
+    },
+    numbers: {
+        value: numbers,
+        toJSON: v => Array.from(v),
+        fromJSON: v => new Float64Array(v),
+    },
+    map: {
+        value: map,
+        toJSON: v => Array.from(v),
+        fromJSON: v => new Map(v),
+    },
+};
+
+for (let kind of ['records', 'numbers', 'map']) {
+    let {value, toJSON, fromJSON} = VALUES[kind];
+    let times = {se: [], sd: [], je: [], jd: []};
+    let encoded, json;
+
+    for (let i = 0; i < %(runs)d; i++) {
+        let usec;
+        [usec, encoded] = time(() => Serialize.encode(value));
+        times.se.push(usec);
+        [usec] = time(() => Serialize.decode(encoded));
+        times.sd.push(usec);
+
+        [usec, json] = time(() => JSON.stringify(toJSON(value)));
+        times.je.push(usec);
+        [usec] = time(() => fromJSON(JSON.parse(json)));
+        times.jd.push(usec);
+    }
+
+    let jsonBytes = ByteArray.fromString(json).length;
+    print(`${kind} ${median(times.se)} ${median(times.sd)} ${encoded.byteLength} ` +
+          `${median(times.je)} ${median(times.jd)} ${jsonBytes}`);
+}
+'''
+
+
+def measure(cjs, args):
+    script = benchutil.JS_PRELUDE + DRIVER % {'count': args.count, 'runs': args.runs}
+    return {kind: [int(v) for v in values]
+            for kind, *values in benchutil.run_driver([cjs, '-c', script])}
+
+
+def main():
+    args = parser.parse_args()
+    print('%d items, median of %d runs, times in ms, sizes in KiB' % (args.count, args.runs))
+    print('%-10s %-8s %10s %10s %10s %10s %10s %10s' % (
+        '', '', 'enc', 'dec', 'size', 'JSON enc', 'JSON dec', 'JSON size'))
+    for label, cjs in benchutil.builds(args):
+        results = measure(cjs, args)
+        for kind in ('records', 'numbers', 'map'):
+            se, sd, ssize, je, jd, jsize = results[kind]
+            print('%-10s %-8s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f' % (
+                label, kind, se / 1000, sd / 1000, ssize / 1024,
+                je / 1000, jd / 1000, jsize / 1024))
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+
+# bench-startup.py - Measure the startup time of short-lived cjs processes
+#
+# Runs a few typical short scripts in a fresh cjs process each, and reports
+# the median and minimum wall time of the whole process:
+#
+#   empty:  no code at all, the cost of creating and tearing down a context
+#   gio:    imports GLib, GObject and Gio with their overrides, as a CLI tool
+#           or applet helper would
+#   gtk:    additionally imports Gtk, skipped if it is not installed
+#
+# Each script is run with the compiled script cache disabled (cold) and with
+# a populated cache (warm). Passing --baseline runs the same scripts with a
+# second cjs executable, to compare two builds.
+
+import os
+import shutil
+import sys
+import tempfile
+
+import benchutil
+
+parser = benchutil.make_parser('Benchmark cjs process startup.', runs=20)
+
+SCRIPTS = [
+    ('empty', ''),
+    ('gio', 'const {GLib, GObject, Gio} = imports.gi; imports.lang; imports.mainloop;'),
+    ('gtk', 'imports.gi.versions.Gtk = "3.0"; const {Gtk} = imports.gi;'),
+]
+
+
+def run_once(cjs, script, cache_home, use_cache):
+    elapsed, _ = benchutil.run_timed([cjs, '-c', script],
+                                     benchutil.cache_env(cache_home, use_cache),
+                                     quiet=True)
+    return elapsed
+
+
+def measure(args, cjs, workdir):
+    rows = []
+    for name, script in SCRIPTS:
+        cache_home = os.path.join(workdir, 'cache-' + name)
+        shutil.rmtree(cache_home, ignore_errors=True)
+
+        # Populates the cache, and skips scripts that can't run here
+        if run_once(cjs, script, cache_home, True) is None:
+            rows.append((name, None, None))
+            continue
+
+        cold = [run_once(cjs, script, cache_home, False) for _ in range(args.runs)]
+        warm = [run_once(cjs, script, cache_home, True) for _ in range(args.runs)]
+        rows.append((name, cold, warm))
+    return rows
+
+
+def print_rows(label, rows):
+    print(label)
+    print('  %-8s %14s %14s %14s %14s' % ('', 'cold median', 'cold min',
+                                          'warm median', 'warm min'))
+    for name, cold, warm in rows:
+        if cold is None:
+            print('  %-8s %14s' % (name, 'skipped'))
+            continue
+        # A script that ran once can still fail later, e.g. if the cache is
+        # broken; only the runs that succeeded are counted
+        cells = (benchutil.median_min(cold, '%s %s cold' % (label, name)) +
+                 benchutil.median_min(warm, '%s %s warm' % (label, name)))
+        print('  %-8s' % name + ''.join(' ' + benchutil.cell(c, 14) for c in cells))
+
+
+def main():
+    args = parser.parse_args()
+    workdir = tempfile.mkdtemp(prefix='cjs-bench-startup-')
+    try:
+        print('%d runs each, ms per process' % args.runs)
+        for label, cjs in benchutil.builds(args):
+            print_rows(label, measure(args, cjs, workdir))
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+
+# bench-variant.py - Measure GLib.Variant packing and unpacking
+#
+# Packs and unpacks a dictionary shaped like a large D-Bus property reply,
+# a{sv} with strings, numbers, string arrays, byte arrays and nested
+# dictionaries, inside a single cjs process, and reports the median time per
+# operation:
+#
+#   pack:      new GLib.Variant('a{sv}', ...)
+#   unpack:    variant.unpack()
+#   deep:      variant.deepUnpack()
+#   recursive: variant.recursiveUnpack()
+#
+# Passing --baseline runs the same operations with a second cjs executable;
+# pointing it at a build from before packing and unpacking were done natively
+# compares against the JS implementation. Operations that the baseline does
+# not have are reported as "-".
+
+import sys
+
+import benchutil
+
+parser = benchutil.make_parser('Benchmark GLib.Variant packing and unpacking.', runs=20,
+                               runs_help='runs per operation')
+parser.add_argument('--entries', type=int, default=2000,
+                    help='entries in the dictionary (default: 2000)')
+
+DRIVER = '''
+const GLib = imports.gi.GLib;
+
+let props = {};
+for (let i = 0; i < %(entries)d; i++) {
+    let v;
+    switch (i %% 5) {
+    case 0:
+        v = new GLib.Variant('s', `value number ${i}`);
+        break;
+    case 1:
+        v = new GLib.Variant('(iud)', [-i, i, i / 3]);
+        break;
+    case 2:
+        v = new GLib.Variant('as', ['alpha', 'beta', 'gamma', `${i}`]);
+        break;
+    case 3:
+        v = new GLib.Variant('ay', [1, 2, 3, 4, 5, 6, 7, 8]);
+        break;
+    case 4:
+        v = new GLib.Variant('a{sv}', {
+            Name: new GLib.Variant('s', 'nested'),
+            Index: new GLib.Variant('t', i),
+            Flags: new GLib.Variant('ab', [true, false, true]),
+        });
+        break;
+    }
+    props[`Property${i}`] = v;
+}
+
+let variant = new GLib.Variant('a{sv}', props);
+const OPERATIONS = {
+    pack: () => new GLib.Variant('a{sv}', props),
+    unpack: () => variant.unpack(),
+    deep: () => variant.deep_unpack(),
+    recursive: variant.recursiveUnpack ? () => variant.recursiveUnpack() : null,
+};
+
+for (let name in OPERATIONS) {
+    let op = OPERATIONS[name];
+    if (!op) {
+        print(`${name} -`);
+        continue;
+    }
+
+    let times = [];
+    for (let i = 0; i < %(runs)d; i++) {
+        let start = GLib.get_monotonic_time();
+        op();
+        times.push(GLib.get_monotonic_time() - start);
+    }
+    print(`${name} ${median(times)}`);
+}
+'''
+
+
+def measure(cjs, args):
+    script = benchutil.JS_PRELUDE + DRIVER % {'entries': args.entries, 'runs': args.runs}
+    return {name: None if usec == '-' else int(usec) / 1000
+            for name, usec in benchutil.run_driver([cjs, '-c', script])}
+
+
+def main():
+    args = parser.parse_args()
+    operations = ('pack', 'unpack', 'deep', 'recursive')
+    print('a{sv} with %d entries, median of %d runs, ms' % (args.entries, args.runs))
+    print('%-10s' % '' + ''.join('%12s' % op for op in operations))
+    for label, cjs in benchutil.builds(args):
+        results = measure(cjs, args)
+        print('%-10s' % label + ''.join(benchutil.cell(results[op], 12, 2)
+                                        for op in operations))
+
+
+if __name__ == '__main__':
+    sys.exit(main())
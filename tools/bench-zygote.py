@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+
+# bench-zygote.py - Compare time-to-first-line of cjs with and without a zygote
+#
+# Starts a zygote ("cjs --zygote=SOCKET"), then runs a script that imports
+# GLib, GObject and Gio and prints one line, and measures the time from
+# launching it until that line can be read from its stdout:
+#
+#   cold:    a fresh cjs process, without a zygote
+#   client:  cjs with CJS_ZYGOTE_SOCKET set, so it forwards its command line
+#            to the zygote and waits for the worker to exit
+#   socket:  the benchmark itself sends the request to the zygote, which shows
+#            the cost of the forked worker without the client's exec
+#
+# All configurations share a populated script cache, so only the difference
+# in process startup is measured. Pass --typelib to have the zygote load more
+# typelibs, and --script to time a different script.
+
+import array
+import os
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+import benchutil
+
+parser = benchutil.make_parser('Benchmark cjs startup with a zygote.', runs=20,
+                               baseline=False)
+parser.add_argument('--typelib', action='append', default=[], metavar='NAMESPACE',
+                    help='extra typelib for the zygote to load, e.g. Gtk-3.0')
+parser.add_argument('--script', metavar='FILE',
+                    help='script to run instead of the default one; must print a line')
+
+SCRIPT = '''
+const {GLib, GObject, Gio} = imports.gi;
+imports.lang;
+print(Gio.File.new_for_path('.').get_basename());
+'''
+
+# Must match ZygoteRequest and ZygoteReply in cjs/zygote.cpp
+ZYGOTE_MAGIC = 0x5a534a43
+ZYGOTE_REPLY_EXIT = 2
+REPLY = struct.Struct('=IIi')
+
+
+def wait_for_line(proc_stdout):
+    line = proc_stdout.readline()
+    if not line:
+        raise RuntimeError('script exited without printing anything')
+
+
+def run_process(args, script, env):
+    start = time.monotonic()
+    proc = subprocess.Popen([args.cjs, script], env=env, stdout=subprocess.PIPE)
+    wait_for_line(proc.stdout)
+    first_line = time.monotonic() - start
+    proc.stdout.read()
+    if proc.wait() != 0:
+        raise RuntimeError('cjs exited with status %d' % proc.returncode)
+    return first_line * 1000
+
+
+def run_socket(args, script, socket_path, env):
+    start = time.monotonic()
+    read_fd, write_fd = os.pipe()
+    strings = [os.getcwd(), args.cjs, script]
+    strings += ['%s=%s' % item for item in env.items()]
+    payload = b''.join(s.encode() + b'\0' for s in strings)
+    header = struct.pack('=IIII', ZYGOTE_MAGIC, 2, len(env), len(payload))
+
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as conn:
+        conn.connect(socket_path)
+        fds = array.array('i', [0, write_fd, 2])
+        conn.sendmsg([header], [(socket.SOL_SOCKET, socket.SCM_RIGHTS, fds)])
+        conn.sendall(payload)
+        os.close(write_fd)
+
+        with os.fdopen(read_fd, 'rb') as stdout:
+            wait_for_line(stdout)
+            first_line = time.monotonic() - start
+            stdout.read()
+
+        data = b''
+        while True:
+            chunk = conn.recv(REPLY.size)
+            if not chunk:
+                raise RuntimeError('lost connection to the zygote')
+            data += chunk
+            while len(data) >= REPLY.size:
+                magic, kind, value = REPLY.unpack(data[:REPLY.size])
+                data = data[REPLY.size:]
+                if kind == ZYGOTE_REPLY_EXIT:
+                    if value != 0:
+                        raise RuntimeError('worker exited with status %d' % value)
+                    return first_line * 1000
+
+
+def start_zygote(args, socket_path, env):
+    cmd = [args.cjs, '--zygote=' + socket_path]
+    cmd += ['--zygote-typelib=' + t for t in args.typelib]
+    zygote = subprocess.Popen(cmd, env=env)
+    deadline = time.monotonic() + 10
+    while not os.path.exists(socket_path):
+        if zygote.poll() is not None or time.monotonic() > deadline:
+            raise RuntimeError('zygote did not start')
+        time.sleep(0.01)
+    return zygote
+
+
+def main():
+    args = parser.parse_args()
+    workdir = tempfile.mkdtemp(prefix='cjs-bench-zygote-')
+    zygote = None
+    try:
+        if args.script:
+            script = os.path.abspath(args.script)
+        else:
+            script = os.path.join(workdir, 'script.js')
+            with open(script, 'w') as f:
+                f.write(SCRIPT)
+
+        env = benchutil.cache_env(os.path.join(workdir, 'cache'), True)
+        env.pop('CJS_ZYGOTE_SOCKET', None)
+        socket_path = os.path.join(workdir, 'zygote.sock')
+
+        # Populate the script cache before the zygote starts, so that it can
+        # pull the cache into memory
+        run_process(args, script, env)
+        zygote = start_zygote(args, socket_path, env)
+
+        client_env = dict(env)
+        client_env['CJS_ZYGOTE_SOCKET'] = socket_path
+
+        results = {'cold': [], 'client': [], 'socket': []}
+        for _ in range(args.runs):
+            results['cold'].append(run_process(args, script, env))
+            results['client'].append(run_process(args, script, client_env))
+            results['socket'].append(run_socket(args, script, socket_path, env))
+
+        print('time to first line, %d runs each' % args.runs)
+        print('%-8s %10s %10s' % ('', 'median ms', 'min ms'))
+        for config in ('cold', 'client', 'socket'):
+            median, fastest = benchutil.median_min(results[config], config)
+            print('%-8s %s %s' % (config, benchutil.cell(median, 10),
+                                  benchutil.cell(fastest, 10)))
+    finally:
+        if zygote:
+            zygote.terminate()
+            zygote.wait()
+        shutil.rmtree(workdir, ignore_errors=True)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
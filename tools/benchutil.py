@@ -0,0 +1,106 @@
+# benchutil.py - Helpers shared by the bench-*.py scripts
+#
+# Not a benchmark by itself. The scripts import it from their own directory,
+# so it needs no installing.
+
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+import time
+
+# Prepended to the JS drivers that time operations inside a single process
+JS_PRELUDE = '''
+function median(values) {
+    values.sort((a, b) => a - b);
+    return values[Math.floor(values.length / 2)];
+}
+'''
+
+
+def make_parser(description, runs, runs_help='runs per configuration',
+                baseline=True):
+    """Argument parser with the --cjs, --baseline and --runs options that
+    every benchmark takes; add the benchmark's own options to it."""
+    parser = argparse.ArgumentParser(description=description)
+    parser.add_argument('--cjs', default='cjs',
+                        help='cjs executable to run (default: cjs from $PATH)')
+    if baseline:
+        parser.add_argument('--baseline', metavar='CJS',
+                            help='another cjs executable to compare against')
+    parser.add_argument('--runs', type=int, default=runs,
+                        help='%s (default: %d)' % (runs_help, runs))
+    return parser
+
+
+def builds(args):
+    """(label, executable) for --cjs and, if given, --baseline."""
+    result = [('cjs', args.cjs)]
+    if getattr(args, 'baseline', None):
+        result.append(('baseline', args.baseline))
+    return result
+
+
+def cache_env(cache_home, use_cache, base=None):
+    """Environment with the compiled script cache in cache_home, enabled or
+    disabled."""
+    env = dict(os.environ if base is None else base)
+    env['XDG_CACHE_HOME'] = cache_home
+    if use_cache:
+        env.pop('GJS_DISABLE_SCRIPT_CACHE', None)
+    else:
+        env['GJS_DISABLE_SCRIPT_CACHE'] = '1'
+    return env
+
+
+def run_driver(command, env=None):
+    """Runs a driver that prints its results, and returns the whitespace
+    separated fields of each line it printed."""
+    output = subprocess.check_output(command, env=env).decode()
+    return [line.split() for line in output.strip().splitlines()]
+
+
+def run_timed(command, env=None, quiet=False):
+    """Runs a whole process and returns its wall time in ms and its output,
+    or None for the time if it did not exit successfully."""
+    start = time.monotonic()
+    result = subprocess.run(command, env=env, stdout=subprocess.PIPE,
+                            stderr=subprocess.DEVNULL if quiet else None)
+    elapsed = time.monotonic() - start
+    if result.returncode != 0:
+        return None, result.stdout.decode()
+    return elapsed * 1000, result.stdout.decode()
+
+
+def successful(values, what):
+    """The values that are not None; the others are failed runs, and are
+    reported on stderr."""
+    values = list(values)
+    ok = [v for v in values if v is not None]
+    if len(ok) < len(values):
+        print('%s: %d of %d runs failed' % (what, len(values) - len(ok),
+                                            len(values)), file=sys.stderr)
+    return ok
+
+
+def median(values, what):
+    """Median of the successful runs, or None if there were none."""
+    ok = successful(values, what)
+    return statistics.median(ok) if ok else None
+
+
+def median_min(values, what):
+    """Median and minimum of the successful runs, or Nones if there were
+    none."""
+    ok = successful(values, what)
+    if not ok:
+        return None, None
+    return statistics.median(ok), min(ok)
+
+
+def cell(value, width, precision=1):
+    """Right-aligned table cell for a number, or "-" if it is missing."""
+    if value is None:
+        return '%*s' % (width, '-')
+    return '%*.*f' % (width, precision, value)
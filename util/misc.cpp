@@ -22,6 +22,14 @@
  */
 
 #include <config.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "misc.h"
 
 bool
@@ -38,3 +46,308 @@ gjs_environment_variable_is_set(const char *env_variable_name)
 
     return true;
 }
+
+/* Returns the first byte at or after @p that has its high bit set, or @end.
+ * Checks 16 bytes at a time with SSE2 where available, otherwise 8 bytes at a
+ * time in a 64-bit word. */
+static inline const uint8_t *
+skip_ascii(const uint8_t *p,
+           const uint8_t *end)
+{
+#ifdef __SSE2__
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int mask = _mm_movemask_epi8(chunk);
+        if (mask != 0)
+            return p + g_bit_nth_lsf(mask, -1);
+    }
+#endif
+
+    for (; end - p >= 8; p += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, p, sizeof(chunk));
+        if (chunk & UINT64_C(0x8080808080808080))
+            break;
+    }
+
+    while (p < end && *p < 0x80)
+        p++;
+    return p;
+}
+
+bool
+gjs_string_is_ascii(const char *str,
+                    size_t      len)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(str);
+    return skip_ascii(p, p + len) == p + len;
+}
+
+/* Decodes the multi-byte sequence at @p, whose lead byte is not ASCII, into
+ * @code_point and returns its length in bytes, or 0 if it is not valid UTF-8:
+ * overlong forms, surrogates, code points above U+10FFFF and truncated
+ * sequences are all rejected, like SpiderMonkey's own decoder does. */
+static inline size_t
+decode_utf8_sequence(const uint8_t *p,
+                     const uint8_t *end,
+                     uint32_t      *code_point)
+{
+    uint8_t lead = *p;
+    size_t n_continuation;
+    uint32_t cp, min;
+
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        n_continuation = 1;
+        cp = lead & 0x1f;
+        min = 0x80;
+    } else if (lead >= 0xe0 && lead <= 0xef) {
+        n_continuation = 2;
+        cp = lead & 0x0f;
+        min = 0x800;
+    } else if (lead >= 0xf0 && lead <= 0xf4) {
+        n_continuation = 3;
+        cp = lead & 0x07;
+        min = 0x10000;
+    } else {
+        return 0;
+    }
+
+    if (size_t(end - p) <= n_continuation)
+        return 0;
+
+    for (size_t ix = 1; ix <= n_continuation; ix++) {
+        if ((p[ix] & 0xc0) != 0x80)
+            return 0;
+        cp = (cp << 6) | (p[ix] & 0x3f);
+    }
+
+    if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff))
+        return 0;
+
+    *code_point = cp;
+    return n_continuation + 1;
+}
+
+bool
+gjs_utf8_validate(const char *str,
+                  size_t      len,
+                  size_t     *utf16_len_out,
+                  bool       *is_latin1_out)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(str);
+    const uint8_t *end = p + len;
+    size_t utf16_len = 0;
+    bool is_latin1 = true;
+
+    while (p < end) {
+        const uint8_t *ascii_end = skip_ascii(p, end);
+        utf16_len += ascii_end - p;
+        p = ascii_end;
+        if (p == end)
+            break;
+
+        uint32_t cp;
+        size_t n_bytes = decode_utf8_sequence(p, end, &cp);
+        if (n_bytes == 0)
+            return false;
+
+        p += n_bytes;
+        utf16_len += cp >= 0x10000 ? 2 : 1;
+        if (cp > 0xff)
+            is_latin1 = false;
+    }
+
+    *utf16_len_out = utf16_len;
+    *is_latin1_out = is_latin1;
+    return true;
+}
+
+void
+gjs_utf8_to_utf16(const char *str,
+                  size_t      len,
+                  char16_t   *out)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(str);
+    const uint8_t *end = p + len;
+
+    while (p < end) {
+#ifdef __SSE2__
+        /* Widen runs of ASCII 16 bytes at a time */
+        const __m128i zero = _mm_setzero_si128();
+        for (; end - p >= 16; p += 16, out += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            if (_mm_movemask_epi8(chunk) != 0)
+                break;
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                             _mm_unpacklo_epi8(chunk, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8),
+                             _mm_unpackhi_epi8(chunk, zero));
+        }
+#endif
+        for (; p < end && *p < 0x80; p++)
+            *out++ = *p;
+        if (p == end)
+            break;
+
+        uint32_t cp;
+        size_t n_bytes = decode_utf8_sequence(p, end, &cp);
+        g_assert(n_bytes > 0 && "UTF-8 must be validated first");
+        p += n_bytes;
+
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            *out++ = 0xd800 | (cp >> 10);
+            *out++ = 0xdc00 | (cp & 0x3ff);
+        } else {
+            *out++ = cp;
+        }
+    }
+}
+
+void
+gjs_utf8_to_latin1(const char *str,
+                   size_t      len,
+                   char       *out)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(str);
+    const uint8_t *end = p + len;
+
+    while (p < end) {
+        const uint8_t *ascii_end = skip_ascii(p, end);
+        memcpy(out, p, ascii_end - p);
+        out += ascii_end - p;
+        p = ascii_end;
+        if (p == end)
+            break;
+
+        /* Only two-byte sequences decode to U+0080..U+00FF */
+        g_assert((p[0] == 0xc2 || p[0] == 0xc3) && end - p >= 2 &&
+                 "UTF-8 must be validated and fit in Latin-1");
+        *out++ = ((p[0] & 0x1f) << 6) | (p[1] & 0x3f);
+        p += 2;
+    }
+}
+
+size_t
+gjs_latin1_utf8_length(const char *str,
+                       size_t      len)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(str);
+    const uint8_t *end = p + len;
+    size_t utf8_len = len;
+
+    /* Every byte with its high bit set takes one more byte in UTF-8; sum the
+     * high bits of eight bytes at a time with a multiplication */
+    for (; end - p >= 8; p += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, p, sizeof(chunk));
+        uint64_t high_bits = (chunk & UINT64_C(0x8080808080808080)) >> 7;
+        utf8_len += (high_bits * UINT64_C(0x0101010101010101)) >> 56;
+    }
+    for (; p < end; p++)
+        utf8_len += *p >> 7;
+
+    return utf8_len;
+}
+
+void
+gjs_latin1_to_utf8(const char *str,
+                   size_t      len,
+                   char       *out)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(str);
+    const uint8_t *end = p + len;
+
+    while (p < end) {
+        const uint8_t *ascii_end = skip_ascii(p, end);
+        memcpy(out, p, ascii_end - p);
+        out += ascii_end - p;
+        p = ascii_end;
+
+        for (; p < end && *p >= 0x80; p++) {
+            *out++ = 0xc0 | (*p >> 6);
+            *out++ = 0x80 | (*p & 0x3f);
+        }
+    }
+}
+
+/* Lone surrogates become U+FFFD REPLACEMENT CHARACTER, three bytes in UTF-8,
+ * like JS_EncodeStringToUTF8() does */
+static inline bool
+is_surrogate_pair(const char16_t *p,
+                  const char16_t *end)
+{
+    return p[0] >= 0xd800 && p[0] <= 0xdbff && end - p >= 2 &&
+        p[1] >= 0xdc00 && p[1] <= 0xdfff;
+}
+
+size_t
+gjs_utf16_utf8_length(const char16_t *str,
+                      size_t          len)
+{
+    const char16_t *end = str + len;
+    size_t utf8_len = 0;
+
+    for (const char16_t *p = str; p < end; p++) {
+        if (*p < 0x80) {
+            utf8_len += 1;
+        } else if (*p < 0x800) {
+            utf8_len += 2;
+        } else if (is_surrogate_pair(p, end)) {
+            utf8_len += 4;
+            p++;
+        } else {
+            utf8_len += 3;
+        }
+    }
+
+    return utf8_len;
+}
+
+void
+gjs_utf16_to_utf8(const char16_t *str,
+                  size_t          len,
+                  char           *out)
+{
+    const char16_t *p = str, *end = str + len;
+
+    while (p < end) {
+#ifdef __SSE2__
+        /* Narrow runs of ASCII 16 code units at a time */
+        const __m128i non_ascii = _mm_set1_epi16(static_cast<short>(0xff80));
+        for (; end - p >= 16; p += 16, out += 16) {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 8));
+            __m128i high_bits = _mm_and_si128(_mm_or_si128(lo, hi), non_ascii);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high_bits,
+                                                  _mm_setzero_si128())) != 0xffff)
+                break;
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                             _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (; p < end && *p < 0x80; p++)
+            *out++ = *p;
+        if (p == end)
+            break;
+
+        uint32_t cp = *p++;
+        if (cp < 0x800) {
+            *out++ = 0xc0 | (cp >> 6);
+            *out++ = 0x80 | (cp & 0x3f);
+            continue;
+        }
+
+        if (is_surrogate_pair(p - 1, end)) {
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (*p++ - 0xdc00);
+            *out++ = 0xf0 | (cp >> 18);
+            *out++ = 0x80 | ((cp >> 12) & 0x3f);
+        } else {
+            if (cp >= 0xd800 && cp <= 0xdfff)
+                cp = 0xfffd;
+            *out++ = 0xe0 | (cp >> 12);
+        }
+        *out++ = 0x80 | ((cp >> 6) & 0x3f);
+        *out++ = 0x80 | (cp & 0x3f);
+    }
+}
@@ -30,6 +30,41 @@ G_BEGIN_DECLS
 
 bool    gjs_environment_variable_is_set   (const char *env_variable_name);
 
+bool    gjs_string_is_ascii               (const char *str,
+                                           size_t      len);
+
+/* UTF-8 kernels for converting between bytes and JS string contents, which
+ * are either Latin-1 or UTF-16. None of them NUL-terminate their output.
+ *
+ * gjs_utf8_validate() checks @len bytes of UTF-8, and computes the length
+ * of the UTF-16 text they decode to, and whether all of the text would fit
+ * in Latin-1. The decoding functions may only be called on validated UTF-8,
+ * and gjs_utf8_to_latin1() only if it fits in Latin-1; their output buffers
+ * must hold the computed number of code units. The encoding functions write
+ * exactly as many bytes as the corresponding _utf8_length() function
+ * returns, and encode lone surrogates as U+FFFD. */
+bool    gjs_utf8_validate                 (const char *str,
+                                           size_t      len,
+                                           size_t     *utf16_len_out,
+                                           bool       *is_latin1_out);
+void    gjs_utf8_to_utf16                 (const char *str,
+                                           size_t      len,
+                                           char16_t   *out);
+void    gjs_utf8_to_latin1                (const char *str,
+                                           size_t      len,
+                                           char       *out);
+
+size_t  gjs_latin1_utf8_length            (const char *str,
+                                           size_t      len);
+void    gjs_latin1_to_utf8                (const char *str,
+                                           size_t      len,
+                                           char       *out);
+size_t  gjs_utf16_utf8_length             (const char16_t *str,
+                                           size_t          len);
+void    gjs_utf16_to_utf8                 (const char16_t *str,
+                                           size_t          len,
+                                           char           *out);
+
 G_END_DECLS
 
 #endif  /* __GJS_UTIL_MISC_H__ */
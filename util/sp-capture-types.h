@@ -62,8 +62,18 @@ typedef enum
   SP_CAPTURE_FRAME_JITMAP    = 7,
   SP_CAPTURE_FRAME_CTRDEF    = 8,
   SP_CAPTURE_FRAME_CTRSET    = 9,
+  SP_CAPTURE_FRAME_MARK      = 10,
 } SpCaptureFrameType;
 
+#define SP_CAPTURE_COUNTER_INT64  0
+#define SP_CAPTURE_COUNTER_DOUBLE 1
+
+typedef union
+{
+  gint64  v64;
+  gdouble vdbl;
+} SpCaptureCounterValue;
+
 #pragma pack(push, 1)
 
 typedef struct
@@ -114,6 +124,52 @@ typedef struct
   SpCaptureAddress addrs[0];
 } SpCaptureSample;
 
+typedef struct
+{
+  gchar                 category[32];
+  gchar                 name[32];
+  gchar                 description[52];
+  guint32               id : 24;
+  guint8                type;
+  SpCaptureCounterValue value;
+} SpCaptureCounter;
+
+typedef struct
+{
+  SpCaptureFrame   frame;
+  guint16          n_counters;
+  guint64          padding : 48;
+  SpCaptureCounter counters[0];
+} SpCaptureFrameCounterDefine;
+
+typedef struct
+{
+  /*
+   * 96 bytes might seem a bit odd, but the counter frame header is 32
+   * bytes.  So this makes a nice 2-cacheline aligned size which is
+   * useful when the number of counters is rather small.
+   */
+  guint32               ids[8];
+  SpCaptureCounterValue values[8];
+} SpCaptureCounterValues;
+
+typedef struct
+{
+  SpCaptureFrame         frame;
+  guint16                n_values;
+  guint64                padding : 48;
+  SpCaptureCounterValues values[0];
+} SpCaptureFrameCounterSet;
+
+typedef struct
+{
+  SpCaptureFrame frame;
+  gint64         duration;
+  gchar          group[24];
+  gchar          name[40];
+  gchar          message[0];
+} SpCaptureMark;
+
 #pragma pack(pop)
 
 G_STATIC_ASSERT (sizeof (SpCaptureFileHeader) == 256);
@@ -121,6 +177,11 @@ G_STATIC_ASSERT (sizeof (SpCaptureFrame) == 24);
 G_STATIC_ASSERT (sizeof (SpCaptureMap) == 56);
 G_STATIC_ASSERT (sizeof (SpCaptureJitmap) == 28);
 G_STATIC_ASSERT (sizeof (SpCaptureSample) == 32);
+G_STATIC_ASSERT (sizeof (SpCaptureCounter) == 128);
+G_STATIC_ASSERT (sizeof (SpCaptureCounterValues) == 96);
+G_STATIC_ASSERT (sizeof (SpCaptureFrameCounterDefine) == 32);
+G_STATIC_ASSERT (sizeof (SpCaptureFrameCounterSet) == 32);
+G_STATIC_ASSERT (sizeof (SpCaptureMark) == 96);
 
 G_END_DECLS
 
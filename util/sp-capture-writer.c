@@ -33,6 +33,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <glib/gstdio.h>
+#include <glib-unix.h>
+#include <poll.h>
 #include <string.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
@@ -43,6 +45,55 @@
 
 #define DEFAULT_BUFFER_SIZE (getpagesize() * 64L)
 #define INVALID_ADDRESS     (G_GUINT64_CONSTANT(0))
+#define MAX_COUNTERS        ((1 << 24) - 1)
+
+/* Asynchronous mode, see sp_capture_writer_new_async() */
+#define DEFAULT_RING_SIZE   (G_GSIZE_CONSTANT (1) << 17)  /* words, 1 MiB */
+#define DRAIN_INTERVAL_USEC (10 * 1000)
+#define LABEL_CACHE_SETS    256
+#define LABEL_CACHE_WAYS    4
+#define CACHED_LABEL_LEN    256
+#define MAX_LABEL_LEN       1024
+
+/*
+ * A record in the ring is a header word followed by payload words:
+ *
+ *   PAD:    nothing, skips the words up to the end of the ring
+ *   SAMPLE: time, cpu << 32 | pid, addresses; extra is the number of addresses
+ *   LABEL:  address, NUL-terminated label; extra is the label length
+ */
+typedef enum
+{
+  RING_RECORD_PAD,
+  RING_RECORD_SAMPLE,
+  RING_RECORD_LABEL,
+} SpCaptureRingRecordType;
+
+#define RING_HEADER(type, n_words, extra) \
+  ((guint64)(type) | ((guint64)(n_words) << 8) | ((guint64)(extra) << 32))
+#define RING_HEADER_TYPE(header)    ((guint)((header) & 0xFF))
+#define RING_HEADER_N_WORDS(header) ((gsize)(((header) >> 8) & 0xFFFFFF))
+#define RING_HEADER_EXTRA(header)   ((guint)((header) >> 32))
+
+/*
+ * Labels already sent to the drain thread, by pointer, in a set-associative
+ * cache. A label's memory may be freed and reused for another label, so a
+ * hit also has to match the whole string; labels too long to keep a copy of
+ * are not cached.
+ */
+typedef struct
+{
+  const gchar *name;
+  gsize len;
+  SpCaptureAddress addr;
+  gchar str[CACHED_LABEL_LEN];
+} SpCaptureLabelCacheEntry;
+
+typedef struct
+{
+  SpCaptureLabelCacheEntry ways[LABEL_CACHE_WAYS];
+  guint next_victim;
+} SpCaptureLabelCacheSet;
 
 typedef struct
 {
@@ -103,11 +154,108 @@ struct _SpCaptureWriter
 
   /* Statistics while recording */
   SpCaptureStat stat;
+
+  /*
+   * Asynchronous mode: the ring of 64-bit words that samples are written
+   * to, from a signal handler, and the thread that drains it into the
+   * buffer above. There is exactly one producer and one consumer; each
+   * only ever advances its own position, so no locks are needed.
+   */
+  guint64 *ring;
+  guint ring_mask;
+  volatile guint ring_head;
+  volatile guint ring_tail;
+  volatile guint n_dropped;
+  SpCaptureLabelCacheSet *label_cache;
+
+  /*
+   * The drain thread sleeps in poll() on @wake_fds. The signal handler only
+   * writes to the pipe, which is signal-safe, for the first record after
+   * the drain thread set @drain_sleeping.
+   */
+  GThread *drain_thread;
+  volatile gint drain_stop;
+  volatile gint drain_sleeping;
+  int wake_fds[2];
+
+  /*
+   * The consumer is whichever thread holds @drain_lock, normally the drain
+   * thread. It also owns the jitmap, and the tables that deduplicate labels
+   * by string: @label_addrs maps each label to the address it was first
+   * written with, and @addr_remap maps any other address the signal handler
+   * handed out for it to that one.
+   */
+  GMutex drain_lock;
+  GThread *drainer;
+  GHashTable *label_addrs;
+  GHashTable *addr_remap;
+  SpCaptureAddress *remap_buf;
+
+  /*
+   * @lock protects the write buffer and everything else. A full buffer is
+   * swapped with @spare, which is then written to disk without holding
+   * @lock, so a thread adding a mark or counters only waits for the disk
+   * if it fills the buffer again before that is done.
+   */
+  GMutex lock;
+  GCond spare_cond;
+  guint8 *spare;
+  gsize spare_len;
+  gboolean writing_spare;
+  gboolean write_failed;
 };
 
 G_DEFINE_BOXED_TYPE (SpCaptureWriter, sp_capture_writer,
                      sp_capture_writer_ref, sp_capture_writer_unref)
 
+static gboolean sp_capture_writer_drain_ring (SpCaptureWriter *self);
+
+static inline void
+sp_capture_writer_lock (SpCaptureWriter *self)
+{
+  if (self->ring != NULL)
+    g_mutex_lock (&self->lock);
+}
+
+static inline void
+sp_capture_writer_unlock (SpCaptureWriter *self)
+{
+  if (self->ring != NULL)
+    g_mutex_unlock (&self->lock);
+}
+
+/* Makes the calling thread the consumer of the ring */
+static inline void
+sp_capture_writer_lock_drain (SpCaptureWriter *self)
+{
+  g_mutex_lock (&self->drain_lock);
+  g_mutex_lock (&self->lock);
+  self->drainer = g_thread_self ();
+}
+
+static inline void
+sp_capture_writer_unlock_drain (SpCaptureWriter *self)
+{
+  self->drainer = NULL;
+  g_mutex_unlock (&self->lock);
+  g_mutex_unlock (&self->drain_lock);
+}
+
+/* Signal-safe */
+static void
+sp_capture_writer_wake_drain (SpCaptureWriter *self)
+{
+  int errsv = errno;
+  gchar c = 0;
+
+  if (write (self->wake_fds[1], &c, 1) < 0)
+    {
+      /* The pipe is full, so the drain thread will wake up anyway */
+    }
+
+  errno = errsv;
+}
+
 static inline void
 sp_capture_writer_frame_init (SpCaptureFrame     *frame_,
                               gint                len,
@@ -131,8 +279,33 @@ sp_capture_writer_finalize (SpCaptureWriter *self)
 {
   if (self != NULL)
     {
+      if (self->drain_thread != NULL)
+        {
+          g_atomic_int_set (&self->drain_stop, TRUE);
+          sp_capture_writer_wake_drain (self);
+          g_thread_join (self->drain_thread);
+          self->drain_thread = NULL;
+        }
+
       sp_capture_writer_flush (self);
       close (self->fd);
+      if (self->ring != NULL)
+        {
+          if (self->wake_fds[0] != -1)
+            {
+              close (self->wake_fds[0]);
+              close (self->wake_fds[1]);
+            }
+          g_free (self->ring);
+          g_free (self->label_cache);
+          g_hash_table_unref (self->label_addrs);
+          g_hash_table_unref (self->addr_remap);
+          g_free (self->remap_buf);
+          g_free (self->spare);
+          g_cond_clear (&self->spare_cond);
+          g_mutex_clear (&self->lock);
+          g_mutex_clear (&self->drain_lock);
+        }
       g_free (self->buf);
       g_free (self);
     }
@@ -160,22 +333,15 @@ sp_capture_writer_unref (SpCaptureWriter *self)
 }
 
 static gboolean
-sp_capture_writer_flush_data (SpCaptureWriter *self)
+sp_capture_writer_write_all (int           fd,
+                             const guint8 *buf,
+                             gsize         to_write)
 {
-  const guint8 *buf;
   gssize written;
-  gsize to_write;
-
-  g_assert (self != NULL);
-  g_assert (self->pos <= self->len);
-  g_assert ((self->pos % SP_CAPTURE_ALIGN) == 0);
-
-  buf = self->buf;
-  to_write = self->pos;
 
   while (to_write > 0)
     {
-      written = write (self->fd, buf, to_write);
+      written = write (fd, buf, to_write);
       if (written < 0)
         return FALSE;
 
@@ -188,6 +354,89 @@ sp_capture_writer_flush_data (SpCaptureWriter *self)
       to_write -= written;
     }
 
+  return TRUE;
+}
+
+/*
+ * Writes the spare buffer to disk, if it holds anything, releasing @lock
+ * meanwhile. Called with @lock held, by the drain thread or the consumer.
+ */
+static gboolean
+sp_capture_writer_write_spare (SpCaptureWriter *self)
+{
+  gboolean ret;
+
+  while (self->writing_spare)
+    g_cond_wait (&self->spare_cond, &self->lock);
+
+  if (self->spare_len == 0)
+    return TRUE;
+
+  self->writing_spare = TRUE;
+  g_mutex_unlock (&self->lock);
+
+  ret = sp_capture_writer_write_all (self->fd, self->spare, self->spare_len);
+
+  g_mutex_lock (&self->lock);
+  self->writing_spare = FALSE;
+  self->spare_len = 0;
+  if (!ret)
+    self->write_failed = TRUE;
+  g_cond_broadcast (&self->spare_cond);
+
+  return ret;
+}
+
+/*
+ * Asynchronous mode's sp_capture_writer_flush_data(): hands the full buffer
+ * to the drain thread and carries on in the spare one. If that hasn't been
+ * written yet, the consumer writes it itself, since the drain thread may be
+ * waiting for it to finish; anyone else waits for the drain thread.
+ */
+static gboolean
+sp_capture_writer_swap_buffers (SpCaptureWriter *self)
+{
+  guint8 *buf;
+
+  while (self->spare_len > 0)
+    {
+      if (self->drainer == g_thread_self ())
+        {
+          if (!sp_capture_writer_write_spare (self))
+            return FALSE;
+        }
+      else
+        {
+          sp_capture_writer_wake_drain (self);
+          g_cond_wait (&self->spare_cond, &self->lock);
+        }
+    }
+
+  buf = self->spare;
+  self->spare = self->buf;
+  self->spare_len = self->pos;
+  self->buf = buf;
+  self->pos = 0;
+
+  if (self->drainer != g_thread_self ())
+    sp_capture_writer_wake_drain (self);
+
+  return TRUE;
+}
+
+static gboolean
+sp_capture_writer_flush_data (SpCaptureWriter *self)
+{
+  g_assert (self != NULL);
+  g_assert (self->pos <= self->len);
+  g_assert ((self->pos % SP_CAPTURE_ALIGN) == 0);
+
+  if (self->ring != NULL)
+    return sp_capture_writer_swap_buffers (self);
+
+  if (!sp_capture_writer_write_all (self->fd, self->buf, self->pos))
+    return FALSE;
+
   self->pos = 0;
 
   return TRUE;
@@ -266,12 +515,26 @@ sp_capture_writer_flush_jitmap (SpCaptureWriter *self)
                                 SP_CAPTURE_FRAME_JITMAP);
   jitmap.n_jitmaps = self->addr_hash_size;
 
-  if (sizeof jitmap != write (self->fd, &jitmap, sizeof jitmap))
-    return FALSE;
+  if (self->ring != NULL)
+    {
+      /* Through the write buffer, so it's written outside the lock too */
+      SpCaptureJitmap *ev = sp_capture_writer_allocate (self, &len);
 
-  r = write (self->fd, self->addr_buf, len - sizeof jitmap);
-  if (r < 0 || (gsize)r != (len - sizeof jitmap))
-    return FALSE;
+      if (ev == NULL)
+        return FALSE;
+
+      memcpy (ev, &jitmap, sizeof jitmap);
+      memcpy (ev->data, self->addr_buf, len - sizeof jitmap);
+    }
+  else
+    {
+      if (sizeof jitmap != write (self->fd, &jitmap, sizeof jitmap))
+        return FALSE;
+
+      r = write (self->fd, self->addr_buf, len - sizeof jitmap);
+      if (r < 0 || (gsize)r != (len - sizeof jitmap))
+        return FALSE;
+    }
 
   self->addr_buf_pos = 0;
   self->addr_hash_size = 0;
@@ -328,10 +591,10 @@ sp_capture_writer_lookup_jitmap (SpCaptureWriter  *self,
 }
 
 static SpCaptureAddress
-sp_capture_writer_insert_jitmap (SpCaptureWriter *self,
-                                 const gchar     *str)
+sp_capture_writer_insert_jitmap_addr (SpCaptureWriter  *self,
+                                      const gchar      *str,
+                                      SpCaptureAddress  addr)
 {
-  SpCaptureAddress addr;
   gchar *dst;
   gsize len;
   guint hash;
@@ -356,9 +619,6 @@ sp_capture_writer_insert_jitmap (SpCaptureWriter *self,
   g_assert (self->addr_hash_size < G_N_ELEMENTS (self->addr_hash));
   g_assert (len > sizeof addr);
 
-  /* Allocate the next unique address */
-  addr = SP_CAPTURE_JITMAP_MARK | ++self->addr_seq;
-
   /* Copy the address into the buffer */
   dst = (gchar *)&self->addr_buf[self->addr_buf_pos];
   memcpy (dst, &addr, sizeof addr);
@@ -410,6 +670,15 @@ sp_capture_writer_insert_jitmap (SpCaptureWriter *self,
   return INVALID_ADDRESS;
 }
 
+static SpCaptureAddress
+sp_capture_writer_insert_jitmap (SpCaptureWriter *self,
+                                 const gchar     *str)
+{
+  /* Allocate the next unique address */
+  return sp_capture_writer_insert_jitmap_addr (self, str,
+                                               SP_CAPTURE_JITMAP_MARK | ++self->addr_seq);
+}
+
 SpCaptureWriter *
 sp_capture_writer_new_from_fd (int   fd,
                                gsize buffer_size)
@@ -498,16 +767,138 @@ sp_capture_writer_new (const gchar *filename,
   return self;
 }
 
-gboolean
-sp_capture_writer_add_map (SpCaptureWriter *self,
-                           gint64           time,
-                           gint             cpu,
-                           GPid             pid,
-                           guint64          start,
-                           guint64          end,
-                           guint64          offset,
-                           guint64          inode,
-                           const gchar     *filename)
+/* Sleeps until there is something in the ring, or someone wakes us */
+static void
+sp_capture_writer_wait_for_wake (SpCaptureWriter *self)
+{
+  struct pollfd pfd = { self->wake_fds[0], POLLIN, 0 };
+  gchar buf[64];
+
+  g_atomic_int_set (&self->drain_sleeping, TRUE);
+
+  /* A record committed before the flag was set didn't wake us */
+  if (g_atomic_int_get (&self->ring_head) == g_atomic_int_get (&self->ring_tail))
+    {
+      while (poll (&pfd, 1, -1) < 0 && errno == EINTR)
+        ;
+    }
+
+  g_atomic_int_set (&self->drain_sleeping, FALSE);
+
+  while (read (self->wake_fds[0], buf, sizeof buf) > 0)
+    ;
+}
+
+static gpointer
+sp_capture_writer_drain_thread (gpointer data)
+{
+  SpCaptureWriter *self = data;
+
+  for (;;)
+    {
+      sp_capture_writer_wait_for_wake (self);
+      if (g_atomic_int_get (&self->drain_stop))
+        break;
+
+      /* Another thread may be waiting for the spare buffer */
+      g_mutex_lock (&self->lock);
+      sp_capture_writer_write_spare (self);
+      g_mutex_unlock (&self->lock);
+
+      /* Let samples collect, rather than draining them one at a time */
+      g_usleep (DRAIN_INTERVAL_USEC);
+
+      sp_capture_writer_lock_drain (self);
+      sp_capture_writer_drain_ring (self);
+      sp_capture_writer_unlock_drain (self);
+
+      g_mutex_lock (&self->lock);
+      sp_capture_writer_write_spare (self);
+      g_mutex_unlock (&self->lock);
+    }
+
+  return NULL;
+}
+
+/*
+ * Creates a writer in asynchronous mode, where samples are recorded with
+ * sp_capture_writer_add_jitmap_async() and sp_capture_writer_add_sample_async()
+ * from a signal handler. These only append records to a preallocated ring of
+ * @ring_size 64-bit words, without locking, allocating or copying more than
+ * a new label. A thread, woken by the first record after it went idle,
+ * drains the ring into the capture buffer, and does all the writes to disk.
+ * Samples that don't fit in the ring are dropped.
+ *
+ * @buffer_size must leave room for a whole jitmap, which goes through the
+ * buffer in this mode.
+ *
+ * sp_capture_writer_add_jitmap() and sp_capture_writer_add_sample() must not
+ * be used in this mode; the other functions may be called from any thread,
+ * but not from a signal handler.
+ */
+SpCaptureWriter *
+sp_capture_writer_new_async (const gchar *filename,
+                             gsize        buffer_size,
+                             gsize        ring_size)
+{
+  SpCaptureWriter *self;
+
+  if (ring_size == 0)
+    ring_size = DEFAULT_RING_SIZE;
+
+  g_assert ((ring_size & (ring_size - 1)) == 0);
+  g_assert (ring_size <= G_MAXINT);
+
+  self = sp_capture_writer_new (filename, buffer_size);
+  if (self == NULL)
+    return NULL;
+
+  g_assert (self->len >= sizeof (SpCaptureJitmap) + sizeof self->addr_buf + SP_CAPTURE_ALIGN);
+
+  g_mutex_init (&self->lock);
+  g_mutex_init (&self->drain_lock);
+  g_cond_init (&self->spare_cond);
+  self->ring = g_new (guint64, ring_size);
+  self->ring_mask = ring_size - 1;
+  self->label_cache = g_new0 (SpCaptureLabelCacheSet, LABEL_CACHE_SETS);
+  self->label_addrs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->addr_remap = g_hash_table_new (NULL, NULL);
+  self->remap_buf = g_new (SpCaptureAddress, ring_size / 2);
+  self->spare = (guint8 *)g_malloc0 (self->len);
+  self->wake_fds[0] = self->wake_fds[1] = -1;
+
+  if (!g_unix_open_pipe (self->wake_fds, FD_CLOEXEC, NULL))
+    {
+      self->wake_fds[0] = self->wake_fds[1] = -1;
+      sp_capture_writer_unref (self);
+      return NULL;
+    }
+
+  g_unix_set_fd_nonblocking (self->wake_fds[0], TRUE, NULL);
+  g_unix_set_fd_nonblocking (self->wake_fds[1], TRUE, NULL);
+
+  self->drain_thread = g_thread_try_new ("sp-capture-drain",
+                                         sp_capture_writer_drain_thread,
+                                         self, NULL);
+  if (self->drain_thread == NULL)
+    {
+      sp_capture_writer_unref (self);
+      return NULL;
+    }
+
+  return self;
+}
+
+static gboolean
+sp_capture_writer_add_map_unlocked (SpCaptureWriter *self,
+                                    gint64           time,
+                                    gint             cpu,
+                                    GPid             pid,
+                                    guint64          start,
+                                    guint64          end,
+                                    guint64          offset,
+                                    guint64          inode,
+                                    const gchar     *filename)
 {
   SpCaptureMap *ev;
   gsize len;
@@ -554,6 +945,7 @@ sp_capture_writer_add_jitmap (SpCaptureWriter *self,
 
   g_assert (self != NULL);
   g_assert (name != NULL);
+  g_assert (self->ring == NULL);
 
   if (!sp_capture_writer_lookup_jitmap (self, name, &addr))
     addr = sp_capture_writer_insert_jitmap (self, name);
@@ -561,13 +953,13 @@ sp_capture_writer_add_jitmap (SpCaptureWriter *self,
   return addr;
 }
 
-gboolean
-sp_capture_writer_add_sample (SpCaptureWriter        *self,
-                              gint64                  time,
-                              gint                    cpu,
-                              GPid                    pid,
-                              const SpCaptureAddress *addrs,
-                              guint                   n_addrs)
+static gboolean
+sp_capture_writer_add_sample_unlocked (SpCaptureWriter        *self,
+                                       gint64                  time,
+                                       gint                    cpu,
+                                       GPid                    pid,
+                                       const SpCaptureAddress *addrs,
+                                       guint                   n_addrs)
 {
   SpCaptureSample *ev;
   gsize len;
@@ -595,6 +987,199 @@ sp_capture_writer_add_sample (SpCaptureWriter        *self,
   return TRUE;
 }
 
+gboolean
+sp_capture_writer_add_sample (SpCaptureWriter        *self,
+                              gint64                  time,
+                              gint                    cpu,
+                              GPid                    pid,
+                              const SpCaptureAddress *addrs,
+                              guint                   n_addrs)
+{
+  g_assert (self != NULL);
+  g_assert (self->ring == NULL);
+
+  return sp_capture_writer_add_sample_unlocked (self, time, cpu, pid,
+                                                addrs, n_addrs);
+}
+
+static guint
+sp_capture_writer_request_counter_unlocked (SpCaptureWriter *self,
+                                            guint            n_counters)
+{
+  gint ret;
+
+  g_assert (self != NULL);
+
+  if (MAX_COUNTERS - n_counters < (guint)self->next_counter_id)
+    return 0;
+
+  ret = self->next_counter_id;
+  self->next_counter_id += n_counters;
+
+  return ret;
+}
+
+static gboolean
+sp_capture_writer_define_counters_unlocked (SpCaptureWriter        *self,
+                                            gint64                  time,
+                                            gint                    cpu,
+                                            GPid                    pid,
+                                            const SpCaptureCounter *counters,
+                                            guint                   n_counters)
+{
+  SpCaptureFrameCounterDefine *def;
+  gsize len;
+  guint n_valid;
+  guint i;
+
+  g_assert (self != NULL);
+  g_assert (counters != NULL);
+
+  /* Unregistered counters are left out of the frame entirely */
+  for (i = 0, n_valid = 0; i < n_counters; i++)
+    {
+      if (counters[i].id >= (guint)self->next_counter_id)
+        g_warning ("Counter %u has not been registered.", counters[i].id);
+      else
+        n_valid++;
+    }
+
+  if (n_valid == 0)
+    return TRUE;
+
+  len = sizeof *def + (sizeof *counters * n_valid);
+
+  def = (SpCaptureFrameCounterDefine *)sp_capture_writer_allocate (self, &len);
+  if (!def)
+    return FALSE;
+
+  sp_capture_writer_frame_init (&def->frame,
+                                len,
+                                cpu,
+                                pid,
+                                time,
+                                SP_CAPTURE_FRAME_CTRDEF);
+  def->padding = 0;
+  def->n_counters = n_valid;
+
+  for (i = 0, n_valid = 0; i < n_counters; i++)
+    {
+      if (counters[i].id < (guint)self->next_counter_id)
+        def->counters[n_valid++] = counters[i];
+    }
+
+  self->stat.frame_count[SP_CAPTURE_FRAME_CTRDEF]++;
+
+  return TRUE;
+}
+
+static gboolean
+sp_capture_writer_add_mark_unlocked (SpCaptureWriter *self,
+                                     gint64           time,
+                                     gint             cpu,
+                                     GPid             pid,
+                                     guint64          duration,
+                                     const gchar     *group,
+                                     const gchar     *name,
+                                     const gchar     *message)
+{
+  SpCaptureMark *ev;
+  gsize message_len;
+  gsize len;
+
+  g_assert (self != NULL);
+  g_assert (name != NULL);
+  g_assert (group != NULL);
+
+  if (message == NULL)
+    message = "";
+  message_len = strlen (message) + 1;
+
+  len = sizeof *ev + message_len;
+  ev = (SpCaptureMark *)sp_capture_writer_allocate (self, &len);
+  if (!ev)
+    return FALSE;
+
+  sp_capture_writer_frame_init (&ev->frame,
+                                len,
+                                cpu,
+                                pid,
+                                time,
+                                SP_CAPTURE_FRAME_MARK);
+
+  ev->duration = duration;
+  g_strlcpy (ev->group, group, sizeof ev->group);
+  g_strlcpy (ev->name, name, sizeof ev->name);
+  memcpy (ev->message, message, message_len);
+
+  self->stat.frame_count[SP_CAPTURE_FRAME_MARK]++;
+
+  return TRUE;
+}
+
+static gboolean
+sp_capture_writer_set_counters_unlocked (SpCaptureWriter             *self,
+                                         gint64                       time,
+                                         gint                         cpu,
+                                         GPid                         pid,
+                                         const guint                 *counters_ids,
+                                         const SpCaptureCounterValue *values,
+                                         guint                        n_counters)
+{
+  SpCaptureFrameCounterSet *set;
+  gsize len;
+  guint n_groups;
+  guint group;
+  guint field;
+  guint i;
+
+  g_assert (self != NULL);
+  g_assert (counters_ids != NULL);
+  g_assert (values != NULL || !n_counters);
+
+  if (n_counters == 0)
+    return TRUE;
+
+  /* Determine how many value groups we need */
+  n_groups = n_counters / G_N_ELEMENTS (set->values[0].values);
+  if ((n_groups * G_N_ELEMENTS (set->values[0].values)) != n_counters)
+    n_groups++;
+
+  len = sizeof *set + (n_groups * sizeof (SpCaptureCounterValues));
+
+  set = (SpCaptureFrameCounterSet *)sp_capture_writer_allocate (self, &len);
+  if (!set)
+    return FALSE;
+
+  memset (set, 0, len);
+
+  sp_capture_writer_frame_init (&set->frame,
+                                len,
+                                cpu,
+                                pid,
+                                time,
+                                SP_CAPTURE_FRAME_CTRSET);
+  set->n_values = n_groups;
+
+  for (i = 0, group = 0, field = 0; i < n_counters; i++)
+    {
+      set->values[group].ids[field] = counters_ids[i];
+      set->values[group].values[field] = values[i];
+
+      field++;
+
+      if (field == G_N_ELEMENTS (set->values[0].values))
+        {
+          field = 0;
+          group++;
+        }
+    }
+
+  self->stat.frame_count[SP_CAPTURE_FRAME_CTRSET]++;
+
+  return TRUE;
+}
+
 static gboolean
 sp_capture_writer_flush_end_time (SpCaptureWriter *self)
 {
@@ -617,12 +1202,402 @@ again:
   return TRUE;
 }
 
-gboolean
-sp_capture_writer_flush (SpCaptureWriter *self)
+static gboolean
+sp_capture_writer_flush_unlocked (SpCaptureWriter *self)
 {
   g_assert (self != NULL);
 
+  /* Write out both buffers here, rather than on the drain thread */
+  if (self->ring != NULL)
+    return (sp_capture_writer_drain_ring (self) &&
+            sp_capture_writer_flush_jitmap (self) &&
+            sp_capture_writer_flush_data (self) &&
+            sp_capture_writer_write_spare (self) &&
+            !self->write_failed &&
+            sp_capture_writer_flush_end_time (self));
+
   return (sp_capture_writer_flush_jitmap (self) &&
           sp_capture_writer_flush_data (self) &&
           sp_capture_writer_flush_end_time (self));
 }
+
+gboolean
+sp_capture_writer_add_map (SpCaptureWriter *self,
+                           gint64           time,
+                           gint             cpu,
+                           GPid             pid,
+                           guint64          start,
+                           guint64          end,
+                           guint64          offset,
+                           guint64          inode,
+                           const gchar     *filename)
+{
+  gboolean ret;
+
+  sp_capture_writer_lock (self);
+  ret = sp_capture_writer_add_map_unlocked (self, time, cpu, pid, start, end,
+                                            offset, inode, filename);
+  sp_capture_writer_unlock (self);
+
+  return ret;
+}
+
+guint
+sp_capture_writer_request_counter (SpCaptureWriter *self,
+                                   guint            n_counters)
+{
+  guint ret;
+
+  sp_capture_writer_lock (self);
+  ret = sp_capture_writer_request_counter_unlocked (self, n_counters);
+  sp_capture_writer_unlock (self);
+
+  return ret;
+}
+
+gboolean
+sp_capture_writer_define_counters (SpCaptureWriter        *self,
+                                   gint64                  time,
+                                   gint                    cpu,
+                                   GPid                    pid,
+                                   const SpCaptureCounter *counters,
+                                   guint                   n_counters)
+{
+  gboolean ret;
+
+  sp_capture_writer_lock (self);
+  ret = sp_capture_writer_define_counters_unlocked (self, time, cpu, pid,
+                                                    counters, n_counters);
+  sp_capture_writer_unlock (self);
+
+  return ret;
+}
+
+gboolean
+sp_capture_writer_add_mark (SpCaptureWriter *self,
+                            gint64           time,
+                            gint             cpu,
+                            GPid             pid,
+                            guint64          duration,
+                            const gchar     *group,
+                            const gchar     *name,
+                            const gchar     *message)
+{
+  gboolean ret;
+
+  sp_capture_writer_lock (self);
+  ret = sp_capture_writer_add_mark_unlocked (self, time, cpu, pid, duration,
+                                             group, name, message);
+  sp_capture_writer_unlock (self);
+
+  return ret;
+}
+
+gboolean
+sp_capture_writer_set_counters (SpCaptureWriter             *self,
+                                gint64                       time,
+                                gint                         cpu,
+                                GPid                         pid,
+                                const guint                 *counters_ids,
+                                const SpCaptureCounterValue *values,
+                                guint                        n_counters)
+{
+  gboolean ret;
+
+  sp_capture_writer_lock (self);
+  ret = sp_capture_writer_set_counters_unlocked (self, time, cpu, pid,
+                                                 counters_ids, values,
+                                                 n_counters);
+  sp_capture_writer_unlock (self);
+
+  return ret;
+}
+
+gboolean
+sp_capture_writer_flush (SpCaptureWriter *self)
+{
+  gboolean ret;
+
+  if (self->ring == NULL)
+    return sp_capture_writer_flush_unlocked (self);
+
+  sp_capture_writer_lock_drain (self);
+  ret = sp_capture_writer_flush_unlocked (self);
+  sp_capture_writer_unlock_drain (self);
+
+  return ret;
+}
+
+/*
+ * Reserves @n_words in the ring, after a PAD record if they would wrap
+ * around its end. Returns %NULL if the ring is full. Only called from the
+ * producer; @advance is what sp_capture_writer_ring_commit() then moves the
+ * head by.
+ */
+static guint64 *
+sp_capture_writer_ring_reserve (SpCaptureWriter *self,
+                                gsize            n_words,
+                                gsize           *advance)
+{
+  gsize size = (gsize)self->ring_mask + 1;
+  guint head = self->ring_head;
+  guint tail = g_atomic_int_get (&self->ring_tail);
+  gsize offset = head & self->ring_mask;
+  gsize pad = 0;
+
+  if (n_words > size / 2)
+    return NULL;
+
+  if (offset + n_words > size)
+    pad = size - offset;
+
+  if ((gsize)(guint)(head - tail) + pad + n_words > size)
+    return NULL;
+
+  if (pad > 0)
+    {
+      self->ring[offset] = RING_HEADER (RING_RECORD_PAD, pad, 0);
+      offset = 0;
+    }
+
+  *advance = pad + n_words;
+  return &self->ring[offset];
+}
+
+/* Publishes the reserved record to the drain thread */
+static inline void
+sp_capture_writer_ring_commit (SpCaptureWriter *self,
+                               gsize            advance)
+{
+  g_atomic_int_set (&self->ring_head, self->ring_head + (guint)advance);
+
+  /* Only the first record after the drain thread went idle wakes it */
+  if (g_atomic_int_compare_and_exchange (&self->drain_sleeping, TRUE, FALSE))
+    sp_capture_writer_wake_drain (self);
+}
+
+/*
+ * Signal-safe version of sp_capture_writer_add_jitmap(), for asynchronous
+ * mode. A label seen recently, with the same contents at the same address,
+ * gets the same address back without copying the string. Any other is
+ * copied into the ring, truncated to MAX_LABEL_LEN bytes, with a new
+ * address; the drain thread writes it to the jitmap, or, if the capture
+ * already has the label, maps the new address to the existing one.
+ */
+SpCaptureAddress
+sp_capture_writer_add_jitmap_async (SpCaptureWriter *self,
+                                    const gchar     *name)
+{
+  SpCaptureLabelCacheSet *set;
+  SpCaptureLabelCacheEntry *entry;
+  SpCaptureAddress addr;
+  guint64 *rec;
+  gsize advance;
+  gsize n_words;
+  gsize len;
+  guint way;
+
+  g_assert (self != NULL);
+  g_assert (self->ring != NULL);
+
+  if (name == NULL)
+    name = "";
+
+  len = strnlen (name, MAX_LABEL_LEN - 1);
+
+  set = &self->label_cache[(guint)(((guintptr)name >> 3) * 2654435761u) % LABEL_CACHE_SETS];
+
+  for (way = 0; way < LABEL_CACHE_WAYS; way++)
+    {
+      entry = &set->ways[way];
+
+      if (entry->name == name)
+        {
+          /* Only cached labels are shorter than CACHED_LABEL_LEN */
+          if (entry->len == len && memcmp (entry->str, name, len) == 0)
+            return entry->addr;
+
+          /* The memory now holds another label, replace this one */
+          break;
+        }
+    }
+
+  if (way == LABEL_CACHE_WAYS)
+    {
+      way = set->next_victim;
+      set->next_victim = (way + 1) % LABEL_CACHE_WAYS;
+    }
+
+  entry = &set->ways[way];
+
+  n_words = 2 + (len + 1 + sizeof (guint64) - 1) / sizeof (guint64);
+  rec = sp_capture_writer_ring_reserve (self, n_words, &advance);
+  if (rec == NULL)
+    return INVALID_ADDRESS;
+
+  addr = SP_CAPTURE_JITMAP_MARK | ++self->addr_seq;
+
+  rec[0] = RING_HEADER (RING_RECORD_LABEL, n_words, len);
+  rec[1] = addr;
+  memcpy (&rec[2], name, len);
+  ((gchar *)&rec[2])[len] = '\0';
+  sp_capture_writer_ring_commit (self, advance);
+
+  if (len < CACHED_LABEL_LEN)
+    {
+      entry->name = name;
+      entry->len = len;
+      entry->addr = addr;
+      memcpy (entry->str, name, len);
+    }
+  else
+    {
+      entry->name = NULL;
+    }
+
+  return addr;
+}
+
+/*
+ * Signal-safe version of sp_capture_writer_add_sample(), for asynchronous
+ * mode. Returns %FALSE if the sample was dropped because the ring is full.
+ */
+gboolean
+sp_capture_writer_add_sample_async (SpCaptureWriter        *self,
+                                    gint64                  time,
+                                    gint                    cpu,
+                                    GPid                    pid,
+                                    const SpCaptureAddress *addrs,
+                                    guint                   n_addrs)
+{
+  guint64 *rec;
+  gsize advance;
+  gsize n_words;
+
+  g_assert (self != NULL);
+  g_assert (self->ring != NULL);
+
+  n_words = 3 + n_addrs;
+  rec = sp_capture_writer_ring_reserve (self, n_words, &advance);
+  if (rec == NULL)
+    {
+      g_atomic_int_inc (&self->n_dropped);
+      return FALSE;
+    }
+
+  rec[0] = RING_HEADER (RING_RECORD_SAMPLE, n_words, n_addrs);
+  rec[1] = (guint64)time;
+  rec[2] = ((guint64)(guint32)cpu << 32) | (guint32)pid;
+  memcpy (&rec[3], addrs, n_addrs * sizeof (SpCaptureAddress));
+  sp_capture_writer_ring_commit (self, advance);
+
+  return TRUE;
+}
+
+/*
+ * Writes a label from the ring to the jitmap, unless the capture already has
+ * it under another address, which samples are then remapped to.
+ */
+static gboolean
+sp_capture_writer_drain_label (SpCaptureWriter  *self,
+                               const gchar      *str,
+                               SpCaptureAddress  addr)
+{
+  gpointer first;
+
+  if (g_hash_table_lookup_extended (self->label_addrs, str, NULL, &first))
+    {
+      g_hash_table_insert (self->addr_remap, GSIZE_TO_POINTER ((gsize)addr), first);
+      return TRUE;
+    }
+
+  if (sp_capture_writer_insert_jitmap_addr (self, str, addr) == INVALID_ADDRESS)
+    return FALSE;
+
+  g_hash_table_insert (self->label_addrs, g_strdup (str), GSIZE_TO_POINTER ((gsize)addr));
+
+  return TRUE;
+}
+
+/* Returns @addrs, with the addresses that sp_capture_writer_drain_label() remapped replaced */
+static const SpCaptureAddress *
+sp_capture_writer_remap_addrs (SpCaptureWriter        *self,
+                               const SpCaptureAddress *addrs,
+                               guint                   n_addrs)
+{
+  guint i;
+
+  if (g_hash_table_size (self->addr_remap) == 0)
+    return addrs;
+
+  for (i = 0; i < n_addrs; i++)
+    {
+      gpointer first;
+
+      if ((addrs[i] & SP_CAPTURE_JITMAP_MARK) == SP_CAPTURE_JITMAP_MARK &&
+          g_hash_table_lookup_extended (self->addr_remap,
+                                        GSIZE_TO_POINTER ((gsize)addrs[i]),
+                                        NULL, &first))
+        self->remap_buf[i] = GPOINTER_TO_SIZE (first);
+      else
+        self->remap_buf[i] = addrs[i];
+    }
+
+  return self->remap_buf;
+}
+
+/*
+ * Writes the records in the ring to the capture buffer. Called by the
+ * consumer, see sp_capture_writer_lock_drain().
+ */
+static gboolean
+sp_capture_writer_drain_ring (SpCaptureWriter *self)
+{
+  guint head = g_atomic_int_get (&self->ring_head);
+  guint tail = self->ring_tail;
+  gboolean ret = TRUE;
+
+  while (tail != head)
+    {
+      const guint64 *rec = &self->ring[tail & self->ring_mask];
+      guint64 header = rec[0];
+      guint extra = RING_HEADER_EXTRA (header);
+
+      switch (RING_HEADER_TYPE (header))
+        {
+        case RING_RECORD_SAMPLE:
+          if (!sp_capture_writer_add_sample_unlocked (self,
+                                                      (gint64)rec[1],
+                                                      (gint)(guint32)(rec[2] >> 32),
+                                                      (GPid)(guint32)rec[2],
+                                                      sp_capture_writer_remap_addrs (self, &rec[3], extra),
+                                                      extra))
+            ret = FALSE;
+          break;
+
+        case RING_RECORD_LABEL:
+          if (!sp_capture_writer_drain_label (self, (const gchar *)&rec[2], rec[1]))
+            ret = FALSE;
+          break;
+
+        case RING_RECORD_PAD:
+        default:
+          break;
+        }
+
+      /* Give the space back as soon as possible */
+      tail += RING_HEADER_N_WORDS (header);
+      g_atomic_int_set (&self->ring_tail, tail);
+    }
+
+  return ret;
+}
+
+/* Returns the number of samples dropped because the ring was full */
+guint
+sp_capture_writer_get_n_dropped (SpCaptureWriter *self)
+{
+  g_assert (self != NULL);
+
+  return g_atomic_int_get (&self->n_dropped);
+}
@@ -52,6 +52,9 @@ SpCaptureWriter    *sp_capture_writer_new             (const gchar             *
                                                        gsize                    buffer_size);
 SpCaptureWriter    *sp_capture_writer_new_from_fd     (int                      fd,
                                                        gsize                    buffer_size);
+SpCaptureWriter    *sp_capture_writer_new_async       (const gchar             *filename,
+                                                       gsize                    buffer_size,
+                                                       gsize                    ring_size);
 SpCaptureWriter    *sp_capture_writer_ref             (SpCaptureWriter         *self);
 void                sp_capture_writer_unref           (SpCaptureWriter         *self);
 gboolean            sp_capture_writer_add_map         (SpCaptureWriter         *self,
@@ -71,6 +74,38 @@ gboolean            sp_capture_writer_add_sample      (SpCaptureWriter         *
                                                        GPid                     pid,
                                                        const SpCaptureAddress  *addrs,
                                                        guint                    n_addrs);
+SpCaptureAddress    sp_capture_writer_add_jitmap_async (SpCaptureWriter         *self,
+                                                        const gchar             *name);
+gboolean            sp_capture_writer_add_sample_async (SpCaptureWriter         *self,
+                                                        gint64                   time,
+                                                        gint                     cpu,
+                                                        GPid                     pid,
+                                                        const SpCaptureAddress  *addrs,
+                                                        guint                    n_addrs);
+guint               sp_capture_writer_get_n_dropped   (SpCaptureWriter         *self);
+guint               sp_capture_writer_request_counter (SpCaptureWriter         *self,
+                                                       guint                    n_counters);
+gboolean            sp_capture_writer_define_counters (SpCaptureWriter         *self,
+                                                       gint64                   time,
+                                                       gint                     cpu,
+                                                       GPid                     pid,
+                                                       const SpCaptureCounter  *counters,
+                                                       guint                    n_counters);
+gboolean            sp_capture_writer_set_counters    (SpCaptureWriter         *self,
+                                                       gint64                   time,
+                                                       gint                     cpu,
+                                                       GPid                     pid,
+                                                       const guint             *counters_ids,
+                                                       const SpCaptureCounterValue *values,
+                                                       guint                    n_counters);
+gboolean            sp_capture_writer_add_mark        (SpCaptureWriter         *self,
+                                                       gint64                   time,
+                                                       gint                     cpu,
+                                                       GPid                     pid,
+                                                       guint64                  duration,
+                                                       const gchar             *group,
+                                                       const gchar             *name,
+                                                       const gchar             *message);
 gboolean            sp_capture_writer_flush           (SpCaptureWriter         *self);
 
 #define SP_TYPE_CAPTURE_WRITER (sp_capture_writer_get_type())